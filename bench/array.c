@@ -0,0 +1,130 @@
+/**
+ * @file array.c
+ * @brief Benchmark: TroveArray append, iterate and destroy from 1K to 10M elements
+ *
+ * Elements are small ARC objects whose addresses are shuffled, so iteration
+ * and release touch memory in a cache-unfriendly order as they would after a
+ * long-running program has churned its heap. The largest size defaults to
+ * 10000000 and can be lowered with the first argument.
+ *
+ * Each size compares per-element append against TroveArray_append_all, and
+ * a naive one-at-a-time release loop against TroveArray_dealloc's batched,
+ * prefetching arc_release_all.
+ */
+
+#include "bench.h"
+#include "array.h"
+#include <stdint.h>
+
+typedef struct BenchObject {
+    ARCObject base;
+    size_t value;
+} BenchObject;
+
+static void BenchObject_dealloc(ARCObject *obj) {
+    free(obj);
+}
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Allocates n objects and returns them in shuffled order
+ */
+static ARCObject** make_objects(size_t n) {
+    ARCObject **objects = (ARCObject **)malloc(n * sizeof(ARCObject *));
+    for (size_t i = 0; i < n; i++) {
+        BenchObject *obj = (BenchObject *)malloc(sizeof(BenchObject));
+        obj->base.ref_count = 1;
+        obj->base.dealloc = BenchObject_dealloc;
+        obj->value = i;
+        objects[i] = (ARCObject *)obj;
+    }
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = (size_t)(next_random() % (i + 1));
+        ARCObject *tmp = objects[i];
+        objects[i] = objects[j];
+        objects[j] = tmp;
+    }
+    return objects;
+}
+
+/**
+ * @brief Fills an array that ends up holding the only reference to each object
+ */
+static TroveArray* make_owning_array(size_t n) {
+    ARCObject **objects = make_objects(n);
+    TroveArray *array = TroveArray_create(n);
+    TroveArray_append_all(array, objects, n);
+    arc_release_all(objects, n);
+    free(objects);
+    return array;
+}
+
+int main(int argc, char **argv) {
+    size_t max_size = bench_arg(argc, argv, 1, 10000000);
+    size_t sink = 0;
+
+    for (size_t n = 1000; n <= max_size; n *= 10) {
+        size_t reps = n >= 1000000 ? 1 : 1000000 / n;
+        double append_one = 0, append_all = 0, iterate = 0, destroy_naive = 0, destroy_batched = 0;
+        ARCObject **objects = make_objects(n);
+
+        for (size_t r = 0; r < reps; r++) {
+            double start = bench_now();
+            TroveArray *a = TroveArray_create(0);
+            for (size_t i = 0; i < n; i++) {
+                TroveArray_append(a, objects[i]);
+            }
+            append_one += bench_now() - start;
+
+            start = bench_now();
+            TroveArray *b = TroveArray_create(0);
+            TroveArray_append_all(b, objects, n);
+            append_all += bench_now() - start;
+
+            start = bench_now();
+            for (size_t i = 0; i < b->count; i++) {
+                sink += ((BenchObject *)TroveArray_get(b, i))->value;
+            }
+            iterate += bench_now() - start;
+
+            arc_release((ARCObject *)a);
+            arc_release((ARCObject *)b);
+        }
+        arc_release_all(objects, n);
+        free(objects);
+
+        for (size_t r = 0; r < reps; r++) {
+            TroveArray *a = make_owning_array(n);
+            double start = bench_now();
+            for (size_t i = 0; i < a->count; i++) {
+                arc_release(a->items[i]);
+            }
+            a->count = 0;
+            arc_release((ARCObject *)a);
+            destroy_naive += bench_now() - start;
+
+            TroveArray *b = make_owning_array(n);
+            start = bench_now();
+            arc_release((ARCObject *)b);
+            destroy_batched += bench_now() - start;
+        }
+
+        double total = (double)n * (double)reps;
+        printf("-- %zu elements x %zu reps\n", n, reps);
+        bench_report("append (one at a time)", append_one, total, "elems");
+        bench_report("append_all", append_all, total, "elems");
+        bench_report("iterate", iterate, total, "elems");
+        bench_report("destroy (naive release loop)", destroy_naive, total, "elems");
+        bench_report("destroy (arc_release_all)", destroy_batched, total, "elems");
+    }
+    printf("checksum %zu\n", sink);
+    return 0;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file bench.h
+ * @brief Shared helpers for the Trove benchmarks
+ *
+ * Each benchmark is a standalone program built by `make bench` into
+ * build/bench. Sizes default to the workloads described in each file and can
+ * be overridden from the command line to get quick runs.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * @brief Returns a monotonic timestamp in seconds
+ */
+static inline double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Reads argv[index] as a size, or returns fallback when absent
+ */
+static inline size_t bench_arg(int argc, char **argv, int index, size_t fallback) {
+    if (argc > index) {
+        return (size_t)strtoull(argv[index], NULL, 10);
+    }
+    return fallback;
+}
+
+/**
+ * @brief Prints one result line: name, elapsed seconds and throughput
+ *
+ * @param name Label for the measurement
+ * @param seconds Elapsed wall-clock time
+ * @param units Number of operations or bytes processed
+ * @param unit_name Label for units, e.g. "MB" or "ops"
+ */
+static inline void bench_report(const char *name, double seconds, double units, const char *unit_name) {
+    printf("%-32s %10.3f ms  %14.2f %s/s\n", name, seconds * 1e3, units / seconds, unit_name);
+}
+
+#endif // BENCH_H
@@ -0,0 +1,85 @@
+/**
+ * @file builder.c
+ * @brief Benchmark: formatting log lines with snprintf + String() vs. TroveStringBuilder
+ *
+ * Formats N log-like lines (1000000 by default, or the first argument) inside
+ * an autorelease pool that is drained every 10000 lines, as a request loop
+ * would. The baseline formats into a stack buffer and copies it with
+ * String(); the builder writes each line once into the pool's arena, either
+ * with appendf or with the typed append functions.
+ */
+
+#include "bench.h"
+#include "builder.h"
+
+#define BATCH 10000
+
+int main(int argc, char **argv) {
+    size_t lines = bench_arg(argc, argv, 1, 1000000);
+    size_t bytes = 0;
+
+    double start = bench_now();
+    for (size_t i = 0; i < lines; i += BATCH) {
+        autorelease_pool_push();
+        for (size_t j = i; j < i + BATCH && j < lines; j++) {
+            char buf[256];
+            snprintf(buf, sizeof(buf), "ts=%zu level=INFO req=%zu status=%d latency=%.3f path=/api/v1/items\n",
+                     1700000000 + j, j * 7, 200, (double)(j % 1000) / 7.0);
+            TroveString *line = String(buf);
+            bytes += line->length;
+        }
+        autorelease_pool_pop();
+    }
+    double snprintf_time = bench_now() - start;
+
+    size_t builder_bytes = 0;
+    start = bench_now();
+    for (size_t i = 0; i < lines; i += BATCH) {
+        autorelease_pool_push();
+        TroveStringBuilder builder;
+        TroveStringBuilder_init(&builder);
+        for (size_t j = i; j < i + BATCH && j < lines; j++) {
+            TroveStringBuilder_appendf(&builder, "ts=%zu level=INFO req=%zu status=%d latency=%.3f path=/api/v1/items\n",
+                                       1700000000 + j, j * 7, 200, (double)(j % 1000) / 7.0);
+            TroveString *line = (TroveString *)arc_autorelease((ARCObject *)TroveStringBuilder_finish(&builder));
+            builder_bytes += line->length;
+        }
+        autorelease_pool_pop();
+    }
+    double appendf_time = bench_now() - start;
+
+    size_t typed_bytes = 0;
+    start = bench_now();
+    for (size_t i = 0; i < lines; i += BATCH) {
+        autorelease_pool_push();
+        TroveStringBuilder builder;
+        TroveStringBuilder_init(&builder);
+        for (size_t j = i; j < i + BATCH && j < lines; j++) {
+            TroveStringBuilder_append_cstr(&builder, "ts=");
+            TroveStringBuilder_append_uint(&builder, 1700000000 + j);
+            TroveStringBuilder_append_cstr(&builder, " level=INFO req=");
+            TroveStringBuilder_append_uint(&builder, j * 7);
+            TroveStringBuilder_append_cstr(&builder, " status=");
+            TroveStringBuilder_append_int(&builder, 200);
+            TroveStringBuilder_append_cstr(&builder, " latency=");
+            TroveStringBuilder_append_double(&builder, (double)(j % 1000) / 7.0);
+            TroveStringBuilder_append_cstr(&builder, " path=/api/v1/items\n");
+            TroveString *line = (TroveString *)arc_autorelease((ARCObject *)TroveStringBuilder_finish(&builder));
+            typed_bytes += line->length;
+        }
+        autorelease_pool_pop();
+    }
+    double typed_time = bench_now() - start;
+
+    if (bytes != builder_bytes) {
+        fprintf(stderr, "output size mismatch: %zu vs %zu\n", bytes, builder_bytes);
+        return 1;
+    }
+
+    printf("%zu lines, %.2f MB\n", lines, (double)bytes / (1024 * 1024));
+    bench_report("snprintf + String()", snprintf_time, (double)lines, "lines");
+    bench_report("builder appendf", appendf_time, (double)lines, "lines");
+    bench_report("builder typed appends", typed_time, (double)lines, "lines");
+    (void)typed_bytes;
+    return 0;
+}
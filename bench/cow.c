@@ -0,0 +1,67 @@
+/**
+ * @file cow.c
+ * @brief Benchmark: append-heavy loops on unique vs. shared strings
+ *
+ * Appends a short piece N times (1000000 by default, or the first argument)
+ * to a uniquely referenced string, which grows in place. The shared case
+ * keeps a retained snapshot of the string before every append, forcing a
+ * copy each time, and runs N / 50 appends to stay tractable. The copy
+ * baseline builds a new string per append, as callers did before the
+ * mutation API existed.
+ */
+
+#include "bench.h"
+#include "trove.h"
+
+int main(int argc, char **argv) {
+    size_t appends = bench_arg(argc, argv, 1, 1000000);
+    size_t shared_appends = appends / 50;
+    static const char piece[] = "0123456789abcdef";
+    size_t piece_len = sizeof(piece) - 1;
+
+    double start = bench_now();
+    TroveString *unique = TroveString_create("");
+    for (size_t i = 0; i < appends; i++) {
+        TroveString_append(&unique, piece, piece_len);
+    }
+    double unique_time = bench_now() - start;
+
+    start = bench_now();
+    TroveString *shared = TroveString_create("");
+    TroveString *snapshot = NULL;
+    for (size_t i = 0; i < shared_appends; i++) {
+        arc_release((ARCObject *)snapshot);
+        arc_retain((ARCObject *)shared);
+        snapshot = shared;
+        TroveString_append(&shared, piece, piece_len);
+    }
+    double shared_time = bench_now() - start;
+
+    start = bench_now();
+    TroveString *copied = TroveString_create("");
+    for (size_t i = 0; i < shared_appends; i++) {
+        TroveString *next = TroveString_create_with_length(NULL, copied->length + piece_len);
+        memcpy(next->str, copied->str, copied->length);
+        memcpy(next->str + copied->length, piece, piece_len);
+        arc_release((ARCObject *)copied);
+        copied = next;
+    }
+    double copy_time = bench_now() - start;
+
+    if (unique->length != appends * piece_len || shared->length != shared_appends * piece_len ||
+        snapshot->length + piece_len != shared->length) {
+        fprintf(stderr, "unexpected lengths\n");
+        return 1;
+    }
+
+    printf("unique: %zu appends, shared/copy: %zu appends\n", appends, shared_appends);
+    bench_report("unique (in place)", unique_time, (double)appends, "appends");
+    bench_report("shared (copy on write)", shared_time, (double)shared_appends, "appends");
+    bench_report("new string per append", copy_time, (double)shared_appends, "appends");
+
+    arc_release((ARCObject *)unique);
+    arc_release((ARCObject *)shared);
+    arc_release((ARCObject *)snapshot);
+    arc_release((ARCObject *)copied);
+    return 0;
+}
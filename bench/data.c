@@ -0,0 +1,113 @@
+/**
+ * @file data.c
+ * @brief Benchmark: scanning a multi-GB file through TroveData_map_file vs. read() + copy
+ *
+ * A text file of 2048 MB (first argument, in MB) made of 64-byte lines is
+ * written to /tmp, then loaded and scanned for newlines two ways:
+ *
+ * - read() into a malloc'ed buffer, copied into a TroveString, as loaders
+ *   did before TroveData existed;
+ * - TroveData_map_file with sequential-access advice, scanned in place and
+ *   split into zero-copy 1 MB sub-ranges.
+ *
+ * The file was just written, so both runs read from a warm page cache and
+ * the comparison measures copying and page mapping rather than the disk.
+ * Peak memory of the baseline is twice the file size.
+ */
+
+#include "bench.h"
+#include "data.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define BENCH_DATA_PATH "/tmp/trove-bench-data.bin"
+#define LINE_LENGTH 64
+#define RANGE_SIZE (1 << 20)
+
+static int write_file(const char *path, size_t size) {
+    char line[LINE_LENGTH];
+    char block[LINE_LENGTH * 1024];
+    memset(line, 'x', LINE_LENGTH - 1);
+    line[LINE_LENGTH - 1] = '\n';
+    for (size_t i = 0; i < sizeof(block); i += LINE_LENGTH) {
+        memcpy(block + i, line, LINE_LENGTH);
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    for (size_t written = 0; written < size; written += sizeof(block)) {
+        if (write(fd, block, sizeof(block)) != (ssize_t)sizeof(block)) {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+static size_t count_lines(const unsigned char *bytes, size_t length) {
+    size_t lines = 0;
+    const unsigned char *end = bytes + length;
+    while ((bytes = memchr(bytes, '\n', (size_t)(end - bytes)))) {
+        lines++;
+        bytes++;
+    }
+    return lines;
+}
+
+int main(int argc, char **argv) {
+    size_t size = bench_arg(argc, argv, 1, 2048) << 20;
+    if (write_file(BENCH_DATA_PATH, size) != 0) {
+        perror(BENCH_DATA_PATH);
+        return 1;
+    }
+
+    double start = bench_now();
+    int fd = open(BENCH_DATA_PATH, O_RDONLY);
+    char *buffer = (char *)malloc(size);
+    size_t filled = 0;
+    ssize_t n;
+    while (filled < size && (n = read(fd, buffer + filled, size - filled)) > 0) {
+        filled += (size_t)n;
+    }
+    close(fd);
+    TroveString *str = TroveString_create_with_length(buffer, filled);
+    free(buffer);
+    double loaded = bench_now();
+    size_t lines = count_lines((const unsigned char *)str->str, str->length);
+    double end = bench_now();
+    arc_release((ARCObject *)str);
+    bench_report("read + copy: load", loaded - start, (double)size / (1 << 20), "MB");
+    bench_report("read + copy: scan", end - loaded, (double)size / (1 << 20), "MB");
+    bench_report("read + copy: total", end - start, (double)size / (1 << 20), "MB");
+
+    start = bench_now();
+    TroveData *data = TroveData_map_file(BENCH_DATA_PATH);
+    if (!data) {
+        perror(BENCH_DATA_PATH);
+        return 1;
+    }
+    TroveData_advise(data, POSIX_MADV_SEQUENTIAL);
+    loaded = bench_now();
+    size_t mapped_lines = 0;
+    for (size_t offset = 0; offset < data->length; offset += RANGE_SIZE) {
+        TroveData *range = TroveData_subdata(data, offset, RANGE_SIZE);
+        mapped_lines += count_lines(range->bytes, range->length);
+        arc_release((ARCObject *)range);
+    }
+    end = bench_now();
+    arc_release((ARCObject *)data);
+    bench_report("map_file: load", loaded - start, (double)size / (1 << 20), "MB");
+    bench_report("map_file: scan", end - loaded, (double)size / (1 << 20), "MB");
+    bench_report("map_file: total", end - start, (double)size / (1 << 20), "MB");
+
+    unlink(BENCH_DATA_PATH);
+    if (lines != mapped_lines) {
+        fprintf(stderr, "line counts differ: %zu vs %zu\n", lines, mapped_lines);
+        return 1;
+    }
+    printf("lines %zu\n", lines);
+    return 0;
+}
@@ -0,0 +1,185 @@
+/**
+ * @file dictionary.c
+ * @brief Benchmark: TroveDictionary vs. a naive chained hash map
+ *
+ * Both maps are sized to 2^20 slots/buckets (or 2^k for a first argument k)
+ * and filled to load factors of 25%, 50%, 75% and 87.5%, the Swiss table's
+ * maximum. Each round measures insert, successful lookup, failed lookup,
+ * iteration and erase of every key. Both maps retain keys and values and
+ * use the hash cached in each TroveString, so the comparison isolates the
+ * table layout.
+ */
+
+#include "bench.h"
+#include "dictionary.h"
+
+/** @brief Node of the baseline separately chained map */
+typedef struct ChainNode {
+    TroveString *key;
+    ARCObject *value;
+    struct ChainNode *next;
+} ChainNode;
+
+typedef struct ChainMap {
+    ChainNode **buckets;
+    size_t mask;
+} ChainMap;
+
+static ChainNode** chain_lookup(ChainMap *map, TroveString *key) {
+    ChainNode **link = &map->buckets[TroveString_hash(key) & map->mask];
+    while (*link) {
+        TroveString *k = (*link)->key;
+        if (k->hash == key->hash && k->length == key->length && memcmp(k->str, key->str, k->length) == 0) {
+            break;
+        }
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+static void chain_set(ChainMap *map, TroveString *key, ARCObject *value) {
+    ChainNode **link = chain_lookup(map, key);
+    arc_retain(value);
+    if (*link) {
+        arc_release((*link)->value);
+        (*link)->value = value;
+        return;
+    }
+    ChainNode *node = (ChainNode *)malloc(sizeof(ChainNode));
+    arc_retain((ARCObject *)key);
+    node->key = key;
+    node->value = value;
+    node->next = NULL;
+    *link = node;
+}
+
+static void chain_remove(ChainMap *map, TroveString *key) {
+    ChainNode **link = chain_lookup(map, key);
+    if (*link) {
+        ChainNode *node = *link;
+        *link = node->next;
+        arc_release((ARCObject *)node->key);
+        arc_release(node->value);
+        free(node);
+    }
+}
+
+static TroveString** make_keys(const char *prefix, size_t n) {
+    TroveString **keys = (TroveString **)malloc(n * sizeof(TroveString *));
+    char buf[64];
+    for (size_t i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf), "%s:%zu", prefix, i * 2654435761u);
+        keys[i] = TroveString_create(buf);
+        TroveString_hash(keys[i]);
+    }
+    return keys;
+}
+
+static void free_keys(TroveString **keys, size_t n) {
+    arc_release_all((ARCObject *const *)keys, n);
+    free(keys);
+}
+
+int main(int argc, char **argv) {
+    size_t capacity = (size_t)1 << bench_arg(argc, argv, 1, 20);
+    static const double loads[] = { 0.25, 0.5, 0.75, 0.875 };
+    size_t sink = 0;
+
+    for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) {
+        size_t n = (size_t)(loads[l] * (double)capacity);
+        TroveString **keys = make_keys("user", n);
+        TroveString **probes = make_keys("user", n);
+        TroveString **misses = make_keys("miss", n);
+        double t[2][5];
+
+        double start = bench_now();
+        TroveDictionary *dict = TroveDictionary_create(capacity - capacity / 8);
+        for (size_t i = 0; i < n; i++) {
+            TroveDictionary_set(dict, keys[i], (ARCObject *)keys[i]);
+        }
+        t[0][0] = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            sink += TroveDictionary_get(dict, probes[i]) != NULL;
+        }
+        t[0][1] = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            sink += TroveDictionary_get(dict, misses[i]) != NULL;
+        }
+        t[0][2] = bench_now() - start;
+
+        start = bench_now();
+        size_t cursor = 0;
+        TroveString *key;
+        ARCObject *value;
+        while (TroveDictionary_next(dict, &cursor, &key, &value)) {
+            sink += key->length;
+        }
+        t[0][3] = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            TroveDictionary_remove(dict, probes[i]);
+        }
+        t[0][4] = bench_now() - start;
+        if (TroveDictionary_count(dict) != 0 || dict->table.capacity != capacity) {
+            fprintf(stderr, "unexpected dictionary state\n");
+            return 1;
+        }
+        arc_release((ARCObject *)dict);
+
+        ChainMap map;
+        map.buckets = (ChainNode **)calloc(capacity, sizeof(ChainNode *));
+        map.mask = capacity - 1;
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            chain_set(&map, keys[i], (ARCObject *)keys[i]);
+        }
+        t[1][0] = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            sink += *chain_lookup(&map, probes[i]) != NULL;
+        }
+        t[1][1] = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            sink += *chain_lookup(&map, misses[i]) != NULL;
+        }
+        t[1][2] = bench_now() - start;
+
+        start = bench_now();
+        for (size_t b = 0; b < capacity; b++) {
+            for (ChainNode *node = map.buckets[b]; node; node = node->next) {
+                sink += node->key->length;
+            }
+        }
+        t[1][3] = bench_now() - start;
+
+        start = bench_now();
+        for (size_t i = 0; i < n; i++) {
+            chain_remove(&map, probes[i]);
+        }
+        t[1][4] = bench_now() - start;
+        free(map.buckets);
+
+        static const char *ops[] = { "insert", "lookup hit", "lookup miss", "iterate", "erase" };
+        printf("-- load factor %.3f: %zu keys in %zu slots\n", loads[l], n, capacity);
+        for (int op = 0; op < 5; op++) {
+            char label[64];
+            snprintf(label, sizeof(label), "swiss   %s", ops[op]);
+            bench_report(label, t[0][op], (double)n, "ops");
+            snprintf(label, sizeof(label), "chained %s", ops[op]);
+            bench_report(label, t[1][op], (double)n, "ops");
+        }
+        free_keys(keys, n);
+        free_keys(probes, n);
+        free_keys(misses, n);
+    }
+    printf("checksum %zu\n", sink);
+    return 0;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file guard.c
+ * @brief Benchmark: cost per object of quarantining released objects
+ *
+ * Creates, retains and releases 5,000,000 (first argument) short strings
+ * with the guard off, with the default quarantine and release stacks of
+ * 12 and of 4 frames, with no stacks, and with no stacks and an empty
+ * quarantine, which checks and frees each object when the next is
+ * released. Each mode runs a fifth of the strings five times, alternating with the others, and
+ * reports its fastest run.
+ */
+
+#include "bench.h"
+#include "guard.h"
+
+/** @brief Guard settings compared */
+#define MODES 5
+
+/**
+ * @brief Creates, retains and releases count strings
+ */
+static void create_release(size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        TroveString *str = TroveString_create_with_length("guard", 5);
+        arc_retain((ARCObject *)str);
+        arc_release((ARCObject *)str);
+        arc_release((ARCObject *)str);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t count = bench_arg(argc, argv, 1, 5000000);
+    const char *labels[MODES] = { "guard off", "guard, 12 frames", "guard, 4 frames", "guard, no stacks",
+                                  "guard, no stacks or quarantine" };
+    size_t quarantines[MODES] = { 0, TROVE_GUARD_DEFAULT_QUARANTINE, TROVE_GUARD_DEFAULT_QUARANTINE,
+                                  TROVE_GUARD_DEFAULT_QUARANTINE, 0 };
+    int frames[MODES] = { 0, TROVE_GUARD_MAX_FRAMES, 4, 0, 0 };
+    double best[MODES] = { 0 };
+
+    // Modes alternate in rounds and keep their fastest, to see through noisy neighbours
+    for (int round = 0; round < 5; round++) {
+        for (int mode = 0; mode < MODES; mode++) {
+            arc_guard_set_quarantine(quarantines[mode]);
+            arc_guard_set_frames(frames[mode]);
+            arc_guard_enable(mode > 0);
+            double start = bench_now();
+            create_release(count / 5);
+            double end = bench_now();
+            if (!round || end - start < best[mode]) {
+                best[mode] = end - start;
+            }
+            arc_guard_enable(0);
+        }
+    }
+    for (int mode = 0; mode < MODES; mode++) {
+        char name[64];
+        snprintf(name, sizeof(name), "create/release, %s", labels[mode]);
+        bench_report(name, best[mode], (double)(count / 5), "strings");
+        printf("  %.2f ns/string (best of 5)\n", best[mode] * 1e9 / (double)(count / 5));
+    }
+    return 0;
+}
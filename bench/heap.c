@@ -0,0 +1,67 @@
+/**
+ * @file heap.c
+ * @brief Benchmark: time and memory of a heap snapshot
+ *
+ * Builds 10,000,000 (first argument) tracked objects: an array holding one
+ * array per ten objects, each holding nine short strings. Then writes a
+ * snapshot to a file (second argument, default /tmp/trove-bench.heap) that
+ * tools/heapanalyze reads, and reports its time, its size and how much the
+ * peak resident set grew while it ran.
+ */
+
+#include "bench.h"
+#include "heap.h"
+#include "leaks.h"
+#include "array.h"
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Returns the peak resident set size in kilobytes
+ */
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main(int argc, char **argv) {
+    size_t count = bench_arg(argc, argv, 1, 10000000);
+    const char *path = argc > 2 ? argv[2] : "/tmp/trove-bench.heap";
+    arc_leaks_enable(1);
+
+    double start = bench_now();
+    TroveArray *root = TroveArray_create(count / 10);
+    for (size_t i = 0; i + 10 <= count; i += 10) {
+        TroveArray *group = TroveArray_create(9);
+        for (int j = 0; j < 9; j++) {
+            TroveString *str = TroveString_create_with_length("element", 7);
+            TroveArray_append(group, (ARCObject *)str);
+            arc_release((ARCObject *)str);
+        }
+        TroveArray_append(root, (ARCObject *)group);
+        arc_release((ARCObject *)group);
+    }
+    double end = bench_now();
+    bench_report("build (tracked)", end - start, (double)count, "objects");
+
+    long peak_before = peak_rss_kb();
+    start = bench_now();
+    int error = arc_heap_snapshot(path);
+    end = bench_now();
+    if (error) {
+        fprintf(stderr, "%s: %s\n", path, strerror(error));
+        return 1;
+    }
+    long peak_after = peak_rss_kb();
+    struct stat info;
+    stat(path, &info);
+    bench_report("snapshot", end - start, (double)count, "objects");
+    printf("  %.1f MB written, %.1f bytes/object\n", (double)info.st_size / 1e6, (double)info.st_size / (double)count);
+    printf("  peak RSS %.1f MB before, grew by %ld KB\n", (double)peak_before / 1024.0, peak_after - peak_before);
+
+    arc_release((ARCObject *)root);
+    arc_leaks_enable(0);
+    return 0;
+}
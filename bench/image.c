@@ -0,0 +1,218 @@
+/**
+ * @file image.c
+ * @brief Benchmark: mapping an object image vs. parsing and building a text config
+ *
+ * The configuration has 3,000,000 entries (first argument) in sections of
+ * 16: a dictionary of section names to dictionaries of keys to string
+ * values of 24 to 87 bytes, just under 500 MB as an image. It is written twice
+ * to /tmp: as an image and as an INI-style text file of "[section]" and
+ * "key = value" lines.
+ *
+ * Startup is measured from nothing to answering 10,000 lookups, cold (the
+ * file evicted from the page cache with POSIX_FADV_DONTNEED first) and
+ * warm (the file cached):
+ *
+ * - TroveImage_open, which maps the file and binds it in one pass over the
+ *   object section, then lookups in the mapped dictionaries;
+ * - TroveLineReader over the text, building TroveStrings and dictionaries,
+ *   then the same lookups.
+ *
+ * Cold numbers depend on the storage device; eviction needs the pages to be
+ * clean, so the files are synced after writing.
+ */
+
+#include "bench.h"
+#include "image.h"
+#include "reader.h"
+#include "dictionary.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define BENCH_IMAGE_PATH "/tmp/trove-bench-config.img"
+#define BENCH_TEXT_PATH "/tmp/trove-bench-config.ini"
+#define SECTION_SIZE 16
+#define LOOKUPS 10000
+
+static size_t section_name(char *out, size_t section) {
+    return (size_t)sprintf(out, "service.%06zu", section);
+}
+
+static size_t key_name(char *out, size_t key) {
+    static const char *KEY_NAMES[] = { "host", "port", "timeout", "retries", "user", "path", "mode", "level" };
+    return (size_t)sprintf(out, "%s_%zu", KEY_NAMES[key % 8], key / 8);
+}
+
+static size_t value_text(char *out, size_t entry) {
+    size_t length = 24 + entry * 2654435761u % 64;
+    for (size_t j = 0; j < length; j++) {
+        out[j] = (char)('a' + (entry + j * 7) % 26);
+    }
+    out[length] = '\0';
+    return length;
+}
+
+static TroveDictionary* make_config(size_t entries) {
+    char name[64], value[96];
+    TroveString *keys[SECTION_SIZE];
+    for (size_t k = 0; k < SECTION_SIZE; k++) {
+        key_name(name, k);
+        keys[k] = TroveString_create(name);
+    }
+    TroveDictionary *root = TroveDictionary_create(entries / SECTION_SIZE + 1);
+    for (size_t s = 0; s * SECTION_SIZE < entries; s++) {
+        TroveDictionary *section = TroveDictionary_create(SECTION_SIZE);
+        for (size_t k = 0; k < SECTION_SIZE && s * SECTION_SIZE + k < entries; k++) {
+            size_t length = value_text(value, s * SECTION_SIZE + k);
+            TroveString *str = TroveString_create_with_length(value, length);
+            TroveDictionary_set(section, keys[k], (ARCObject *)str);
+            arc_release((ARCObject *)str);
+        }
+        size_t length = section_name(name, s);
+        TroveString *str = TroveString_create_with_length(name, length);
+        TroveDictionary_set(root, str, (ARCObject *)section);
+        arc_release((ARCObject *)str);
+        arc_release((ARCObject *)section);
+    }
+    for (size_t k = 0; k < SECTION_SIZE; k++) {
+        arc_release((ARCObject *)keys[k]);
+    }
+    return root;
+}
+
+static void write_text(TroveDictionary *root) {
+    FILE *file = fopen(BENCH_TEXT_PATH, "w");
+    size_t cursor = 0;
+    TroveString *name;
+    ARCObject *section;
+    while (TroveDictionary_next(root, &cursor, &name, &section)) {
+        fprintf(file, "[%s]\n", name->str);
+        size_t inner = 0;
+        TroveString *key;
+        ARCObject *value;
+        while (TroveDictionary_next((TroveDictionary *)section, &inner, &key, &value)) {
+            fprintf(file, "%s = %s\n", key->str, ((TroveString *)value)->str);
+        }
+    }
+    fflush(file);
+    fsync(fileno(file));
+    fclose(file);
+}
+
+static TroveDictionary* parse_text(void) {
+    TroveLineReader *reader = TroveLineReader_open(BENCH_TEXT_PATH);
+    TroveDictionary *root = TroveDictionary_create(0);
+    TroveDictionary *section = NULL;
+    TroveStringSlice *line;
+    while ((line = TroveLineReader_next(reader))) {
+        if (line->length > 2 && line->ptr[0] == '[') {
+            TroveString *name = TroveString_create_with_length(line->ptr + 1, line->length - 2);
+            section = TroveDictionary_create(SECTION_SIZE);
+            TroveDictionary_set(root, name, (ARCObject *)section);
+            arc_release((ARCObject *)name);
+            arc_release((ARCObject *)section);
+            continue;
+        }
+        const char *equals = memchr(line->ptr, '=', line->length);
+        if (!equals || !section) {
+            continue;
+        }
+        size_t key_length = (size_t)(equals - line->ptr);
+        while (key_length && line->ptr[key_length - 1] == ' ') {
+            key_length--;
+        }
+        const char *value = equals + 1;
+        while (value < line->ptr + line->length && *value == ' ') {
+            value++;
+        }
+        TroveString *key = TroveString_create_with_length(line->ptr, key_length);
+        TroveString *str = TroveString_create_with_length(value, (size_t)(line->ptr + line->length - value));
+        TroveDictionary_set(section, key, (ARCObject *)str);
+        arc_release((ARCObject *)key);
+        arc_release((ARCObject *)str);
+    }
+    arc_release((ARCObject *)reader);
+    return root;
+}
+
+static size_t lookups(TroveDictionary *root, size_t entries) {
+    char name[64], key[64];
+    size_t found = 0;
+    size_t sections = (entries + SECTION_SIZE - 1) / SECTION_SIZE;
+    for (size_t i = 0; i < LOOKUPS; i++) {
+        size_t entry = i * 40503u % entries;
+        size_t name_length = section_name(name, entry / SECTION_SIZE % sections);
+        size_t key_length = key_name(key, entry % SECTION_SIZE);
+        TroveDictionary *section = (TroveDictionary *)TroveDictionary_get_bytes(root, name, name_length);
+        TroveString *value = (TroveString *)TroveDictionary_get_bytes(section, key, key_length);
+        found += value && value->length >= 24;
+    }
+    return found;
+}
+
+static void evict(const char *path) {
+    int fd = open(path, O_RDONLY);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+int main(int argc, char **argv) {
+    size_t entries = bench_arg(argc, argv, 1, 3000000);
+    TroveDictionary *config = make_config(entries);
+    int error = trove_image_write((ARCObject *)config, BENCH_IMAGE_PATH);
+    if (error) {
+        fprintf(stderr, "%s: %s\n", BENCH_IMAGE_PATH, strerror(error));
+        return 1;
+    }
+    int fd = open(BENCH_IMAGE_PATH, O_RDONLY);
+    fsync(fd);
+    close(fd);
+    write_text(config);
+    arc_release((ARCObject *)config);
+    printf("image %.1f MB, text %.1f MB, %zu entries\n", (double)file_size(BENCH_IMAGE_PATH) / (1 << 20),
+           (double)file_size(BENCH_TEXT_PATH) / (1 << 20), entries);
+
+    for (int warm = 0; warm < 2; warm++) {
+        if (!warm) {
+            evict(BENCH_IMAGE_PATH);
+        }
+        double start = bench_now();
+        TroveImage *image = TroveImage_open(BENCH_IMAGE_PATH);
+        size_t found = image ? lookups((TroveDictionary *)image->root, entries) : 0;
+        double end = bench_now();
+        bench_report(warm ? "image open, warm" : "image open, cold", end - start, (double)entries, "entries");
+        if (found != LOOKUPS) {
+            fprintf(stderr, "image lookups failed (%zu found)\n", found);
+            return 1;
+        }
+        arc_release((ARCObject *)image);
+    }
+
+    for (int warm = 0; warm < 2; warm++) {
+        if (!warm) {
+            evict(BENCH_TEXT_PATH);
+        }
+        autorelease_pool_push();
+        double start = bench_now();
+        TroveDictionary *parsed = parse_text();
+        size_t found = lookups(parsed, entries);
+        double end = bench_now();
+        bench_report(warm ? "parse and build, warm" : "parse and build, cold", end - start, (double)entries, "entries");
+        if (found != LOOKUPS) {
+            fprintf(stderr, "parsed lookups failed (%zu found)\n", found);
+            return 1;
+        }
+        arc_release((ARCObject *)parsed);
+        autorelease_pool_pop();
+    }
+
+    unlink(BENCH_IMAGE_PATH);
+    unlink(BENCH_TEXT_PATH);
+    return 0;
+}
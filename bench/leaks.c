@@ -0,0 +1,87 @@
+/**
+ * @file leaks.c
+ * @brief Benchmark: cost of leak tracking with threads creating objects at once
+ *
+ * Each of 1, 2, 4 and 8 threads (or the list given as the second argument,
+ * e.g. 1,16) creates and releases strings, 4,000,000 in all (first
+ * argument), in batches of 1000 kept alive together, so the registry
+ * holds several thousand objects and every object is tracked and
+ * untracked once. Each thread count runs with tracking off and then on, and
+ * the ratio is the tracking overhead under that much contention.
+ */
+
+#include "bench.h"
+#include "leaks.h"
+#include <string.h>
+#include <pthread.h>
+
+/** @brief Strings each thread keeps alive at once */
+#define BATCH 1000
+
+/**
+ * @brief Work for one thread
+ */
+typedef struct LeaksWorker {
+    pthread_t thread;    /**< The thread */
+    size_t count;        /**< Strings to create */
+} LeaksWorker;
+
+/**
+ * @brief Creates and releases a worker's strings in batches
+ */
+static void *create_release(void *arg) {
+    LeaksWorker *worker = (LeaksWorker *)arg;
+    TroveString *batch[BATCH];
+    for (size_t done = 0; done < worker->count; done += BATCH) {
+        for (size_t i = 0; i < BATCH; i++) {
+            batch[i] = TroveString_create_with_length("trove", 5);
+        }
+        for (size_t i = 0; i < BATCH; i++) {
+            arc_release((ARCObject *)batch[i]);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs threads workers sharing count strings and returns the seconds taken
+ */
+static double run(size_t threads, size_t count) {
+    LeaksWorker workers[64];
+    double start = bench_now();
+    for (size_t i = 0; i < threads; i++) {
+        workers[i].count = count / threads;
+        pthread_create(&workers[i].thread, NULL, create_release, &workers[i]);
+    }
+    for (size_t i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    return bench_now() - start;
+}
+
+int main(int argc, char **argv) {
+    size_t count = bench_arg(argc, argv, 1, 4000000);
+    const char *list = argc > 2 ? argv[2] : "1,2,4,8";
+    char *copy = strdup(list);
+    for (char *item = strtok(copy, ","); item; item = strtok(NULL, ",")) {
+        size_t threads = (size_t)strtoull(item, NULL, 10);
+        if (threads < 1 || threads > 64) {
+            continue;
+        }
+        // Warm up malloc's per-thread arenas before timing
+        run(threads, threads * BATCH * 10);
+        double seconds[2];
+        for (int on = 0; on < 2; on++) {
+            arc_leaks_enable(on);
+            seconds[on] = run(threads, count);
+            char name[64];
+            snprintf(name, sizeof(name), "%zu threads, leaks %s", threads, on ? "on" : "off");
+            bench_report(name, seconds[on], (double)count, "objects");
+        }
+        arc_leaks_enable(0);
+        printf("  %.1f -> %.1f ns/object, %.2fx\n", seconds[0] * 1e9 / (double)count,
+               seconds[1] * 1e9 / (double)count, seconds[1] / seconds[0]);
+    }
+    free(copy);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file number.c
+ * @brief Benchmark: number formatting and parsing vs. snprintf/strtod
+ *
+ * Converts N values (1000000 by default, or the first argument) each way.
+ * Doubles are compared against "%.17g", the shortest libc format that always
+ * round-trips, and every formatted double is checked to parse back exactly.
+ */
+
+#include "bench.h"
+#include "number.h"
+#include <inttypes.h>
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+int main(int argc, char **argv) {
+    size_t count = bench_arg(argc, argv, 1, 1000000);
+    int64_t *ints = (int64_t *)malloc(count * sizeof(int64_t));
+    double *doubles = (double *)malloc(count * sizeof(double));
+    char (*text)[TROVE_NUMBER_BUFFER_SIZE] = malloc(count * TROVE_NUMBER_BUFFER_SIZE);
+    size_t *lengths = (size_t *)malloc(count * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) {
+        ints[i] = (int64_t)(next_random() >> (next_random() % 64)) * ((i & 1) ? -1 : 1);
+        doubles[i] = (i % 2) ? (double)(next_random() % 1000000) / 1000.0
+                             : (double)(next_random() >> 11) * 0x1.0p-53 * 1e6;
+    }
+    size_t sink = 0;
+
+    double start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+        sink += (size_t)snprintf(text[i], TROVE_NUMBER_BUFFER_SIZE, "%" PRId64, ints[i]);
+    }
+    double int_snprintf = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+        lengths[i] = trove_format_int64(ints[i], text[i]);
+    }
+    double int_format = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+        sink += (size_t)strtoll(text[i], NULL, 10);
+    }
+    double int_strtoll = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+        int64_t value;
+        if (!trove_parse_int64(text[i], lengths[i], &value) || value != ints[i]) {
+            fprintf(stderr, "int64 round trip failed for %s\n", text[i]);
+            return 1;
+        }
+    }
+    double int_parse = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+        sink += (size_t)snprintf(text[i], TROVE_NUMBER_BUFFER_SIZE, "%.17g", doubles[i]);
+    }
+    double dbl_snprintf = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+        lengths[i] = trove_format_double(doubles[i], text[i]);
+    }
+    double dbl_format = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+        sink += (size_t)(strtod(text[i], NULL) > 0);
+    }
+    double dbl_strtod = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+        double value;
+        if (!trove_parse_double(text[i], lengths[i], &value) || value != doubles[i]) {
+            fprintf(stderr, "double round trip failed for %s\n", text[i]);
+            return 1;
+        }
+    }
+    double dbl_parse = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+        char buf[TROVE_NUMBER_BUFFER_SIZE];
+        snprintf(buf, sizeof(buf), "%.17g", doubles[i]);
+        TroveString *str = TroveString_create(buf);
+        sink += str->length;
+        arc_release((ARCObject *)str);
+    }
+    double str_snprintf = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < count; i++) {
+        TroveString *str = TroveString_from_double(doubles[i]);
+        sink += str->length;
+        arc_release((ARCObject *)str);
+    }
+    double str_format = bench_now() - start;
+
+    printf("%zu values (checksum %zu)\n", count, sink);
+    bench_report("int64: snprintf", int_snprintf, (double)count, "ops");
+    bench_report("int64: trove_format_int64", int_format, (double)count, "ops");
+    bench_report("int64: strtoll", int_strtoll, (double)count, "ops");
+    bench_report("int64: trove_parse_int64", int_parse, (double)count, "ops");
+    bench_report("double: snprintf %.17g", dbl_snprintf, (double)count, "ops");
+    bench_report("double: trove_format_double", dbl_format, (double)count, "ops");
+    bench_report("double: strtod", dbl_strtod, (double)count, "ops");
+    bench_report("double: trove_parse_double", dbl_parse, (double)count, "ops");
+    bench_report("string: snprintf + create", str_snprintf, (double)count, "ops");
+    bench_report("string: TroveString_from_double", str_format, (double)count, "ops");
+
+    free(ints);
+    free(doubles);
+    free(text);
+    free(lengths);
+    return 0;
+}
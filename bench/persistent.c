@@ -0,0 +1,174 @@
+/**
+ * @file persistent.c
+ * @brief Benchmark: versioned updates of TroveVector and TroveMap vs. full copies
+ *
+ * A vector and a map of 1000000 entries (first argument) are built, then
+ * 10000 versions (second argument) are derived, each by replacing one
+ * randomly chosen entry of the previous version. Every version stays alive
+ * until the end, as in a history of configuration snapshots, so the
+ * resident-memory growth shows what structural sharing costs per version.
+ *
+ * The baseline copies the whole structure for each version (a TroveArray
+ * for the vector, a TroveDictionary for the map). It is only run for 8
+ * versions, since 10000 full copies would not fit in memory; its
+ * per-version figures are directly comparable.
+ */
+
+#include "bench.h"
+#include "vector.h"
+#include "map.h"
+#include "array.h"
+#include "dictionary.h"
+#include <stdint.h>
+#include <unistd.h>
+
+#define BASELINE_VERSIONS 8
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Returns the resident set size in bytes, or 0 where /proc is unavailable
+ */
+static size_t resident_bytes(void) {
+    unsigned long size = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (!f) {
+        return 0;
+    }
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(f);
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static void report_versions(const char *name, double seconds, size_t versions, size_t rss_before) {
+    size_t rss = resident_bytes();
+    bench_report(name, seconds, (double)versions, "versions");
+    printf("%-32s %10.1f bytes/version\n", "", rss > rss_before ? (double)(rss - rss_before) / (double)versions : 0.0);
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_arg(argc, argv, 1, 1000000);
+    size_t versions = bench_arg(argc, argv, 2, 10000);
+    size_t baseline = versions < BASELINE_VERSIONS ? versions : BASELINE_VERSIONS;
+    TroveString **keys = (TroveString **)malloc(n * sizeof(TroveString *));
+    char buf[64];
+    for (size_t i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf), "setting.%zu", i);
+        keys[i] = TroveString_create(buf);
+        TroveString_hash(keys[i]);
+    }
+
+    // Vector
+    double start = bench_now();
+    TroveVector *vector = TroveVector_create();
+    for (size_t i = 0; i < n; i++) {
+        TroveVector *next = TroveVector_push(vector, (ARCObject *)keys[i]);
+        arc_release((ARCObject *)vector);
+        vector = next;
+    }
+    bench_report("vector build (push)", bench_now() - start, (double)n, "ops");
+
+    TroveVector **vector_versions = (TroveVector **)malloc((versions + 1) * sizeof(TroveVector *));
+    vector_versions[0] = vector;
+    size_t rss = resident_bytes();
+    start = bench_now();
+    for (size_t v = 1; v <= versions; v++) {
+        vector_versions[v] = TroveVector_set(vector_versions[v - 1], next_random() % n, (ARCObject *)keys[next_random() % n]);
+    }
+    report_versions("vector set, versions kept", bench_now() - start, versions, rss);
+
+    TroveArray **array_versions = (TroveArray **)malloc(baseline * sizeof(TroveArray *));
+    rss = resident_bytes();
+    start = bench_now();
+    TroveArray *first = TroveArray_create(n);
+    TroveArray_append_all(first, (ARCObject *const *)keys, n);
+    TroveArray *previous = first;
+    for (size_t v = 0; v < baseline; v++) {
+        TroveArray *copy = TroveArray_create(n);
+        TroveArray_append_all(copy, previous->items, previous->count);
+        TroveArray_set(copy, next_random() % n, (ARCObject *)keys[next_random() % n]);
+        array_versions[v] = copy;
+        previous = copy;
+    }
+    report_versions("array full copy, versions kept", bench_now() - start, baseline, rss);
+    for (size_t v = 0; v < baseline; v++) {
+        arc_release((ARCObject *)array_versions[v]);
+    }
+    arc_release((ARCObject *)first);
+
+    start = bench_now();
+    for (size_t v = 0; v <= versions; v++) {
+        arc_release((ARCObject *)vector_versions[v]);
+    }
+    bench_report("vector release all versions", bench_now() - start, (double)versions + 1, "versions");
+    free(vector_versions);
+    free(array_versions);
+
+    // Map
+    start = bench_now();
+    TroveMap *map = TroveMap_create();
+    for (size_t i = 0; i < n; i++) {
+        TroveMap *next = TroveMap_set(map, keys[i], (ARCObject *)keys[i]);
+        arc_release((ARCObject *)map);
+        map = next;
+    }
+    bench_report("map build (set)", bench_now() - start, (double)n, "ops");
+
+    TroveMap **map_versions = (TroveMap **)malloc((versions + 1) * sizeof(TroveMap *));
+    map_versions[0] = map;
+    rss = resident_bytes();
+    start = bench_now();
+    for (size_t v = 1; v <= versions; v++) {
+        map_versions[v] = TroveMap_set(map_versions[v - 1], keys[next_random() % n], (ARCObject *)keys[next_random() % n]);
+    }
+    report_versions("map set, versions kept", bench_now() - start, versions, rss);
+
+    start = bench_now();
+    size_t sink = 0;
+    for (size_t i = 0; i < n; i++) {
+        sink += TroveMap_get(map_versions[versions], keys[next_random() % n]) != NULL;
+    }
+    bench_report("map get", bench_now() - start, (double)n, "ops");
+
+    TroveDictionary **dict_versions = (TroveDictionary **)malloc(baseline * sizeof(TroveDictionary *));
+    rss = resident_bytes();
+    start = bench_now();
+    for (size_t v = 0; v < baseline; v++) {
+        TroveDictionary *copy = TroveDictionary_create(n);
+        TroveMapIter it;
+        TroveString *key;
+        ARCObject *value;
+        TroveMap_iter_init(&it, map);
+        while (TroveMap_iter_next(&it, &key, &value)) {
+            TroveDictionary_set(copy, key, value);
+        }
+        TroveDictionary_set(copy, keys[next_random() % n], (ARCObject *)keys[next_random() % n]);
+        dict_versions[v] = copy;
+    }
+    report_versions("dictionary full copy, kept", bench_now() - start, baseline, rss);
+
+    start = bench_now();
+    for (size_t v = 0; v <= versions; v++) {
+        arc_release((ARCObject *)map_versions[v]);
+    }
+    bench_report("map release all versions", bench_now() - start, (double)versions + 1, "versions");
+    for (size_t v = 0; v < baseline; v++) {
+        arc_release((ARCObject *)dict_versions[v]);
+    }
+    free(map_versions);
+    free(dict_versions);
+
+    arc_release_all((ARCObject *const *)keys, n);
+    free(keys);
+    printf("checksum %zu\n", sink);
+    return 0;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file poolstats.c
+ * @brief Benchmark: cost of pool histograms on push/pop
+ *
+ * Pushes and pops 2,000,000 (first argument) pools holding 0, 1 and 16
+ * strings, and a fiftieth as many holding 1,000, with histograms off and
+ * then on, in one process. Also times a snapshot and its Prometheus export,
+ * which is what a scrape costs. Run any other benchmark with
+ * TROVE_POOL_STATS=1 in the environment to measure it with histograms on.
+ */
+
+#include "bench.h"
+#include "poolstats.h"
+
+static void push_pop(size_t pools, size_t objects) {
+    for (size_t i = 0; i < pools; i++) {
+        autorelease_pool_push();
+        for (size_t j = 0; j < objects; j++) {
+            arc_autorelease((ARCObject *)TroveString_create_with_length("trove", 5));
+        }
+        autorelease_pool_pop();
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t count = bench_arg(argc, argv, 1, 2000000);
+    const size_t sizes[4] = { 0, 1, 16, 1000 };
+    const char *labels[2] = { "histograms off", "histograms on" };
+
+    for (int on = 0; on < 2; on++) {
+        arc_pool_stats_enable(on);
+        for (int s = 0; s < 4; s++) {
+            size_t pools = sizes[s] >= 1000 ? count / 50 : count;
+            char name[64];
+            double start = bench_now();
+            push_pop(pools, sizes[s]);
+            double end = bench_now();
+            snprintf(name, sizeof(name), "pools of %zu, %s", sizes[s], labels[on]);
+            bench_report(name, end - start, (double)pools, "pools");
+            printf("  %.1f ns/pool\n", (end - start) * 1e9 / (double)pools);
+        }
+    }
+
+    ArcPoolStatsSnapshot *snapshot = (ArcPoolStatsSnapshot *)malloc(sizeof(ArcPoolStatsSnapshot));
+    double start = bench_now();
+    for (int i = 0; i < 1000; i++) {
+        arc_pool_stats_snapshot(snapshot);
+        arc_release((ARCObject *)arc_pool_stats_to_prometheus(snapshot));
+    }
+    double end = bench_now();
+    bench_report("snapshot + export", end - start, 1000.0, "scrapes");
+    printf("  p50 drain %llu ns, p99 drain %llu ns, max %llu ns\n",
+           (unsigned long long)arc_histogram_quantile(&snapshot->drain_ns, 0.5),
+           (unsigned long long)arc_histogram_quantile(&snapshot->drain_ns, 0.99),
+           (unsigned long long)snapshot->drain_ns.max);
+    free(snapshot);
+    return 0;
+}
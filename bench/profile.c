@@ -0,0 +1,76 @@
+/**
+ * @file profile.c
+ * @brief Benchmark: cost per object of the sampling allocation profiler
+ *
+ * Creates and releases 20,000,000 (first argument) short strings, keeping
+ * every hundredth alive until the end of its run so some samples stay live,
+ * with the profiler off, at the default rate and at a 4 KB rate, in one
+ * process. Each mode runs a fifth of the strings five times, alternating
+ * with the others, and reports its fastest run.
+ * Then writes the profile to a file (second argument, default
+ * /tmp/trove-bench.pprof) for `go tool pprof`.
+ */
+
+#include "bench.h"
+#include "profile.h"
+#include "array.h"
+#include <string.h>
+
+/**
+ * @brief Creates and releases count strings, appending every hundredth to kept
+ */
+static void create_release(TroveArray *kept, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        TroveString *str = TroveString_create_with_length("profile", 7);
+        if (i % 100 == 0) {
+            TroveArray_append(kept, (ARCObject *)str);
+        }
+        arc_release((ARCObject *)str);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t count = bench_arg(argc, argv, 1, 20000000);
+    const char *path = argc > 2 ? argv[2] : "/tmp/trove-bench.pprof";
+    const char *labels[3] = { "profile off", "profile 512 KB", "profile 4 KB" };
+    size_t rates[3] = { 0, TROVE_PROFILE_DEFAULT_RATE, 4096 };
+    double best[3] = { 0, 0, 0 };
+    size_t samples[3] = { 0, 0, 0 };
+
+    // Modes alternate in rounds and keep their fastest, to see through noisy neighbours
+    for (int round = 0; round < 5; round++) {
+        for (int mode = 0; mode < 3; mode++) {
+            if (rates[mode]) {
+                arc_profile_set_rate(rates[mode]);
+            }
+            arc_profile_enable(mode > 0);
+            TroveArray *kept = TroveArray_create(count / 500 + 1);
+            size_t before = arc_profile_samples();
+            double start = bench_now();
+            create_release(kept, count / 5);
+            double end = bench_now();
+            samples[mode] += arc_profile_samples() - before;
+            if (!round || end - start < best[mode]) {
+                best[mode] = end - start;
+            }
+            arc_release((ARCObject *)kept);
+        }
+    }
+    arc_profile_enable(0);
+    for (int mode = 0; mode < 3; mode++) {
+        char name[64];
+        snprintf(name, sizeof(name), "create/release, %s", labels[mode]);
+        bench_report(name, best[mode], (double)(count / 5), "strings");
+        printf("  %.2f ns/string (best of 5), %zu samples in all\n", best[mode] * 1e9 / (double)(count / 5), samples[mode]);
+    }
+
+    double start = bench_now();
+    int error = arc_profile_save(path);
+    double end = bench_now();
+    if (error) {
+        fprintf(stderr, "%s: %s\n", path, strerror(error));
+        return 1;
+    }
+    bench_report("save", end - start, (double)arc_profile_samples(), "samples");
+    return 0;
+}
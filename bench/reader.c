@@ -0,0 +1,113 @@
+/**
+ * @file reader.c
+ * @brief Benchmark: streaming lines with TroveLineReader vs. getline + String copies
+ *
+ * A text file of 10240 MB (first argument, in MB) made of 64-byte lines is
+ * written to /tmp and read line by line two ways:
+ *
+ * - TroveLineReader over the whole file, yielding zero-copy slices that are
+ *   released batch by batch;
+ * - getline into a buffer, copying each line into an autoreleased
+ *   TroveString under a single pool, as loaders did before the reader
+ *   existed. Its memory grows with the input, so it only reads the first
+ *   512 MB (second argument, in MB).
+ *
+ * Peak RSS is reported after each run; the reader runs first because the
+ * peak never goes down. A 10 GB file does not fit in the page cache of most
+ * test machines, so the reader run is usually bound by the disk.
+ */
+
+#include "bench.h"
+#include "reader.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define BENCH_READER_PATH "/tmp/trove-bench-reader.txt"
+#define LINE_LENGTH 64
+
+static int write_file(const char *path, size_t size) {
+    char line[LINE_LENGTH];
+    char block[LINE_LENGTH * 1024];
+    memset(line, 'x', LINE_LENGTH - 1);
+    line[LINE_LENGTH - 1] = '\n';
+    for (size_t i = 0; i < sizeof(block); i += LINE_LENGTH) {
+        memcpy(block + i, line, LINE_LENGTH);
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    for (size_t written = 0; written < size; written += sizeof(block)) {
+        if (write(fd, block, sizeof(block)) != (ssize_t)sizeof(block)) {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+static double peak_rss_mb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)usage.ru_maxrss / 1024.0;
+}
+
+int main(int argc, char **argv) {
+    size_t size = bench_arg(argc, argv, 1, 10240) << 20;
+    size_t baseline_size = bench_arg(argc, argv, 2, 512) << 20;
+    if (baseline_size > size) {
+        baseline_size = size;
+    }
+    if (write_file(BENCH_READER_PATH, size) != 0) {
+        perror(BENCH_READER_PATH);
+        return 1;
+    }
+
+    double start = bench_now();
+    TroveLineReader *reader = TroveLineReader_open(BENCH_READER_PATH);
+    if (!reader) {
+        perror(BENCH_READER_PATH);
+        return 1;
+    }
+    size_t lines = 0, bytes = 0;
+    TroveStringSlice *line;
+    while ((line = TroveLineReader_next(reader))) {
+        lines++;
+        bytes += line->length;
+    }
+    arc_release((ARCObject *)reader);
+    double end = bench_now();
+    bench_report("line reader", end - start, (double)lines, "lines");
+    printf("  %.1f MB/s, peak RSS %.1f MB\n", (double)size / (1 << 20) / (end - start), peak_rss_mb());
+
+    start = bench_now();
+    FILE *file = fopen(BENCH_READER_PATH, "r");
+    char *buffer = NULL;
+    size_t buffer_size = 0;
+    size_t copied_lines = 0, copied = 0;
+    ssize_t n;
+    autorelease_pool_push();
+    while (copied < baseline_size && (n = getline(&buffer, &buffer_size, file)) > 0) {
+        TroveString *copy = TroveString_create_with_length(buffer, (size_t)n - (buffer[n - 1] == '\n'));
+        arc_autorelease((ARCObject *)copy);
+        copied_lines++;
+        copied += (size_t)n;
+    }
+    autorelease_pool_pop();
+    free(buffer);
+    fclose(file);
+    end = bench_now();
+    bench_report("getline + copy", end - start, (double)copied_lines, "lines");
+    printf("  %.1f MB/s, peak RSS %.1f MB\n", (double)copied / (1 << 20) / (end - start), peak_rss_mb());
+
+    unlink(BENCH_READER_PATH);
+    if (bytes != lines * (LINE_LENGTH - 1)) {
+        fprintf(stderr, "unexpected line bytes: %zu for %zu lines\n", bytes, lines);
+        return 1;
+    }
+    printf("lines %zu\n", lines);
+    return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file rope.c
+ * @brief Benchmark: repeated append and serialization, TroveRope vs. TroveString
+ *
+ * Appends N short pieces (20000 by default, or the first argument) to an
+ * output, once by building a new flat TroveString per append and once with
+ * TroveRope, then writes each result to /dev/null.
+ */
+
+#include "bench.h"
+#include "rope.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @brief Naive concatenation as callers do it today: copy both sides into a new string
+ */
+static TroveString* naive_concat(TroveString *a, const char *b, size_t b_len) {
+    TroveString *out = TroveString_create_with_length(NULL, a->length + b_len);
+    memcpy(out->str, a->str, a->length);
+    memcpy(out->str + a->length, b, b_len);
+    return out;
+}
+
+int main(int argc, char **argv) {
+    size_t pieces = bench_arg(argc, argv, 1, 20000);
+    static const char *piece = "{\"id\": 12345, \"name\": \"trove\", \"ok\": true},\n";
+    size_t piece_len = strlen(piece);
+    int fd = open("/dev/null", O_WRONLY);
+
+    double start = bench_now();
+    TroveString *flat = TroveString_create("");
+    for (size_t i = 0; i < pieces; i++) {
+        TroveString *next = naive_concat(flat, piece, piece_len);
+        arc_release((ARCObject *)flat);
+        flat = next;
+    }
+    double flat_append = bench_now() - start;
+
+    start = bench_now();
+    TroveRope *rope = TroveRope_create("");
+    for (size_t i = 0; i < pieces; i++) {
+        TroveRope *next = TroveRope_append(rope, piece);
+        arc_release((ARCObject *)rope);
+        rope = next;
+    }
+    double rope_append = bench_now() - start;
+
+    start = bench_now();
+    if (write(fd, flat->str, flat->length) != (ssize_t)flat->length) {
+        perror("write");
+    }
+    double flat_write = bench_now() - start;
+
+    start = bench_now();
+    if (TroveRope_writev(rope, fd) != (ssize_t)rope->length) {
+        perror("writev");
+    }
+    double rope_write = bench_now() - start;
+
+    start = bench_now();
+    TroveString *flattened = TroveRope_flatten(rope);
+    double rope_flatten = bench_now() - start;
+
+    if (flattened->length != flat->length || memcmp(flattened->str, flat->str, flat->length) != 0) {
+        fprintf(stderr, "rope contents differ from flat string\n");
+        return 1;
+    }
+
+    double mb = (double)flat->length / (1024 * 1024);
+    printf("%zu appends, %.2f MB output, rope height %d\n", pieces, mb, rope->height);
+    bench_report("append: TroveString copy", flat_append, (double)pieces, "appends");
+    bench_report("append: TroveRope", rope_append, (double)pieces, "appends");
+    bench_report("serialize: write(flat)", flat_write, mb, "MB");
+    bench_report("serialize: TroveRope_writev", rope_write, mb, "MB");
+    bench_report("serialize: TroveRope_flatten", rope_flatten, mb, "MB");
+
+    arc_release((ARCObject *)flattened);
+    arc_release((ARCObject *)flat);
+    arc_release((ARCObject *)rope);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,262 @@
+/**
+ * @file serial.c
+ * @brief Benchmark: binary serialization vs. a hand-written JSON encoder and parser
+ *
+ * The graph is an array of 100,000 records (first argument). Each record
+ * is a dictionary with five fields: three strings of 8 to 40 bytes, a
+ * 4-element array of short strings and a nested dictionary. Field names
+ * are shared TroveStrings, as they are when keys are interned.
+ *
+ * Both formats encode into memory and decode under an autorelease pool. The
+ * JSON side is the minimal code a project would write by hand: escaping
+ * only what JSON requires and parsing only strings, arrays and objects.
+ * Throughput is reported in MB of the respective encoding.
+ */
+
+#include "bench.h"
+#include "serial.h"
+#include "array.h"
+#include "dictionary.h"
+
+static const char *FIELD_NAMES[] = { "name", "email", "city", "tags", "meta" };
+static const char *META_NAMES[] = { "created", "owner" };
+
+static TroveString* make_text(size_t i, size_t salt) {
+    char text[48];
+    size_t length = 8 + (i * 2654435761u + salt * 40503u) % 33;
+    for (size_t j = 0; j < length; j++) {
+        text[j] = (char)('a' + (i + j * 7 + salt) % 26);
+    }
+    if (i % 97 == 0) {
+        text[length / 2] = '"';
+    }
+    return TroveString_create_with_length(text, length);
+}
+
+static TroveArray* make_graph(size_t count) {
+    TroveString *fields[5], *metas[2];
+    for (size_t f = 0; f < 5; f++) {
+        fields[f] = TroveString_create(FIELD_NAMES[f]);
+    }
+    for (size_t f = 0; f < 2; f++) {
+        metas[f] = TroveString_create(META_NAMES[f]);
+    }
+    TroveArray *root = TroveArray_create(count);
+    for (size_t i = 0; i < count; i++) {
+        TroveDictionary *record = TroveDictionary_create(5);
+        for (size_t f = 0; f < 3; f++) {
+            TroveString *value = make_text(i, f);
+            TroveDictionary_set(record, fields[f], (ARCObject *)value);
+            arc_release((ARCObject *)value);
+        }
+        TroveArray *tags = TroveArray_create(4);
+        for (size_t t = 0; t < 4; t++) {
+            TroveString *tag = make_text(i + t, 9);
+            TroveArray_append(tags, (ARCObject *)tag);
+            arc_release((ARCObject *)tag);
+        }
+        TroveDictionary_set(record, fields[3], (ARCObject *)tags);
+        arc_release((ARCObject *)tags);
+        TroveDictionary *meta = TroveDictionary_create(2);
+        for (size_t f = 0; f < 2; f++) {
+            TroveString *value = make_text(i, 20 + f);
+            TroveDictionary_set(meta, metas[f], (ARCObject *)value);
+            arc_release((ARCObject *)value);
+        }
+        TroveDictionary_set(record, fields[4], (ARCObject *)meta);
+        arc_release((ARCObject *)meta);
+        TroveArray_append(root, (ARCObject *)record);
+        arc_release((ARCObject *)record);
+    }
+    for (size_t f = 0; f < 5; f++) {
+        arc_release((ARCObject *)fields[f]);
+    }
+    for (size_t f = 0; f < 2; f++) {
+        arc_release((ARCObject *)metas[f]);
+    }
+    return root;
+}
+
+/* ---- hand-written JSON baseline ---- */
+
+typedef struct JsonBuffer {
+    char *bytes;
+    size_t length;
+    size_t capacity;
+} JsonBuffer;
+
+static void json_reserve(JsonBuffer *out, size_t extra) {
+    if (out->capacity - out->length < extra) {
+        while (out->capacity - out->length < extra) {
+            out->capacity *= 2;
+        }
+        out->bytes = (char *)realloc(out->bytes, out->capacity);
+    }
+}
+
+static void json_put(JsonBuffer *out, char c) {
+    json_reserve(out, 1);
+    out->bytes[out->length++] = c;
+}
+
+static void json_encode_string(JsonBuffer *out, TroveString *str) {
+    json_reserve(out, str->length * 6 + 2);
+    char *p = out->bytes + out->length;
+    *p++ = '"';
+    for (size_t i = 0; i < str->length; i++) {
+        unsigned char c = (unsigned char)str->str[i];
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = (char)c;
+        } else if (c < 0x20) {
+            p += sprintf(p, "\\u%04x", c);
+        } else {
+            *p++ = (char)c;
+        }
+    }
+    *p++ = '"';
+    out->length = (size_t)(p - out->bytes);
+}
+
+static void json_encode(JsonBuffer *out, ARCObject *obj) {
+    if (obj->dealloc == TroveString_dealloc) {
+        json_encode_string(out, (TroveString *)obj);
+    } else if (obj->dealloc == TroveArray_dealloc) {
+        TroveArray *array = (TroveArray *)obj;
+        json_put(out, '[');
+        for (size_t i = 0; i < array->count; i++) {
+            if (i) {
+                json_put(out, ',');
+            }
+            json_encode(out, array->items[i]);
+        }
+        json_put(out, ']');
+    } else {
+        size_t cursor = 0, n = 0;
+        TroveString *key;
+        ARCObject *value;
+        json_put(out, '{');
+        while (TroveDictionary_next((TroveDictionary *)obj, &cursor, &key, &value)) {
+            if (n++) {
+                json_put(out, ',');
+            }
+            json_encode_string(out, key);
+            json_put(out, ':');
+            json_encode(out, value);
+        }
+        json_put(out, '}');
+    }
+}
+
+static TroveString* json_parse_string(const char **cursor) {
+    const char *p = *cursor + 1;
+    const char *start = p;
+    while (*p != '"' && *p != '\\') {
+        p++;
+    }
+    if (*p == '"') {
+        *cursor = p + 1;
+        return TroveString_create_with_length(start, (size_t)(p - start));
+    }
+    TroveString *str = TroveString_create_with_length(start, (size_t)(p - start));
+    while (*p != '"') {
+        char c = *p++;
+        if (c == '\\') {
+            c = *p++;
+            if (c == 'u') {
+                c = (char)strtol((char[5]){ p[0], p[1], p[2], p[3], 0 }, NULL, 16);
+                p += 4;
+            }
+        }
+        TroveString_append(&str, &c, 1);
+    }
+    *cursor = p + 1;
+    return str;
+}
+
+static ARCObject* json_parse(const char **cursor) {
+    const char *p = *cursor;
+    if (*p == '"') {
+        return (ARCObject *)json_parse_string(cursor);
+    }
+    if (*p == '[') {
+        TroveArray *array = TroveArray_create(0);
+        *cursor = p + 1;
+        while (**cursor != ']') {
+            ARCObject *item = json_parse(cursor);
+            TroveArray_append(array, item);
+            arc_release(item);
+            if (**cursor == ',') {
+                (*cursor)++;
+            }
+        }
+        (*cursor)++;
+        return (ARCObject *)array;
+    }
+    TroveDictionary *dict = TroveDictionary_create(0);
+    *cursor = p + 1;
+    while (**cursor != '}') {
+        TroveString *key = json_parse_string(cursor);
+        (*cursor)++;
+        ARCObject *value = json_parse(cursor);
+        TroveDictionary_set(dict, key, value);
+        arc_release((ARCObject *)key);
+        arc_release(value);
+        if (**cursor == ',') {
+            (*cursor)++;
+        }
+    }
+    (*cursor)++;
+    return (ARCObject *)dict;
+}
+
+int main(int argc, char **argv) {
+    size_t count = bench_arg(argc, argv, 1, 100000);
+    TroveArray *graph = make_graph(count);
+
+    double start = bench_now();
+    int error;
+    TroveData *encoded = trove_serialize((ARCObject *)graph, &error);
+    double end = bench_now();
+    double mb = (double)encoded->length / (1 << 20);
+    bench_report("binary encode", end - start, mb, "MB");
+
+    autorelease_pool_push();
+    start = bench_now();
+    ARCObject *decoded = trove_deserialize(encoded->bytes, encoded->length, &error);
+    end = bench_now();
+    bench_report("binary decode", end - start, mb, "MB");
+    if (!decoded || ((TroveArray *)decoded)->count != count) {
+        fprintf(stderr, "binary round trip failed (error %d)\n", error);
+        return 1;
+    }
+    arc_release(decoded);
+    autorelease_pool_pop();
+
+    start = bench_now();
+    JsonBuffer json = { (char *)malloc(TROVE_SERIAL_BUFFER_SIZE), 0, TROVE_SERIAL_BUFFER_SIZE };
+    json_encode(&json, (ARCObject *)graph);
+    json_put(&json, '\0');
+    end = bench_now();
+    double json_mb = (double)json.length / (1 << 20);
+    bench_report("JSON encode", end - start, json_mb, "MB");
+
+    autorelease_pool_push();
+    start = bench_now();
+    const char *cursor = json.bytes;
+    decoded = json_parse(&cursor);
+    end = bench_now();
+    bench_report("JSON decode", end - start, json_mb, "MB");
+    if (((TroveArray *)decoded)->count != count) {
+        fprintf(stderr, "JSON round trip failed\n");
+        return 1;
+    }
+    arc_release(decoded);
+    autorelease_pool_pop();
+
+    printf("sizes: binary %.1f MB, JSON %.1f MB\n", mb, json_mb);
+    free(json.bytes);
+    arc_release((ARCObject *)encoded);
+    arc_release((ARCObject *)graph);
+    return 0;
+}
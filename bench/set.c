@@ -0,0 +1,142 @@
+/**
+ * @file set.c
+ * @brief Benchmark: TroveSet algebra on 1M-element sets vs. sorted arrays
+ *
+ * Set A holds keys 0..n-1 and set B keys n/2..3n/2-1, so the sets overlap by
+ * half. n defaults to 1000000 and can be changed with the first argument.
+ *
+ * The baseline is the ad-hoc approach TroveSet replaces: sort string arrays
+ * with strcmp, then merge them. Building a TroveSet deduplicates a list that
+ * contains every key twice; the baseline sorts the same list and drops
+ * adjacent duplicates. Union, intersection and difference are measured for
+ * both, including the cost of retaining the result's keys.
+ */
+
+#include "bench.h"
+#include "set.h"
+#include <string.h>
+
+static TroveString** make_keys(size_t first, size_t n) {
+    TroveString **keys = (TroveString **)malloc(2 * n * sizeof(TroveString *));
+    char buf[64];
+    for (size_t i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf), "item:%zu", (first + i) * 2654435761u);
+        keys[i] = TroveString_create(buf);
+        keys[n + i] = keys[i];
+    }
+    return keys;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp((*(TroveString *const *)a)->str, (*(TroveString *const *)b)->str);
+}
+
+/**
+ * @brief Sorts keys and removes duplicates in place, returning the new count
+ */
+static size_t sort_unique(TroveString **keys, size_t n) {
+    qsort(keys, n, sizeof(TroveString *), compare_strings);
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (out == 0 || strcmp(keys[out - 1]->str, keys[i]->str) != 0) {
+            keys[out++] = keys[i];
+        }
+    }
+    return out;
+}
+
+enum { MERGE_UNION, MERGE_INTERSECTION, MERGE_DIFFERENCE };
+
+/**
+ * @brief Merges two sorted unique arrays into a newly allocated, retained result
+ */
+static size_t merge(TroveString **a, size_t na, TroveString **b, size_t nb, int op, TroveString ***out) {
+    TroveString **result = (TroveString **)malloc((na + nb) * sizeof(TroveString *));
+    size_t i = 0, j = 0, n = 0;
+    while (i < na && j < nb) {
+        int cmp = strcmp(a[i]->str, b[j]->str);
+        if (cmp < 0) {
+            if (op != MERGE_INTERSECTION) result[n++] = a[i];
+            i++;
+        } else if (cmp > 0) {
+            if (op == MERGE_UNION) result[n++] = b[j];
+            j++;
+        } else {
+            if (op != MERGE_DIFFERENCE) result[n++] = a[i];
+            i++;
+            j++;
+        }
+    }
+    if (op != MERGE_INTERSECTION) {
+        while (i < na) result[n++] = a[i++];
+    }
+    if (op == MERGE_UNION) {
+        while (j < nb) result[n++] = b[j++];
+    }
+    arc_retain_all((ARCObject *const *)result, n);
+    *out = result;
+    return n;
+}
+
+int main(int argc, char **argv) {
+    size_t n = bench_arg(argc, argv, 1, 1000000);
+    TroveString **keys_a = make_keys(0, n);
+    TroveString **keys_b = make_keys(n / 2, n);
+    static const char *ops[] = { "union", "intersection", "difference" };
+    size_t sink = 0;
+
+    double start = bench_now();
+    TroveSet *a = TroveSet_create_with_strings(keys_a, 2 * n);
+    TroveSet *b = TroveSet_create_with_strings(keys_b, 2 * n);
+    bench_report("set    build (dedup 2x2n)", bench_now() - start, 4.0 * (double)n, "keys");
+
+    for (int op = 0; op < 3; op++) {
+        char label[64];
+        start = bench_now();
+        TroveSet *result = op == 0 ? TroveSet_union(a, b) : op == 1 ? TroveSet_intersection(a, b) : TroveSet_difference(a, b);
+        double elapsed = bench_now() - start;
+        snprintf(label, sizeof(label), "set    %s", ops[op]);
+        bench_report(label, elapsed, 2.0 * (double)n, "keys");
+        sink += TroveSet_count(result);
+        arc_release((ARCObject *)result);
+    }
+
+    start = bench_now();
+    for (size_t i = 0; i < n; i++) {
+        sink += (size_t)TroveSet_contains(b, keys_a[i]);
+    }
+    bench_report("set    contains", bench_now() - start, (double)n, "ops");
+    arc_release((ARCObject *)a);
+    arc_release((ARCObject *)b);
+
+    TroveString **sorted_a = (TroveString **)malloc(2 * n * sizeof(TroveString *));
+    TroveString **sorted_b = (TroveString **)malloc(2 * n * sizeof(TroveString *));
+    memcpy(sorted_a, keys_a, 2 * n * sizeof(TroveString *));
+    memcpy(sorted_b, keys_b, 2 * n * sizeof(TroveString *));
+    start = bench_now();
+    size_t na = sort_unique(sorted_a, 2 * n);
+    size_t nb = sort_unique(sorted_b, 2 * n);
+    bench_report("sorted build (dedup 2x2n)", bench_now() - start, 4.0 * (double)n, "keys");
+
+    for (int op = 0; op < 3; op++) {
+        char label[64];
+        TroveString **result;
+        start = bench_now();
+        size_t count = merge(sorted_a, na, sorted_b, nb, op, &result);
+        double elapsed = bench_now() - start;
+        snprintf(label, sizeof(label), "sorted %s", ops[op]);
+        bench_report(label, elapsed, 2.0 * (double)n, "keys");
+        sink += count;
+        arc_release_all((ARCObject *const *)result, count);
+        free(result);
+    }
+    free(sorted_a);
+    free(sorted_b);
+
+    arc_release_all((ARCObject *const *)keys_a, n);
+    arc_release_all((ARCObject *const *)keys_b, n);
+    free(keys_a);
+    free(keys_b);
+    printf("checksum %zu\n", sink);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file slice.c
+ * @brief Benchmark: tokenizing a large buffer by copying vs. slicing
+ *
+ * Builds a buffer of space-separated words (100 MB by default, or the size in
+ * MB given as the first argument) and splits it into tokens, once creating a
+ * TroveString copy per token and once creating a TroveStringSlice per token.
+ */
+
+#include "bench.h"
+#include "slice.h"
+
+int main(int argc, char **argv) {
+    size_t size = bench_arg(argc, argv, 1, 100) * 1024 * 1024;
+    static const char *words[] = { "alpha", "be", "gamma", "delta-epsilon", "z", "trove" };
+
+    char *buf = (char *)malloc(size + 1);
+    size_t pos = 0;
+    for (size_t i = 0; pos < size; i++) {
+        const char *w = words[i % 6];
+        while (*w && pos < size) {
+            buf[pos++] = *w++;
+        }
+        if (pos < size) {
+            buf[pos++] = ' ';
+        }
+    }
+    buf[size] = '\0';
+    TroveString *input = TroveString_create_with_length(buf, size);
+    free(buf);
+
+    size_t tokens = 0;
+    size_t bytes = 0;
+    double start = bench_now();
+    for (size_t cursor = 0; cursor < input->length;) {
+        size_t from = cursor;
+        while (from < input->length && input->str[from] == ' ') {
+            from++;
+        }
+        size_t to = from;
+        while (to < input->length && input->str[to] != ' ') {
+            to++;
+        }
+        cursor = to;
+        if (to == from) {
+            break;
+        }
+        TroveString *copy = TroveString_create_with_length(input->str + from, to - from);
+        bytes += copy->length;
+        tokens++;
+        arc_release((ARCObject *)copy);
+    }
+    double copy_time = bench_now() - start;
+
+    size_t slice_tokens = 0;
+    size_t slice_bytes = 0;
+    start = bench_now();
+    size_t cursor = 0;
+    TroveStringSlice *token;
+    while ((token = TroveStringSlice_next_token(input, &cursor, " ")) != NULL) {
+        slice_bytes += token->length;
+        slice_tokens++;
+        arc_release((ARCObject *)token);
+    }
+    double slice_time = bench_now() - start;
+
+    if (tokens != slice_tokens || bytes != slice_bytes) {
+        fprintf(stderr, "token mismatch: %zu/%zu vs %zu/%zu\n", tokens, bytes, slice_tokens, slice_bytes);
+        return 1;
+    }
+
+    printf("tokenize %zu MB, %zu tokens\n", size / (1024 * 1024), tokens);
+    bench_report("copy (TroveString per token)", copy_time, (double)size / (1024 * 1024), "MB");
+    bench_report("slice (TroveStringSlice)", slice_time, (double)size / (1024 * 1024), "MB");
+
+    arc_release((ARCObject *)input);
+    return 0;
+}
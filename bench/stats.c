@@ -0,0 +1,79 @@
+/**
+ * @file stats.c
+ * @brief Benchmark: cost of per-type statistics on the ARC hot paths
+ *
+ * Each workload runs with statistics off and then on, in one process:
+ *
+ * - 20,000,000 (first argument) retain/release pairs on one string;
+ * - creating and releasing a string, a twentieth as many times;
+ * - building an array of a million strings and releasing it, which goes
+ *   through arc_release_all.
+ *
+ * The snapshot taken at the end is printed as JSON. Run any other benchmark
+ * with TROVE_STATS=1 in the environment to measure it with stats on.
+ */
+
+#include "bench.h"
+#include "stats.h"
+#include "array.h"
+
+static void retain_release(TroveString *str, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        arc_retain((ARCObject *)str);
+        arc_release((ARCObject *)str);
+    }
+}
+
+static void create_release(size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        arc_release((ARCObject *)TroveString_create_with_length("trove", 5));
+    }
+}
+
+static void build_array(size_t count) {
+    TroveArray *array = TroveArray_create(count);
+    for (size_t i = 0; i < count; i++) {
+        TroveString *str = TroveString_create_with_length("trove", 5);
+        TroveArray_append(array, (ARCObject *)str);
+        arc_release((ARCObject *)str);
+    }
+    arc_release((ARCObject *)array);
+}
+
+int main(int argc, char **argv) {
+    size_t count = bench_arg(argc, argv, 1, 20000000);
+    TroveString *str = TroveString_create("shared");
+    const char *labels[2] = { "stats off", "stats on" };
+
+    for (int on = 0; on < 2; on++) {
+        arc_stats_enable(on);
+        char name[64];
+
+        double start = bench_now();
+        retain_release(str, count);
+        double end = bench_now();
+        snprintf(name, sizeof(name), "retain/release, %s", labels[on]);
+        bench_report(name, end - start, (double)count, "pairs");
+        printf("  %.2f ns/pair\n", (end - start) * 1e9 / (double)count);
+
+        start = bench_now();
+        create_release(count / 20);
+        end = bench_now();
+        snprintf(name, sizeof(name), "create/release, %s", labels[on]);
+        bench_report(name, end - start, (double)(count / 20), "strings");
+
+        start = bench_now();
+        build_array(1000000);
+        end = bench_now();
+        snprintf(name, sizeof(name), "array of 1M, %s", labels[on]);
+        bench_report(name, end - start, 1e6, "strings");
+    }
+
+    arc_release((ARCObject *)str);
+    ArcStatsSnapshot snapshot;
+    arc_stats_snapshot(&snapshot);
+    TroveString *json = arc_stats_to_json(&snapshot);
+    fputs(json->str, stdout);
+    arc_release((ARCObject *)json);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file trace.c
+ * @brief Benchmark: cost per operation of retain/release tracing
+ *
+ * Each workload runs with tracing off, on, and on with a filter for an
+ * object that is never touched, in one process:
+ *
+ * - 20,000,000 (first argument) retain/release pairs on one string;
+ * - creating, autoreleasing and draining strings, a twentieth as many times.
+ *
+ * The last section collects the events and writes them to a file (second
+ * argument, default /tmp/trove-bench.trace), which tools/tracedump reads.
+ */
+
+#include "bench.h"
+#include "trace.h"
+#include <string.h>
+
+static void retain_release(TroveString *str, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        arc_retain((ARCObject *)str);
+        arc_release((ARCObject *)str);
+    }
+}
+
+static void create_autorelease(size_t count) {
+    for (size_t i = 0; i < count; i += 1000) {
+        autorelease_pool_push();
+        for (size_t j = i; j < count && j < i + 1000; j++) {
+            arc_autorelease((ARCObject *)TroveString_create_with_length("trove", 5));
+        }
+        autorelease_pool_pop();
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t count = bench_arg(argc, argv, 1, 20000000);
+    const char *path = argc > 2 ? argv[2] : "/tmp/trove-bench.trace";
+    TroveString *str = TroveString_create("shared");
+    TroveString *untouched = TroveString_create("untouched");
+    const char *labels[3] = { "trace off", "trace on", "trace filtered" };
+
+    for (int mode = 0; mode < 3; mode++) {
+        arc_trace_enable(mode > 0);
+        arc_trace_filter(mode == 2 ? (ARCObject *)untouched : NULL, NULL);
+        char name[64];
+
+        double start = bench_now();
+        retain_release(str, count);
+        double end = bench_now();
+        snprintf(name, sizeof(name), "retain/release, %s", labels[mode]);
+        bench_report(name, end - start, (double)count, "pairs");
+        printf("  %.2f ns/op\n", (end - start) * 1e9 / (double)(2 * count));
+
+        // Each string is created, autoreleased, released and freed: 4 events
+        start = bench_now();
+        create_autorelease(count / 20);
+        end = bench_now();
+        snprintf(name, sizeof(name), "create/autorelease, %s", labels[mode]);
+        bench_report(name, end - start, (double)(count / 20), "strings");
+        printf("  %.2f ns/string\n", (end - start) * 1e9 / (double)(count / 20));
+    }
+    arc_trace_enable(0);
+    arc_trace_filter(NULL, NULL);
+
+    double start = bench_now();
+    size_t events;
+    free(arc_trace_collect(&events));
+    double end = bench_now();
+    bench_report("collect", end - start, (double)events, "events");
+
+    start = bench_now();
+    int error = arc_trace_save(path);
+    end = bench_now();
+    if (error) {
+        fprintf(stderr, "%s: %s\n", path, strerror(error));
+        return 1;
+    }
+    bench_report("save", end - start, (double)events, "events");
+
+    arc_release((ARCObject *)untouched);
+    arc_release((ARCObject *)str);
+    return 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file transient.c
+ * @brief Benchmark: building 1M-element persistent collections in place vs. by pure updates
+ *
+ * A TroveVector and a TroveMap are filled with 1000000 elements (first
+ * argument) three ways: with the persistent functions, which copy the
+ * updated path and release the previous version on every step; with the
+ * _in_place functions on a uniquely owned collection; and with the
+ * _in_place functions while a snapshot is retained every 1024 updates, so
+ * shared nodes have to be copied once after each snapshot. A TroveArray
+ * and a TroveDictionary filled one element at a time give the cost of a
+ * mutable collection for reference.
+ */
+
+#include "bench.h"
+#include "vector.h"
+#include "map.h"
+#include "array.h"
+#include "dictionary.h"
+
+#define SNAPSHOT_INTERVAL 1024
+
+int main(int argc, char **argv) {
+    size_t n = bench_arg(argc, argv, 1, 1000000);
+    TroveString **keys = (TroveString **)malloc(n * sizeof(TroveString *));
+    TroveVector **vector_snapshots = (TroveVector **)malloc((n / SNAPSHOT_INTERVAL + 1) * sizeof(TroveVector *));
+    TroveMap **map_snapshots = (TroveMap **)malloc((n / SNAPSHOT_INTERVAL + 1) * sizeof(TroveMap *));
+    char buf[64];
+    for (size_t i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf), "key:%zu", i);
+        keys[i] = TroveString_create(buf);
+        TroveString_hash(keys[i]);
+    }
+
+    double start = bench_now();
+    TroveVector *vector = TroveVector_create();
+    for (size_t i = 0; i < n; i++) {
+        TroveVector *next = TroveVector_push(vector, (ARCObject *)keys[i]);
+        arc_release((ARCObject *)vector);
+        vector = next;
+    }
+    bench_report("vector push (persistent)", bench_now() - start, (double)n, "ops");
+    arc_release((ARCObject *)vector);
+
+    start = bench_now();
+    vector = TroveVector_create();
+    for (size_t i = 0; i < n; i++) {
+        TroveVector_push_in_place(&vector, (ARCObject *)keys[i]);
+    }
+    bench_report("vector push (in place)", bench_now() - start, (double)n, "ops");
+
+    start = bench_now();
+    for (size_t i = 0; i < n; i++) {
+        TroveVector_set_in_place(&vector, i, (ARCObject *)keys[n - 1 - i]);
+    }
+    bench_report("vector set (in place)", bench_now() - start, (double)n, "ops");
+    arc_release((ARCObject *)vector);
+
+    size_t snapshots = 0;
+    start = bench_now();
+    vector = TroveVector_create();
+    for (size_t i = 0; i < n; i++) {
+        if (i % SNAPSHOT_INTERVAL == 0) {
+            arc_retain((ARCObject *)vector);
+            vector_snapshots[snapshots++] = vector;
+        }
+        TroveVector_push_in_place(&vector, (ARCObject *)keys[i]);
+    }
+    bench_report("vector push (in place, snapshots)", bench_now() - start, (double)n, "ops");
+    arc_release((ARCObject *)vector);
+    arc_release_all((ARCObject *const *)vector_snapshots, snapshots);
+
+    start = bench_now();
+    TroveArray *array = TroveArray_create(0);
+    for (size_t i = 0; i < n; i++) {
+        TroveArray_append(array, (ARCObject *)keys[i]);
+    }
+    bench_report("array append (mutable)", bench_now() - start, (double)n, "ops");
+    arc_release((ARCObject *)array);
+
+    start = bench_now();
+    TroveMap *map = TroveMap_create();
+    for (size_t i = 0; i < n; i++) {
+        TroveMap *next = TroveMap_set(map, keys[i], (ARCObject *)keys[i]);
+        arc_release((ARCObject *)map);
+        map = next;
+    }
+    bench_report("map set (persistent)", bench_now() - start, (double)n, "ops");
+    arc_release((ARCObject *)map);
+
+    start = bench_now();
+    map = TroveMap_create();
+    for (size_t i = 0; i < n; i++) {
+        TroveMap_set_in_place(&map, keys[i], (ARCObject *)keys[i]);
+    }
+    bench_report("map set (in place)", bench_now() - start, (double)n, "ops");
+
+    start = bench_now();
+    for (size_t i = 0; i < n; i++) {
+        TroveMap_remove_in_place(&map, keys[i]);
+    }
+    bench_report("map remove (in place)", bench_now() - start, (double)n, "ops");
+    arc_release((ARCObject *)map);
+
+    snapshots = 0;
+    start = bench_now();
+    map = TroveMap_create();
+    for (size_t i = 0; i < n; i++) {
+        if (i % SNAPSHOT_INTERVAL == 0) {
+            arc_retain((ARCObject *)map);
+            map_snapshots[snapshots++] = map;
+        }
+        TroveMap_set_in_place(&map, keys[i], (ARCObject *)keys[i]);
+    }
+    bench_report("map set (in place, snapshots)", bench_now() - start, (double)n, "ops");
+    arc_release((ARCObject *)map);
+    arc_release_all((ARCObject *const *)map_snapshots, snapshots);
+
+    start = bench_now();
+    TroveDictionary *dict = TroveDictionary_create(0);
+    for (size_t i = 0; i < n; i++) {
+        TroveDictionary_set(dict, keys[i], (ARCObject *)keys[i]);
+    }
+    bench_report("dictionary set (mutable)", bench_now() - start, (double)n, "ops");
+    arc_release((ARCObject *)dict);
+
+    arc_release_all((ARCObject *const *)keys, n);
+    free(keys);
+    free(vector_snapshots);
+    free(map_snapshots);
+    return 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file writer.c
+ * @brief Benchmark: TroveWriter writev batches vs. per-string fwrite and write
+ *
+ * 1,000,000 strings (first argument) of 8 to 71 bytes, each followed by a
+ * newline, are written to a file in /tmp three ways. The minimum length is
+ * the second argument: strings this short are copied into the writer's
+ * batch buffers, while strings of TROVE_WRITER_COPY_MAX bytes or more are
+ * written from their own storage.
+ *
+ * - fwrite per string and newline through a 64 KB stdio buffer, which copies
+ *   every byte once; its system calls are counted from the buffer size;
+ * - write per string and newline, one system call each;
+ * - TroveWriter, whose batches go through a backend that counts writev
+ *   calls before delegating to TroveWriter_submit_writev.
+ *
+ * The output file sizes are compared to catch lost or duplicated writes.
+ */
+
+#include "bench.h"
+#include "writer.h"
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define BENCH_WRITER_PATH "/tmp/trove-bench-writer.txt"
+#define STDIO_BUFFER (64 * 1024)
+
+/** @brief Bench backend context: the descriptor plus a writev counter */
+typedef struct CountingBackend {
+    int fd;
+    size_t calls;
+} CountingBackend;
+
+static int counting_submit(void *context, TroveWriteBatch *batch) {
+    CountingBackend *backend = (CountingBackend *)context;
+    backend->calls += (batch->count + TROVE_WRITER_MAX_IOV - 1) / TROVE_WRITER_MAX_IOV;
+    return TroveWriter_submit_writev((void *)(intptr_t)backend->fd, batch);
+}
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+int main(int argc, char **argv) {
+    size_t count = bench_arg(argc, argv, 1, 1000000);
+    size_t min_length = bench_arg(argc, argv, 2, 8);
+    TroveString **strings = (TroveString **)malloc(count * sizeof(TroveString *));
+    char *text = (char *)malloc(min_length + 64);
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t length = min_length + (i * 2654435761u) % 64;
+        memset(text, 'a' + (int)(i % 26), length);
+        strings[i] = TroveString_create_with_length(text, length);
+        bytes += length + 1;
+    }
+
+    double start = bench_now();
+    FILE *file = fopen(BENCH_WRITER_PATH, "w");
+    setvbuf(file, NULL, _IOFBF, STDIO_BUFFER);
+    for (size_t i = 0; i < count; i++) {
+        fwrite(strings[i]->str, 1, strings[i]->length, file);
+        fputc('\n', file);
+    }
+    fclose(file);
+    double end = bench_now();
+    off_t expected = file_size(BENCH_WRITER_PATH);
+    bench_report("fwrite per string", end - start, (double)count, "strings");
+    printf("  %.1f MB/s, ~%.5f syscalls/string\n", (double)bytes / (1 << 20) / (end - start),
+           (double)((bytes + STDIO_BUFFER - 1) / STDIO_BUFFER) / (double)count);
+
+    start = bench_now();
+    int fd = open(BENCH_WRITER_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    for (size_t i = 0; i < count; i++) {
+        if (write(fd, strings[i]->str, strings[i]->length) < 0 || write(fd, "\n", 1) < 0) {
+            perror(BENCH_WRITER_PATH);
+            return 1;
+        }
+    }
+    close(fd);
+    end = bench_now();
+    bench_report("write per string", end - start, (double)count, "strings");
+    printf("  %.1f MB/s, 2 syscalls/string\n", (double)bytes / (1 << 20) / (end - start));
+    if (file_size(BENCH_WRITER_PATH) != expected) {
+        fprintf(stderr, "write output differs in size\n");
+        return 1;
+    }
+
+    start = bench_now();
+    CountingBackend backend = { open(BENCH_WRITER_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0600), 0 };
+    TroveWriter *writer = TroveWriter_create(counting_submit, &backend);
+    for (size_t i = 0; i < count; i++) {
+        TroveWriter_write_string(writer, strings[i]);
+        TroveWriter_write_static(writer, "\n", 1);
+    }
+    int error = TroveWriter_flush(writer);
+    arc_release((ARCObject *)writer);
+    close(backend.fd);
+    end = bench_now();
+    bench_report("TroveWriter writev", end - start, (double)count, "strings");
+    printf("  %.1f MB/s, %.5f syscalls/string\n", (double)bytes / (1 << 20) / (end - start),
+           (double)backend.calls / (double)count);
+    if (error || file_size(BENCH_WRITER_PATH) != expected) {
+        fprintf(stderr, "writer output differs in size (error %d)\n", error);
+        return 1;
+    }
+
+    unlink(BENCH_WRITER_PATH);
+    for (size_t i = 0; i < count; i++) {
+        arc_release((ARCObject *)strings[i]);
+    }
+    free(strings);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file pool_exporter.c
+ * @brief Example: serving autorelease pool histograms to Prometheus
+ *
+ * This program runs a toy workload of request-sized autorelease pools and
+ * serves arc_pool_stats_to_prometheus over HTTP, so a Prometheus server can
+ * scrape it:
+ *
+ *     ./build/examples/pool_exporter 9464 &
+ *     curl http://localhost:9464/metrics
+ *
+ * With "-" instead of a port it runs the workload once and prints the
+ * metrics to stdout.
+ */
+
+#include "macros.h"
+#include "poolstats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/**
+ * @brief Handles one simulated request inside its own autorelease pool
+ *
+ * Request sizes vary over three orders of magnitude, as they do in a
+ * server mixing small lookups and bulk responses.
+ *
+ * @param request Request number, used to vary its size
+ */
+static void handle_request(unsigned request) {
+    unsigned objects = 1u << (request * 2654435761u >> 28) % 12;
+    TROVE {
+        for (unsigned i = 0; i < objects; i++) {
+            (void)String("response fragment");
+        }
+    }
+}
+
+/**
+ * @brief Writes the current pool histograms to a file descriptor
+ *
+ * @param fd Destination
+ * @param http Nonzero to send an HTTP response header first
+ */
+static void write_metrics(int fd, int http) {
+    ArcPoolStatsSnapshot *snapshot = (ArcPoolStatsSnapshot *)malloc(sizeof(ArcPoolStatsSnapshot));
+    if (!snapshot) {
+        fprintf(stderr, "Failed to allocate snapshot.\n");
+        exit(1);
+    }
+    arc_pool_stats_snapshot(snapshot);
+    TroveString *text = arc_pool_stats_to_prometheus(snapshot);
+    if (http) {
+        char header[128];
+        int length = snprintf(header, sizeof(header),
+                              "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n",
+                              text->length);
+        if (write(fd, header, (size_t)length) < 0) {
+            perror("write");
+        }
+    }
+    if (write(fd, text->str, text->length) < 0) {
+        perror("write");
+    }
+    RELEASE(text);
+    free(snapshot);
+}
+
+/**
+ * @brief Opens a listening TCP socket on all interfaces
+ *
+ * @param port Port number
+ * @return The socket, or -1 after printing an error
+ */
+static int listen_on(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((unsigned short)port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 16) != 0) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Program entry point
+ *
+ * Enables the pool histograms, then alternates between batches of
+ * simulated requests and answering scrapes.
+ *
+ * @return Exit status code
+ */
+int main(int argc, char **argv) {
+    arc_pool_stats_enable(1);
+    unsigned request = 0;
+
+    if (argc > 1 && strcmp(argv[1], "-") == 0) {
+        for (; request < 10000; request++) {
+            handle_request(request);
+        }
+        write_metrics(STDOUT_FILENO, 0);
+        return 0;
+    }
+
+    int port = argc > 1 ? atoi(argv[1]) : 9464;
+    int server = listen_on(port);
+    if (server < 0) {
+        return 1;
+    }
+    printf("Serving pool metrics on http://localhost:%d/metrics\n", port);
+    fflush(stdout);
+    for (;;) {
+        for (unsigned i = 0; i < 1000; i++, request++) {
+            handle_request(request);
+        }
+        struct pollfd ready = { server, POLLIN, 0 };
+        if (poll(&ready, 1, 100) > 0) {
+            int client = accept(server, NULL, NULL);
+            if (client >= 0) {
+                char discard[1024];
+                if (read(client, discard, sizeof(discard)) >= 0) {
+                    write_metrics(client, 1);
+                }
+                close(client);
+            }
+        }
+    }
+}
@@ -0,0 +1,335 @@
+/**
+ * @file array.c
+ * @brief Implementation of TroveArray and TroveArraySlice
+ */
+
+#include "array.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Smallest non-zero capacity allocated by growth */
+#define ARRAY_MIN_CAPACITY 8
+
+/** @brief Removed elements that TroveArray_remove_range copies aside without allocating */
+#define ARRAY_REMOVE_LOCAL 64
+
+/**
+ * @brief Reallocates the element buffer to exactly capacity slots
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static void array_resize(TroveArray *array, size_t capacity) {
+    if (capacity == 0) {
+        free(array->items);
+        array->items = NULL;
+        array->capacity = 0;
+        return;
+    }
+    ARCObject **items = (ARCObject **)realloc(array->items, capacity * sizeof(ARCObject *));
+    if (!items) {
+        fprintf(stderr, "Failed to reallocate TroveArray storage.\n");
+        exit(1);
+    }
+    array->items = items;
+    array->capacity = capacity;
+}
+
+/**
+ * @brief Grows the buffer geometrically so that needed slots fit
+ */
+static void array_grow(TroveArray *array, size_t needed) {
+    if (needed <= array->capacity) {
+        return;
+    }
+    size_t capacity = array->capacity * 2;
+    if (capacity < ARRAY_MIN_CAPACITY) {
+        capacity = ARRAY_MIN_CAPACITY;
+    }
+    if (capacity < needed) {
+        capacity = needed;
+    }
+    array_resize(array, capacity);
+}
+
+/**
+ * @brief Creates an empty array
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param capacity Initial number of slots to allocate (can be 0)
+ * @return A new TroveArray with a reference count of 1
+ */
+TroveArray* TroveArray_create(size_t capacity) {
+    TroveArray *array = (TroveArray *)malloc(sizeof(TroveArray));
+    if (!array) {
+        fprintf(stderr, "Failed to allocate TroveArray.\n");
+        exit(1);
+    }
+    arc_object_init(&array->base, TroveArray_dealloc, sizeof(TroveArray));
+    array->items = NULL;
+    array->count = 0;
+    array->capacity = 0;
+    if (capacity > 0) {
+        array_resize(array, capacity);
+    }
+    return array;
+}
+
+/**
+ * @brief Ensures the array can hold at least capacity elements without growing
+ *
+ * @param array The array
+ * @param capacity Minimum number of slots
+ */
+void TroveArray_reserve(TroveArray *array, size_t capacity) {
+    if (capacity > array->capacity) {
+        array_resize(array, capacity);
+    }
+}
+
+/**
+ * @brief Releases unused slots so capacity equals count
+ *
+ * @param array The array
+ */
+void TroveArray_shrink(TroveArray *array) {
+    if (array->capacity > array->count) {
+        array_resize(array, array->count);
+    }
+}
+
+/**
+ * @brief Makes *array uniquely referenced so it can be mutated
+ *
+ * A shared array is copied with one batched retain of its elements, the
+ * caller's reference to the original is released and *array is pointed at
+ * the copy. A unique array is left as is.
+ *
+ * @param array Address of an owned reference; may be replaced with a copy
+ */
+void TroveArray_make_unique(TroveArray **array) {
+    TroveArray *original = *array;
+    if (original->base.ref_count == 1) {
+        return;
+    }
+    TroveArray *copy = TroveArray_create(original->count);
+    TroveArray_append_all(copy, original->items, original->count);
+    arc_release((ARCObject *)original);
+    *array = copy;
+}
+
+/**
+ * @brief Appends an object, retaining it
+ *
+ * @param array The array
+ * @param obj The object to append (may be NULL)
+ */
+void TroveArray_append(TroveArray *array, ARCObject *obj) {
+    if (array->count == array->capacity) {
+        array_grow(array, array->count + 1);
+    }
+    arc_retain(obj);
+    array->items[array->count++] = obj;
+}
+
+/**
+ * @brief Appends many objects, retaining them in one batch
+ *
+ * The buffer grows at most once and the pointers are copied with memcpy
+ * before their reference counts are adjusted. The objects may be items of the
+ * array itself: growing moves the buffer, so they are then read at the same
+ * index of the new one.
+ *
+ * @param array The array
+ * @param objects The objects to append
+ * @param count Number of entries in objects
+ */
+void TroveArray_append_all(TroveArray *array, ARCObject *const *objects, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    uintptr_t start = (uintptr_t)array->items;
+    uintptr_t at = (uintptr_t)objects;
+    int inside = array->items && at >= start && at < start + array->capacity * sizeof(ARCObject *);
+    size_t index = (size_t)(at - start) / sizeof(ARCObject *);
+    array_grow(array, array->count + count);
+    if (inside) {
+        objects = array->items + index;
+    }
+    memcpy(array->items + array->count, objects, count * sizeof(ARCObject *));
+    arc_retain_all(array->items + array->count, count);
+    array->count += count;
+}
+
+/**
+ * @brief Returns the element at an index without retaining it
+ *
+ * @param array The array
+ * @param index Element index
+ * @return The element, or NULL when index is out of range
+ */
+ARCObject* TroveArray_get(TroveArray *array, size_t index) {
+    if (index >= array->count) {
+        return NULL;
+    }
+    return array->items[index];
+}
+
+/**
+ * @brief Replaces the element at an index
+ *
+ * The new object is retained before the old one is released, so setting an
+ * element to itself is safe.
+ *
+ * @param array The array
+ * @param index Element index
+ * @param obj The new element (may be NULL)
+ */
+void TroveArray_set(TroveArray *array, size_t index, ARCObject *obj) {
+    if (index >= array->count) {
+        return;
+    }
+    ARCObject *old = array->items[index];
+    arc_retain(obj);
+    array->items[index] = obj;
+    arc_release(old);
+}
+
+/**
+ * @brief Removes a range of elements, releasing them in one batch
+ *
+ * The removed elements are copied aside and the array is closed up before
+ * any of them is released, so a dealloc that reaches the array sees only
+ * live elements.
+ *
+ * @param array The array
+ * @param offset Index of the first element to remove
+ * @param length Number of elements to remove
+ */
+void TroveArray_remove_range(TroveArray *array, size_t offset, size_t length) {
+    if (offset > array->count) {
+        offset = array->count;
+    }
+    if (length > array->count - offset) {
+        length = array->count - offset;
+    }
+    if (length == 0) {
+        return;
+    }
+    ARCObject *local[ARRAY_REMOVE_LOCAL];
+    ARCObject **removed = local;
+    if (length > ARRAY_REMOVE_LOCAL) {
+        removed = (ARCObject **)malloc(length * sizeof(ARCObject *));
+        if (!removed) {
+            fprintf(stderr, "Failed to allocate TroveArray removed elements.\n");
+            exit(1);
+        }
+    }
+    memcpy(removed, array->items + offset, length * sizeof(ARCObject *));
+    memmove(array->items + offset, array->items + offset + length,
+            (array->count - offset - length) * sizeof(ARCObject *));
+    array->count -= length;
+    arc_release_all(removed, length);
+    if (removed != local) {
+        free(removed);
+    }
+}
+
+/**
+ * @brief Removes every element
+ *
+ * @param array The array
+ */
+void TroveArray_remove_all(TroveArray *array) {
+    TroveArray_remove_range(array, 0, array->count);
+}
+
+/**
+ * @brief Deallocates a TroveArray
+ *
+ * Releases every element in one prefetching pass, then frees the storage
+ * and the array itself.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveArray_dealloc(ARCObject *obj) {
+    TroveArray *array = (TroveArray *)obj;
+    arc_release_all(array->items, array->count);
+    free(array->items);
+    arc_object_free(&array->base);
+}
+
+/**
+ * @brief TroveArraySlice Implementation
+ */
+
+/**
+ * @brief Creates a view of a range of an array
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param parent The array to view
+ * @param offset Index of the first element
+ * @param count Number of elements
+ * @return A new TroveArraySlice with a reference count of 1
+ */
+TroveArraySlice* TroveArraySlice_create(TroveArray *parent, size_t offset, size_t count) {
+    TroveArraySlice *slice = (TroveArraySlice *)malloc(sizeof(TroveArraySlice));
+    if (!slice) {
+        fprintf(stderr, "Failed to allocate TroveArraySlice.\n");
+        exit(1);
+    }
+    if (offset > parent->count) {
+        offset = parent->count;
+    }
+    if (count > parent->count - offset) {
+        count = parent->count - offset;
+    }
+    arc_object_init(&slice->base, TroveArraySlice_dealloc, sizeof(TroveArraySlice));
+    arc_retain((ARCObject *)parent);
+    slice->parent = parent;
+    slice->offset = offset;
+    slice->count = count;
+    return slice;
+}
+
+/**
+ * @brief Returns the element at an index of a view without retaining it
+ *
+ * @param slice The view
+ * @param index Index relative to the start of the view
+ * @return The element, or NULL when index is outside the view or the parent
+ */
+ARCObject* TroveArraySlice_get(TroveArraySlice *slice, size_t index) {
+    if (index >= slice->count) {
+        return NULL;
+    }
+    return TroveArray_get(slice->parent, slice->offset + index);
+}
+
+/**
+ * @brief Copies the elements of a view into a new array
+ *
+ * @param slice The view
+ * @return A new TroveArray with a reference count of 1
+ */
+TroveArray* TroveArraySlice_to_array(TroveArraySlice *slice) {
+    TroveArray *parent = slice->parent;
+    size_t offset = slice->offset < parent->count ? slice->offset : parent->count;
+    size_t count = slice->count < parent->count - offset ? slice->count : parent->count - offset;
+    TroveArray *array = TroveArray_create(count);
+    TroveArray_append_all(array, parent->items + offset, count);
+    return array;
+}
+
+/**
+ * @brief Deallocates a TroveArraySlice
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveArraySlice_dealloc(ARCObject *obj) {
+    TroveArraySlice *slice = (TroveArraySlice *)obj;
+    arc_release((ARCObject *)slice->parent);
+    arc_object_free(&slice->base);
+}
@@ -0,0 +1,194 @@
+/**
+ * @file array.h
+ * @brief Contiguous ARC collection for the Trove ARC memory management system
+ *
+ * A TroveArray stores retained ARCObject pointers in one contiguous buffer.
+ * Elements are retained when inserted and released when removed or when the
+ * array is deallocated. Bulk operations adjust reference counts with
+ * arc_retain_all and arc_release_all, which coalesce repeated objects and
+ * prefetch ahead of the release loop.
+ */
+
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "trove.h"
+
+/**
+ * @brief Array type managed by ARC
+ */
+typedef struct TroveArray {
+    ARCObject base;       /**< Inheritance: must be the first member */
+    ARCObject **items;    /**< Retained elements */
+    size_t count;         /**< Number of elements */
+    size_t capacity;      /**< Number of slots allocated in items */
+} TroveArray;
+
+/**
+ * @brief Read-only view of a range of an array, managed by ARC
+ *
+ * The view retains its parent and reads through the parent's storage, so it
+ * never copies or retains elements. Indexes are checked against the parent's
+ * current count on every access: modifying the parent never makes the view
+ * unsafe, but removals shift which elements the view sees.
+ */
+typedef struct TroveArraySlice {
+    ARCObject base;       /**< Inheritance: must be the first member */
+    TroveArray *parent;   /**< Retained array that owns the elements */
+    size_t offset;        /**< Index in parent of the first element */
+    size_t count;         /**< Number of elements in the view */
+} TroveArraySlice;
+
+/**
+ * @brief Creates an empty array
+ *
+ * @param capacity Initial number of slots to allocate (can be 0)
+ * @return A new TroveArray with a reference count of 1
+ */
+TroveArray* TroveArray_create(size_t capacity);
+
+/**
+ * @brief Ensures the array can hold at least capacity elements without growing
+ *
+ * @param array The array
+ * @param capacity Minimum number of slots
+ */
+void TroveArray_reserve(TroveArray *array, size_t capacity);
+
+/**
+ * @brief Releases unused slots so capacity equals count
+ *
+ * @param array The array
+ */
+void TroveArray_shrink(TroveArray *array);
+
+/**
+ * @brief Makes *array uniquely referenced so it can be mutated
+ *
+ * TroveArray mutators always edit in place, which other holders of the
+ * array observe. Calling this first gives copy-on-write semantics: a
+ * shared array is replaced by a copy (the caller's reference to the
+ * original is released), while a unique one is edited with no copying.
+ *
+ * @code
+ * TroveArray_make_unique(&items);
+ * TroveArray_append(items, obj);
+ * @endcode
+ *
+ * @param array Address of an owned reference; may be replaced with a copy
+ */
+void TroveArray_make_unique(TroveArray **array);
+
+/**
+ * @brief Appends an object, retaining it
+ *
+ * @param array The array
+ * @param obj The object to append (may be NULL)
+ */
+void TroveArray_append(TroveArray *array, ARCObject *obj);
+
+/**
+ * @brief Appends many objects, retaining them in one batch
+ *
+ * @param array The array
+ * @param objects The objects to append (may be items of the array itself)
+ * @param count Number of entries in objects
+ */
+void TroveArray_append_all(TroveArray *array, ARCObject *const *objects, size_t count);
+
+/**
+ * @brief Returns the element at an index without retaining it
+ *
+ * @param array The array
+ * @param index Element index
+ * @return The element, or NULL when index is out of range
+ */
+ARCObject* TroveArray_get(TroveArray *array, size_t index);
+
+/**
+ * @brief Replaces the element at an index
+ *
+ * The new object is retained and the old one released. Does nothing when
+ * index is out of range.
+ *
+ * @param array The array
+ * @param index Element index
+ * @param obj The new element (may be NULL)
+ */
+void TroveArray_set(TroveArray *array, size_t index, ARCObject *obj);
+
+/**
+ * @brief Removes a range of elements, releasing them in one batch
+ *
+ * The range is clamped to the bounds of the array. The elements are taken
+ * out of the array before they are released, so their dealloc functions may
+ * read or modify the array.
+ *
+ * @param array The array
+ * @param offset Index of the first element to remove
+ * @param length Number of elements to remove
+ */
+void TroveArray_remove_range(TroveArray *array, size_t offset, size_t length);
+
+/**
+ * @brief Removes every element
+ *
+ * @param array The array
+ */
+void TroveArray_remove_all(TroveArray *array);
+
+/**
+ * @brief Deallocates a TroveArray, releasing every element
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveArray_dealloc(ARCObject *obj);
+
+/**
+ * @brief Creates a view of a range of an array
+ *
+ * The range is clamped to the array's current bounds. The array is retained.
+ *
+ * @param parent The array to view
+ * @param offset Index of the first element
+ * @param count Number of elements
+ * @return A new TroveArraySlice with a reference count of 1
+ */
+TroveArraySlice* TroveArraySlice_create(TroveArray *parent, size_t offset, size_t count);
+
+/**
+ * @brief Returns the element at an index of a view without retaining it
+ *
+ * @param slice The view
+ * @param index Index relative to the start of the view
+ * @return The element, or NULL when index is outside the view or the parent
+ */
+ARCObject* TroveArraySlice_get(TroveArraySlice *slice, size_t index);
+
+/**
+ * @brief Copies the elements of a view into a new array
+ *
+ * @param slice The view
+ * @return A new TroveArray with a reference count of 1
+ */
+TroveArray* TroveArraySlice_to_array(TroveArraySlice *slice);
+
+/**
+ * @brief Deallocates a TroveArraySlice and releases its parent
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveArraySlice_dealloc(ARCObject *obj);
+
+/**
+ * @brief Convenience macro for creating autoreleased TroveArray objects
+ *
+ * @code
+ * TroveArray *array = Array(10);
+ * @endcode
+ */
+#define Array(capacity) ((TroveArray *)arc_autorelease((ARCObject *)TROVE_AT_SITE(TroveArray_create(capacity))))
+
+#endif // ARRAY_H
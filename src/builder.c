@@ -0,0 +1,256 @@
+/**
+ * @file builder.c
+ * @brief Implementation of the arena-backed string builder
+ *
+ * While a builder is writing into an arena chunk it marks the chunk as
+ * reserved, so no other builder in the same pool writes into the same tail.
+ * Finishing commits the written bytes to the chunk and wraps them in a
+ * TroveString that retains the chunk.
+ */
+
+#include "builder.h"
+#include "number.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Initial heap buffer size when no autorelease pool is in place */
+#define BUILDER_HEAP_INITIAL 64
+
+/**
+ * @brief Claims initial storage able to hold need bytes
+ *
+ * Uses the free tail of the current pool's arena chunk when a pool is in
+ * place, otherwise a heap buffer.
+ * If allocation fails, the program will exit with an error message.
+ */
+static void builder_claim(TroveStringBuilder *builder, size_t need) {
+    TroveArena *arena = autorelease_pool_arena(need);
+    if (arena) {
+        arena->reserved = 1;
+        TroveArena_retain(arena);
+        builder->arena = arena;
+        builder->buf = arena->bytes + arena->used;
+        builder->capacity = arena->capacity - arena->used;
+    } else {
+        size_t capacity = need > BUILDER_HEAP_INITIAL ? need : BUILDER_HEAP_INITIAL;
+        builder->buf = (char *)malloc(capacity);
+        if (!builder->buf) {
+            fprintf(stderr, "Failed to allocate string builder buffer.\n");
+            exit(1);
+        }
+        builder->arena = NULL;
+        builder->capacity = capacity;
+    }
+}
+
+/**
+ * @brief Moves the written bytes to storage able to hold need bytes
+ *
+ * Arena-backed builders move to a fresh chunk from the pool (the written
+ * prefix is copied once per doubling); heap-backed builders realloc.
+ * If allocation fails, the program will exit with an error message.
+ */
+static void builder_grow(TroveStringBuilder *builder, size_t need) {
+    size_t capacity = builder->capacity * 2 > need ? builder->capacity * 2 : need;
+    TroveArena *old = builder->arena;
+    if (old) {
+        old->reserved = 0;
+        TroveArena *arena = autorelease_pool_arena(capacity);
+        if (arena) {
+            arena->reserved = 1;
+            TroveArena_retain(arena);
+            memcpy(arena->bytes + arena->used, builder->buf, builder->length);
+            builder->arena = arena;
+            builder->buf = arena->bytes + arena->used;
+            builder->capacity = arena->capacity - arena->used;
+            TroveArena_release(old);
+            return;
+        }
+        // The pool was popped while the builder was in use: continue on the heap.
+        char *heap = (char *)malloc(capacity);
+        if (!heap) {
+            fprintf(stderr, "Failed to allocate string builder buffer.\n");
+            exit(1);
+        }
+        memcpy(heap, builder->buf, builder->length);
+        TroveArena_release(old);
+        builder->arena = NULL;
+        builder->buf = heap;
+        builder->capacity = capacity;
+        return;
+    }
+    char *grown = (char *)realloc(builder->buf, capacity);
+    if (!grown) {
+        fprintf(stderr, "Failed to reallocate string builder buffer.\n");
+        exit(1);
+    }
+    builder->buf = grown;
+    builder->capacity = capacity;
+}
+
+/**
+ * @brief Initializes an empty builder
+ *
+ * @param builder The builder to initialize
+ */
+void TroveStringBuilder_init(TroveStringBuilder *builder) {
+    builder->arena = NULL;
+    builder->buf = NULL;
+    builder->length = 0;
+    builder->capacity = 0;
+}
+
+/**
+ * @brief Ensures at least extra more bytes (plus a terminator) fit
+ *
+ * @param builder The builder
+ * @param extra Number of additional bytes
+ */
+void TroveStringBuilder_reserve(TroveStringBuilder *builder, size_t extra) {
+    size_t need = builder->length + extra + 1;
+    if (!builder->buf) {
+        builder_claim(builder, need);
+    } else if (need > builder->capacity) {
+        builder_grow(builder, need);
+    }
+}
+
+/**
+ * @brief Appends bytes
+ *
+ * @param builder The builder
+ * @param bytes The bytes to append (need not be null-terminated)
+ * @param length The number of bytes to append
+ */
+void TroveStringBuilder_append(TroveStringBuilder *builder, const char *bytes, size_t length) {
+    TroveStringBuilder_reserve(builder, length);
+    memcpy(builder->buf + builder->length, bytes, length);
+    builder->length += length;
+}
+
+/**
+ * @brief Appends a null-terminated C string
+ *
+ * @param builder The builder
+ * @param text The text to append
+ */
+void TroveStringBuilder_append_cstr(TroveStringBuilder *builder, const char *text) {
+    TroveStringBuilder_append(builder, text, strlen(text));
+}
+
+/**
+ * @brief Appends a single byte
+ *
+ * @param builder The builder
+ * @param c The byte to append
+ */
+void TroveStringBuilder_append_char(TroveStringBuilder *builder, char c) {
+    TroveStringBuilder_reserve(builder, 1);
+    builder->buf[builder->length++] = c;
+}
+
+/**
+ * @brief Appends the decimal representation of an unsigned integer
+ *
+ * @param builder The builder
+ * @param value The value to format
+ */
+void TroveStringBuilder_append_uint(TroveStringBuilder *builder, unsigned long long value) {
+    TroveStringBuilder_reserve(builder, TROVE_NUMBER_BUFFER_SIZE);
+    builder->length += trove_format_uint64((uint64_t)value, builder->buf + builder->length);
+}
+
+/**
+ * @brief Appends the decimal representation of a signed integer
+ *
+ * @param builder The builder
+ * @param value The value to format
+ */
+void TroveStringBuilder_append_int(TroveStringBuilder *builder, long long value) {
+    TroveStringBuilder_reserve(builder, TROVE_NUMBER_BUFFER_SIZE);
+    builder->length += trove_format_int64((int64_t)value, builder->buf + builder->length);
+}
+
+/**
+ * @brief Appends the shortest round-trip representation of a double
+ *
+ * @param builder The builder
+ * @param value The value to format
+ */
+void TroveStringBuilder_append_double(TroveStringBuilder *builder, double value) {
+    TroveStringBuilder_reserve(builder, TROVE_NUMBER_BUFFER_SIZE);
+    builder->length += trove_format_double(value, builder->buf + builder->length);
+}
+
+/**
+ * @brief Appends printf-style formatted text
+ *
+ * The first attempt formats straight into the free space; if the output was
+ * truncated, the buffer is grown to the exact size and formatting repeats.
+ *
+ * @param builder The builder
+ * @param format The printf format string
+ */
+void TroveStringBuilder_appendf(TroveStringBuilder *builder, const char *format, ...) {
+    va_list args;
+    va_list retry;
+    TroveStringBuilder_reserve(builder, 0);
+    va_start(args, format);
+    va_copy(retry, args);
+    size_t avail = builder->capacity - builder->length;
+    int written = vsnprintf(builder->buf + builder->length, avail, format, args);
+    if (written >= 0 && (size_t)written >= avail) {
+        TroveStringBuilder_reserve(builder, (size_t)written);
+        vsnprintf(builder->buf + builder->length, (size_t)written + 1, format, retry);
+    }
+    if (written > 0) {
+        builder->length += (size_t)written;
+    }
+    va_end(retry);
+    va_end(args);
+}
+
+/**
+ * @brief Finishes the builder into a string without copying
+ *
+ * Arena-backed output is committed to its chunk, which the string retains.
+ * Heap-backed output is adopted by the string together with its spare
+ * capacity, so later copy-on-write appends can use it.
+ *
+ * @param builder The builder
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveStringBuilder_finish(TroveStringBuilder *builder) {
+    TroveString *str;
+    TroveStringBuilder_reserve(builder, 0);
+    builder->buf[builder->length] = '\0';
+    if (builder->arena) {
+        TroveArena *arena = builder->arena;
+        arena->used += builder->length + 1;
+        arena->reserved = 0;
+        str = TroveString_create_with_storage(builder->buf, builder->length, (ARCObject *)arena);
+        TroveArena_release(arena);
+    } else {
+        str = TroveString_create_with_storage(builder->buf, builder->length, NULL);
+        str->capacity = builder->capacity - 1;
+    }
+    TroveStringBuilder_init(builder);
+    return str;
+}
+
+/**
+ * @brief Drops everything written and releases the builder's storage
+ *
+ * @param builder The builder
+ */
+void TroveStringBuilder_discard(TroveStringBuilder *builder) {
+    if (builder->arena) {
+        builder->arena->reserved = 0;
+        TroveArena_release(builder->arena);
+    } else {
+        free(builder->buf);
+    }
+    TroveStringBuilder_init(builder);
+}
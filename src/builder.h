@@ -0,0 +1,130 @@
+/**
+ * @file builder.h
+ * @brief String builder backed by the autorelease pool arena
+ *
+ * A TroveStringBuilder formats bytes, numbers and printf-style text directly
+ * into the unused tail of the current autorelease pool's arena chunk and
+ * finishes into a TroveString that points at those bytes, so output is
+ * written exactly once. The finished string retains the chunk and therefore
+ * stays valid after the pool is popped. Without a pool in place the builder
+ * falls back to a heap buffer that the finished string adopts.
+ */
+
+#ifndef BUILDER_H
+#define BUILDER_H
+
+#include "trove.h"
+
+/**
+ * @brief String builder state
+ *
+ * A plain value type, typically declared on the stack. Initialize with
+ * TroveStringBuilder_init; the builder claims storage on the first append and
+ * can be reused after TroveStringBuilder_finish.
+ */
+typedef struct TroveStringBuilder {
+    TroveArena *arena;  /**< Retained arena chunk being written, or NULL for heap storage */
+    char *buf;          /**< Start of the bytes written so far, or NULL before the first append */
+    size_t length;      /**< Number of bytes written */
+    size_t capacity;    /**< Bytes available at buf, including room for the terminator */
+} TroveStringBuilder;
+
+/**
+ * @brief Initializes an empty builder
+ *
+ * @param builder The builder to initialize
+ */
+void TroveStringBuilder_init(TroveStringBuilder *builder);
+
+/**
+ * @brief Ensures at least extra more bytes can be appended without growing
+ *
+ * @param builder The builder
+ * @param extra Number of additional bytes
+ */
+void TroveStringBuilder_reserve(TroveStringBuilder *builder, size_t extra);
+
+/**
+ * @brief Appends bytes
+ *
+ * @param builder The builder
+ * @param bytes The bytes to append (need not be null-terminated)
+ * @param length The number of bytes to append
+ */
+void TroveStringBuilder_append(TroveStringBuilder *builder, const char *bytes, size_t length);
+
+/**
+ * @brief Appends a null-terminated C string
+ *
+ * @param builder The builder
+ * @param text The text to append
+ */
+void TroveStringBuilder_append_cstr(TroveStringBuilder *builder, const char *text);
+
+/**
+ * @brief Appends a single byte
+ *
+ * @param builder The builder
+ * @param c The byte to append
+ */
+void TroveStringBuilder_append_char(TroveStringBuilder *builder, char c);
+
+/**
+ * @brief Appends the decimal representation of a signed integer
+ *
+ * @param builder The builder
+ * @param value The value to format
+ */
+void TroveStringBuilder_append_int(TroveStringBuilder *builder, long long value);
+
+/**
+ * @brief Appends the decimal representation of an unsigned integer
+ *
+ * @param builder The builder
+ * @param value The value to format
+ */
+void TroveStringBuilder_append_uint(TroveStringBuilder *builder, unsigned long long value);
+
+/**
+ * @brief Appends the shortest round-trip representation of a double
+ *
+ * Uses the same notation as TroveString_from_double (see number.h).
+ *
+ * @param builder The builder
+ * @param value The value to format
+ */
+void TroveStringBuilder_append_double(TroveStringBuilder *builder, double value);
+
+/**
+ * @brief Appends printf-style formatted text
+ *
+ * Formats directly into the builder's buffer, growing it once if the output
+ * does not fit.
+ *
+ * @param builder The builder
+ * @param format The printf format string
+ */
+void TroveStringBuilder_appendf(TroveStringBuilder *builder, const char *format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+/**
+ * @brief Finishes the builder into a string without copying
+ *
+ * The builder is reset and may be reused.
+ *
+ * @param builder The builder
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveStringBuilder_finish(TroveStringBuilder *builder);
+
+/**
+ * @brief Drops everything written and releases the builder's storage
+ *
+ * @param builder The builder
+ */
+void TroveStringBuilder_discard(TroveStringBuilder *builder);
+
+#endif // BUILDER_H
@@ -0,0 +1,208 @@
+/**
+ * @file data.c
+ * @brief Implementation of TroveData
+ */
+
+#include "data.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Allocates a data object with a reference count of 1
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static TroveData* data_alloc(TroveDataKind kind, const unsigned char *bytes, size_t length) {
+    TroveData *data = (TroveData *)malloc(sizeof(TroveData));
+    if (!data) {
+        fprintf(stderr, "Failed to allocate TroveData.\n");
+        exit(1);
+    }
+    arc_object_init(&data->base, TroveData_dealloc, sizeof(TroveData));
+    data->bytes = bytes;
+    data->length = length;
+    data->kind = kind;
+    data->storage = NULL;
+    data->deallocator = NULL;
+    data->context = NULL;
+    data->mapped_length = 0;
+    return data;
+}
+
+/**
+ * @brief Creates a data object holding a copy of some bytes
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param bytes The bytes to copy, or NULL for uninitialized content
+ * @param length Number of bytes
+ * @return A new TroveData with a reference count of 1
+ */
+TroveData* TroveData_create(const void *bytes, size_t length) {
+    unsigned char *copy = NULL;
+    if (length > 0) {
+        copy = (unsigned char *)malloc(length);
+        if (!copy) {
+            fprintf(stderr, "Failed to allocate data content.\n");
+            exit(1);
+        }
+        if (bytes) {
+            memcpy(copy, bytes, length);
+        }
+    }
+    return data_alloc(TROVE_DATA_HEAP, copy, length);
+}
+
+/**
+ * @brief Creates a data object over caller memory without copying it
+ *
+ * @param bytes The bytes to adopt
+ * @param length Number of bytes
+ * @param deallocator Release callback, or NULL
+ * @param context Passed to the callback
+ * @return A new TroveData with a reference count of 1
+ */
+TroveData* TroveData_create_no_copy(void *bytes, size_t length, TroveDataDeallocator deallocator, void *context) {
+    TroveData *data = data_alloc(TROVE_DATA_ADOPTED, (const unsigned char *)bytes, length);
+    data->deallocator = deallocator;
+    data->context = context;
+    return data;
+}
+
+/**
+ * @brief Maps a whole file read-only into memory
+ *
+ * The descriptor is closed as soon as the mapping exists. An empty file
+ * produces an empty data object with no mapping.
+ *
+ * @param path Path of the file
+ * @return A new TroveData with a reference count of 1, or NULL with errno
+ *         set on failure
+ */
+TroveData* TroveData_map_file(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    size_t length = (size_t)st.st_size;
+    if (length == 0) {
+        close(fd);
+        return data_alloc(TROVE_DATA_HEAP, NULL, 0);
+    }
+    void *base = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    int saved = errno;
+    close(fd);
+    if (base == MAP_FAILED) {
+        errno = saved;
+        return NULL;
+    }
+    TroveData *data = data_alloc(TROVE_DATA_MAPPED, (const unsigned char *)base, length);
+    data->context = base;
+    data->mapped_length = length;
+    return data;
+}
+
+/**
+ * @brief Creates a data object over a range of another without copying
+ *
+ * @param data The data to take bytes from
+ * @param offset Index of the first byte
+ * @param length Number of bytes
+ * @return A new TroveData with a reference count of 1
+ */
+TroveData* TroveData_subdata(TroveData *data, size_t offset, size_t length) {
+    if (offset > data->length) {
+        offset = data->length;
+    }
+    if (length > data->length - offset) {
+        length = data->length - offset;
+    }
+    TroveData *owner = data->kind == TROVE_DATA_RANGE ? data->storage : data;
+    TroveData *range = data_alloc(TROVE_DATA_RANGE, length ? data->bytes + offset : NULL, length);
+    arc_retain((ARCObject *)owner);
+    range->storage = owner;
+    return range;
+}
+
+/**
+ * @brief Returns the number of bytes
+ *
+ * @param data The data
+ * @return Number of bytes
+ */
+size_t TroveData_length(TroveData *data) {
+    return data->length;
+}
+
+/**
+ * @brief Tells the kernel how the bytes of a mapped data object will be accessed
+ *
+ * The advised range is widened to whole pages and limited to the mapping.
+ *
+ * @param data The data
+ * @param advice POSIX_MADV_SEQUENTIAL, POSIX_MADV_RANDOM, POSIX_MADV_WILLNEED, ...
+ * @return 0 on success, an error number otherwise
+ */
+int TroveData_advise(TroveData *data, int advice) {
+    TroveData *owner = data->kind == TROVE_DATA_RANGE ? data->storage : data;
+    if (owner->kind != TROVE_DATA_MAPPED || data->length == 0) {
+        return 0;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = (size_t)(data->bytes - (const unsigned char *)owner->context);
+    size_t aligned = start & ~(page - 1);
+    return posix_madvise((char *)owner->context + aligned, start - aligned + data->length, advice);
+}
+
+/**
+ * @brief Copies the bytes into a new TroveString
+ *
+ * @param data The data
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveData_to_string(TroveData *data) {
+    return TroveString_create_with_length((const char *)data->bytes, data->length);
+}
+
+/**
+ * @brief Deallocates a TroveData
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveData_dealloc(ARCObject *obj) {
+    TroveData *data = (TroveData *)obj;
+    switch (data->kind) {
+        case TROVE_DATA_HEAP:
+            free((void *)data->bytes);
+            break;
+        case TROVE_DATA_ADOPTED:
+            if (data->deallocator) {
+                data->deallocator((void *)data->bytes, data->length, data->context);
+            }
+            break;
+        case TROVE_DATA_MAPPED:
+            munmap(data->context, data->mapped_length);
+            break;
+        case TROVE_DATA_RANGE:
+            arc_release((ARCObject *)data->storage);
+            break;
+    }
+    arc_object_free(&data->base);
+}
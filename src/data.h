@@ -0,0 +1,144 @@
+/**
+ * @file data.h
+ * @brief Reference-counted byte buffers for the Trove ARC memory management system
+ *
+ * A TroveData is an immutable run of bytes with one of four kinds of
+ * backing storage:
+ *
+ * - heap memory owned by the data object,
+ * - caller memory adopted with a release callback (or borrowed with none),
+ * - a read-only mmap of a file, unmapped on dealloc,
+ * - a range of another TroveData, which is retained instead of copied.
+ *
+ * Sub-ranges always retain the object that owns the storage, never an
+ * intermediate range, so slicing a slice does not build chains of objects.
+ */
+
+#ifndef DATA_H
+#define DATA_H
+
+#include "trove.h"
+#include <sys/mman.h>
+
+/**
+ * @brief Callback that frees adopted bytes when a TroveData is deallocated
+ *
+ * @param bytes The adopted bytes
+ * @param length Number of bytes
+ * @param context The context pointer given at creation
+ */
+typedef void (*TroveDataDeallocator)(void *bytes, size_t length, void *context);
+
+/**
+ * @brief Kind of storage behind a TroveData
+ */
+typedef enum TroveDataKind {
+    TROVE_DATA_HEAP,        /**< bytes were allocated with malloc and are owned */
+    TROVE_DATA_ADOPTED,     /**< bytes are freed by the deallocator callback, if any */
+    TROVE_DATA_MAPPED,      /**< bytes lie in a private read-only file mapping */
+    TROVE_DATA_RANGE        /**< bytes belong to the retained storage object */
+} TroveDataKind;
+
+/**
+ * @brief Byte buffer managed by ARC
+ */
+typedef struct TroveData {
+    ARCObject base;                      /**< Inheritance: must be the first member */
+    const unsigned char *bytes;          /**< First byte (NULL only when length is 0) */
+    size_t length;                       /**< Number of bytes */
+    TroveDataKind kind;                  /**< How the bytes are owned */
+    struct TroveData *storage;           /**< Range only: retained data that owns the bytes */
+    TroveDataDeallocator deallocator;    /**< Adopted only: callback, or NULL to borrow */
+    void *context;                       /**< Adopted: callback context; mapped: mapping base */
+    size_t mapped_length;                /**< Mapped only: length of the mapping */
+} TroveData;
+
+/**
+ * @brief Creates a data object holding a copy of some bytes
+ *
+ * @param bytes The bytes to copy, or NULL for uninitialized content
+ * @param length Number of bytes
+ * @return A new TroveData with a reference count of 1
+ */
+TroveData* TroveData_create(const void *bytes, size_t length);
+
+/**
+ * @brief Creates a data object over caller memory without copying it
+ *
+ * The deallocator is called with bytes, length and context when the data is
+ * deallocated. Passing NULL borrows memory that outlives the object, such
+ * as static tables.
+ *
+ * @param bytes The bytes to adopt
+ * @param length Number of bytes
+ * @param deallocator Release callback, or NULL
+ * @param context Passed to the callback
+ * @return A new TroveData with a reference count of 1
+ */
+TroveData* TroveData_create_no_copy(void *bytes, size_t length, TroveDataDeallocator deallocator, void *context);
+
+/**
+ * @brief Maps a whole file read-only into memory
+ *
+ * Pages are loaded lazily by the kernel as they are touched, so opening a
+ * large file is cheap and memory pressure can drop clean pages at any time.
+ * The mapping is private: later writes to the file by other processes may or
+ * may not be visible, and truncating the file while it is mapped makes
+ * accesses past the new end fault.
+ *
+ * @param path Path of the file
+ * @return A new TroveData with a reference count of 1, or NULL with errno
+ *         set if the file cannot be opened, inspected or mapped
+ */
+TroveData* TroveData_map_file(const char *path);
+
+/**
+ * @brief Creates a data object over a range of another without copying
+ *
+ * The range is clamped to the bounds of data. The returned object retains
+ * the owner of data's storage.
+ *
+ * @param data The data to take bytes from
+ * @param offset Index of the first byte
+ * @param length Number of bytes
+ * @return A new TroveData with a reference count of 1
+ */
+TroveData* TroveData_subdata(TroveData *data, size_t offset, size_t length);
+
+/**
+ * @brief Returns the number of bytes
+ *
+ * @param data The data
+ * @return Number of bytes
+ */
+size_t TroveData_length(TroveData *data);
+
+/**
+ * @brief Tells the kernel how the bytes of a mapped data object will be accessed
+ *
+ * Has no effect on data that is not backed by a file mapping.
+ *
+ * @param data The data
+ * @param advice POSIX_MADV_SEQUENTIAL, POSIX_MADV_RANDOM, POSIX_MADV_WILLNEED, ...
+ * @return 0 on success, an error number otherwise
+ */
+int TroveData_advise(TroveData *data, int advice);
+
+/**
+ * @brief Copies the bytes into a new TroveString
+ *
+ * @param data The data
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveData_to_string(TroveData *data);
+
+/**
+ * @brief Deallocates a TroveData, releasing its storage
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveData_dealloc(ARCObject *obj);
+
+#endif // DATA_H
@@ -0,0 +1,178 @@
+/**
+ * @file dictionary.c
+ * @brief Implementation of TroveDictionary
+ */
+
+#include "dictionary.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * @brief Creates an empty dictionary
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param capacity Number of entries to hold without rehashing (can be 0)
+ * @return A new TroveDictionary with a reference count of 1
+ */
+TroveDictionary* TroveDictionary_create(size_t capacity) {
+    TroveDictionary *dict = (TroveDictionary *)malloc(sizeof(TroveDictionary));
+    if (!dict) {
+        fprintf(stderr, "Failed to allocate TroveDictionary.\n");
+        exit(1);
+    }
+    arc_object_init(&dict->base, TroveDictionary_dealloc, sizeof(TroveDictionary));
+    trove_table_init(&dict->table, capacity);
+    return dict;
+}
+
+/**
+ * @brief Returns the number of entries
+ *
+ * @param dict The dictionary
+ * @return Number of entries
+ */
+size_t TroveDictionary_count(TroveDictionary *dict) {
+    return dict->table.count;
+}
+
+/**
+ * @brief Makes *dict uniquely referenced so it can be mutated
+ *
+ * The copy duplicates the table's storage without rehashing.
+ *
+ * @param dict Address of an owned reference; may be replaced with a copy
+ */
+void TroveDictionary_make_unique(TroveDictionary **dict) {
+    TroveDictionary *original = *dict;
+    if (original->base.ref_count == 1) {
+        return;
+    }
+    TroveDictionary *copy = TroveDictionary_create(0);
+    trove_table_copy(&copy->table, &original->table);
+    arc_release((ARCObject *)original);
+    *dict = copy;
+}
+
+/**
+ * @brief Grows the dictionary so count entries fit without rehashing
+ *
+ * @param dict The dictionary
+ * @param count Number of entries
+ */
+void TroveDictionary_reserve(TroveDictionary *dict, size_t count) {
+    trove_table_reserve(&dict->table, count);
+}
+
+/**
+ * @brief Associates a value with a key
+ *
+ * @param dict The dictionary
+ * @param key The key
+ * @param value The value (may be NULL)
+ */
+void TroveDictionary_set(TroveDictionary *dict, TroveString *key, ARCObject *value) {
+    size_t slot = trove_table_find_key(&dict->table, key);
+    arc_retain(value);
+    if (slot != TROVE_TABLE_NOT_FOUND) {
+        ARCObject *old = dict->table.entries[slot].value;
+        dict->table.entries[slot].value = value;
+        arc_release(old);
+        return;
+    }
+    slot = trove_table_claim(&dict->table, key->hash);
+    arc_retain((ARCObject *)key);
+    dict->table.entries[slot].key = key;
+    dict->table.entries[slot].value = value;
+}
+
+/**
+ * @brief Returns the value for a key without retaining it
+ *
+ * @param dict The dictionary
+ * @param key The key
+ * @return The value, or NULL when the key is absent
+ */
+ARCObject* TroveDictionary_get(TroveDictionary *dict, TroveString *key) {
+    size_t slot = trove_table_find_key(&dict->table, key);
+    return slot == TROVE_TABLE_NOT_FOUND ? NULL : dict->table.entries[slot].value;
+}
+
+/**
+ * @brief Returns the value for a key given as bytes, without retaining it
+ *
+ * @param dict The dictionary
+ * @param bytes Key bytes
+ * @param length Number of key bytes
+ * @return The value, or NULL when the key is absent
+ */
+ARCObject* TroveDictionary_get_bytes(TroveDictionary *dict, const char *bytes, size_t length) {
+    size_t slot = trove_table_find(&dict->table, bytes, length, trove_hash_bytes(bytes, length));
+    return slot == TROVE_TABLE_NOT_FOUND ? NULL : dict->table.entries[slot].value;
+}
+
+/**
+ * @brief Checks whether a key is present
+ *
+ * @param dict The dictionary
+ * @param key The key
+ * @return 1 if present, 0 otherwise
+ */
+int TroveDictionary_contains(TroveDictionary *dict, TroveString *key) {
+    return trove_table_find_key(&dict->table, key) != TROVE_TABLE_NOT_FOUND;
+}
+
+/**
+ * @brief Removes a key and its value, releasing both
+ *
+ * @param dict The dictionary
+ * @param key The key
+ * @return 1 if the key was present, 0 otherwise
+ */
+int TroveDictionary_remove(TroveDictionary *dict, TroveString *key) {
+    size_t slot = trove_table_find_key(&dict->table, key);
+    if (slot == TROVE_TABLE_NOT_FOUND) {
+        return 0;
+    }
+    trove_table_erase(&dict->table, slot);
+    return 1;
+}
+
+/**
+ * @brief Removes every entry, keeping the allocated capacity
+ *
+ * @param dict The dictionary
+ */
+void TroveDictionary_remove_all(TroveDictionary *dict) {
+    trove_table_clear(&dict->table);
+}
+
+/**
+ * @brief Iterates over the entries in unspecified order
+ *
+ * @param dict The dictionary
+ * @param cursor In/out iteration position
+ * @param key Receives the key (not retained)
+ * @param value Receives the value (not retained)
+ * @return 1 if an entry was produced, 0 when iteration is done
+ */
+int TroveDictionary_next(TroveDictionary *dict, size_t *cursor, TroveString **key, ARCObject **value) {
+    size_t slot = trove_table_next(&dict->table, cursor);
+    if (slot == TROVE_TABLE_NOT_FOUND) {
+        return 0;
+    }
+    *key = dict->table.entries[slot].key;
+    *value = dict->table.entries[slot].value;
+    return 1;
+}
+
+/**
+ * @brief Deallocates a TroveDictionary
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveDictionary_dealloc(ARCObject *obj) {
+    TroveDictionary *dict = (TroveDictionary *)obj;
+    trove_table_destroy(&dict->table);
+    arc_object_free(&dict->base);
+}
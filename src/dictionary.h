@@ -0,0 +1,163 @@
+/**
+ * @file dictionary.h
+ * @brief Hash map keyed by TroveString for the Trove ARC memory management system
+ *
+ * A TroveDictionary maps TroveString keys to ARC objects using the
+ * Swiss-table layout in table.h. Keys and values are retained on insertion
+ * and released on removal or when the dictionary is deallocated. Keys use the
+ * hash cached in each TroveString, so a key is hashed once no matter how many
+ * dictionaries it is used with.
+ *
+ * Stored keys must not be mutated: the dictionary's reference makes them
+ * shared, so the copy-on-write API copies instead, but only for callers that
+ * own their reference.
+ */
+
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include "trove.h"
+#include "table.h"
+
+/**
+ * @brief Dictionary type managed by ARC
+ */
+typedef struct TroveDictionary {
+    ARCObject base;      /**< Inheritance: must be the first member */
+    TroveTable table;    /**< Key/value storage */
+} TroveDictionary;
+
+/**
+ * @brief Creates an empty dictionary
+ *
+ * @param capacity Number of entries to hold without rehashing (can be 0)
+ * @return A new TroveDictionary with a reference count of 1
+ */
+TroveDictionary* TroveDictionary_create(size_t capacity);
+
+/**
+ * @brief Returns the number of entries
+ *
+ * @param dict The dictionary
+ * @return Number of entries
+ */
+size_t TroveDictionary_count(TroveDictionary *dict);
+
+/**
+ * @brief Makes *dict uniquely referenced so it can be mutated
+ *
+ * Gives copy-on-write semantics to the in-place mutators: a shared dictionary
+ * is replaced by a copy (the caller's reference to the original is
+ * released), while a unique one is left as is.
+ *
+ * @param dict Address of an owned reference; may be replaced with a copy
+ */
+void TroveDictionary_make_unique(TroveDictionary **dict);
+
+/**
+ * @brief Grows the dictionary so count entries fit without rehashing
+ *
+ * @param dict The dictionary
+ * @param count Number of entries
+ */
+void TroveDictionary_reserve(TroveDictionary *dict, size_t count);
+
+/**
+ * @brief Associates a value with a key
+ *
+ * The value is retained. A new key is retained; when the key is already
+ * present the stored key object is kept and only the value is replaced (the
+ * old value is released).
+ *
+ * @param dict The dictionary
+ * @param key The key
+ * @param value The value (may be NULL)
+ */
+void TroveDictionary_set(TroveDictionary *dict, TroveString *key, ARCObject *value);
+
+/**
+ * @brief Returns the value for a key without retaining it
+ *
+ * @param dict The dictionary
+ * @param key The key
+ * @return The value, or NULL when the key is absent
+ */
+ARCObject* TroveDictionary_get(TroveDictionary *dict, TroveString *key);
+
+/**
+ * @brief Returns the value for a key given as bytes, without retaining it
+ *
+ * Useful for lookups with C strings or slices, which have no cached hash.
+ *
+ * @param dict The dictionary
+ * @param bytes Key bytes
+ * @param length Number of key bytes
+ * @return The value, or NULL when the key is absent
+ */
+ARCObject* TroveDictionary_get_bytes(TroveDictionary *dict, const char *bytes, size_t length);
+
+/**
+ * @brief Checks whether a key is present
+ *
+ * @param dict The dictionary
+ * @param key The key
+ * @return 1 if present, 0 otherwise
+ */
+int TroveDictionary_contains(TroveDictionary *dict, TroveString *key);
+
+/**
+ * @brief Removes a key and its value, releasing both
+ *
+ * @param dict The dictionary
+ * @param key The key
+ * @return 1 if the key was present, 0 otherwise
+ */
+int TroveDictionary_remove(TroveDictionary *dict, TroveString *key);
+
+/**
+ * @brief Removes every entry, keeping the allocated capacity
+ *
+ * @param dict The dictionary
+ */
+void TroveDictionary_remove_all(TroveDictionary *dict);
+
+/**
+ * @brief Iterates over the entries in unspecified order
+ *
+ * Start with *cursor set to 0. The dictionary must not gain entries during
+ * iteration; removing the entry just returned is allowed.
+ *
+ * @code
+ * size_t cursor = 0;
+ * TroveString *key;
+ * ARCObject *value;
+ * while (TroveDictionary_next(dict, &cursor, &key, &value)) { ... }
+ * @endcode
+ *
+ * @param dict The dictionary
+ * @param cursor In/out iteration position
+ * @param key Receives the key (not retained)
+ * @param value Receives the value (not retained)
+ * @return 1 if an entry was produced, 0 when iteration is done
+ */
+int TroveDictionary_next(TroveDictionary *dict, size_t *cursor, TroveString **key, ARCObject **value);
+
+/**
+ * @brief Deallocates a TroveDictionary, releasing every key and value
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveDictionary_dealloc(ARCObject *obj);
+
+/**
+ * @brief Convenience macro for creating autoreleased TroveDictionary objects
+ *
+ * @code
+ * TroveDictionary *headers = Dictionary(16);
+ * @endcode
+ */
+#define Dictionary(capacity) ((TroveDictionary *)arc_autorelease((ARCObject *)TROVE_AT_SITE(TroveDictionary_create(capacity))))
+
+#endif // DICTIONARY_H
@@ -0,0 +1,307 @@
+/**
+ * @file guard.c
+ * @brief Use-after-release detection for the Trove ARC memory management system
+ */
+
+#include "guard.h"
+#include "stats.h"
+#include "trace.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+/** @brief Initial number of quarantine entries, doubled as it fills */
+#define GUARD_INITIAL_ENTRIES 1024
+
+/**
+ * @brief A quarantined object and what is known of its release
+ */
+typedef struct GuardEntry {
+    ARCObject *obj;                         /**< The poisoned object */
+    void (*type)(ARCObject *);              /**< Its dealloc function */
+    uint32_t size;                          /**< Bytes poisoned */
+    int depth;                              /**< Frames used */
+    void *frames[TROVE_GUARD_MAX_FRAMES];   /**< Stack that released it, innermost first */
+} GuardEntry;
+
+int arc_guard_enabled = 0;
+
+/** @brief Ring of quarantined objects, oldest at guard_head */
+static GuardEntry *guard_entries = NULL;
+
+/** @brief Slots in guard_entries (a power of two) */
+static size_t guard_capacity = 0;
+
+/** @brief Slot of the oldest quarantined object */
+static size_t guard_head = 0;
+
+/** @brief Quarantined objects */
+static size_t guard_count = 0;
+
+/** @brief Bytes of the quarantined objects */
+static size_t guard_bytes = 0;
+
+/** @brief Bytes the quarantine may hold */
+static size_t guard_limit = TROVE_GUARD_DEFAULT_QUARANTINE;
+
+/** @brief Frames kept of release stacks */
+static int guard_frames = TROVE_GUARD_MAX_FRAMES;
+
+/** @brief Spin lock guarding the quarantine */
+static volatile char guard_lock = 0;
+
+/**
+ * @brief Acquires the quarantine lock
+ */
+static inline void guard_lock_acquire(void) {
+#if defined(__GNUC__)
+    while (__atomic_test_and_set(&guard_lock, __ATOMIC_ACQUIRE)) {
+    }
+#endif
+}
+
+/**
+ * @brief Releases the quarantine lock
+ */
+static inline void guard_lock_release(void) {
+#if defined(__GNUC__)
+    __atomic_clear(&guard_lock, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * @brief Starts or stops quarantining released objects
+ */
+void arc_guard_enable(int enabled) {
+    arc_guard_enabled = enabled != 0;
+    if (!enabled) {
+        arc_guard_flush();
+    }
+}
+
+/**
+ * @brief Sets how many bytes of released objects the quarantine holds
+ */
+void arc_guard_set_quarantine(size_t bytes) {
+    guard_lock_acquire();
+    guard_limit = bytes;
+    guard_lock_release();
+}
+
+/**
+ * @brief Sets how many frames of the stack that released an object are kept
+ */
+void arc_guard_set_frames(int frames) {
+    guard_frames = frames < 0 ? 0 : frames > TROVE_GUARD_MAX_FRAMES ? TROVE_GUARD_MAX_FRAMES : frames;
+}
+
+#if defined(__GNUC__)
+/**
+ * @brief Enables the guard at startup when TROVE_GUARD is set
+ */
+__attribute__((constructor)) static void guard_enable_from_environment(void) {
+    const char *size = getenv("TROVE_GUARD_QUARANTINE");
+    if (size && *size) {
+        arc_guard_set_quarantine((size_t)strtoull(size, NULL, 10));
+    }
+    const char *frames = getenv("TROVE_GUARD_FRAMES");
+    if (frames && *frames) {
+        arc_guard_set_frames(atoi(frames));
+    }
+    const char *value = getenv("TROVE_GUARD");
+    if (value && *value && strcmp(value, "0") != 0) {
+        atexit(arc_guard_flush);
+        arc_guard_enable(1);
+    }
+}
+#endif
+
+/**
+ * @brief Writes a stack trace, one frame per line
+ */
+static void guard_print_frames(void *const *frames, int depth) {
+#if defined(__GLIBC__)
+    fflush(stderr);
+    backtrace_symbols_fd(frames, depth, fileno(stderr));
+#else
+    for (int i = 0; i < depth; i++) {
+        fprintf(stderr, "    %p\n", frames[i]);
+    }
+#endif
+}
+
+/**
+ * @brief Writes the type and release stack of a quarantined object
+ */
+static void guard_print_entry(const GuardEntry *entry) {
+    const char *name = arc_stats_type_name(entry->type);
+    fprintf(stderr, "  object %p, %s, %u bytes\n", (void *)entry->obj, name ? name : "unknown type", entry->size);
+    if (entry->depth) {
+        fprintf(stderr, "  released by:\n");
+        guard_print_frames(entry->frames, entry->depth);
+    } else {
+        fprintf(stderr, "  released by: stack not recorded (TROVE_GUARD_FRAMES=0)\n");
+    }
+}
+
+/**
+ * @brief Writes the stack of the current call, from the given return address on
+ */
+static void guard_print_current(void *caller) {
+#if defined(__GLIBC__)
+    void *trace[TROVE_GUARD_MAX_FRAMES + 4];
+    int count = backtrace(trace, TROVE_GUARD_MAX_FRAMES + 4);
+    for (int i = 0; i < count; i++) {
+        if (trace[i] == caller) {
+            guard_print_frames(&trace[i], count - i);
+            return;
+        }
+    }
+    guard_print_frames(trace, count);
+#else
+    guard_print_frames(&caller, 1);
+#endif
+}
+
+/**
+ * @brief Checks that a quarantined object still holds its poison and frees it
+ *
+ * Aborts with a report if a byte was changed.
+ */
+static void guard_release(const GuardEntry *entry) {
+    const unsigned char *bytes = (const unsigned char *)entry->obj;
+    for (uint32_t i = 0; i < entry->size; i++) {
+        if (bytes[i] != TROVE_GUARD_POISON) {
+            fprintf(stderr, "trove guard: write to released object at offset %u (byte 0x%02x)\n", i, bytes[i]);
+            guard_print_entry(entry);
+            abort();
+        }
+    }
+    free(entry->obj);
+}
+
+/**
+ * @brief Moves the quarantine into a ring twice its size
+ *
+ * Called with the lock held. If allocation fails, the program will exit
+ * with an error message.
+ */
+static void guard_grow(void) {
+    size_t capacity = guard_capacity ? guard_capacity * 2 : GUARD_INITIAL_ENTRIES;
+    GuardEntry *entries = (GuardEntry *)malloc(capacity * sizeof(GuardEntry));
+    if (!entries) {
+        fprintf(stderr, "Failed to allocate guard quarantine.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < guard_count; i++) {
+        entries[i] = guard_entries[(guard_head + i) & (guard_capacity - 1)];
+    }
+    free(guard_entries);
+    guard_entries = entries;
+    guard_capacity = capacity;
+    guard_head = 0;
+}
+
+/**
+ * @brief Removes the oldest quarantined object if the quarantine is over its size
+ *
+ * Called with the lock held.
+ *
+ * @return 1 if an object was removed into entry, 0 otherwise
+ */
+static int guard_evict(GuardEntry *entry, size_t limit) {
+    if (!guard_count || guard_bytes <= limit) {
+        return 0;
+    }
+    *entry = guard_entries[guard_head];
+    guard_head = (guard_head + 1) & (guard_capacity - 1);
+    guard_count--;
+    guard_bytes -= entry->size;
+    return 1;
+}
+
+/**
+ * @brief Poisons a released object and quarantines it
+ */
+void arc_guard_quarantine(ARCObject *obj) {
+    GuardEntry entry;
+    entry.obj = obj;
+    entry.type = obj->dealloc;
+    entry.size = obj->size;
+    entry.depth = 0;
+#if defined(__GLIBC__)
+    if (guard_frames) {
+        void *trace[TROVE_GUARD_MAX_FRAMES + 1];
+        int count = backtrace(trace, guard_frames + 1);
+        // Frame 0 is this function
+        entry.depth = count > 1 ? count - 1 : 0;
+        memcpy(entry.frames, trace + 1, (size_t)entry.depth * sizeof(void *));
+    }
+#else
+    if (guard_frames) {
+        entry.frames[0] = TROVE_RETURN_ADDRESS();
+        entry.depth = 1;
+    }
+#endif
+    memset(obj, TROVE_GUARD_POISON, entry.size);
+
+    guard_lock_acquire();
+    if (guard_count == guard_capacity) {
+        guard_grow();
+    }
+    guard_entries[(guard_head + guard_count) & (guard_capacity - 1)] = entry;
+    guard_count++;
+    guard_bytes += entry.size;
+    // The newest object stays even when it alone exceeds the limit
+    while (guard_count > 1 && guard_evict(&entry, guard_limit)) {
+        guard_lock_release();
+        guard_release(&entry);
+        guard_lock_acquire();
+    }
+    guard_lock_release();
+}
+
+/**
+ * @brief Checks the poison of every quarantined object and frees them all
+ */
+void arc_guard_flush(void) {
+    GuardEntry entry;
+    guard_lock_acquire();
+    while (guard_evict(&entry, 0)) {
+        guard_lock_release();
+        guard_release(&entry);
+        guard_lock_acquire();
+    }
+    guard_lock_release();
+}
+
+/**
+ * @brief Reports an operation on a released object and aborts
+ */
+void arc_guard_dead(ARCObject *obj, const char *operation, void *caller) {
+    fprintf(stderr, "trove guard: %s of released object %p\n", operation, (void *)obj);
+    // The lock is left held: no other thread recycles the evidence while it is written
+    guard_lock_acquire();
+    int found = 0;
+    for (size_t i = guard_count; i-- > 0 && !found;) {
+        const GuardEntry *entry = &guard_entries[(guard_head + i) & (guard_capacity - 1)];
+        if (entry->obj == obj) {
+            guard_print_entry(entry);
+            found = 1;
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "  object %p is poisoned but no longer in the quarantine\n", (void *)obj);
+    }
+    fprintf(stderr, "  %s by:\n", operation);
+    guard_print_current(caller);
+    if (arc_trace_enabled) {
+        fprintf(stderr, "  traced history:\n");
+        arc_trace_print_history(stderr, obj);
+    }
+    abort();
+}
@@ -0,0 +1,105 @@
+/**
+ * @file guard.h
+ * @brief Use-after-release detection for the Trove ARC memory management system
+ *
+ * When enabled, arc_object_free does not return an object's memory to
+ * malloc. It fills the object, header included, with TROVE_GUARD_POISON
+ * and holds it in a quarantine, first in first out, until the quarantined
+ * objects exceed TROVE_GUARD_DEFAULT_QUARANTINE bytes. A poisoned header
+ * reads as a reference count of TROVE_GUARD_DEAD, so arc_retain,
+ * arc_release, arc_autorelease and their batch forms recognize a released
+ * object and abort, writing its type, the stack that freed it, the stack
+ * of the offending call and, while tracing, its recorded history. Calling
+ * a poisoned object's dealloc faults on the poisoned address. When an
+ * object leaves the quarantine its poison is checked, and a write after
+ * release aborts the same way, naming the first byte changed.
+ *
+ * Only the object's own block is quarantined; buffers it owns apart from
+ * it, such as a string's bytes, are freed as usual. An object is protected
+ * while it stays in the quarantine, so a larger quarantine catches later
+ * misuse at the price of memory. Release stacks come from backtrace() on
+ * glibc, which costs about a microsecond per object whatever the depth;
+ * for load tests arc_guard_set_frames(0) drops them, leaving a poisoning
+ * and a lock per object, and tracing still names each release's caller.
+ *
+ * Setting the environment variable TROVE_GUARD enables the guard at
+ * startup (with GCC and Clang) and checks the whole quarantine at exit;
+ * TROVE_GUARD_QUARANTINE sets its size in bytes and TROVE_GUARD_FRAMES
+ * the frames kept. The quarantine is shared by all threads behind a spin
+ * lock.
+ */
+
+#ifndef GUARD_H
+#define GUARD_H
+
+#include "trove.h"
+#include <stddef.h>
+
+/** @brief Byte that released objects are filled with */
+#define TROVE_GUARD_POISON 0xDD
+
+/** @brief Reference count read from a poisoned header, 0xDDDDDDDD */
+#define TROVE_GUARD_DEAD (-0x22222223)
+
+/** @brief Bytes of released objects quarantined unless set otherwise */
+#define TROVE_GUARD_DEFAULT_QUARANTINE (64 * 1024 * 1024)
+
+/** @brief Most frames kept of the stack that released an object */
+#define TROVE_GUARD_MAX_FRAMES 12
+
+/** @brief Nonzero while released objects are quarantined; set with arc_guard_enable */
+extern int arc_guard_enabled;
+
+/**
+ * @brief Starts or stops quarantining released objects
+ *
+ * Stopping checks and frees the whole quarantine, as arc_guard_flush does.
+ *
+ * @param enabled Nonzero to quarantine
+ */
+void arc_guard_enable(int enabled);
+
+/**
+ * @brief Sets how many bytes of released objects the quarantine holds
+ *
+ * @param bytes Quarantine size; 0 checks and frees each object as soon
+ *              as the next one is released
+ */
+void arc_guard_set_quarantine(size_t bytes);
+
+/**
+ * @brief Sets how many frames of the stack that released an object are kept
+ *
+ * @param frames Frames to keep, at most TROVE_GUARD_MAX_FRAMES (the
+ *               default); 0 takes no stack trace
+ */
+void arc_guard_set_frames(int frames);
+
+/**
+ * @brief Checks the poison of every quarantined object and frees them all
+ *
+ * Aborts with a report if any was written to after its release.
+ */
+void arc_guard_flush(void);
+
+/**
+ * @brief Poisons a released object and quarantines it; called by arc_object_free
+ *
+ * Objects leaving the quarantine to make room are checked and freed.
+ *
+ * @param obj The object, whose header is still intact
+ */
+void arc_guard_quarantine(ARCObject *obj);
+
+/**
+ * @brief Reports an operation on a released object and aborts
+ *
+ * Called by the ARC operations when they find a TROVE_GUARD_DEAD count.
+ *
+ * @param obj The released object
+ * @param operation Name of the operation, e.g. "retain"
+ * @param caller Return address of the operation's caller
+ */
+void arc_guard_dead(ARCObject *obj, const char *operation, void *caller);
+
+#endif // GUARD_H
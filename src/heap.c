@@ -0,0 +1,390 @@
+/**
+ * @file heap.c
+ * @brief Heap snapshots for the Trove ARC memory management system
+ */
+
+#include "heap.h"
+#include "leaks.h"
+#include "stats.h"
+#include "array.h"
+#include "data.h"
+#include "dictionary.h"
+#include "image.h"
+#include "map.h"
+#include "reader.h"
+#include "rope.h"
+#include "set.h"
+#include "slice.h"
+#include "vector.h"
+#include "writer.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Initial number of site table slots */
+#define HEAP_INITIAL_SITES 256
+
+/**
+ * @brief A child enumerator registered with arc_heap_register_type
+ */
+typedef struct HeapChildrenEntry {
+    void (*dealloc)(ARCObject *);    /**< Type */
+    TroveHeapChildren children;      /**< Its enumerator */
+} HeapChildrenEntry;
+
+/**
+ * @brief A visitor and its context, filtering out NULL and immortal children
+ */
+typedef struct HeapFilter {
+    TroveHeapVisitor visit;    /**< Called with each heap child */
+    void *context;             /**< Passed to visit */
+} HeapFilter;
+
+/**
+ * @brief An allocation site in a snapshot
+ */
+typedef struct HeapSite {
+    const char *file;    /**< Source file, NULL for a free slot */
+    int line;            /**< Source line */
+    uint32_t index;      /**< 1-based index in the file's site table */
+} HeapSite;
+
+/**
+ * @brief State of one arc_heap_snapshot call
+ */
+typedef struct HeapWriter {
+    FILE *file;                                  /**< Snapshot being written */
+    int error;                                   /**< First write error, or 0 */
+    uint64_t node_count;                         /**< Nodes written */
+    uint64_t edge_count;                         /**< Edges written */
+    uint64_t *edges;                             /**< Children of the current node */
+    size_t edge_capacity;                        /**< Entries allocated in edges */
+    size_t edges_used;                           /**< Entries used in edges */
+    ArcHeapType types[TROVE_STATS_MAX_TYPES];    /**< Types seen, in order */
+    uint32_t type_count;                         /**< Entries used in types */
+    void (*last_type)(ARCObject *);              /**< Type of the previous node, already in types */
+    HeapSite *sites;                             /**< Open-addressing table of sites, linear probing */
+    size_t site_capacity;                        /**< Slots in sites (a power of two) */
+    uint32_t site_count;                         /**< Sites in the table */
+} HeapWriter;
+
+/** @brief Enumerators registered with arc_heap_register_type */
+static HeapChildrenEntry registered_children[TROVE_STATS_MAX_TYPES];
+
+/** @brief Entries used in registered_children */
+static size_t registered_count = 0;
+
+/**
+ * @brief Registers the child enumerator of an object type
+ */
+void arc_heap_register_type(void (*dealloc)(ARCObject *), TroveHeapChildren children) {
+    for (size_t i = 0; i < registered_count; i++) {
+        if (registered_children[i].dealloc == dealloc) {
+            registered_children[i].children = children;
+            return;
+        }
+    }
+    if (registered_count < TROVE_STATS_MAX_TYPES) {
+        registered_children[registered_count].dealloc = dealloc;
+        registered_children[registered_count].children = children;
+        registered_count++;
+    }
+}
+
+/**
+ * @brief Passes a child on unless it is NULL or immortal
+ */
+static void heap_filter(ARCObject *child, void *context) {
+    HeapFilter *filter = (HeapFilter *)context;
+    if (child && child->ref_count != TROVE_REF_IMMORTAL) {
+        filter->visit(child, filter->context);
+    }
+}
+
+/**
+ * @brief Visits the keys and values of a swiss table
+ */
+static void heap_table_children(TroveTable *table, TroveHeapVisitor visit, void *context) {
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i].key) {
+            visit((ARCObject *)table->entries[i].key, context);
+            visit(table->entries[i].value, context);
+        }
+    }
+}
+
+/**
+ * @brief Visits the retained children of an object
+ */
+void arc_heap_children(ARCObject *obj, TroveHeapVisitor visit, void *context) {
+    HeapFilter filter = { visit, context };
+    void (*dealloc)(ARCObject *) = obj->dealloc;
+    size_t i;
+
+    for (i = 0; i < registered_count; i++) {
+        if (registered_children[i].dealloc == dealloc) {
+            registered_children[i].children(obj, heap_filter, &filter);
+            return;
+        }
+    }
+
+    if (dealloc == TroveString_dealloc) {
+        heap_filter(((TroveString *)obj)->storage, &filter);
+    } else if (dealloc == TroveStringSlice_dealloc) {
+        heap_filter((ARCObject *)((TroveStringSlice *)obj)->parent, &filter);
+    } else if (dealloc == TroveRope_dealloc) {
+        TroveRope *rope = (TroveRope *)obj;
+        if (rope->left) {
+            heap_filter((ARCObject *)rope->left, &filter);
+            heap_filter((ARCObject *)rope->right, &filter);
+        } else {
+            heap_filter(rope->owner, &filter);
+        }
+    } else if (dealloc == TroveArray_dealloc) {
+        TroveArray *array = (TroveArray *)obj;
+        for (i = 0; i < array->count; i++) {
+            heap_filter(array->items[i], &filter);
+        }
+    } else if (dealloc == TroveArraySlice_dealloc) {
+        heap_filter((ARCObject *)((TroveArraySlice *)obj)->parent, &filter);
+    } else if (dealloc == TroveDictionary_dealloc) {
+        heap_table_children(&((TroveDictionary *)obj)->table, heap_filter, &filter);
+    } else if (dealloc == TroveSet_dealloc) {
+        heap_table_children(&((TroveSet *)obj)->table, heap_filter, &filter);
+    } else if (dealloc == TroveVectorNode_dealloc) {
+        for (i = 0; i < TROVE_VECTOR_WIDTH; i++) {
+            heap_filter(((TroveVectorNode *)obj)->slots[i], &filter);
+        }
+    } else if (dealloc == TroveVector_dealloc) {
+        heap_filter((ARCObject *)((TroveVector *)obj)->root, &filter);
+        heap_filter((ARCObject *)((TroveVector *)obj)->tail, &filter);
+    } else if (dealloc == TroveMapNode_dealloc) {
+        // Nodes are allocated with exactly as many slots as they use
+        size_t slots = (obj->size - sizeof(TroveMapNode)) / sizeof(ARCObject *);
+        for (i = 0; i < slots; i++) {
+            heap_filter(((TroveMapNode *)obj)->slots[i], &filter);
+        }
+    } else if (dealloc == TroveMap_dealloc) {
+        heap_filter((ARCObject *)((TroveMap *)obj)->root, &filter);
+    } else if (dealloc == TroveData_dealloc) {
+        heap_filter((ARCObject *)((TroveData *)obj)->storage, &filter);
+    } else if (dealloc == TroveLineReader_dealloc) {
+        TroveLineReader *reader = (TroveLineReader *)obj;
+        heap_filter((ARCObject *)reader->chunk, &filter);
+        for (i = 0; i < reader->batch_count; i++) {
+            heap_filter(reader->batch[i], &filter);
+        }
+    } else if (dealloc == TroveWriteBatch_dealloc) {
+        TroveWriteBatch *batch = (TroveWriteBatch *)obj;
+        for (i = 0; i < batch->count; i++) {
+            heap_filter(batch->owners[i], &filter);
+        }
+    } else if (dealloc == TroveWriter_dealloc) {
+        heap_filter((ARCObject *)((TroveWriter *)obj)->batch, &filter);
+    } else if (dealloc == TroveImage_dealloc) {
+        heap_filter(((TroveImage *)obj)->root, &filter);
+    }
+}
+
+/**
+ * @brief Writes bytes to the snapshot, remembering the first error
+ */
+static void heap_write(HeapWriter *writer, const void *bytes, size_t size, size_t count) {
+    if (count && fwrite(bytes, size, count, writer->file) != count && !writer->error) {
+        writer->error = errno ? errno : EIO;
+    }
+}
+
+/**
+ * @brief Appends a child address to the current node's edges
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static void heap_add_edge(ARCObject *child, void *context) {
+    HeapWriter *writer = (HeapWriter *)context;
+    if (writer->edges_used == writer->edge_capacity) {
+        size_t capacity = writer->edge_capacity ? writer->edge_capacity * 2 : 64;
+        uint64_t *edges = (uint64_t *)realloc(writer->edges, capacity * sizeof(uint64_t));
+        if (!edges) {
+            fprintf(stderr, "Failed to allocate heap snapshot edges.\n");
+            exit(1);
+        }
+        writer->edges = edges;
+        writer->edge_capacity = capacity;
+    }
+    writer->edges[writer->edges_used++] = (uint64_t)(uintptr_t)child;
+}
+
+/**
+ * @brief Adds a type to the snapshot's type table
+ */
+static void heap_add_type(HeapWriter *writer, void (*dealloc)(ARCObject *)) {
+    if (dealloc == writer->last_type) {
+        return;
+    }
+    uint64_t type = (uint64_t)(uintptr_t)dealloc;
+    for (uint32_t i = 0; i < writer->type_count; i++) {
+        if (writer->types[i].type == type) {
+            writer->last_type = dealloc;
+            return;
+        }
+    }
+    if (writer->type_count == TROVE_STATS_MAX_TYPES) {
+        return;
+    }
+    ArcHeapType *entry = &writer->types[writer->type_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->type = type;
+    const char *name = arc_stats_type_name(dealloc);
+    if (name) {
+        strncpy(entry->name, name, TROVE_HEAP_NAME_SIZE - 1);
+    }
+    writer->last_type = dealloc;
+}
+
+/**
+ * @brief Returns the 1-based index of a site, adding it if new
+ *
+ * Sites are keyed by the address of their file name, which is a string
+ * literal, and line. If allocation fails, the program will exit with an
+ * error message.
+ */
+static uint32_t heap_site_index(HeapWriter *writer, const char *file, int line) {
+    if (!file) {
+        return 0;
+    }
+    if ((writer->site_count + 1) * 2 > writer->site_capacity) {
+        size_t capacity = writer->site_capacity ? writer->site_capacity * 2 : HEAP_INITIAL_SITES;
+        HeapSite *sites = (HeapSite *)calloc(capacity, sizeof(HeapSite));
+        if (!sites) {
+            fprintf(stderr, "Failed to allocate heap snapshot sites.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < writer->site_capacity; i++) {
+            HeapSite *site = &writer->sites[i];
+            if (site->file) {
+                size_t slot = ((uintptr_t)site->file * 31 + (size_t)site->line) & (capacity - 1);
+                while (sites[slot].file) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                sites[slot] = *site;
+            }
+        }
+        free(writer->sites);
+        writer->sites = sites;
+        writer->site_capacity = capacity;
+    }
+    size_t slot = ((uintptr_t)file * 31 + (size_t)line) & (writer->site_capacity - 1);
+    while (writer->sites[slot].file) {
+        if (writer->sites[slot].file == file && writer->sites[slot].line == line) {
+            return writer->sites[slot].index;
+        }
+        slot = (slot + 1) & (writer->site_capacity - 1);
+    }
+    writer->sites[slot].file = file;
+    writer->sites[slot].line = line;
+    writer->sites[slot].index = ++writer->site_count;
+    return writer->site_count;
+}
+
+/**
+ * @brief Writes one tracked object and its edges
+ */
+static void heap_write_node(ARCObject *obj, const char *file, int line, void *context) {
+    HeapWriter *writer = (HeapWriter *)context;
+    writer->edges_used = 0;
+    arc_heap_children(obj, heap_add_edge, writer);
+    heap_add_type(writer, obj->dealloc);
+
+    ArcHeapNode node;
+    node.address = (uint64_t)(uintptr_t)obj;
+    node.type = (uint64_t)(uintptr_t)obj->dealloc;
+    node.size = obj->size;
+    node.ref_count = obj->ref_count;
+    node.site = heap_site_index(writer, file, line);
+    node.edge_count = (uint32_t)writer->edges_used;
+    heap_write(writer, &node, sizeof(node), 1);
+    heap_write(writer, writer->edges, sizeof(uint64_t), writer->edges_used);
+    writer->node_count++;
+    writer->edge_count += writer->edges_used;
+}
+
+/**
+ * @brief Writes the site table in index order
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static void heap_write_sites(HeapWriter *writer) {
+    const HeapSite **ordered = (const HeapSite **)calloc(writer->site_count + 1, sizeof(HeapSite *));
+    if (!ordered) {
+        fprintf(stderr, "Failed to allocate heap snapshot sites.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < writer->site_capacity; i++) {
+        if (writer->sites[i].file) {
+            ordered[writer->sites[i].index] = &writer->sites[i];
+        }
+    }
+    for (uint32_t i = 1; i <= writer->site_count; i++) {
+        uint32_t record[2];
+        record[0] = (uint32_t)ordered[i]->line;
+        record[1] = (uint32_t)strlen(ordered[i]->file);
+        heap_write(writer, record, sizeof(uint32_t), 2);
+        heap_write(writer, ordered[i]->file, 1, record[1]);
+    }
+    free(ordered);
+}
+
+/**
+ * @brief Writes every tracked live object to a snapshot file
+ *
+ * The header is written twice: as a placeholder, then with the counts and
+ * offsets once they are known.
+ */
+int arc_heap_snapshot(const char *path) {
+    if (!arc_leaks_enabled) {
+        return ENOTSUP;
+    }
+    HeapWriter *writer = (HeapWriter *)calloc(1, sizeof(HeapWriter));
+    if (!writer) {
+        fprintf(stderr, "Failed to allocate heap snapshot writer.\n");
+        exit(1);
+    }
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        int error = errno;
+        free(writer);
+        return error;
+    }
+
+    ArcHeapFileHeader header;
+    memset(&header, 0, sizeof(header));
+    errno = 0;
+    heap_write(writer, &header, sizeof(header), 1);
+    arc_leaks_each(heap_write_node, writer);
+
+    header.types_offset = (uint64_t)ftello(writer->file);
+    heap_write(writer, writer->types, sizeof(ArcHeapType), writer->type_count);
+    header.sites_offset = (uint64_t)ftello(writer->file);
+    heap_write_sites(writer);
+
+    memcpy(header.magic, TROVE_HEAP_MAGIC, sizeof(header.magic));
+    header.node_count = writer->node_count;
+    header.edge_count = writer->edge_count;
+    header.type_count = writer->type_count;
+    header.site_count = writer->site_count;
+    if (fseeko(writer->file, 0, SEEK_SET) != 0 && !writer->error) {
+        writer->error = errno;
+    }
+    heap_write(writer, &header, sizeof(header), 1);
+    if (fclose(writer->file) != 0 && !writer->error) {
+        writer->error = errno ? errno : EIO;
+    }
+
+    int error = writer->error;
+    free(writer->edges);
+    free(writer->sites);
+    free(writer);
+    return error;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file heap.h
+ * @brief Heap snapshots for the Trove ARC memory management system
+ *
+ * arc_heap_snapshot writes every live object tracked by leaks.h, with its
+ * type, size, reference count, allocation site and the objects it holds
+ * references to, so tools/heapanalyze can rebuild the object graph offline
+ * and answer what keeps memory alive: it computes the dominator tree, the
+ * bytes each object retains, and the cycles nothing outside holds.
+ *
+ * Edges come from a per-type function that visits an object's retained
+ * children. The built-in types are known; other types register theirs with
+ * arc_heap_register_type, and are otherwise written without edges.
+ *
+ * The snapshot streams straight from the leak registry to the file, so it
+ * needs no memory beyond the stdio buffer and the child list of the largest
+ * object, however large the heap is. The registry stays locked while it
+ * runs, which stops other threads creating or freeing objects; they must
+ * not modify objects meanwhile either.
+ */
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "trove.h"
+#include <stdint.h>
+
+/** @brief Magic bytes at the start of a heap snapshot file */
+#define TROVE_HEAP_MAGIC "TRVHEAP1"
+
+/** @brief Bytes of a type name in a snapshot file, including the terminator */
+#define TROVE_HEAP_NAME_SIZE 32
+
+/**
+ * @brief Called with each child of an object
+ */
+typedef void (*TroveHeapVisitor)(ARCObject *child, void *context);
+
+/**
+ * @brief Visits the retained children of an object
+ *
+ * Must call visit once per reference the object holds (so an object
+ * holding the same child twice visits it twice), and may pass NULL.
+ */
+typedef void (*TroveHeapChildren)(ARCObject *obj, TroveHeapVisitor visit, void *context);
+
+/**
+ * @brief Header of a heap snapshot file
+ *
+ * Followed by node_count nodes, each an ArcHeapNode and then edge_count
+ * child addresses (uint64_t). The type and site tables come after the
+ * nodes, at the offsets given here. Everything is in the byte order of the
+ * snapshotted machine.
+ */
+typedef struct ArcHeapFileHeader {
+    char magic[8];              /**< TROVE_HEAP_MAGIC */
+    uint64_t node_count;        /**< Objects */
+    uint64_t edge_count;        /**< References between them, in total */
+    uint64_t types_offset;      /**< File offset of type_count ArcHeapType records */
+    uint64_t sites_offset;      /**< File offset of site_count site records */
+    uint32_t type_count;        /**< Type records */
+    uint32_t site_count;        /**< Site records */
+} ArcHeapFileHeader;
+
+/**
+ * @brief One object in a snapshot file
+ */
+typedef struct ArcHeapNode {
+    uint64_t address;       /**< Object address */
+    uint64_t type;          /**< Address of the object's dealloc function */
+    uint32_t size;          /**< Bytes allocated for the object */
+    int32_t ref_count;      /**< Reference count */
+    uint32_t site;          /**< 1-based index of the allocation site, 0 if unknown */
+    uint32_t edge_count;    /**< Child addresses that follow */
+} ArcHeapNode;
+
+/**
+ * @brief Name of a type in a snapshot file
+ */
+typedef struct ArcHeapType {
+    uint64_t type;                        /**< Address of the dealloc function */
+    char name[TROVE_HEAP_NAME_SIZE];      /**< Type name, empty if unknown */
+} ArcHeapType;
+
+/*
+ * Each site record is a uint32_t line, a uint32_t length and then length
+ * bytes of file name, without a terminator.
+ */
+
+/**
+ * @brief Registers the child enumerator of an object type
+ *
+ * Later registrations for the same type replace earlier ones.
+ *
+ * @param dealloc The type's dealloc function
+ * @param children Function visiting the type's retained children
+ */
+void arc_heap_register_type(void (*dealloc)(ARCObject *), TroveHeapChildren children);
+
+/**
+ * @brief Visits the retained children of an object
+ *
+ * Immortal children are skipped: they live in mapped images, not the heap.
+ *
+ * @param obj The object
+ * @param visit Called with each child
+ * @param context Passed to visit
+ */
+void arc_heap_children(ARCObject *obj, TroveHeapVisitor visit, void *context);
+
+/**
+ * @brief Writes every tracked live object to a snapshot file
+ *
+ * Objects are tracked while arc_leaks_enable is on (or TROVE_LEAKS is set);
+ * objects created before that are left out, and appear only as the
+ * targets of edges.
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param path File to create
+ * @return 0 on success, ENOTSUP if leak tracking is off,
+ *         otherwise errno
+ */
+int arc_heap_snapshot(const char *path);
+
+#endif // HEAP_H
@@ -0,0 +1,617 @@
+/**
+ * @file image.c
+ * @brief Memory-mapped images of immutable object graphs for the Trove ARC memory management system
+ */
+
+#define _DEFAULT_SOURCE    // MAP_ANONYMOUS
+#include "image.h"
+#include "array.h"
+#include "dictionary.h"
+#include "set.h"
+#include "vector.h"
+#include "map.h"
+#include "data.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** @brief Alignment of every object placed in the object section */
+#define IMAGE_ALIGN 16
+
+/** @brief Alignment of the byte section; covers 4 KB, 16 KB and 64 KB pages */
+#define IMAGE_SECTION_ALIGN (64 * 1024)
+
+/** @brief Placeholder tag of a pointer into the object section while writing */
+#define IMAGE_OBJECT_REF (1ull << 62)
+
+/** @brief Placeholder tag of a pointer into the byte section while writing */
+#define IMAGE_BYTES_REF (1ull << 61)
+
+/** @brief Prefault the object section's anonymous pages in one call where supported */
+#ifdef MAP_POPULATE
+#define IMAGE_MAP_POPULATE MAP_POPULATE
+#else
+#define IMAGE_MAP_POPULATE 0
+#endif
+
+/** @brief Deepest nesting of objects accepted by the writer */
+#define IMAGE_MAX_DEPTH 4096
+
+/**
+ * @brief Type indexes stored in place of dealloc functions; part of the file format
+ */
+enum {
+    IMAGE_STRING = 1,
+    IMAGE_ARRAY,
+    IMAGE_DICTIONARY,
+    IMAGE_SET,
+    IMAGE_VECTOR,
+    IMAGE_VECTOR_NODE,
+    IMAGE_MAP,
+    IMAGE_MAP_NODE,
+    IMAGE_DATA
+};
+
+/**
+ * @brief Dealloc functions by the type index stored in place of them
+ *
+ * Index 0 is unused so that a stored index is never mistaken for NULL.
+ */
+static void (*const image_types[])(ARCObject *) = {
+    NULL,
+    TroveString_dealloc,
+    TroveArray_dealloc,
+    TroveDictionary_dealloc,
+    TroveSet_dealloc,
+    TroveVector_dealloc,
+    TroveVectorNode_dealloc,
+    TroveMap_dealloc,
+    TroveMapNode_dealloc,
+    TroveData_dealloc
+};
+
+/** @brief Number of entries in image_types */
+#define IMAGE_TYPE_COUNT (sizeof(image_types) / sizeof(image_types[0]))
+
+/**
+ * @brief Growable section being laid out
+ */
+typedef struct ImageSection {
+    unsigned char *bytes;    /**< Section contents */
+    size_t length;           /**< Bytes used */
+    size_t capacity;         /**< Bytes allocated */
+} ImageSection;
+
+/**
+ * @brief State of one trove_image_write call
+ */
+typedef struct ImageWriter {
+    ImageSection objects;    /**< Object section; pointer words hold placeholders */
+    ImageSection bytes;      /**< Byte section */
+    uint64_t *bitmap;        /**< One bit per object-section word that holds a pointer */
+    size_t bitmap_words;     /**< Words allocated in bitmap */
+    ARCObject **seen;        /**< Open-addressing table of shared objects, NULL slots empty */
+    uint64_t *placed;        /**< Placeholder of each object in seen */
+    size_t seen_capacity;    /**< Slots in seen (a power of two) */
+    size_t seen_count;       /**< Occupied slots in seen */
+    int depth;               /**< Current nesting depth */
+    int error;               /**< First error, or 0 */
+} ImageWriter;
+
+static uint64_t image_place(ImageWriter *writer, ARCObject *obj);
+
+/**
+ * @brief Rounds a size up to a multiple of a power of two
+ */
+static inline uint64_t image_round(uint64_t size, uint64_t align) {
+    return (size + align - 1) & ~(align - 1);
+}
+
+/**
+ * @brief Reserves zero-filled space in a section
+ *
+ * @return Offset of the space in the section
+ */
+static size_t section_alloc(ImageSection *section, size_t size, size_t align) {
+    size_t offset = (size_t)image_round(section->length, align);
+    if (offset + size > section->capacity) {
+        size_t capacity = section->capacity ? section->capacity : IMAGE_SECTION_ALIGN;
+        while (offset + size > capacity) {
+            capacity *= 2;
+        }
+        section->bytes = (unsigned char *)realloc(section->bytes, capacity);
+        if (!section->bytes) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        memset(section->bytes + section->capacity, 0, capacity - section->capacity);
+        section->capacity = capacity;
+    }
+    section->length = offset + size;
+    return offset;
+}
+
+/**
+ * @brief Stores a pointer placeholder or type index and marks its word in the bitmap
+ */
+static void image_pointer(ImageWriter *writer, size_t offset, uint64_t value) {
+    size_t word = offset / 8;
+    if (word / 64 >= writer->bitmap_words) {
+        size_t words = writer->bitmap_words ? writer->bitmap_words : 64;
+        while (word / 64 >= words) {
+            words *= 2;
+        }
+        writer->bitmap = (uint64_t *)realloc(writer->bitmap, words * sizeof(uint64_t));
+        if (!writer->bitmap) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        memset(writer->bitmap + writer->bitmap_words, 0, (words - writer->bitmap_words) * sizeof(uint64_t));
+        writer->bitmap_words = words;
+    }
+    memcpy(writer->objects.bytes + offset, &value, sizeof(value));
+    writer->bitmap[word / 64] |= 1ull << (word % 64);
+}
+
+/**
+ * @brief Slot of an object in the shared-object table
+ */
+static size_t image_seen_slot(ImageWriter *writer, ARCObject *obj) {
+    size_t mask = writer->seen_capacity - 1;
+    size_t slot = (size_t)(((uintptr_t)obj >> 4) * 0x9E3779B97F4A7C15ull) & mask;
+    while (writer->seen[slot] && writer->seen[slot] != obj) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Records where a shared object was placed
+ */
+static void image_remember(ImageWriter *writer, ARCObject *obj, uint64_t placed) {
+    if (writer->seen_count * 2 >= writer->seen_capacity) {
+        ARCObject **old_seen = writer->seen;
+        uint64_t *old_placed = writer->placed;
+        size_t old_capacity = writer->seen_capacity;
+        writer->seen_capacity = old_capacity ? old_capacity * 2 : 256;
+        writer->seen = (ARCObject **)calloc(writer->seen_capacity, sizeof(ARCObject *));
+        writer->placed = (uint64_t *)malloc(writer->seen_capacity * sizeof(uint64_t));
+        if (!writer->seen || !writer->placed) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_seen[i]) {
+                size_t slot = image_seen_slot(writer, old_seen[i]);
+                writer->seen[slot] = old_seen[i];
+                writer->placed[slot] = old_placed[i];
+            }
+        }
+        free(old_seen);
+        free(old_placed);
+    }
+    size_t slot = image_seen_slot(writer, obj);
+    writer->seen[slot] = obj;
+    writer->placed[slot] = placed;
+    writer->seen_count++;
+}
+
+/**
+ * @brief Places an immortal object header and remembers shared objects
+ *
+ * Shared objects are remembered before their children are placed, so
+ * cycles through them resolve to the header instead of recursing.
+ *
+ * @return Offset of the object in the object section
+ */
+static size_t image_object(ImageWriter *writer, ARCObject *obj, size_t size, unsigned type) {
+    size_t offset = section_alloc(&writer->objects, size, IMAGE_ALIGN);
+    ((ARCObject *)(writer->objects.bytes + offset))->ref_count = TROVE_REF_IMMORTAL;
+    image_pointer(writer, offset + offsetof(ARCObject, dealloc), type);
+    if (obj->ref_count > 1) {
+        image_remember(writer, obj, IMAGE_OBJECT_REF | offset);
+    }
+    return offset;
+}
+
+/**
+ * @brief Places an array of child pointers already reserved in the object section
+ */
+static void image_place_slots(ImageWriter *writer, size_t offset, ARCObject *const *slots, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t child = image_place(writer, slots[i]);
+        if (child) {
+            image_pointer(writer, offset + i * sizeof(ARCObject *), child);
+        }
+    }
+}
+
+/**
+ * @brief Places a string, its bytes and its hash
+ */
+static size_t image_place_string(ImageWriter *writer, TroveString *str) {
+    uint64_t hash = TroveString_hash(str);
+    size_t offset = image_object(writer, (ARCObject *)str, sizeof(TroveString), IMAGE_STRING);
+    size_t bytes = section_alloc(&writer->bytes, str->length + 1, 1);
+    memcpy(writer->bytes.bytes + bytes, str->str, str->length);
+    TroveString *out = (TroveString *)(writer->objects.bytes + offset);
+    out->length = str->length;
+    out->capacity = str->length;
+    out->hash = hash;
+    image_pointer(writer, offset + offsetof(TroveString, str), IMAGE_BYTES_REF | bytes);
+    return offset;
+}
+
+/**
+ * @brief Places an array with capacity trimmed to its count
+ */
+static size_t image_place_array(ImageWriter *writer, TroveArray *array) {
+    size_t offset = image_object(writer, (ARCObject *)array, sizeof(TroveArray), IMAGE_ARRAY);
+    TroveArray *out = (TroveArray *)(writer->objects.bytes + offset);
+    out->count = array->count;
+    out->capacity = array->count;
+    if (array->count) {
+        size_t items = section_alloc(&writer->objects, array->count * sizeof(ARCObject *), 8);
+        image_pointer(writer, offset + offsetof(TroveArray, items), IMAGE_OBJECT_REF | items);
+        image_place_slots(writer, items, array->items, array->count);
+    }
+    return offset;
+}
+
+/**
+ * @brief Places the table embedded at offset in an object, with its control bytes and entries
+ */
+static void image_place_table(ImageWriter *writer, size_t offset, const TroveTable *table) {
+    if (!table->capacity) {
+        return;
+    }
+    TroveTable *out = (TroveTable *)(writer->objects.bytes + offset);
+    out->capacity = table->capacity;
+    out->count = table->count;
+    out->growth_left = table->growth_left;
+    size_t ctrl = section_alloc(&writer->bytes, table->capacity + TROVE_TABLE_GROUP_WIDTH, 16);
+    memcpy(writer->bytes.bytes + ctrl, table->ctrl, table->capacity + TROVE_TABLE_GROUP_WIDTH);
+    image_pointer(writer, offset + offsetof(TroveTable, ctrl), IMAGE_BYTES_REF | ctrl);
+    size_t entries = section_alloc(&writer->objects, table->capacity * sizeof(TroveTableEntry), 8);
+    image_pointer(writer, offset + offsetof(TroveTable, entries), IMAGE_OBJECT_REF | entries);
+    image_place_slots(writer, entries, (ARCObject *const *)table->entries, table->capacity * 2);
+}
+
+/**
+ * @brief Places a vector trie node
+ */
+static size_t image_place_vector_node(ImageWriter *writer, TroveVectorNode *node) {
+    size_t offset = image_object(writer, (ARCObject *)node, sizeof(TroveVectorNode), IMAGE_VECTOR_NODE);
+    image_place_slots(writer, offset + offsetof(TroveVectorNode, slots), node->slots, TROVE_VECTOR_WIDTH);
+    return offset;
+}
+
+/**
+ * @brief Places a vector header; its nodes are placed as children
+ */
+static size_t image_place_vector(ImageWriter *writer, TroveVector *vector) {
+    size_t offset = image_object(writer, (ARCObject *)vector, sizeof(TroveVector), IMAGE_VECTOR);
+    TroveVector *out = (TroveVector *)(writer->objects.bytes + offset);
+    out->count = vector->count;
+    out->shift = vector->shift;
+    image_place_slots(writer, offset + offsetof(TroveVector, root), (ARCObject *const *)&vector->root, 1);
+    image_place_slots(writer, offset + offsetof(TroveVector, tail), (ARCObject *const *)&vector->tail, 1);
+    return offset;
+}
+
+/**
+ * @brief Number of bits set in a map node bitmap
+ */
+static inline unsigned image_popcount(uint32_t bits) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_popcount(bits);
+#else
+    unsigned count = 0;
+    for (; bits; bits &= bits - 1) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+/**
+ * @brief Places a map trie node with its variable number of slots
+ */
+static size_t image_place_map_node(ImageWriter *writer, TroveMapNode *node) {
+    size_t slots = node->collisions ? 2 * (size_t)node->collisions
+                                    : 2 * (size_t)image_popcount(node->datamap) + image_popcount(node->nodemap);
+    size_t offset = image_object(writer, (ARCObject *)node, sizeof(TroveMapNode) + slots * sizeof(ARCObject *), IMAGE_MAP_NODE);
+    TroveMapNode *out = (TroveMapNode *)(writer->objects.bytes + offset);
+    out->datamap = node->datamap;
+    out->nodemap = node->nodemap;
+    out->collisions = node->collisions;
+    image_place_slots(writer, offset + offsetof(TroveMapNode, slots), node->slots, slots);
+    return offset;
+}
+
+/**
+ * @brief Places a map header; its nodes are placed as children
+ */
+static size_t image_place_map(ImageWriter *writer, TroveMap *map) {
+    size_t offset = image_object(writer, (ARCObject *)map, sizeof(TroveMap), IMAGE_MAP);
+    ((TroveMap *)(writer->objects.bytes + offset))->count = map->count;
+    image_place_slots(writer, offset + offsetof(TroveMap, root), (ARCObject *const *)&map->root, 1);
+    return offset;
+}
+
+/**
+ * @brief Places a data object as borrowed bytes in the byte section
+ */
+static size_t image_place_data(ImageWriter *writer, TroveData *data) {
+    size_t offset = image_object(writer, (ARCObject *)data, sizeof(TroveData), IMAGE_DATA);
+    TroveData *out = (TroveData *)(writer->objects.bytes + offset);
+    out->length = data->length;
+    out->kind = TROVE_DATA_ADOPTED;
+    if (data->length) {
+        size_t bytes = section_alloc(&writer->bytes, data->length, 16);
+        memcpy(writer->bytes.bytes + bytes, data->bytes, data->length);
+        image_pointer(writer, offset + offsetof(TroveData, bytes), IMAGE_BYTES_REF | bytes);
+    }
+    return offset;
+}
+
+/**
+ * @brief Places an object, or finds where it was placed before
+ *
+ * @return The object's placeholder, or 0 for NULL and after an error
+ */
+static uint64_t image_place(ImageWriter *writer, ARCObject *obj) {
+    if (!obj || writer->error) {
+        return 0;
+    }
+    if (obj->ref_count > 1 && writer->seen_count) {
+        size_t slot = image_seen_slot(writer, obj);
+        if (writer->seen[slot]) {
+            return writer->placed[slot];
+        }
+    }
+    if (++writer->depth > IMAGE_MAX_DEPTH) {
+        writer->error = ELOOP;
+        return 0;
+    }
+    size_t offset;
+    void (*dealloc)(ARCObject *) = obj->dealloc;
+    if (dealloc == TroveString_dealloc) {
+        offset = image_place_string(writer, (TroveString *)obj);
+    } else if (dealloc == TroveArray_dealloc) {
+        offset = image_place_array(writer, (TroveArray *)obj);
+    } else if (dealloc == TroveDictionary_dealloc || dealloc == TroveSet_dealloc) {
+        offset = image_object(writer, obj, dealloc == TroveSet_dealloc ? sizeof(TroveSet) : sizeof(TroveDictionary),
+                              dealloc == TroveSet_dealloc ? IMAGE_SET : IMAGE_DICTIONARY);
+        image_place_table(writer, offset + offsetof(TroveDictionary, table), &((TroveDictionary *)obj)->table);
+    } else if (dealloc == TroveVector_dealloc) {
+        offset = image_place_vector(writer, (TroveVector *)obj);
+    } else if (dealloc == TroveVectorNode_dealloc) {
+        offset = image_place_vector_node(writer, (TroveVectorNode *)obj);
+    } else if (dealloc == TroveMap_dealloc) {
+        offset = image_place_map(writer, (TroveMap *)obj);
+    } else if (dealloc == TroveMapNode_dealloc) {
+        offset = image_place_map_node(writer, (TroveMapNode *)obj);
+    } else if (dealloc == TroveData_dealloc) {
+        offset = image_place_data(writer, (TroveData *)obj);
+    } else {
+        writer->error = ENOTSUP;
+        return 0;
+    }
+    writer->depth--;
+    return IMAGE_OBJECT_REF | offset;
+}
+
+/**
+ * @brief Turns a placeholder into an address at the preferred base
+ */
+static uint64_t image_resolve(uint64_t value, const TroveImageHeader *header) {
+    if (value & IMAGE_OBJECT_REF) {
+        return header->base + header->objects_offset + (value & ~IMAGE_OBJECT_REF);
+    }
+    if (value & IMAGE_BYTES_REF) {
+        return header->base + header->bytes_offset + (value & ~IMAGE_BYTES_REF);
+    }
+    return value;
+}
+
+/**
+ * @brief Writes a whole buffer at an offset, retrying short writes
+ *
+ * @return 0 on success, otherwise errno
+ */
+static int image_pwrite(int fd, const void *bytes, size_t length, uint64_t offset) {
+    const unsigned char *p = (const unsigned char *)bytes;
+    while (length) {
+        ssize_t written = pwrite(fd, p, length, (off_t)offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        p += written;
+        length -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes an object graph as an image file
+ */
+int trove_image_write(ARCObject *root, const char *path) {
+    ImageWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    uint64_t placed = image_place(&writer, root);
+    int error = writer.error;
+
+    TroveImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TROVE_IMAGE_MAGIC, sizeof(TROVE_IMAGE_MAGIC));
+    header.base = TROVE_IMAGE_BASE;
+    header.objects_offset = image_round(sizeof(header), IMAGE_ALIGN);
+    header.objects_length = image_round(writer.objects.length, 8);
+    header.bytes_offset = image_round(header.objects_offset + header.objects_length, IMAGE_SECTION_ALIGN);
+    header.bytes_length = writer.bytes.length;
+    header.bitmap_offset = image_round(header.bytes_offset + header.bytes_length, 8);
+    size_t bitmap_words = (size_t)(header.objects_length / 8 + 63) / 64;
+    header.length = header.bitmap_offset + bitmap_words * sizeof(uint64_t);
+    header.root = image_resolve(placed, &header);
+
+    if (!error) {
+        for (size_t i = 0; i < bitmap_words && i < writer.bitmap_words; i++) {
+            for (uint64_t bits = writer.bitmap[i]; bits; bits &= bits - 1) {
+                uint64_t *word = (uint64_t *)writer.objects.bytes + i * 64 + (size_t)__builtin_ctzll(bits);
+                *word = image_resolve(*word, &header);
+            }
+        }
+        if (writer.bitmap_words < bitmap_words) {
+            writer.bitmap = (uint64_t *)realloc(writer.bitmap, bitmap_words * sizeof(uint64_t));
+            if (!writer.bitmap) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            memset(writer.bitmap + writer.bitmap_words, 0, (bitmap_words - writer.bitmap_words) * sizeof(uint64_t));
+        }
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            error = errno;
+        } else {
+            error = image_pwrite(fd, &header, sizeof(header), 0);
+            if (!error) {
+                error = image_pwrite(fd, writer.objects.bytes, writer.objects.length, header.objects_offset);
+            }
+            if (!error) {
+                error = image_pwrite(fd, writer.bytes.bytes, writer.bytes.length, header.bytes_offset);
+            }
+            if (!error) {
+                error = image_pwrite(fd, writer.bitmap, bitmap_words * sizeof(uint64_t), header.bitmap_offset);
+            }
+            if (!error && ftruncate(fd, (off_t)header.length) != 0) {
+                error = errno;
+            }
+            if (close(fd) != 0 && !error) {
+                error = errno;
+            }
+        }
+    }
+
+    free(writer.objects.bytes);
+    free(writer.bytes.bytes);
+    free(writer.bitmap);
+    free(writer.seen);
+    free(writer.placed);
+    return error;
+}
+
+/**
+ * @brief Checks that a header describes a well-formed file of the given size
+ */
+static int image_header_valid(const TroveImageHeader *header, uint64_t size) {
+    return memcmp(header->magic, TROVE_IMAGE_MAGIC, sizeof(TROVE_IMAGE_MAGIC)) == 0 &&
+           header->length == size &&
+           header->objects_offset >= sizeof(*header) && header->objects_offset % IMAGE_ALIGN == 0 &&
+           header->objects_length % 8 == 0 && header->bytes_offset >= header->objects_offset &&
+           header->objects_length <= header->bytes_offset - header->objects_offset &&
+           header->bytes_offset % IMAGE_SECTION_ALIGN == 0 && header->bytes_offset <= size &&
+           header->bytes_length <= header->bitmap_offset - header->bytes_offset &&
+           header->bitmap_offset >= header->bytes_offset && header->bitmap_offset <= size &&
+           header->bitmap_offset % 8 == 0 &&
+           (header->objects_length / 8 + 63) / 64 * 8 <= size - header->bitmap_offset;
+}
+
+/**
+ * @brief Binds type indexes to dealloc functions and rebases pointers by delta
+ */
+static void image_bind(unsigned char *mapping, const TroveImageHeader *header, uint64_t delta) {
+    uint64_t *words = (uint64_t *)(mapping + header->objects_offset);
+    const uint64_t *bitmap = (const uint64_t *)(mapping + header->bitmap_offset);
+    size_t bitmap_words = (size_t)(header->objects_length / 8 + 63) / 64;
+    for (size_t i = 0; i < bitmap_words; i++) {
+        for (uint64_t bits = bitmap[i]; bits; bits &= bits - 1) {
+            uint64_t *word = words + i * 64 + (size_t)__builtin_ctzll(bits);
+            if (*word < IMAGE_TYPE_COUNT) {
+                void (*dealloc)(ARCObject *) = image_types[*word];
+                memcpy(word, &dealloc, sizeof(dealloc));
+            } else {
+                *word += delta;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Maps an image file and binds it to this process
+ */
+TroveImage* TroveImage_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    TroveImageHeader header;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return NULL;
+    }
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        !image_header_valid(&header, (uint64_t)st.st_size)) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+    void *mapping = mmap((void *)(uintptr_t)header.base, (size_t)header.length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return NULL;
+    }
+    // Every page of the object section is written while binding. Reading it
+    // into populated anonymous pages copies it once, where copy-on-write
+    // would take a fault per page.
+    void *objects = mmap(mapping, (size_t)header.bytes_offset, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS | IMAGE_MAP_POPULATE, -1, 0);
+    if (objects == MAP_FAILED ||
+        pread(fd, objects, (size_t)header.bytes_offset, 0) != (ssize_t)header.bytes_offset) {
+        int saved = objects == MAP_FAILED ? errno : EIO;
+        munmap(mapping, (size_t)header.length);
+        close(fd);
+        errno = saved;
+        return NULL;
+    }
+    close(fd);
+    uint64_t delta = (uint64_t)(uintptr_t)mapping - header.base;
+    image_bind((unsigned char *)mapping, &header, delta);
+    mprotect(objects, (size_t)header.bytes_offset, PROT_READ);
+
+    TroveImage *image = (TroveImage *)malloc(sizeof(TroveImage));
+    if (!image) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    arc_object_init(&image->base, TroveImage_dealloc, sizeof(TroveImage));
+    image->mapping = mapping;
+    image->length = (size_t)header.length;
+    image->root = header.root ? (ARCObject *)(uintptr_t)(header.root + delta) : NULL;
+    image->rebased = delta != 0;
+    return image;
+}
+
+/**
+ * @brief Deallocates a TroveImage, unmapping every object in it
+ */
+void TroveImage_dealloc(ARCObject *obj) {
+    TroveImage *image = (TroveImage *)obj;
+    munmap(image->mapping, image->length);
+    arc_object_free(&image->base);
+}
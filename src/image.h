@@ -0,0 +1,96 @@
+/**
+ * @file image.h
+ * @brief Memory-mapped images of immutable object graphs for the Trove ARC memory management system
+ *
+ * trove_image_write lays out a graph of strings, arrays, dictionaries, sets,
+ * vectors, maps and data objects in a file exactly as they sit in memory,
+ * with every reference count set to TROVE_REF_IMMORTAL. TroveImage_open maps
+ * the file and hands back the root: no parsing, no per-object allocation,
+ * and retains and releases of the mapped objects cost nothing.
+ *
+ * The file has two sections. The object section holds headers, element
+ * arrays and table entries, i.e. everything that contains pointers. Pointers
+ * are written for a preferred base address and a bitmap marks every pointer
+ * word, so the loader can rebase them with one linear pass if the mapping
+ * lands elsewhere. Dealloc functions move with each run of the program, so
+ * they are stored as type indexes and always bound at load; the object
+ * section is therefore read into private memory rather than shared.
+ * The byte section holds string contents, data bytes and table control
+ * bytes; it is never written and stays shared with the page cache, which is
+ * where the bulk of a large configuration lives.
+ *
+ * Both sections are read-only once loaded. Mapped objects live as long as
+ * the TroveImage; keep it for as long as any of them is in use. Images are
+ * trusted input: only the header is validated.
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "trove.h"
+#include <stdint.h>
+
+/** @brief Bytes at the start of every image */
+#define TROVE_IMAGE_MAGIC "TRVIMG1"
+
+/** @brief Address images are written for; a second image mapped at once is rebased */
+#define TROVE_IMAGE_BASE ((uintptr_t)0x200000000000ull)
+
+/**
+ * @brief On-disk header at offset 0 of an image
+ */
+typedef struct TroveImageHeader {
+    char magic[8];             /**< TROVE_IMAGE_MAGIC */
+    uint64_t base;             /**< Address the pointers in the file assume */
+    uint64_t length;           /**< Total file size */
+    uint64_t objects_offset;   /**< File offset of the object section */
+    uint64_t objects_length;   /**< Size of the object section (a multiple of 8) */
+    uint64_t bytes_offset;     /**< File offset of the byte section (page aligned) */
+    uint64_t bytes_length;     /**< Size of the byte section */
+    uint64_t bitmap_offset;    /**< File offset of the pointer bitmap, one bit per object-section word */
+    uint64_t root;             /**< Address of the root object, 0 for NULL */
+} TroveImageHeader;
+
+/**
+ * @brief Mapped image managed by ARC
+ */
+typedef struct TroveImage {
+    ARCObject base;         /**< Inheritance: must be the first member */
+    void *mapping;          /**< Start of the mapping */
+    size_t length;          /**< Length of the mapping */
+    ARCObject *root;        /**< Immortal root object, or NULL */
+    int rebased;            /**< Nonzero if the mapping missed the preferred base */
+} TroveImage;
+
+/**
+ * @brief Writes an object graph as an image file
+ *
+ * Objects reachable more than once are laid out once. String hashes are
+ * computed and stored, so lookups never write to mapped keys.
+ *
+ * @param root The root object (may be NULL)
+ * @param path Path of the file to create or replace
+ * @return 0 on success, ENOTSUP if the graph holds an unsupported type, or
+ *         the errno of a failed file operation
+ */
+int trove_image_write(ARCObject *root, const char *path);
+
+/**
+ * @brief Maps an image file and binds it to this process
+ *
+ * @param path Path of the image
+ * @return A new TroveImage with a reference count of 1, or NULL with errno
+ *         set if the file cannot be mapped or is not an image (EINVAL)
+ */
+TroveImage* TroveImage_open(const char *path);
+
+/**
+ * @brief Deallocates a TroveImage, unmapping every object in it
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveImage_dealloc(ARCObject *obj);
+
+#endif // IMAGE_H
@@ -0,0 +1,654 @@
+/**
+ * @file leaks.c
+ * @brief Leak detection for the Trove ARC memory management system
+ */
+
+#include "leaks.h"
+#include "stats.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/** @brief log2 of the address span of one registry page */
+#define LEAKS_PAGE_SHIFT 16
+
+/**
+ * @brief log2 of the address granule of one registry slot
+ *
+ * Objects are at least this large, so no two live objects share a granule.
+ */
+#define LEAKS_GRANULE_SHIFT (sizeof(void *) == 8 ? 4 : 3)
+
+/** @brief Independently locked parts of the registry (a power of two) */
+#define LEAKS_SHARDS 64
+
+/** @brief Initial number of page directory slots of a shard */
+#define LEAKS_INITIAL_PAGES 64
+
+/** @brief Initial number of site table slots */
+#define LEAKS_INITIAL_SITES 256
+
+/** @brief Site index of objects created at an unknown site; 0 marks a free slot */
+#define LEAKS_UNKNOWN_SITE 1
+
+/** @brief Bit of LeakSlot.retain set for objects autoreleased with no pool */
+#define LEAKS_ORPHANED 0x80000000u
+
+/**
+ * @brief Registry slot of one live object
+ */
+typedef struct LeakSlot {
+    uint32_t site;      /**< Allocation site index, 0 for a free slot */
+    uint32_t retain;    /**< Last RETAIN site index (0 for none), plus LEAKS_ORPHANED */
+} LeakSlot;
+
+/**
+ * @brief Registry slots of the objects in one aligned span of addresses
+ *
+ * Objects allocated one after the other mostly land in the same page, so
+ * tracking them touches the same few cache lines instead of random slots
+ * of one large hash table.
+ */
+typedef struct LeakPage {
+    uintptr_t number;    /**< Address >> LEAKS_PAGE_SHIFT */
+    size_t live;         /**< Occupied slots */
+    LeakSlot slots[];    /**< One per granule */
+} LeakPage;
+
+/**
+ * @brief The pages of the addresses that hash to one shard, behind their own lock
+ *
+ * Threads allocating from different malloc arenas mostly touch different
+ * pages and so different shards. Each shard is padded to a cache line so
+ * their locks do not share one.
+ */
+typedef struct LeakShard {
+    volatile char lock;           /**< Spin lock guarding the shard */
+    LeakPage **pages;             /**< Open-addressing table of pages by page number, linear probing */
+    size_t capacity;              /**< Slots in pages (a power of two) */
+    size_t page_count;            /**< Pages in pages */
+    LeakPage *last_page;          /**< Page of the last object tracked or untracked */
+    size_t live;                  /**< Live tracked objects */
+    char padding[64 - 6 * sizeof(void *)];  /**< Fills the cache line */
+} LeakShard;
+
+/**
+ * @brief An allocation or RETAIN site
+ */
+typedef struct LeakSite {
+    const char *file;    /**< Source file, NULL if unknown */
+    int line;            /**< Source line */
+} LeakSite;
+
+/**
+ * @brief Leaked objects sharing a type and allocation site
+ */
+typedef struct LeakGroup {
+    void (*dealloc)(ARCObject *);    /**< Type */
+    const char *file;                /**< Allocation site */
+    int line;                        /**< Allocation line */
+    size_t count;                    /**< Objects */
+    size_t bytes;                    /**< Their sizes */
+    size_t orphaned;                 /**< Objects autoreleased with no pool */
+    const char *retain_file;         /**< A RETAIN site seen in the group */
+    int retain_line;                 /**< Its line */
+} LeakGroup;
+
+int arc_leaks_enabled = 0;
+
+/** @brief Registry shards by hash of page number */
+static LeakShard leak_shards[LEAKS_SHARDS];
+
+/** @brief Sites by index; entries 0 and LEAKS_UNKNOWN_SITE are reserved */
+static LeakSite *leak_sites = NULL;
+
+/** @brief Entries used in leak_sites */
+static uint32_t leak_site_count = 0;
+
+/** @brief Entries allocated in leak_sites */
+static uint32_t leak_site_capacity = 0;
+
+/** @brief Open-addressing table of site indices by file and line, linear probing */
+static uint32_t *leak_site_index = NULL;
+
+/** @brief Slots in leak_site_index (a power of two) */
+static size_t leak_site_index_capacity = 0;
+
+/** @brief Spin lock guarding the site table */
+static volatile char leak_site_lock = 0;
+
+/** @brief Exit status forced when leaks remain at exit, 0 to only report */
+static int leak_exit_status = 0;
+
+/** @brief Nonzero once the exit report is registered */
+static int leak_report_registered = 0;
+
+/**
+ * @brief Acquires a spin lock
+ */
+static inline void leaks_lock(volatile char *lock) {
+#if defined(__GNUC__)
+    while (__atomic_test_and_set(lock, __ATOMIC_ACQUIRE)) {
+    }
+#else
+    (void)lock;
+#endif
+}
+
+/**
+ * @brief Releases a spin lock
+ */
+static inline void leaks_unlock(volatile char *lock) {
+#if defined(__GNUC__)
+    __atomic_clear(lock, __ATOMIC_RELEASE);
+#else
+    (void)lock;
+#endif
+}
+
+/**
+ * @brief Hashes a page number or site to a table slot
+ */
+static inline size_t leaks_hash(uintptr_t key, size_t capacity) {
+    return (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+}
+
+/**
+ * @brief Returns the shard holding the page of an object
+ */
+static inline LeakShard* leaks_shard(ARCObject *obj) {
+    uintptr_t number = (uintptr_t)obj >> LEAKS_PAGE_SHIFT;
+    return &leak_shards[(size_t)(((uint64_t)number * 0x9E3779B97F4A7C15ull) >> 58) & (LEAKS_SHARDS - 1)];
+}
+
+/**
+ * @brief Acquires every shard lock, in order, and then the site lock
+ */
+static void leaks_lock_all(void) {
+    for (size_t i = 0; i < LEAKS_SHARDS; i++) {
+        leaks_lock(&leak_shards[i].lock);
+    }
+    leaks_lock(&leak_site_lock);
+}
+
+/**
+ * @brief Releases the locks taken by leaks_lock_all
+ */
+static void leaks_unlock_all(void) {
+    leaks_unlock(&leak_site_lock);
+    for (size_t i = LEAKS_SHARDS; i > 0; i--) {
+        leaks_unlock(&leak_shards[i - 1].lock);
+    }
+}
+
+/**
+ * @brief Allocates a zeroed table, exiting with an error message on failure
+ */
+static void* leaks_calloc(size_t count, size_t size) {
+    void *table = calloc(count, size);
+    if (!table) {
+        fprintf(stderr, "Failed to allocate leak registry.\n");
+        exit(1);
+    }
+    return table;
+}
+
+/**
+ * @brief Slot of a page number in the page directory, or the empty slot where it belongs
+ */
+static size_t leaks_page_slot(LeakPage **pages, size_t capacity, uintptr_t number) {
+    size_t slot = leaks_hash(number, capacity);
+    while (pages[slot] && pages[slot]->number != number) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return slot;
+}
+
+/**
+ * @brief Returns the page covering an object, or NULL if it has none and create is 0
+ *
+ * Call with the shard's lock held. If allocation fails, the program will
+ * exit with an error message.
+ */
+static LeakPage* leaks_page(LeakShard *shard, ARCObject *obj, int create) {
+    uintptr_t number = (uintptr_t)obj >> LEAKS_PAGE_SHIFT;
+    if (shard->last_page && shard->last_page->number == number) {
+        return shard->last_page;
+    }
+    if (!shard->capacity) {
+        if (!create) {
+            return NULL;
+        }
+        shard->capacity = LEAKS_INITIAL_PAGES;
+        shard->pages = (LeakPage **)leaks_calloc(shard->capacity, sizeof(LeakPage *));
+    }
+    size_t slot = leaks_page_slot(shard->pages, shard->capacity, number);
+    if (!shard->pages[slot]) {
+        if (!create) {
+            return NULL;
+        }
+        if ((shard->page_count + 1) * 2 > shard->capacity) {
+            size_t capacity = shard->capacity * 2;
+            LeakPage **pages = (LeakPage **)leaks_calloc(capacity, sizeof(LeakPage *));
+            for (size_t i = 0; i < shard->capacity; i++) {
+                if (shard->pages[i]) {
+                    pages[leaks_page_slot(pages, capacity, shard->pages[i]->number)] = shard->pages[i];
+                }
+            }
+            free(shard->pages);
+            shard->pages = pages;
+            shard->capacity = capacity;
+            slot = leaks_page_slot(shard->pages, shard->capacity, number);
+        }
+        size_t granules = (size_t)1 << (LEAKS_PAGE_SHIFT - LEAKS_GRANULE_SHIFT);
+        LeakPage *page = (LeakPage *)leaks_calloc(1, sizeof(LeakPage) + granules * sizeof(LeakSlot));
+        page->number = number;
+        shard->pages[slot] = page;
+        shard->page_count++;
+    }
+    shard->last_page = shard->pages[slot];
+    return shard->last_page;
+}
+
+/**
+ * @brief Returns the registry slot of a tracked object, or NULL
+ *
+ * Call with the shard's lock held.
+ */
+static LeakSlot* leaks_find(LeakShard *shard, ARCObject *obj) {
+    LeakPage *page = leaks_page(shard, obj, 0);
+    if (!page) {
+        return NULL;
+    }
+    LeakSlot *slot = &page->slots[((uintptr_t)obj & (((uintptr_t)1 << LEAKS_PAGE_SHIFT) - 1)) >> LEAKS_GRANULE_SHIFT];
+    return slot->site ? slot : NULL;
+}
+
+/**
+ * @brief Slot of a site in the site index, or the empty slot where it belongs
+ */
+static size_t leaks_site_slot(uint32_t *index, size_t capacity, const char *file, int line) {
+    size_t slot = leaks_hash((uintptr_t)file ^ ((uintptr_t)line << 20), capacity);
+    while (index[slot] && (leak_sites[index[slot]].file != file || leak_sites[index[slot]].line != line)) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return slot;
+}
+
+/**
+ * @brief Returns the index of a site, adding it if it is new
+ *
+ * Sites are told apart by the address of their file name, which is a
+ * string literal from __FILE__. Call with the site lock held. If allocation
+ * fails, the program will exit with an error message.
+ */
+static uint32_t leaks_site(const char *file, int line) {
+    if (!leak_site_index_capacity) {
+        leak_site_capacity = LEAKS_INITIAL_SITES;
+        leak_sites = (LeakSite *)leaks_calloc(leak_site_capacity, sizeof(LeakSite));
+        leak_site_count = LEAKS_UNKNOWN_SITE + 1;
+        leak_site_index_capacity = LEAKS_INITIAL_SITES * 2;
+        leak_site_index = (uint32_t *)leaks_calloc(leak_site_index_capacity, sizeof(uint32_t));
+    }
+    if (!file) {
+        return LEAKS_UNKNOWN_SITE;
+    }
+    size_t slot = leaks_site_slot(leak_site_index, leak_site_index_capacity, file, line);
+    if (leak_site_index[slot]) {
+        return leak_site_index[slot];
+    }
+    if (leak_site_count == leak_site_capacity) {
+        leak_site_capacity *= 2;
+        leak_sites = (LeakSite *)realloc(leak_sites, leak_site_capacity * sizeof(LeakSite));
+        if (!leak_sites) {
+            fprintf(stderr, "Failed to allocate leak registry.\n");
+            exit(1);
+        }
+        size_t capacity = (size_t)leak_site_capacity * 2;
+        uint32_t *index = (uint32_t *)leaks_calloc(capacity, sizeof(uint32_t));
+        for (uint32_t i = LEAKS_UNKNOWN_SITE + 1; i < leak_site_count; i++) {
+            index[leaks_site_slot(index, capacity, leak_sites[i].file, leak_sites[i].line)] = i;
+        }
+        free(leak_site_index);
+        leak_site_index = index;
+        leak_site_index_capacity = capacity;
+        slot = leaks_site_slot(leak_site_index, leak_site_index_capacity, file, line);
+    }
+    uint32_t site = leak_site_count++;
+    leak_sites[site].file = file;
+    leak_sites[site].line = line;
+    leak_site_index[slot] = site;
+    return site;
+}
+
+/**
+ * @brief Returns the index of a site, adding it if it is new, under the site lock
+ */
+static uint32_t leaks_site_locked(const char *file, int line) {
+    leaks_lock(&leak_site_lock);
+    uint32_t site = leaks_site(file, line);
+    leaks_unlock(&leak_site_lock);
+    return site;
+}
+
+/**
+ * @brief Frees the whole registry
+ *
+ * Call with every lock held.
+ */
+static void leaks_clear(void) {
+    for (size_t i = 0; i < LEAKS_SHARDS; i++) {
+        LeakShard *shard = &leak_shards[i];
+        for (size_t j = 0; j < shard->capacity; j++) {
+            free(shard->pages[j]);
+        }
+        free(shard->pages);
+        shard->pages = NULL;
+        shard->capacity = 0;
+        shard->page_count = 0;
+        shard->last_page = NULL;
+        shard->live = 0;
+    }
+    free(leak_sites);
+    free(leak_site_index);
+    leak_sites = NULL;
+    leak_site_count = 0;
+    leak_site_capacity = 0;
+    leak_site_index = NULL;
+    leak_site_index_capacity = 0;
+}
+
+/**
+ * @brief Reports leaks at exit and turns them into a failing exit status if asked to
+ */
+static void leaks_report_at_exit(void) {
+    if (!arc_leaks_enabled) {
+        return;
+    }
+    size_t leaked = arc_leaks_report(stderr);
+    if (leaked && leak_exit_status) {
+        fflush(NULL);
+        _exit(leak_exit_status);
+    }
+}
+
+#if defined(__GNUC__)
+/**
+ * @brief Enables tracking at startup when TROVE_LEAKS is set to anything but 0
+ *
+ * TROVE_LEAKS=fail also makes leaks fail the process.
+ */
+__attribute__((constructor)) static void leaks_enable_from_environment(void) {
+    const char *value = getenv("TROVE_LEAKS");
+    if (value && *value && strcmp(value, "0") != 0) {
+        leak_exit_status = strcmp(value, "fail") == 0 ? 1 : 0;
+        arc_leaks_enable(1);
+    }
+}
+#endif
+
+/**
+ * @brief Starts or stops tracking objects
+ */
+void arc_leaks_enable(int enabled) {
+    if (enabled && !leak_report_registered) {
+        leak_report_registered = 1;
+        atexit(leaks_report_at_exit);
+    }
+    if (enabled) {
+        // Objects are tracked at the unknown site until tagged, so the table must exist
+        leaks_site_locked(NULL, 0);
+    }
+    arc_leaks_enabled = enabled != 0;
+    if (!enabled) {
+        leaks_lock_all();
+        leaks_clear();
+        leaks_unlock_all();
+    }
+}
+
+/**
+ * @brief Records the allocation site of a newly created object and returns it
+ */
+ARCObject* arc_tag_site(ARCObject *obj, const char *file, int line) {
+    if (!arc_leaks_enabled || !obj) {
+        return obj;
+    }
+    uint32_t site = leaks_site_locked(file, line);
+    LeakShard *shard = leaks_shard(obj);
+    leaks_lock(&shard->lock);
+    LeakSlot *slot = leaks_find(shard, obj);
+    if (slot) {
+        slot->site = site;
+    }
+    leaks_unlock(&shard->lock);
+    return obj;
+}
+
+/**
+ * @brief Enters a new object in the registry, at an unknown site
+ */
+void arc_leaks_track(ARCObject *obj) {
+    LeakShard *shard = leaks_shard(obj);
+    leaks_lock(&shard->lock);
+    LeakPage *page = leaks_page(shard, obj, 1);
+    LeakSlot *slot = &page->slots[((uintptr_t)obj & (((uintptr_t)1 << LEAKS_PAGE_SHIFT) - 1)) >> LEAKS_GRANULE_SHIFT];
+    if (!slot->site) {
+        page->live++;
+        shard->live++;
+    }
+    slot->site = LEAKS_UNKNOWN_SITE;
+    slot->retain = 0;
+    leaks_unlock(&shard->lock);
+}
+
+/**
+ * @brief Removes an object from the registry
+ */
+void arc_leaks_untrack(ARCObject *obj) {
+    LeakShard *shard = leaks_shard(obj);
+    leaks_lock(&shard->lock);
+    LeakSlot *slot = leaks_find(shard, obj);
+    if (slot) {
+        slot->site = 0;
+        shard->last_page->live--;
+        shard->live--;
+    }
+    leaks_unlock(&shard->lock);
+}
+
+/**
+ * @brief Stops tracking one object
+ */
+void arc_leaks_ignore(ARCObject *obj) {
+    arc_leaks_untrack(obj);
+}
+
+/**
+ * @brief Records the RETAIN site of an object
+ */
+void arc_leaks_retained(ARCObject *obj, const char *file, int line) {
+    uint32_t site = leaks_site_locked(file, line);
+    LeakShard *shard = leaks_shard(obj);
+    leaks_lock(&shard->lock);
+    LeakSlot *slot = leaks_find(shard, obj);
+    if (slot) {
+        slot->retain = (slot->retain & LEAKS_ORPHANED) | site;
+    }
+    leaks_unlock(&shard->lock);
+}
+
+/**
+ * @brief Marks an object autoreleased with no pool
+ */
+void arc_leaks_orphaned(ARCObject *obj) {
+    LeakShard *shard = leaks_shard(obj);
+    leaks_lock(&shard->lock);
+    LeakSlot *slot = leaks_find(shard, obj);
+    if (slot) {
+        slot->retain |= LEAKS_ORPHANED;
+    }
+    leaks_unlock(&shard->lock);
+}
+
+/**
+ * @brief Returns the number of tracked objects that are still alive
+ *
+ * Shards are counted one at a time, so the total is only exact when no
+ * other thread creates or frees objects meanwhile.
+ */
+size_t arc_leaks_count(void) {
+    size_t count = 0;
+    for (size_t i = 0; i < LEAKS_SHARDS; i++) {
+        leaks_lock(&leak_shards[i].lock);
+        count += leak_shards[i].live;
+        leaks_unlock(&leak_shards[i].lock);
+    }
+    return count;
+}
+
+/**
+ * @brief Calls a function for every tracked live object
+ */
+void arc_leaks_each(void (*visit)(ARCObject *obj, const char *file, int line, void *context), void *context) {
+    size_t granules = (size_t)1 << (LEAKS_PAGE_SHIFT - LEAKS_GRANULE_SHIFT);
+    leaks_lock_all();
+    for (size_t s = 0; s < LEAKS_SHARDS; s++) {
+        LeakShard *shard = &leak_shards[s];
+        for (size_t i = 0; i < shard->capacity; i++) {
+            LeakPage *page = shard->pages[i];
+            for (size_t j = 0; page && page->live && j < granules; j++) {
+                LeakSlot *slot = &page->slots[j];
+                if (slot->site) {
+                    ARCObject *obj = (ARCObject *)((page->number << LEAKS_PAGE_SHIFT) | (j << LEAKS_GRANULE_SHIFT));
+                    visit(obj, leak_sites[slot->site].file, leak_sites[slot->site].line, context);
+                }
+            }
+        }
+    }
+    leaks_unlock_all();
+}
+
+/**
+ * @brief Orders groups by type, then allocation site
+ */
+static int leaks_compare_site(const void *a, const void *b) {
+    const LeakGroup *x = (const LeakGroup *)a;
+    const LeakGroup *y = (const LeakGroup *)b;
+    if (x->dealloc != y->dealloc) {
+        return (uintptr_t)x->dealloc < (uintptr_t)y->dealloc ? -1 : 1;
+    }
+    if (x->file != y->file) {
+        if (!x->file || !y->file) {
+            return x->file ? -1 : 1;
+        }
+        int order = strcmp(x->file, y->file);
+        if (order) {
+            return order;
+        }
+    }
+    return x->line - y->line;
+}
+
+/**
+ * @brief Orders groups by descending object count
+ */
+static int leaks_compare_count(const void *a, const void *b) {
+    const LeakGroup *x = (const LeakGroup *)a;
+    const LeakGroup *y = (const LeakGroup *)b;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+/**
+ * @brief Writes the tracked live objects, grouped by type and allocation site
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+size_t arc_leaks_report(FILE *out) {
+    leaks_lock_all();
+    size_t count = 0;
+    for (size_t s = 0; s < LEAKS_SHARDS; s++) {
+        count += leak_shards[s].live;
+    }
+    LeakGroup *groups = (LeakGroup *)malloc((count ? count : 1) * sizeof(LeakGroup));
+    if (!groups) {
+        fprintf(stderr, "Failed to allocate leak report.\n");
+        exit(1);
+    }
+    size_t n = 0;
+    size_t granules = (size_t)1 << (LEAKS_PAGE_SHIFT - LEAKS_GRANULE_SHIFT);
+    for (size_t s = 0; s < LEAKS_SHARDS; s++) {
+        LeakShard *shard = &leak_shards[s];
+        for (size_t i = 0; i < shard->capacity; i++) {
+            LeakPage *page = shard->pages[i];
+            for (size_t j = 0; page && page->live && j < granules; j++) {
+                LeakSlot *slot = &page->slots[j];
+                if (slot->site) {
+                    ARCObject *obj = (ARCObject *)((page->number << LEAKS_PAGE_SHIFT) | (j << LEAKS_GRANULE_SHIFT));
+                    LeakSite *site = &leak_sites[slot->site];
+                    LeakSite *retain = &leak_sites[slot->retain & ~LEAKS_ORPHANED];
+                    LeakGroup group = { obj->dealloc, site->file, site->line, 1, obj->size,
+                                        (slot->retain & LEAKS_ORPHANED) ? 1 : 0, retain->file, retain->line };
+                    groups[n++] = group;
+                }
+            }
+        }
+    }
+    leaks_unlock_all();
+
+    qsort(groups, n, sizeof(LeakGroup), leaks_compare_site);
+    size_t merged = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (merged && leaks_compare_site(&groups[merged - 1], &groups[i]) == 0) {
+            LeakGroup *group = &groups[merged - 1];
+            group->count++;
+            group->bytes += groups[i].bytes;
+            group->orphaned += groups[i].orphaned;
+            if (groups[i].retain_file) {
+                group->retain_file = groups[i].retain_file;
+                group->retain_line = groups[i].retain_line;
+            }
+        } else {
+            groups[merged++] = groups[i];
+        }
+    }
+    qsort(groups, merged, sizeof(LeakGroup), leaks_compare_count);
+
+    if (n) {
+        fprintf(out, "trove: %zu leaked object%s in %zu group%s\n", n, n == 1 ? "" : "s", merged, merged == 1 ? "" : "s");
+    }
+    size_t shown = merged < TROVE_LEAKS_MAX_GROUPS ? merged : TROVE_LEAKS_MAX_GROUPS;
+    for (size_t i = 0; i < shown; i++) {
+        LeakGroup *group = &groups[i];
+        const char *name = arc_stats_type_name(group->dealloc);
+        char address[32];
+        if (!name) {
+            snprintf(address, sizeof(address), "0x%lx", (unsigned long)(uintptr_t)group->dealloc);
+            name = address;
+        }
+        fprintf(out, "  %8zu x %-18s %10zu bytes", group->count, name, group->bytes);
+        if (group->file) {
+            fprintf(out, "  created at %s:%d", group->file, group->line);
+        } else {
+            fprintf(out, "  created at an unknown site");
+        }
+        if (group->retain_file) {
+            fprintf(out, ", retained at %s:%d", group->retain_file, group->retain_line);
+        }
+        if (group->orphaned) {
+            fprintf(out, ", %zu autoreleased with no pool", group->orphaned);
+        }
+        fputc('\n', out);
+    }
+    if (merged > shown) {
+        size_t rest = 0;
+        for (size_t i = shown; i < merged; i++) {
+            rest += groups[i].count;
+        }
+        fprintf(out, "  ... %zu more objects in %zu groups\n", rest, merged - shown);
+    }
+    free(groups);
+    return n;
+}
@@ -0,0 +1,107 @@
+/**
+ * @file leaks.h
+ * @brief Leak detection for the Trove ARC memory management system
+ *
+ * When enabled, every object created from then on is entered in a registry
+ * with its allocation site, and removed when it is freed. The registry is
+ * paged by address, one slot per 16 bytes, so objects allocated together
+ * share cache lines and tracking costs little beyond a lock. Pages are
+ * spread over 64 shards, each with its own lock, so threads allocating
+ * from different malloc arenas rarely wait for each other. Whatever
+ * is left at exit has leaked: a RELEASE was missed, or the object was
+ * autoreleased with no pool in place. arc_leaks_report groups the survivors
+ * by type and allocation site.
+ *
+ * Allocation sites come from the String, ARC_NEW and Array-style macros,
+ * which tag the object they create with __FILE__ and __LINE__ through
+ * arc_tag_site once the create call has returned; objects created
+ * by direct calls to create functions, and the internal objects of
+ * collections, are reported under their type with an unknown site. RETAIN
+ * records its site as the object's last retain, which usually points at
+ * the reference that was never released.
+ *
+ * Setting the environment variable TROVE_LEAKS enables tracking at startup
+ * (with GCC and Clang) and reports leaks to stderr at exit; with
+ * TROVE_LEAKS=fail a leak also makes the process exit with status 1, so
+ * test runs fail.
+ */
+
+#ifndef LEAKS_H
+#define LEAKS_H
+
+#include "trove.h"
+#include <stdio.h>
+
+/** @brief Leak groups listed by arc_leaks_report; the rest are summed up */
+#define TROVE_LEAKS_MAX_GROUPS 50
+
+/** @brief Nonzero while objects are tracked; set with arc_leaks_enable */
+extern int arc_leaks_enabled;
+
+/**
+ * @brief Starts or stops tracking objects
+ *
+ * Objects created while tracking is off are never reported; turning it
+ * off forgets the objects tracked so far.
+ *
+ * @param enabled Nonzero to track
+ */
+void arc_leaks_enable(int enabled);
+
+/**
+ * @brief Stops tracking one object, e.g. one meant to live until exit
+ *
+ * @param obj The object
+ */
+void arc_leaks_ignore(ARCObject *obj);
+
+/**
+ * @brief Returns the number of tracked objects that are still alive
+ */
+size_t arc_leaks_count(void);
+
+/**
+ * @brief Writes the tracked live objects, grouped by type and allocation site
+ *
+ * Groups are listed by descending object count, each with its bytes, the
+ * last RETAIN site seen in the group and how many of its objects were
+ * autoreleased with no pool in place. Writes nothing when there are none.
+ *
+ * @param out Stream to write to
+ * @return Number of live objects reported
+ */
+size_t arc_leaks_report(FILE *out);
+
+/**
+ * @brief Calls a function for every tracked live object
+ *
+ * The registry stays locked throughout, so other threads block when they
+ * create or free an object; visit must not do either.
+ *
+ * @param visit Called with each object, its allocation site (NULL if
+ *              unknown) and line, and context
+ * @param context Passed to visit
+ */
+void arc_leaks_each(void (*visit)(ARCObject *obj, const char *file, int line, void *context), void *context);
+
+/**
+ * @brief Enters a new object in the registry; called by arc_object_init
+ */
+void arc_leaks_track(ARCObject *obj);
+
+/**
+ * @brief Removes an object from the registry; called by arc_object_free
+ */
+void arc_leaks_untrack(ARCObject *obj);
+
+/**
+ * @brief Records the RETAIN site of an object; called by arc_retain_at
+ */
+void arc_leaks_retained(ARCObject *obj, const char *file, int line);
+
+/**
+ * @brief Marks an object autoreleased with no pool; called by autorelease_add
+ */
+void arc_leaks_orphaned(ARCObject *obj);
+
+#endif // LEAKS_H
@@ -26,7 +26,7 @@
  * TroveString *s = String("Hello, ARC!");
  * @endcode
  */
-#define String(text) ((TroveString *)arc_autorelease((ARCObject *)TroveString_create(text)))
+#define String(text) ((TroveString *)arc_autorelease((ARCObject *)TROVE_AT_SITE(TroveString_create(text))))
 
 /**
  * @brief Generic macro to create any ARC-managed object
@@ -43,7 +43,7 @@
  * TroveArray *array = ARC_NEW(TroveArray, 10);
  * @endcode
  */
-#define ARC_NEW(type, ...) ((type *)arc_autorelease((ARCObject *)type##_create(__VA_ARGS__)))
+#define ARC_NEW(type, ...) ((type *)arc_autorelease((ARCObject *)TROVE_AT_SITE(type##_create(__VA_ARGS__))))
 
 /**
  * @brief Convenience macros for ARC memory management
@@ -52,9 +52,12 @@
 /**
  * @brief Increments the reference count of an object
  * 
+ * The call site is recorded as the object's last retain when leak
+ * tracking is on.
+ * 
  * @param obj The object whose reference count should be incremented
  */
-#define RETAIN(obj)  arc_retain((ARCObject *)(obj))
+#define RETAIN(obj)  arc_retain_at((ARCObject *)(obj), __FILE__, __LINE__)
 
 /**
  * @brief Decrements the reference count of an object
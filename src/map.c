@@ -0,0 +1,736 @@
+/**
+ * @file map.c
+ * @brief Implementation of persistent hash maps
+ *
+ * Level d of the trie indexes by hash bits [5d, 5d + 5). Nodes are kept in
+ * canonical form: a child node always holds at least two pairs in total,
+ * because removing down to a single pair pulls that pair up into the parent.
+ * This keeps the trie as shallow as its keys allow.
+ *
+ * Internal helpers return a node with a reference count the caller owns.
+ * Helpers that leave a node unchanged return it retained, which callers
+ * detect by pointer comparison.
+ */
+
+#include "map.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Mask selecting the hash bits of one trie level */
+#define TROVE_MAP_MASK ((1u << TROVE_MAP_BITS) - 1)
+
+/** @brief Number of set bits in a bitmap */
+static inline unsigned popcount(uint32_t bits) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_popcount(bits);
+#else
+    unsigned count = 0;
+    for (; bits; bits &= bits - 1) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+/** @brief Bitmap bit selected by a hash at a level shift */
+static inline uint32_t hash_bit(uint64_t hash, unsigned shift) {
+    return 1u << ((hash >> shift) & TROVE_MAP_MASK);
+}
+
+/** @brief Number of pairs stored in a node */
+static inline unsigned pair_count(TroveMapNode *node) {
+    return node->collisions ? node->collisions : popcount(node->datamap);
+}
+
+/** @brief Number of slots used by a node */
+static inline size_t slot_count(TroveMapNode *node) {
+    return 2 * (size_t)pair_count(node) + popcount(node->nodemap);
+}
+
+/** @brief Compares a stored key with a key given as bytes and hash */
+static inline int key_equals(TroveString *stored, const char *bytes, size_t length, uint64_t hash) {
+    return stored->hash == hash && stored->length == length && memcmp(stored->str, bytes, length) == 0;
+}
+
+/**
+ * @brief Allocates a node with uninitialized slots and a reference count of 1
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static TroveMapNode* node_alloc(uint32_t datamap, uint32_t nodemap, uint32_t collisions) {
+    size_t slots = collisions ? 2 * (size_t)collisions : 2 * (size_t)popcount(datamap) + popcount(nodemap);
+    TroveMapNode *node = (TroveMapNode *)malloc(sizeof(TroveMapNode) + slots * sizeof(ARCObject *));
+    if (!node) {
+        fprintf(stderr, "Failed to allocate TroveMapNode.\n");
+        exit(1);
+    }
+    arc_object_init(&node->base, TroveMapNode_dealloc, sizeof(TroveMapNode) + slots * sizeof(ARCObject *));
+    node->datamap = datamap;
+    node->nodemap = nodemap;
+    node->collisions = collisions;
+    return node;
+}
+
+/**
+ * @brief Builds an edited copy of a bitmap node
+ *
+ * The new node has the given bitmaps, which may differ from old's only at
+ * bit. At bit, it holds the pair key/value if key is non-NULL, or child if
+ * child is non-NULL; every other pair and child is taken from old. key,
+ * value and child are consumed.
+ *
+ * Normally the entries taken from old are retained and old is left intact.
+ * When steal is set, old must be uniquely owned by the caller: its entries
+ * are moved instead, the ones at bit that are not carried over are
+ * released, and old is freed.
+ *
+ * @param old Node to copy from (NULL when nothing is copied)
+ * @param datamap Pair bitmap of the new node
+ * @param nodemap Child bitmap of the new node
+ * @param bit The edited bit
+ * @param key Key of the new pair at bit, or NULL
+ * @param value Value of the new pair at bit
+ * @param child New child at bit, or NULL
+ * @param steal Non-zero to consume old
+ */
+static TroveMapNode* node_build(TroveMapNode *old, uint32_t datamap, uint32_t nodemap, uint32_t bit,
+                                TroveString *key, ARCObject *value, TroveMapNode *child, int steal) {
+    TroveMapNode *node = node_alloc(datamap, nodemap, 0);
+    ARCObject **out = node->slots;
+    for (uint32_t bits = datamap; bits; bits &= bits - 1) {
+        uint32_t b = bits & (~bits + 1);
+        if (b == bit && key) {
+            *out++ = (ARCObject *)key;
+            *out++ = value;
+        } else {
+            unsigned index = popcount(old->datamap & (b - 1));
+            ARCObject *old_key = old->slots[2 * index];
+            ARCObject *old_value = old->slots[2 * index + 1];
+            if (!steal) {
+                arc_retain(old_key);
+                arc_retain(old_value);
+            }
+            *out++ = old_key;
+            *out++ = old_value;
+        }
+    }
+    size_t old_children = old ? 2 * (size_t)popcount(old->datamap) : 0;
+    for (uint32_t bits = nodemap; bits; bits &= bits - 1) {
+        uint32_t b = bits & (~bits + 1);
+        if (b == bit && child) {
+            *out++ = (ARCObject *)child;
+        } else {
+            ARCObject *old_child = old->slots[old_children + popcount(old->nodemap & (b - 1))];
+            if (!steal) {
+                arc_retain(old_child);
+            }
+            *out++ = old_child;
+        }
+    }
+    if (steal) {
+        if ((old->datamap & bit) && (key || !(datamap & bit))) {
+            unsigned index = popcount(old->datamap & (bit - 1));
+            arc_release(old->slots[2 * index]);
+            arc_release(old->slots[2 * index + 1]);
+        }
+        if ((old->nodemap & bit) && (child || !(nodemap & bit))) {
+            arc_release(old->slots[old_children + popcount(old->nodemap & (bit - 1))]);
+        }
+        arc_object_free(&old->base);
+    }
+    return node;
+}
+
+/**
+ * @brief Builds a copy of a collision node with one pair removed, replaced or added
+ *
+ * The pair at skip is left out and key/value, if given, is appended, so
+ * passing both replaces a pair. key and value are consumed.
+ *
+ * @param old The collision node
+ * @param skip Index of a pair to leave out, or old->collisions for none
+ * @param key Key of a pair to append, or NULL
+ * @param value Value of that pair
+ */
+static TroveMapNode* collision_build(TroveMapNode *old, uint32_t skip, TroveString *key, ARCObject *value) {
+    uint32_t count = old->collisions + (key && skip == old->collisions) - (!key && skip < old->collisions);
+    TroveMapNode *node = node_alloc(0, 0, count);
+    ARCObject **out = node->slots;
+    for (uint32_t i = 0; i < old->collisions; i++) {
+        if (i == skip) {
+            continue;
+        }
+        arc_retain(old->slots[2 * i]);
+        arc_retain(old->slots[2 * i + 1]);
+        *out++ = old->slots[2 * i];
+        *out++ = old->slots[2 * i + 1];
+    }
+    if (key) {
+        *out++ = (ARCObject *)key;
+        *out++ = value;
+    }
+    return node;
+}
+
+/**
+ * @brief Creates the smallest subtree holding two pairs whose keys differ
+ *
+ * Consumes both keys and values.
+ */
+static TroveMapNode* node_merge(unsigned shift, TroveString *key1, ARCObject *value1, TroveString *key2, ARCObject *value2) {
+    if (shift >= 64) {
+        TroveMapNode *node = node_alloc(0, 0, 2);
+        node->slots[0] = (ARCObject *)key1;
+        node->slots[1] = value1;
+        node->slots[2] = (ARCObject *)key2;
+        node->slots[3] = value2;
+        return node;
+    }
+    uint32_t bit1 = hash_bit(key1->hash, shift);
+    uint32_t bit2 = hash_bit(key2->hash, shift);
+    if (bit1 == bit2) {
+        TroveMapNode *node = node_alloc(0, bit1, 0);
+        node->slots[0] = (ARCObject *)node_merge(shift + TROVE_MAP_BITS, key1, value1, key2, value2);
+        return node;
+    }
+    TroveMapNode *node = node_alloc(bit1 | bit2, 0, 0);
+    int first = bit1 < bit2 ? 0 : 2;
+    node->slots[first] = (ARCObject *)key1;
+    node->slots[first + 1] = value1;
+    node->slots[2 - first] = (ARCObject *)key2;
+    node->slots[3 - first] = value2;
+    return node;
+}
+
+/**
+ * @brief Returns node with key associated with value
+ *
+ * @param node The subtree (not consumed)
+ * @param shift Hash shift of the subtree's level
+ * @param key The key, with its hash cached
+ * @param value The value
+ * @param added Set to 1 if the key was not present
+ */
+static TroveMapNode* node_set(TroveMapNode *node, unsigned shift, TroveString *key, ARCObject *value, int *added) {
+    if (node->collisions) {
+        for (uint32_t i = 0; i < node->collisions; i++) {
+            if (key_equals((TroveString *)node->slots[2 * i], key->str, key->length, key->hash)) {
+                if (node->slots[2 * i + 1] == value) {
+                    arc_retain((ARCObject *)node);
+                    return node;
+                }
+                TroveString *stored = (TroveString *)node->slots[2 * i];
+                arc_retain((ARCObject *)stored);
+                arc_retain(value);
+                return collision_build(node, i, stored, value);
+            }
+        }
+        *added = 1;
+        arc_retain((ARCObject *)key);
+        arc_retain(value);
+        return collision_build(node, node->collisions, key, value);
+    }
+
+    uint32_t bit = hash_bit(key->hash, shift);
+    if (node->datamap & bit) {
+        unsigned index = popcount(node->datamap & (bit - 1));
+        TroveString *stored = (TroveString *)node->slots[2 * index];
+        ARCObject *stored_value = node->slots[2 * index + 1];
+        if (key_equals(stored, key->str, key->length, key->hash)) {
+            if (stored_value == value) {
+                arc_retain((ARCObject *)node);
+                return node;
+            }
+            arc_retain((ARCObject *)stored);
+            arc_retain(value);
+            return node_build(node, node->datamap, node->nodemap, bit, stored, value, NULL, 0);
+        }
+        *added = 1;
+        arc_retain((ARCObject *)stored);
+        arc_retain(stored_value);
+        arc_retain((ARCObject *)key);
+        arc_retain(value);
+        TroveMapNode *child = node_merge(shift + TROVE_MAP_BITS, stored, stored_value, key, value);
+        return node_build(node, node->datamap & ~bit, node->nodemap | bit, bit, NULL, NULL, child, 0);
+    }
+    if (node->nodemap & bit) {
+        TroveMapNode *child = (TroveMapNode *)node->slots[2 * popcount(node->datamap) + popcount(node->nodemap & (bit - 1))];
+        TroveMapNode *updated = node_set(child, shift + TROVE_MAP_BITS, key, value, added);
+        if (updated == child) {
+            arc_release((ARCObject *)updated);
+            arc_retain((ARCObject *)node);
+            return node;
+        }
+        return node_build(node, node->datamap, node->nodemap, bit, NULL, NULL, updated, 0);
+    }
+    *added = 1;
+    arc_retain((ARCObject *)key);
+    arc_retain(value);
+    return node_build(node, node->datamap | bit, node->nodemap, bit, key, value, NULL, 0);
+}
+
+/**
+ * @brief Returns non-zero if a node holds exactly one pair and no children
+ */
+static inline int is_singleton(TroveMapNode *node) {
+    return node->nodemap == 0 && pair_count(node) == 1;
+}
+
+/**
+ * @brief Returns node without key, or NULL if nothing remains
+ *
+ * @param node The subtree (not consumed)
+ * @param shift Hash shift of the subtree's level
+ * @param key The key, with its hash cached
+ * @param removed Set to 1 if the key was present
+ */
+static TroveMapNode* node_remove(TroveMapNode *node, unsigned shift, TroveString *key, int *removed) {
+    if (node->collisions) {
+        for (uint32_t i = 0; i < node->collisions; i++) {
+            if (key_equals((TroveString *)node->slots[2 * i], key->str, key->length, key->hash)) {
+                *removed = 1;
+                return node->collisions == 1 ? NULL : collision_build(node, i, NULL, NULL);
+            }
+        }
+        arc_retain((ARCObject *)node);
+        return node;
+    }
+
+    uint32_t bit = hash_bit(key->hash, shift);
+    if (node->datamap & bit) {
+        unsigned index = popcount(node->datamap & (bit - 1));
+        if (!key_equals((TroveString *)node->slots[2 * index], key->str, key->length, key->hash)) {
+            arc_retain((ARCObject *)node);
+            return node;
+        }
+        *removed = 1;
+        if (is_singleton(node)) {
+            return NULL;
+        }
+        return node_build(node, node->datamap & ~bit, node->nodemap, bit, NULL, NULL, NULL, 0);
+    }
+    if (node->nodemap & bit) {
+        TroveMapNode *child = (TroveMapNode *)node->slots[2 * popcount(node->datamap) + popcount(node->nodemap & (bit - 1))];
+        TroveMapNode *updated = node_remove(child, shift + TROVE_MAP_BITS, key, removed);
+        if (updated == child) {
+            arc_release((ARCObject *)updated);
+            arc_retain((ARCObject *)node);
+            return node;
+        }
+        if (!updated) {
+            if (node->datamap == 0 && node->nodemap == bit) {
+                return NULL;
+            }
+            return node_build(node, node->datamap, node->nodemap & ~bit, bit, NULL, NULL, NULL, 0);
+        }
+        if (is_singleton(updated)) {
+            TroveString *moved_key = (TroveString *)updated->slots[0];
+            ARCObject *moved_value = updated->slots[1];
+            arc_retain((ARCObject *)moved_key);
+            arc_retain(moved_value);
+            arc_release((ARCObject *)updated);
+            return node_build(node, node->datamap | bit, node->nodemap & ~bit, bit, moved_key, moved_value, NULL, 0);
+        }
+        return node_build(node, node->datamap, node->nodemap, bit, NULL, NULL, updated, 0);
+    }
+    arc_retain((ARCObject *)node);
+    return node;
+}
+
+/**
+ * @brief In-place Editing
+ *
+ * The helpers below take over the caller's reference to node, which must be
+ * reachable only through uniquely owned ancestors, and return what the
+ * caller should store in its place. A node whose own ref_count is 1 is then
+ * owned by the caller alone and is edited in place (or rebuilt by stealing
+ * its entries when its size changes). A shared node falls back to the
+ * persistent helpers, whose copies are unique for the next edit.
+ */
+
+/**
+ * @brief Associates key with value in a subtree, editing unique nodes in place
+ *
+ * @param node The subtree (consumed)
+ * @param shift Hash shift of the subtree's level
+ * @param key The key, with its hash cached
+ * @param value The value
+ * @param added Set to 1 if the key was not present
+ */
+static TroveMapNode* node_set_in_place(TroveMapNode *node, unsigned shift, TroveString *key, ARCObject *value, int *added) {
+    if (node->base.ref_count != 1) {
+        TroveMapNode *updated = node_set(node, shift, key, value, added);
+        arc_release((ARCObject *)node);
+        return updated;
+    }
+    if (node->collisions) {
+        for (uint32_t i = 0; i < node->collisions; i++) {
+            if (key_equals((TroveString *)node->slots[2 * i], key->str, key->length, key->hash)) {
+                ARCObject *old = node->slots[2 * i + 1];
+                arc_retain(value);
+                node->slots[2 * i + 1] = value;
+                arc_release(old);
+                return node;
+            }
+        }
+        TroveMapNode *updated = node_set(node, shift, key, value, added);
+        arc_release((ARCObject *)node);
+        return updated;
+    }
+
+    uint32_t bit = hash_bit(key->hash, shift);
+    if (node->datamap & bit) {
+        unsigned index = popcount(node->datamap & (bit - 1));
+        TroveString *stored = (TroveString *)node->slots[2 * index];
+        ARCObject *stored_value = node->slots[2 * index + 1];
+        if (key_equals(stored, key->str, key->length, key->hash)) {
+            arc_retain(value);
+            node->slots[2 * index + 1] = value;
+            arc_release(stored_value);
+            return node;
+        }
+        *added = 1;
+        arc_retain((ARCObject *)stored);
+        arc_retain(stored_value);
+        arc_retain((ARCObject *)key);
+        arc_retain(value);
+        TroveMapNode *child = node_merge(shift + TROVE_MAP_BITS, stored, stored_value, key, value);
+        return node_build(node, node->datamap & ~bit, node->nodemap | bit, bit, NULL, NULL, child, 1);
+    }
+    if (node->nodemap & bit) {
+        ARCObject **slot = &node->slots[2 * popcount(node->datamap) + popcount(node->nodemap & (bit - 1))];
+        *slot = (ARCObject *)node_set_in_place((TroveMapNode *)*slot, shift + TROVE_MAP_BITS, key, value, added);
+        return node;
+    }
+    *added = 1;
+    arc_retain((ARCObject *)key);
+    arc_retain(value);
+    return node_build(node, node->datamap | bit, node->nodemap, bit, key, value, NULL, 1);
+}
+
+/**
+ * @brief Removes key from a subtree, editing unique nodes in place
+ *
+ * @param node The subtree (consumed)
+ * @param shift Hash shift of the subtree's level
+ * @param key The key, with its hash cached
+ * @param removed Set to 1 if the key was present
+ * @return The edited subtree, or NULL if nothing remains
+ */
+static TroveMapNode* node_remove_in_place(TroveMapNode *node, unsigned shift, TroveString *key, int *removed) {
+    if (node->base.ref_count != 1 || node->collisions) {
+        TroveMapNode *updated = node_remove(node, shift, key, removed);
+        arc_release((ARCObject *)node);
+        return updated;
+    }
+
+    uint32_t bit = hash_bit(key->hash, shift);
+    if (node->datamap & bit) {
+        unsigned index = popcount(node->datamap & (bit - 1));
+        if (!key_equals((TroveString *)node->slots[2 * index], key->str, key->length, key->hash)) {
+            return node;
+        }
+        *removed = 1;
+        if (is_singleton(node)) {
+            arc_release((ARCObject *)node);
+            return NULL;
+        }
+        return node_build(node, node->datamap & ~bit, node->nodemap, bit, NULL, NULL, NULL, 1);
+    }
+    if (node->nodemap & bit) {
+        ARCObject **slot = &node->slots[2 * popcount(node->datamap) + popcount(node->nodemap & (bit - 1))];
+        TroveMapNode *updated = node_remove_in_place((TroveMapNode *)*slot, shift + TROVE_MAP_BITS, key, removed);
+        *slot = (ARCObject *)updated;
+        if (!updated) {
+            if (node->datamap == 0 && node->nodemap == bit) {
+                arc_object_free(&node->base);
+                return NULL;
+            }
+            return node_build(node, node->datamap, node->nodemap & ~bit, bit, NULL, NULL, NULL, 1);
+        }
+        if (is_singleton(updated)) {
+            TroveString *moved_key = (TroveString *)updated->slots[0];
+            ARCObject *moved_value = updated->slots[1];
+            arc_retain((ARCObject *)moved_key);
+            arc_retain(moved_value);
+            return node_build(node, node->datamap | bit, node->nodemap & ~bit, bit, moved_key, moved_value, NULL, 1);
+        }
+    }
+    return node;
+}
+
+/**
+ * @brief Creates a map, consuming root
+ */
+static TroveMap* map_new(size_t count, TroveMapNode *root) {
+    TroveMap *map = (TroveMap *)malloc(sizeof(TroveMap));
+    if (!map) {
+        fprintf(stderr, "Failed to allocate TroveMap.\n");
+        exit(1);
+    }
+    arc_object_init(&map->base, TroveMap_dealloc, sizeof(TroveMap));
+    map->count = count;
+    map->root = root;
+    return map;
+}
+
+/**
+ * @brief Finds the value slot for a key given as bytes and hash
+ */
+static ARCObject** map_lookup(TroveMap *map, const char *bytes, size_t length, uint64_t hash) {
+    TroveMapNode *node = map->root;
+    unsigned shift = 0;
+    while (node) {
+        if (node->collisions) {
+            for (uint32_t i = 0; i < node->collisions; i++) {
+                if (key_equals((TroveString *)node->slots[2 * i], bytes, length, hash)) {
+                    return &node->slots[2 * i + 1];
+                }
+            }
+            return NULL;
+        }
+        uint32_t bit = hash_bit(hash, shift);
+        if (node->datamap & bit) {
+            unsigned index = popcount(node->datamap & (bit - 1));
+            return key_equals((TroveString *)node->slots[2 * index], bytes, length, hash) ? &node->slots[2 * index + 1] : NULL;
+        }
+        if (!(node->nodemap & bit)) {
+            return NULL;
+        }
+        node = (TroveMapNode *)node->slots[2 * popcount(node->datamap) + popcount(node->nodemap & (bit - 1))];
+        shift += TROVE_MAP_BITS;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Creates an empty map
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @return A new TroveMap with a reference count of 1
+ */
+TroveMap* TroveMap_create(void) {
+    return map_new(0, NULL);
+}
+
+/**
+ * @brief Returns the number of pairs
+ *
+ * @param map The map
+ * @return Number of pairs
+ */
+size_t TroveMap_count(TroveMap *map) {
+    return map->count;
+}
+
+/**
+ * @brief Returns the value for a key without retaining it
+ *
+ * @param map The map
+ * @param key The key
+ * @return The value, or NULL when the key is absent
+ */
+ARCObject* TroveMap_get(TroveMap *map, TroveString *key) {
+    ARCObject **slot = map_lookup(map, key->str, key->length, TroveString_hash(key));
+    return slot ? *slot : NULL;
+}
+
+/**
+ * @brief Returns the value for a key given as bytes, without retaining it
+ *
+ * @param map The map
+ * @param bytes Key bytes
+ * @param length Number of key bytes
+ * @return The value, or NULL when the key is absent
+ */
+ARCObject* TroveMap_get_bytes(TroveMap *map, const char *bytes, size_t length) {
+    ARCObject **slot = map_lookup(map, bytes, length, trove_hash_bytes(bytes, length));
+    return slot ? *slot : NULL;
+}
+
+/**
+ * @brief Checks whether a key is present
+ *
+ * @param map The map
+ * @param key The key
+ * @return 1 if present, 0 otherwise
+ */
+int TroveMap_contains(TroveMap *map, TroveString *key) {
+    return map_lookup(map, key->str, key->length, TroveString_hash(key)) != NULL;
+}
+
+/**
+ * @brief Returns a map with a key associated with a value
+ *
+ * @param map The map
+ * @param key The key (retained if new)
+ * @param value The value (retained, may be NULL)
+ * @return A new TroveMap with a reference count of 1, or map itself retained
+ *         if the key already maps to value
+ */
+TroveMap* TroveMap_set(TroveMap *map, TroveString *key, ARCObject *value) {
+    TroveString_hash(key);
+    if (!map->root) {
+        arc_retain((ARCObject *)key);
+        arc_retain(value);
+        return map_new(1, node_build(NULL, hash_bit(key->hash, 0), 0, hash_bit(key->hash, 0), key, value, NULL, 0));
+    }
+    int added = 0;
+    TroveMapNode *root = node_set(map->root, 0, key, value, &added);
+    if (root == map->root) {
+        arc_release((ARCObject *)root);
+        arc_retain((ARCObject *)map);
+        return map;
+    }
+    return map_new(map->count + (size_t)added, root);
+}
+
+/**
+ * @brief Returns a map without a key
+ *
+ * @param map The map
+ * @param key The key
+ * @return A new TroveMap with a reference count of 1, or map itself retained
+ *         if the key is absent
+ */
+TroveMap* TroveMap_remove(TroveMap *map, TroveString *key) {
+    TroveString_hash(key);
+    int removed = 0;
+    TroveMapNode *root = map->root ? node_remove(map->root, 0, key, &removed) : NULL;
+    if (!removed) {
+        arc_release((ARCObject *)root);
+        arc_retain((ARCObject *)map);
+        return map;
+    }
+    return map_new(map->count - 1, root);
+}
+
+/**
+ * @brief Makes *map uniquely referenced, copying only the map header if shared
+ *
+ * The copy shares the whole trie with the original.
+ */
+static TroveMap* map_make_unique(TroveMap **map) {
+    TroveMap *original = *map;
+    if (original->base.ref_count == 1) {
+        return original;
+    }
+    arc_retain((ARCObject *)original->root);
+    TroveMap *copy = map_new(original->count, original->root);
+    arc_release((ARCObject *)original);
+    *map = copy;
+    return copy;
+}
+
+/**
+ * @brief Associates a key with a value, editing *map in place when possible
+ *
+ * Nodes referenced only through *map are modified in place; shared nodes
+ * are copied as by TroveMap_set, and the copies are then owned by *map, so
+ * a run of updates copies each shared node at most once.
+ *
+ * @param map Address of an owned reference; may be replaced with a copy
+ * @param key The key (retained if new)
+ * @param value The value (retained, may be NULL)
+ */
+void TroveMap_set_in_place(TroveMap **map, TroveString *key, ARCObject *value) {
+    TroveMap *edited = map_make_unique(map);
+    TroveString_hash(key);
+    if (!edited->root) {
+        TroveMap *updated = TroveMap_set(edited, key, value);
+        arc_release((ARCObject *)edited);
+        *map = updated;
+        return;
+    }
+    int added = 0;
+    edited->root = node_set_in_place(edited->root, 0, key, value, &added);
+    edited->count += (size_t)added;
+}
+
+/**
+ * @brief Removes a key, editing *map in place when possible
+ *
+ * @param map Address of an owned reference; may be replaced with a copy
+ * @param key The key
+ * @return 1 if the key was present, 0 otherwise
+ */
+int TroveMap_remove_in_place(TroveMap **map, TroveString *key) {
+    if (!TroveMap_contains(*map, key)) {
+        return 0;
+    }
+    TroveMap *edited = map_make_unique(map);
+    int removed = 0;
+    edited->root = node_remove_in_place(edited->root, 0, key, &removed);
+    edited->count -= (size_t)removed;
+    return removed;
+}
+
+/**
+ * @brief Prepares an iterator over the pairs of a map in unspecified order
+ *
+ * @param it Iterator to initialize
+ * @param map The map
+ */
+void TroveMap_iter_init(TroveMapIter *it, TroveMap *map) {
+    it->depth = 0;
+    if (map->root) {
+        it->nodes[0] = map->root;
+        it->positions[0] = 0;
+        it->depth = 1;
+    }
+}
+
+/**
+ * @brief Produces the next pair
+ *
+ * Each node's pairs are produced before descending into its children.
+ *
+ * @param it The iterator
+ * @param key Receives the key (not retained)
+ * @param value Receives the value (not retained)
+ * @return 1 if a pair was produced, 0 when iteration is done
+ */
+int TroveMap_iter_next(TroveMapIter *it, TroveString **key, ARCObject **value) {
+    while (it->depth > 0) {
+        TroveMapNode *node = it->nodes[it->depth - 1];
+        uint32_t position = it->positions[it->depth - 1]++;
+        unsigned pairs = pair_count(node);
+        if (position < pairs) {
+            *key = (TroveString *)node->slots[2 * position];
+            *value = node->slots[2 * position + 1];
+            return 1;
+        }
+        if (position < slot_count(node) - pairs) {
+            it->nodes[it->depth] = (TroveMapNode *)node->slots[pairs + position];
+            it->positions[it->depth] = 0;
+            it->depth++;
+        } else {
+            it->depth--;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Deallocates a TroveMap
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveMap_dealloc(ARCObject *obj) {
+    TroveMap *map = (TroveMap *)obj;
+    arc_release((ARCObject *)map->root);
+    arc_object_free(&map->base);
+}
+
+/**
+ * @brief Deallocates a TroveMapNode, releasing its pairs and children
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveMapNode_dealloc(ARCObject *obj) {
+    TroveMapNode *node = (TroveMapNode *)obj;
+    arc_release_all(node->slots, slot_count(node));
+    arc_object_free(&node->base);
+}
@@ -0,0 +1,204 @@
+/**
+ * @file map.h
+ * @brief Persistent hash maps for the Trove ARC memory management system
+ *
+ * A TroveMap is an immutable map from TroveString keys to ARC objects, stored
+ * as a hash array mapped trie (HAMT) in the compact CHAMP layout: each node
+ * consumes 5 bits of the key's cached hash and keeps two bitmaps, one for
+ * key/value pairs stored inline and one for child nodes. Nodes are ARC
+ * objects, so an update copies only the O(log32 n) nodes on the path to the
+ * key and shares every other subtree with the previous version. Releasing
+ * an old version frees exactly the nodes no other version shares.
+ *
+ * Update functions return a new map and leave their input unchanged. The
+ * _in_place variants instead edit nodes that only the caller's map
+ * references, which makes building a map with many updates as cheap as
+ * filling a mutable one. Keys must not be mutated while stored, as with
+ * TroveDictionary.
+ */
+
+#ifndef MAP_H
+#define MAP_H
+
+#include "trove.h"
+#include <stdint.h>
+
+/** @brief Number of hash bits consumed per trie level */
+#define TROVE_MAP_BITS 5
+
+/** @brief Maximum trie depth: 13 bitmap levels cover 64 hash bits, then one collision level */
+#define TROVE_MAP_MAX_DEPTH 14
+
+/**
+ * @brief Trie node managed by ARC
+ *
+ * A bitmap node stores its pairs first, in bit order, followed by its
+ * children, in bit order. Below the last bitmap level, keys with identical
+ * hashes share a collision node, which has both bitmaps zero and stores
+ * only pairs.
+ */
+typedef struct TroveMapNode {
+    ARCObject base;         /**< Inheritance: must be the first member */
+    uint32_t datamap;       /**< Bit i set when hash chunk i has an inline pair */
+    uint32_t nodemap;       /**< Bit i set when hash chunk i has a child node */
+    uint32_t collisions;    /**< Collision nodes only: number of pairs, otherwise 0 */
+    ARCObject *slots[];     /**< Retained keys and values, then retained children */
+} TroveMapNode;
+
+/**
+ * @brief Persistent map managed by ARC
+ */
+typedef struct TroveMap {
+    ARCObject base;         /**< Inheritance: must be the first member */
+    size_t count;           /**< Number of pairs */
+    TroveMapNode *root;     /**< Retained trie root, NULL when empty */
+} TroveMap;
+
+/**
+ * @brief Iterator state for walking the pairs of a map
+ *
+ * Declare on the stack and initialize with TroveMap_iter_init. The map must
+ * stay alive while the iterator is in use.
+ */
+typedef struct TroveMapIter {
+    TroveMapNode *nodes[TROVE_MAP_MAX_DEPTH];    /**< Nodes on the current path */
+    uint32_t positions[TROVE_MAP_MAX_DEPTH];     /**< Next pair or child to visit in each node */
+    int depth;                                   /**< Number of nodes on the path */
+} TroveMapIter;
+
+/**
+ * @brief Creates an empty map
+ *
+ * @return A new TroveMap with a reference count of 1
+ */
+TroveMap* TroveMap_create(void);
+
+/**
+ * @brief Returns the number of pairs
+ *
+ * @param map The map
+ * @return Number of pairs
+ */
+size_t TroveMap_count(TroveMap *map);
+
+/**
+ * @brief Returns the value for a key without retaining it
+ *
+ * @param map The map
+ * @param key The key
+ * @return The value, or NULL when the key is absent
+ */
+ARCObject* TroveMap_get(TroveMap *map, TroveString *key);
+
+/**
+ * @brief Returns the value for a key given as bytes, without retaining it
+ *
+ * @param map The map
+ * @param bytes Key bytes
+ * @param length Number of key bytes
+ * @return The value, or NULL when the key is absent
+ */
+ARCObject* TroveMap_get_bytes(TroveMap *map, const char *bytes, size_t length);
+
+/**
+ * @brief Checks whether a key is present
+ *
+ * @param map The map
+ * @param key The key
+ * @return 1 if present, 0 otherwise
+ */
+int TroveMap_contains(TroveMap *map, TroveString *key);
+
+/**
+ * @brief Returns a map with a key associated with a value
+ *
+ * When the key is already present, the stored key object is kept and only
+ * the value is replaced.
+ *
+ * @param map The map
+ * @param key The key (retained if new)
+ * @param value The value (retained, may be NULL)
+ * @return A new TroveMap with a reference count of 1, or map itself retained
+ *         if the key already maps to value
+ */
+TroveMap* TroveMap_set(TroveMap *map, TroveString *key, ARCObject *value);
+
+/**
+ * @brief Returns a map without a key
+ *
+ * @param map The map
+ * @param key The key
+ * @return A new TroveMap with a reference count of 1, or map itself retained
+ *         if the key is absent
+ */
+TroveMap* TroveMap_remove(TroveMap *map, TroveString *key);
+
+/**
+ * @brief Associates a key with a value, editing *map in place when possible
+ *
+ * This is the transient counterpart of TroveMap_set. When the caller holds
+ * the only reference to *map, nodes that no other version shares are
+ * updated in place. Otherwise *map is replaced by a new version (the
+ * caller's reference to the old one is released) that shares as much as
+ * TroveMap_set would, and later in-place updates reuse the copied path.
+ *
+ * @param map Address of an owned reference; may be replaced with a copy
+ * @param key The key (retained if new)
+ * @param value The value (retained, may be NULL)
+ */
+void TroveMap_set_in_place(TroveMap **map, TroveString *key, ARCObject *value);
+
+/**
+ * @brief Removes a key, editing *map in place when possible
+ *
+ * The transient counterpart of TroveMap_remove; see TroveMap_set_in_place.
+ *
+ * @param map Address of an owned reference; may be replaced with a copy
+ * @param key The key
+ * @return 1 if the key was present, 0 otherwise
+ */
+int TroveMap_remove_in_place(TroveMap **map, TroveString *key);
+
+/**
+ * @brief Prepares an iterator over the pairs of a map in unspecified order
+ *
+ * @param it Iterator to initialize
+ * @param map The map
+ */
+void TroveMap_iter_init(TroveMapIter *it, TroveMap *map);
+
+/**
+ * @brief Produces the next pair
+ *
+ * @code
+ * TroveMapIter it;
+ * TroveString *key;
+ * ARCObject *value;
+ * TroveMap_iter_init(&it, map);
+ * while (TroveMap_iter_next(&it, &key, &value)) { ... }
+ * @endcode
+ *
+ * @param it The iterator
+ * @param key Receives the key (not retained)
+ * @param value Receives the value (not retained)
+ * @return 1 if a pair was produced, 0 when iteration is done
+ */
+int TroveMap_iter_next(TroveMapIter *it, TroveString **key, ARCObject **value);
+
+/**
+ * @brief Deallocates a TroveMap
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveMap_dealloc(ARCObject *obj);
+
+/**
+ * @brief Deallocates a TroveMapNode, releasing its pairs and children
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveMapNode_dealloc(ARCObject *obj);
+
+#endif // MAP_H
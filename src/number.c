@@ -0,0 +1,648 @@
+/**
+ * @file number.c
+ * @brief Implementation of fast number formatting and parsing
+ *
+ * The Grisu2 implementation follows Florian Loitsch, "Printing Floating-Point
+ * Numbers Quickly and Accurately with Integers" (PLDI 2010). The parsing fast
+ * path is Clinger's: a decimal significand below 2^53 scaled by a power of
+ * ten no larger than 10^22 is computed exactly by one IEEE multiplication or
+ * division, which assumes FLT_EVAL_METHOD == 0 (any SSE2 or AArch64 target).
+ */
+
+#include "number.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/** @brief "00" through "99", indexed by twice the two-digit value */
+static const char digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/** @brief Powers of ten representable exactly as uint64_t */
+static const uint64_t pow10_u64[20] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/** @brief Powers of ten representable exactly as double */
+static const double pow10_f64[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * @brief Integer Formatting
+ */
+
+/**
+ * @brief Formats an unsigned integer in decimal
+ *
+ * Digits are emitted two at a time, back to front, from digit_pairs.
+ *
+ * @param value The value to format
+ * @param buf Destination of at least TROVE_NUMBER_BUFFER_SIZE bytes
+ * @return Number of bytes written, excluding the terminator
+ */
+size_t trove_format_uint64(uint64_t value, char *buf) {
+    char tmp[20];
+    size_t pos = sizeof(tmp);
+    while (value >= 100) {
+        unsigned idx = (unsigned)(value % 100) * 2;
+        value /= 100;
+        tmp[--pos] = digit_pairs[idx + 1];
+        tmp[--pos] = digit_pairs[idx];
+    }
+    if (value >= 10) {
+        unsigned idx = (unsigned)value * 2;
+        tmp[--pos] = digit_pairs[idx + 1];
+        tmp[--pos] = digit_pairs[idx];
+    } else {
+        tmp[--pos] = (char)('0' + value);
+    }
+    size_t length = sizeof(tmp) - pos;
+    memcpy(buf, tmp + pos, length);
+    buf[length] = '\0';
+    return length;
+}
+
+/**
+ * @brief Formats a signed integer in decimal
+ *
+ * @param value The value to format
+ * @param buf Destination of at least TROVE_NUMBER_BUFFER_SIZE bytes
+ * @return Number of bytes written, excluding the terminator
+ */
+size_t trove_format_int64(int64_t value, char *buf) {
+    if (value < 0) {
+        buf[0] = '-';
+        return 1 + trove_format_uint64(0ULL - (uint64_t)value, buf + 1);
+    }
+    return trove_format_uint64((uint64_t)value, buf);
+}
+
+/**
+ * @brief Grisu2 Double Formatting
+ */
+
+/** @brief Floating-point value f * 2^e with a 64-bit significand */
+typedef struct DiyFp {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+#define DIY_SIGNIFICAND_SIZE 64
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_MIN_EXPONENT (-DP_EXPONENT_BIAS)
+#define DP_EXPONENT_MASK 0x7FF0000000000000ULL
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+
+/**
+ * @brief Normalized powers of ten 10^k for k = -348, -340, ..., 340
+ *
+ * Each entry is the 64-bit significand (rounded to nearest) and binary
+ * exponent of the power.
+ */
+static const DiyFp cached_powers[87] = {
+    { 0xfa8fd5a0081c0288ULL, -1220 }, { 0xbaaee17fa23ebf76ULL, -1193 }, { 0x8b16fb203055ac76ULL, -1166 },
+    { 0xcf42894a5dce35eaULL, -1140 }, { 0x9a6bb0aa55653b2dULL, -1113 }, { 0xe61acf033d1a45dfULL, -1087 },
+    { 0xab70fe17c79ac6caULL, -1060 }, { 0xff77b1fcbebcdc4fULL, -1034 }, { 0xbe5691ef416bd60cULL, -1007 },
+    { 0x8dd01fad907ffc3cULL, -980 }, { 0xd3515c2831559a83ULL, -954 }, { 0x9d71ac8fada6c9b5ULL, -927 },
+    { 0xea9c227723ee8bcbULL, -901 }, { 0xaecc49914078536dULL, -874 }, { 0x823c12795db6ce57ULL, -847 },
+    { 0xc21094364dfb5637ULL, -821 }, { 0x9096ea6f3848984fULL, -794 }, { 0xd77485cb25823ac7ULL, -768 },
+    { 0xa086cfcd97bf97f4ULL, -741 }, { 0xef340a98172aace5ULL, -715 }, { 0xb23867fb2a35b28eULL, -688 },
+    { 0x84c8d4dfd2c63f3bULL, -661 }, { 0xc5dd44271ad3cdbaULL, -635 }, { 0x936b9fcebb25c996ULL, -608 },
+    { 0xdbac6c247d62a584ULL, -582 }, { 0xa3ab66580d5fdaf6ULL, -555 }, { 0xf3e2f893dec3f126ULL, -529 },
+    { 0xb5b5ada8aaff80b8ULL, -502 }, { 0x87625f056c7c4a8bULL, -475 }, { 0xc9bcff6034c13053ULL, -449 },
+    { 0x964e858c91ba2655ULL, -422 }, { 0xdff9772470297ebdULL, -396 }, { 0xa6dfbd9fb8e5b88fULL, -369 },
+    { 0xf8a95fcf88747d94ULL, -343 }, { 0xb94470938fa89bcfULL, -316 }, { 0x8a08f0f8bf0f156bULL, -289 },
+    { 0xcdb02555653131b6ULL, -263 }, { 0x993fe2c6d07b7facULL, -236 }, { 0xe45c10c42a2b3b06ULL, -210 },
+    { 0xaa242499697392d3ULL, -183 }, { 0xfd87b5f28300ca0eULL, -157 }, { 0xbce5086492111aebULL, -130 },
+    { 0x8cbccc096f5088ccULL, -103 }, { 0xd1b71758e219652cULL, -77 }, { 0x9c40000000000000ULL, -50 },
+    { 0xe8d4a51000000000ULL, -24 }, { 0xad78ebc5ac620000ULL, 3 }, { 0x813f3978f8940984ULL, 30 },
+    { 0xc097ce7bc90715b3ULL, 56 }, { 0x8f7e32ce7bea5c70ULL, 83 }, { 0xd5d238a4abe98068ULL, 109 },
+    { 0x9f4f2726179a2245ULL, 136 }, { 0xed63a231d4c4fb27ULL, 162 }, { 0xb0de65388cc8ada8ULL, 189 },
+    { 0x83c7088e1aab65dbULL, 216 }, { 0xc45d1df942711d9aULL, 242 }, { 0x924d692ca61be758ULL, 269 },
+    { 0xda01ee641a708deaULL, 295 }, { 0xa26da3999aef774aULL, 322 }, { 0xf209787bb47d6b85ULL, 348 },
+    { 0xb454e4a179dd1877ULL, 375 }, { 0x865b86925b9bc5c2ULL, 402 }, { 0xc83553c5c8965d3dULL, 428 },
+    { 0x952ab45cfa97a0b3ULL, 455 }, { 0xde469fbd99a05fe3ULL, 481 }, { 0xa59bc234db398c25ULL, 508 },
+    { 0xf6c69a72a3989f5cULL, 534 }, { 0xb7dcbf5354e9beceULL, 561 }, { 0x88fcf317f22241e2ULL, 588 },
+    { 0xcc20ce9bd35c78a5ULL, 614 }, { 0x98165af37b2153dfULL, 641 }, { 0xe2a0b5dc971f303aULL, 667 },
+    { 0xa8d9d1535ce3b396ULL, 694 }, { 0xfb9b7cd9a4a7443cULL, 720 }, { 0xbb764c4ca7a44410ULL, 747 },
+    { 0x8bab8eefb6409c1aULL, 774 }, { 0xd01fef10a657842cULL, 800 }, { 0x9b10a4e5e9913129ULL, 827 },
+    { 0xe7109bfba19c0c9dULL, 853 }, { 0xac2820d9623bf429ULL, 880 }, { 0x80444b5e7aa7cf85ULL, 907 },
+    { 0xbf21e44003acdd2dULL, 933 }, { 0x8e679c2f5e44ff8fULL, 960 }, { 0xd433179d9c8cb841ULL, 986 },
+    { 0x9e19db92b4e31ba9ULL, 1013 }, { 0xeb96bf6ebadf77d9ULL, 1039 }, { 0xaf87023b9bf0ee6bULL, 1066 },
+};
+
+/** @brief Multiplies two DiyFp values, keeping the rounded upper 64 bits */
+static DiyFp diy_multiply(DiyFp x, DiyFp y) {
+    const uint64_t M32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1ULL << 31;
+    DiyFp r = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+    return r;
+}
+
+/** @brief Shifts the significand left until its top bit is set */
+static DiyFp diy_normalize(DiyFp x) {
+    while (!(x.f & (1ULL << 63))) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/**
+ * @brief Computes the normalized boundaries m- and m+ of a double
+ *
+ * Both boundaries share the exponent of m+.
+ */
+static void diy_boundaries(DiyFp v, DiyFp *minus, DiyFp *plus) {
+    DiyFp pl = { (v.f << 1) + 1, v.e - 1 };
+    while (!(pl.f & (DP_HIDDEN_BIT << 1))) {
+        pl.f <<= 1;
+        pl.e--;
+    }
+    pl.f <<= DIY_SIGNIFICAND_SIZE - DP_SIGNIFICAND_SIZE - 2;
+    pl.e -= DIY_SIGNIFICAND_SIZE - DP_SIGNIFICAND_SIZE - 2;
+    DiyFp mi;
+    if (v.f == DP_HIDDEN_BIT) {
+        mi.f = (v.f << 2) - 1;
+        mi.e = v.e - 2;
+    } else {
+        mi.f = (v.f << 1) - 1;
+        mi.e = v.e - 1;
+    }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+    *minus = mi;
+    *plus = pl;
+}
+
+/**
+ * @brief Selects the cached power c = 10^-K that scales exponent e into [-60, -32]
+ */
+static DiyFp cached_power(int e, int *K) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if (dk - k > 0.0) {
+        k++;
+    }
+    unsigned index = (unsigned)((k >> 3) + 1);
+    *K = -(-348 + (int)(index << 3));
+    return cached_powers[index];
+}
+
+/** @brief Moves the last generated digit closer to the exact value when possible */
+static void grisu_round(char *buffer, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+/** @brief Returns the number of decimal digits of n */
+static int count_digits32(uint32_t n) {
+    int count = 1;
+    while (count < 10 && n >= pow10_u64[count]) {
+        count++;
+    }
+    return count;
+}
+
+/** @brief Generates the digits of Mp that fall inside the rounding interval */
+static void digit_gen(DiyFp W, DiyFp Mp, uint64_t delta, char *buffer, int *length, int *K) {
+    DiyFp one = { 1ULL << -Mp.e, Mp.e };
+    uint64_t wp_w = Mp.f - W.f;
+    uint32_t p1 = (uint32_t)(Mp.f >> -one.e);
+    uint64_t p2 = Mp.f & (one.f - 1);
+    int kappa = count_digits32(p1);
+    *length = 0;
+
+    while (kappa > 0) {
+        uint32_t divisor = (uint32_t)pow10_u64[kappa - 1];
+        uint32_t d = p1 / divisor;
+        p1 %= divisor;
+        if (d || *length) {
+            buffer[(*length)++] = (char)('0' + d);
+        }
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *K += kappa;
+            grisu_round(buffer, *length, delta, rest, pow10_u64[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || *length) {
+            buffer[(*length)++] = (char)('0' + d);
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *K += kappa;
+            int index = -kappa;
+            grisu_round(buffer, *length, delta, p2, one.f, wp_w * (index < 20 ? pow10_u64[index] : 0));
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Produces the digits and decimal exponent of a positive finite double
+ *
+ * On return value == digits * 10^K.
+ */
+static void grisu2(uint64_t bits, char *buffer, int *length, int *K) {
+    int biased_e = (int)((bits & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+    uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+    DiyFp v;
+    if (biased_e != 0) {
+        v.f = significand + DP_HIDDEN_BIT;
+        v.e = biased_e - DP_EXPONENT_BIAS;
+    } else {
+        v.f = significand;
+        v.e = DP_MIN_EXPONENT + 1;
+    }
+
+    DiyFp w_m, w_p;
+    diy_boundaries(v, &w_m, &w_p);
+    DiyFp c_mk = cached_power(w_p.e, K);
+    DiyFp W = diy_multiply(diy_normalize(v), c_mk);
+    DiyFp Wp = diy_multiply(w_p, c_mk);
+    DiyFp Wm = diy_multiply(w_m, c_mk);
+    Wm.f++;
+    Wp.f--;
+    digit_gen(W, Wp, Wp.f - Wm.f, buffer, length, K);
+}
+
+/** @brief Writes a signed decimal exponent such as "+21" or "-7" */
+static int write_exponent(int exponent, char *buf) {
+    int length = 0;
+    buf[length++] = exponent < 0 ? '-' : '+';
+    if (exponent < 0) {
+        exponent = -exponent;
+    }
+    if (exponent >= 100) {
+        buf[length++] = (char)('0' + exponent / 100);
+        exponent %= 100;
+        buf[length++] = digit_pairs[exponent * 2];
+        buf[length++] = digit_pairs[exponent * 2 + 1];
+    } else if (exponent >= 10) {
+        buf[length++] = digit_pairs[exponent * 2];
+        buf[length++] = digit_pairs[exponent * 2 + 1];
+    } else {
+        buf[length++] = (char)('0' + exponent);
+    }
+    return length;
+}
+
+/**
+ * @brief Lays out digits * 10^k as decimal or scientific notation in place
+ *
+ * @return Number of bytes written, excluding the terminator
+ */
+static int prettify(char *buffer, int length, int k) {
+    int kk = length + k;  // 10^(kk-1) <= value < 10^kk
+
+    if (k >= 0 && kk <= 21) {
+        // 1234e3 -> 1234000
+        for (int i = length; i < kk; i++) {
+            buffer[i] = '0';
+        }
+        buffer[kk] = '\0';
+        return kk;
+    }
+    if (0 < kk && kk <= 21) {
+        // 1234e-2 -> 12.34
+        memmove(&buffer[kk + 1], &buffer[kk], (size_t)(length - kk));
+        buffer[kk] = '.';
+        buffer[length + 1] = '\0';
+        return length + 1;
+    }
+    if (-6 < kk && kk <= 0) {
+        // 1234e-6 -> 0.001234
+        int offset = 2 - kk;
+        memmove(&buffer[offset], &buffer[0], (size_t)length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for (int i = 2; i < offset; i++) {
+            buffer[i] = '0';
+        }
+        buffer[length + offset] = '\0';
+        return length + offset;
+    }
+    if (length == 1) {
+        // 1e30
+        buffer[1] = 'e';
+        int n = 2 + write_exponent(kk - 1, &buffer[2]);
+        buffer[n] = '\0';
+        return n;
+    }
+    // 1234e30 -> 1.234e+33
+    memmove(&buffer[2], &buffer[1], (size_t)(length - 1));
+    buffer[1] = '.';
+    buffer[length + 1] = 'e';
+    int n = length + 2 + write_exponent(kk - 1, &buffer[length + 2]);
+    buffer[n] = '\0';
+    return n;
+}
+
+/**
+ * @brief Formats a double with the shortest round-trip representation
+ *
+ * @param value The value to format
+ * @param buf Destination of at least TROVE_NUMBER_BUFFER_SIZE bytes
+ * @return Number of bytes written, excluding the terminator
+ */
+size_t trove_format_double(double value, char *buf) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    char *p = buf;
+    int negative = (bits >> 63) != 0;
+    bits &= ~(1ULL << 63);
+
+    if ((bits & DP_EXPONENT_MASK) == DP_EXPONENT_MASK) {
+        if (bits & DP_SIGNIFICAND_MASK) {
+            memcpy(buf, "nan", 4);
+            return 3;
+        }
+        if (negative) {
+            *p++ = '-';
+        }
+        memcpy(p, "inf", 4);
+        return (size_t)(p - buf) + 3;
+    }
+    if (negative) {
+        *p++ = '-';
+    }
+    if (bits == 0) {
+        p[0] = '0';
+        p[1] = '\0';
+        return (size_t)(p - buf) + 1;
+    }
+    int length, K;
+    grisu2(bits, p, &length, &K);
+    return (size_t)(p - buf) + (size_t)prettify(p, length, K);
+}
+
+/**
+ * @brief Parsing
+ */
+
+/**
+ * @brief Parses a decimal unsigned integer occupying exactly length bytes
+ *
+ * @param bytes The text to parse
+ * @param length Number of bytes to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input or overflow
+ */
+int trove_parse_uint64(const char *bytes, size_t length, uint64_t *out) {
+    size_t i = 0;
+    if (i < length && bytes[i] == '+') {
+        i++;
+    }
+    if (i == length) {
+        return 0;
+    }
+    uint64_t value = 0;
+    for (; i < length; i++) {
+        unsigned d = (unsigned)((unsigned char)bytes[i] - '0');
+        if (d > 9 || value > (UINT64_MAX - d) / 10) {
+            return 0;
+        }
+        value = value * 10 + d;
+    }
+    *out = value;
+    return 1;
+}
+
+/**
+ * @brief Parses a decimal signed integer occupying exactly length bytes
+ *
+ * @param bytes The text to parse
+ * @param length Number of bytes to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input or overflow
+ */
+int trove_parse_int64(const char *bytes, size_t length, int64_t *out) {
+    int negative = length > 0 && bytes[0] == '-';
+    uint64_t magnitude;
+    if (negative) {
+        if (length < 2 || bytes[1] == '+' || !trove_parse_uint64(bytes + 1, length - 1, &magnitude)) {
+            return 0;
+        }
+    } else if (!trove_parse_uint64(bytes, length, &magnitude)) {
+        return 0;
+    }
+    uint64_t limit = negative ? (1ULL << 63) : (1ULL << 63) - 1;
+    if (magnitude > limit) {
+        return 0;
+    }
+    *out = negative ? (int64_t)(0ULL - magnitude) : (int64_t)magnitude;
+    return 1;
+}
+
+/**
+ * @brief Parses with strtod, requiring the whole range to be consumed
+ *
+ * Copies the bytes to add a terminator, since slices are not null-terminated.
+ */
+static int parse_double_slow(const char *bytes, size_t length, double *out) {
+    char stack_buf[64];
+    char *buf = stack_buf;
+    if (length == 0 || bytes[0] == ' ' || (bytes[0] >= '\t' && bytes[0] <= '\r')) {
+        return 0;
+    }
+    if (length >= sizeof(stack_buf)) {
+        buf = (char *)malloc(length + 1);
+        if (!buf) {
+            fprintf(stderr, "Failed to allocate number parse buffer.\n");
+            exit(1);
+        }
+    }
+    memcpy(buf, bytes, length);
+    buf[length] = '\0';
+    char *end;
+    double value = strtod(buf, &end);
+    int ok = end == buf + length;
+    if (buf != stack_buf) {
+        free(buf);
+    }
+    if (ok) {
+        *out = value;
+    }
+    return ok;
+}
+
+/**
+ * @brief Parses a floating-point number occupying exactly length bytes
+ *
+ * Plain decimal input with at most 19 significant digits whose value is
+ * significand * 10^e with significand <= 2^53 and |e| <= 22 is converted
+ * exactly without calling strtod. Anything else (more digits, large
+ * exponents, hex floats, inf/nan) goes through strtod.
+ *
+ * @param bytes The text to parse
+ * @param length Number of bytes to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input
+ */
+int trove_parse_double(const char *bytes, size_t length, double *out) {
+    const char *p = bytes;
+    const char *end = bytes + length;
+    int negative = 0;
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    int any_digits = 0;
+    int truncated = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    for (; p < end && (unsigned)(*p - '0') <= 9; p++) {
+        any_digits = 1;
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            significant += mantissa != 0;
+        } else {
+            exponent++;
+            truncated |= *p != '0';
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && (unsigned)(*p - '0') <= 9; p++) {
+            any_digits = 1;
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                significant += mantissa != 0;
+                exponent--;
+            } else {
+                truncated |= *p != '0';
+            }
+        }
+    }
+    if (any_digits && p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        int exp_negative = 0;
+        int exp_value = 0;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exp_negative = *p == '-';
+            p++;
+        }
+        if (p == end || (unsigned)(*p - '0') > 9) {
+            return 0;
+        }
+        for (; p < end && (unsigned)(*p - '0') <= 9; p++) {
+            if (exp_value < 100000) {
+                exp_value = exp_value * 10 + (*p - '0');
+            }
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+    if (!any_digits || p != end || truncated) {
+        return parse_double_slow(bytes, length, out);
+    }
+
+    double value;
+    if (mantissa == 0) {
+        value = 0.0;
+    } else if (mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+        value = (double)mantissa;
+        value = exponent < 0 ? value / pow10_f64[-exponent] : value * pow10_f64[exponent];
+    } else {
+        return parse_double_slow(bytes, length, out);
+    }
+    *out = negative ? -value : value;
+    return 1;
+}
+
+/**
+ * @brief TroveString Conversions
+ */
+
+/**
+ * @brief Creates a string holding the decimal form of a signed integer
+ *
+ * @param value The value to format
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_from_int64(int64_t value) {
+    char buf[TROVE_NUMBER_BUFFER_SIZE];
+    return TroveString_create_with_length(buf, trove_format_int64(value, buf));
+}
+
+/**
+ * @brief Creates a string holding the decimal form of an unsigned integer
+ *
+ * @param value The value to format
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_from_uint64(uint64_t value) {
+    char buf[TROVE_NUMBER_BUFFER_SIZE];
+    return TroveString_create_with_length(buf, trove_format_uint64(value, buf));
+}
+
+/**
+ * @brief Creates a string holding the shortest round-trip form of a double
+ *
+ * @param value The value to format
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_from_double(double value) {
+    char buf[TROVE_NUMBER_BUFFER_SIZE];
+    return TroveString_create_with_length(buf, trove_format_double(value, buf));
+}
+
+/**
+ * @brief Parses a whole string as a signed integer
+ *
+ * @param str The string to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input or overflow
+ */
+int TroveString_parse_int64(TroveString *str, int64_t *out) {
+    return trove_parse_int64(str->str, str->length, out);
+}
+
+/**
+ * @brief Parses a whole string as an unsigned integer
+ *
+ * @param str The string to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input or overflow
+ */
+int TroveString_parse_uint64(TroveString *str, uint64_t *out) {
+    return trove_parse_uint64(str->str, str->length, out);
+}
+
+/**
+ * @brief Parses a whole string as a double
+ *
+ * @param str The string to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input
+ */
+int TroveString_parse_double(TroveString *str, double *out) {
+    return trove_parse_double(str->str, str->length, out);
+}
@@ -0,0 +1,139 @@
+/**
+ * @file number.h
+ * @brief Fast number formatting and parsing for TroveString
+ *
+ * Integers are formatted two digits at a time from a lookup table. Doubles
+ * are formatted with the Grisu2 algorithm, which produces the shortest (or,
+ * in rare cases, a near-shortest) digit string that parses back to exactly the
+ * same value. Parsing handles the common case of at most 19 significant
+ * digits and small exponents with exact floating-point arithmetic and falls
+ * back to strtod for everything else, so results are always correctly
+ * rounded.
+ *
+ * Doubles use JavaScript-style notation: plain decimals for magnitudes from
+ * 1e-6 up to 1e21, scientific notation ("1.5e+300") outside that range, and
+ * "nan", "inf" and "-inf" for non-finite values.
+ */
+
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include "trove.h"
+#include <stdint.h>
+
+/** @brief Buffer size sufficient for any formatted number, including the terminator */
+#define TROVE_NUMBER_BUFFER_SIZE 32
+
+/**
+ * @brief Formats an unsigned integer in decimal
+ *
+ * @param value The value to format
+ * @param buf Destination of at least TROVE_NUMBER_BUFFER_SIZE bytes
+ * @return Number of bytes written, excluding the terminator
+ */
+size_t trove_format_uint64(uint64_t value, char *buf);
+
+/**
+ * @brief Formats a signed integer in decimal
+ *
+ * @param value The value to format
+ * @param buf Destination of at least TROVE_NUMBER_BUFFER_SIZE bytes
+ * @return Number of bytes written, excluding the terminator
+ */
+size_t trove_format_int64(int64_t value, char *buf);
+
+/**
+ * @brief Formats a double with the shortest round-trip representation
+ *
+ * @param value The value to format
+ * @param buf Destination of at least TROVE_NUMBER_BUFFER_SIZE bytes
+ * @return Number of bytes written, excluding the terminator
+ */
+size_t trove_format_double(double value, char *buf);
+
+/**
+ * @brief Parses a decimal unsigned integer occupying exactly length bytes
+ *
+ * An optional leading '+' is accepted. Whitespace and trailing bytes are not.
+ *
+ * @param bytes The text to parse
+ * @param length Number of bytes to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input or overflow
+ */
+int trove_parse_uint64(const char *bytes, size_t length, uint64_t *out);
+
+/**
+ * @brief Parses a decimal signed integer occupying exactly length bytes
+ *
+ * @param bytes The text to parse
+ * @param length Number of bytes to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input or overflow
+ */
+int trove_parse_int64(const char *bytes, size_t length, int64_t *out);
+
+/**
+ * @brief Parses a floating-point number occupying exactly length bytes
+ *
+ * Accepts everything strtod accepts, provided it spans the whole range.
+ *
+ * @param bytes The text to parse
+ * @param length Number of bytes to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input
+ */
+int trove_parse_double(const char *bytes, size_t length, double *out);
+
+/**
+ * @brief Creates a string holding the decimal form of a signed integer
+ *
+ * @param value The value to format
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_from_int64(int64_t value);
+
+/**
+ * @brief Creates a string holding the decimal form of an unsigned integer
+ *
+ * @param value The value to format
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_from_uint64(uint64_t value);
+
+/**
+ * @brief Creates a string holding the shortest round-trip form of a double
+ *
+ * @param value The value to format
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_from_double(double value);
+
+/**
+ * @brief Parses a whole string as a signed integer
+ *
+ * @param str The string to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input or overflow
+ */
+int TroveString_parse_int64(TroveString *str, int64_t *out);
+
+/**
+ * @brief Parses a whole string as an unsigned integer
+ *
+ * @param str The string to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input or overflow
+ */
+int TroveString_parse_uint64(TroveString *str, uint64_t *out);
+
+/**
+ * @brief Parses a whole string as a double
+ *
+ * @param str The string to parse
+ * @param out Receives the value on success
+ * @return 1 on success, 0 on malformed input
+ */
+int TroveString_parse_double(TroveString *str, double *out);
+
+#endif // NUMBER_H
@@ -0,0 +1,284 @@
+/**
+ * @file poolstats.c
+ * @brief Autorelease pool histograms for the Trove ARC memory management system
+ */
+
+#include "poolstats.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+/**
+ * @brief Relaxed loads and stores of histogram fields
+ *
+ * Only the owning thread writes a block, so an update is a plain load and
+ * store; making both relaxed atomics keeps concurrent snapshots free of
+ * data races at no cost on the hot path.
+ */
+#if defined(__GNUC__)
+#define POOL_STATS_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define POOL_STATS_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#else
+#define POOL_STATS_LOAD(field) (field)
+#define POOL_STATS_STORE(field, value) ((field) = (value))
+#endif
+
+/** @brief Linear buckets below the first log-linear one */
+#define HISTOGRAM_SUB_COUNT (1 << TROVE_HISTOGRAM_SUB_BITS)
+
+/**
+ * @brief Histograms of one thread, kept after the thread exits
+ */
+typedef struct PoolStatsBlock {
+    struct PoolStatsBlock *next;    /**< Next block in pool_stats_blocks */
+    ArcPoolStatsSnapshot stats;     /**< The thread's histograms */
+} PoolStatsBlock;
+
+int arc_pool_stats_enabled = 0;
+
+/** @brief Blocks of all threads that have popped a pool, newest first */
+static PoolStatsBlock *pool_stats_blocks = NULL;
+
+/** @brief Block of the calling thread, created on its first pop */
+static TROVE_THREAD_LOCAL PoolStatsBlock *thread_pool_stats = NULL;
+
+/**
+ * @brief Starts or stops recording pool histograms
+ */
+void arc_pool_stats_enable(int enabled) {
+    arc_pool_stats_enabled = enabled != 0;
+}
+
+#if defined(__GNUC__)
+/**
+ * @brief Enables pool histograms at startup when TROVE_POOL_STATS is set to anything but 0
+ */
+__attribute__((constructor)) static void pool_stats_enable_from_environment(void) {
+    const char *value = getenv("TROVE_POOL_STATS");
+    if (value && *value && strcmp(value, "0") != 0) {
+        arc_pool_stats_enabled = 1;
+    }
+}
+#endif
+
+/**
+ * @brief Returns the bucket of a value
+ *
+ * Values above zero are placed by value - 1, so that every power of two
+ * is the upper bound of a bucket and Prometheus "le" bounds come out exact.
+ */
+size_t arc_histogram_bucket(uint64_t value) {
+    if (!value) {
+        return 0;
+    }
+    uint64_t x = value - 1;
+    if (x < HISTOGRAM_SUB_COUNT) {
+        return 1 + (size_t)x;
+    }
+#if defined(__GNUC__)
+    int exponent = 63 - __builtin_clzll(x);
+#else
+    int exponent = 0;
+    while (x >> (exponent + 1)) {
+        exponent++;
+    }
+#endif
+    size_t sub = (size_t)(x >> (exponent - TROVE_HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_COUNT - 1);
+    return 1 + (size_t)(exponent - TROVE_HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT + sub;
+}
+
+/**
+ * @brief Returns the largest value that falls in a bucket
+ */
+uint64_t arc_histogram_bound(size_t bucket) {
+    if (bucket <= HISTOGRAM_SUB_COUNT) {
+        return bucket;
+    }
+    size_t index = bucket - 1;
+    int shift = (int)(index / HISTOGRAM_SUB_COUNT) - 1;
+    uint64_t sub = index % HISTOGRAM_SUB_COUNT;
+    if (shift >= 64 - TROVE_HISTOGRAM_SUB_BITS - 1 && sub == HISTOGRAM_SUB_COUNT - 1) {
+        return UINT64_MAX;
+    }
+    return (HISTOGRAM_SUB_COUNT + sub + 1) << shift;
+}
+
+/**
+ * @brief Returns the value below which a fraction of the recorded values fall
+ */
+uint64_t arc_histogram_quantile(const ArcHistogram *histogram, double quantile) {
+    if (!histogram->count) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(quantile * (double)histogram->count + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < TROVE_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            uint64_t bound = arc_histogram_bound(i);
+            return bound < histogram->max ? bound : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds
+ */
+uint64_t arc_pool_stats_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Allocates the calling thread's block and publishes it
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static PoolStatsBlock* pool_stats_block_create(void) {
+    PoolStatsBlock *block = (PoolStatsBlock *)calloc(1, sizeof(PoolStatsBlock));
+    if (!block) {
+        fprintf(stderr, "Failed to allocate pool statistics block.\n");
+        exit(1);
+    }
+#if defined(__GNUC__)
+    block->next = __atomic_load_n(&pool_stats_blocks, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&pool_stats_blocks, &block->next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+#else
+    block->next = pool_stats_blocks;
+    pool_stats_blocks = block;
+#endif
+    thread_pool_stats = block;
+    return block;
+}
+
+/**
+ * @brief Adds a value to a histogram of the calling thread
+ */
+static void histogram_record(ArcHistogram *histogram, uint64_t value) {
+    size_t bucket = arc_histogram_bucket(value);
+    POOL_STATS_STORE(histogram->buckets[bucket], histogram->buckets[bucket] + 1);
+    POOL_STATS_STORE(histogram->count, histogram->count + 1);
+    POOL_STATS_STORE(histogram->sum, histogram->sum + value);
+    if (value > histogram->max) {
+        POOL_STATS_STORE(histogram->max, value);
+    }
+}
+
+/**
+ * @brief Records a popped pool
+ *
+ * The object array starts at TROVE_POOL_INITIAL_CAPACITY entries and
+ * doubles on each reallocation, so the count follows from its capacity.
+ */
+void arc_pool_stats_record_pop(size_t objects, size_t capacity, uint64_t drain_ns) {
+    PoolStatsBlock *block = thread_pool_stats;
+    if (!block) {
+        block = pool_stats_block_create();
+    }
+    uint64_t grows = 0;
+    while (((size_t)TROVE_POOL_INITIAL_CAPACITY << grows) < capacity) {
+        grows++;
+    }
+    histogram_record(&block->stats.objects, objects);
+    histogram_record(&block->stats.drain_ns, drain_ns);
+    histogram_record(&block->stats.grows, grows);
+}
+
+/**
+ * @brief Adds a histogram being written by another thread to a total
+ */
+static void histogram_merge(ArcHistogram *total, ArcHistogram *histogram) {
+    total->count += POOL_STATS_LOAD(histogram->count);
+    total->sum += POOL_STATS_LOAD(histogram->sum);
+    uint64_t max = POOL_STATS_LOAD(histogram->max);
+    if (max > total->max) {
+        total->max = max;
+    }
+    for (size_t i = 0; i < TROVE_HISTOGRAM_BUCKETS; i++) {
+        total->buckets[i] += POOL_STATS_LOAD(histogram->buckets[i]);
+    }
+}
+
+/**
+ * @brief Sums the histograms of all threads
+ */
+void arc_pool_stats_snapshot(ArcPoolStatsSnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+#if defined(__GNUC__)
+    PoolStatsBlock *block = __atomic_load_n(&pool_stats_blocks, __ATOMIC_ACQUIRE);
+#else
+    PoolStatsBlock *block = pool_stats_blocks;
+#endif
+    for (; block; block = block->next) {
+        histogram_merge(&snapshot->objects, &block->stats.objects);
+        histogram_merge(&snapshot->drain_ns, &block->stats.drain_ns);
+        histogram_merge(&snapshot->grows, &block->stats.grows);
+    }
+}
+
+/**
+ * @brief Appends formatted text to a string
+ */
+static void prometheus_append(TroveString **text, const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    TroveString_append(text, line, length < (int)sizeof(line) ? (size_t)length : sizeof(line) - 1);
+}
+
+/**
+ * @brief Appends one histogram in the Prometheus text format
+ *
+ * Bucket bounds run from first to last, multiplying by step; every bound
+ * must be a bucket bound of the histogram (a power of two, or at most 16)
+ * for the cumulative counts to be exact. Values are divided by scale.
+ */
+static void prometheus_histogram(TroveString **text, const char *name, const char *help, const ArcHistogram *histogram,
+                                 uint64_t first, uint64_t last, uint64_t step, double scale) {
+    prometheus_append(text, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (uint64_t le = first; ; le = step > 1 ? le * step : le + 1) {
+        while (bucket < TROVE_HISTOGRAM_BUCKETS && arc_histogram_bound(bucket) <= le) {
+            cumulative += histogram->buckets[bucket++];
+        }
+        prometheus_append(text, "%s_bucket{le=\"%.9g\"} %" PRIu64 "\n", name, (double)le / scale, cumulative);
+        if (le >= last) {
+            break;
+        }
+    }
+    prometheus_append(text, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", name, histogram->count);
+    prometheus_append(text, "%s_sum %.9g\n", name, (double)histogram->sum / scale);
+    prometheus_append(text, "%s_count %" PRIu64 "\n", name, histogram->count);
+}
+
+/**
+ * @brief Formats a snapshot in the Prometheus text exposition format
+ */
+TroveString* arc_pool_stats_to_prometheus(const ArcPoolStatsSnapshot *snapshot) {
+    TroveString *text = TroveString_create("");
+    prometheus_histogram(&text, "trove_pool_objects", "Objects in an autorelease pool when it is popped.",
+                         &snapshot->objects, 1, (uint64_t)1 << 20, 2, 1.0);
+    prometheus_histogram(&text, "trove_pool_drain_seconds", "Time spent releasing the objects of a popped autorelease pool.",
+                         &snapshot->drain_ns, (uint64_t)1 << 10, (uint64_t)1 << 34, 4, 1e9);
+    prometheus_histogram(&text, "trove_pool_grows", "Reallocations of an autorelease pool's object array.",
+                         &snapshot->grows, 0, 16, 1, 1.0);
+    prometheus_append(&text, "# HELP trove_pool_objects_max Most objects held by a popped autorelease pool.\n"
+                             "# TYPE trove_pool_objects_max gauge\ntrove_pool_objects_max %" PRIu64 "\n",
+                      snapshot->objects.max);
+    prometheus_append(&text, "# HELP trove_pool_drain_seconds_max Longest autorelease pool drain.\n"
+                             "# TYPE trove_pool_drain_seconds_max gauge\ntrove_pool_drain_seconds_max %.9g\n",
+                      (double)snapshot->drain_ns.max / 1e9);
+    return text;
+}
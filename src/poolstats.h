@@ -0,0 +1,122 @@
+/**
+ * @file poolstats.h
+ * @brief Autorelease pool histograms for the Trove ARC memory management system
+ *
+ * When enabled, autorelease_pool_pop records three histograms:
+ *
+ * - how many objects the pool held;
+ * - how long the drain took, in nanoseconds;
+ * - how many times the pool's object array was reallocated.
+ *
+ * Each histogram also keeps its high-water mark.
+ *
+ * Histograms are log-linear in the manner of HDR histograms: eight buckets
+ * per power of two, so any value is placed within 12.5% of its size, over
+ * the full 64-bit range in under 4 KB. Each thread fills its own block with
+ * plain (relaxed) stores; arc_pool_stats_snapshot sums the blocks of all
+ * threads, including threads that have exited.
+ *
+ * Setting the environment variable TROVE_POOL_STATS to anything but 0
+ * enables recording at startup (with GCC and Clang).
+ */
+
+#ifndef POOLSTATS_H
+#define POOLSTATS_H
+
+#include "trove.h"
+#include <stdint.h>
+
+/** @brief Sub-buckets per power of two, as a power of two */
+#define TROVE_HISTOGRAM_SUB_BITS 3
+
+/** @brief Buckets of an ArcHistogram: zero, then every 64-bit value at 1/8 precision */
+#define TROVE_HISTOGRAM_BUCKETS (1 + (65 - TROVE_HISTOGRAM_SUB_BITS) * (1 << TROVE_HISTOGRAM_SUB_BITS))
+
+/**
+ * @brief A log-linear histogram of unsigned values
+ *
+ * Bucket 0 holds zeros; bucket i > 0 holds the values in
+ * (arc_histogram_bound(i - 1), arc_histogram_bound(i)].
+ */
+typedef struct ArcHistogram {
+    uint64_t count;                               /**< Values recorded */
+    uint64_t sum;                                 /**< Their sum */
+    uint64_t max;                                 /**< High-water mark */
+    uint64_t buckets[TROVE_HISTOGRAM_BUCKETS];    /**< Values per bucket */
+} ArcHistogram;
+
+/**
+ * @brief Pool histograms, merged across threads
+ */
+typedef struct ArcPoolStatsSnapshot {
+    ArcHistogram objects;     /**< Objects in a pool when it is popped */
+    ArcHistogram drain_ns;    /**< Nanoseconds spent releasing a pool's objects */
+    ArcHistogram grows;       /**< Reallocations of a pool's object array */
+} ArcPoolStatsSnapshot;
+
+/** @brief Nonzero while pool histograms are recorded; set with arc_pool_stats_enable */
+extern int arc_pool_stats_enabled;
+
+/**
+ * @brief Starts or stops recording pool histograms
+ *
+ * @param enabled Nonzero to record
+ */
+void arc_pool_stats_enable(int enabled);
+
+/**
+ * @brief Returns the bucket of a value
+ */
+size_t arc_histogram_bucket(uint64_t value);
+
+/**
+ * @brief Returns the largest value that falls in a bucket
+ */
+uint64_t arc_histogram_bound(size_t bucket);
+
+/**
+ * @brief Returns the value below which a fraction of the recorded values fall
+ *
+ * @param histogram The histogram
+ * @param quantile Fraction between 0 and 1, e.g. 0.99
+ * @return Upper bound of the bucket holding the quantile, capped at the
+ *         maximum, or 0 for an empty histogram
+ */
+uint64_t arc_histogram_quantile(const ArcHistogram *histogram, double quantile);
+
+/**
+ * @brief Sums the histograms of all threads
+ *
+ * Histograms being updated by other threads are read as they stand.
+ *
+ * @param snapshot Receives the histograms
+ */
+void arc_pool_stats_snapshot(ArcPoolStatsSnapshot *snapshot);
+
+/**
+ * @brief Formats a snapshot in the Prometheus text exposition format
+ *
+ * Exports the histograms trove_pool_objects, trove_pool_drain_seconds and
+ * trove_pool_grows, with power-of-two bucket bounds, and the gauges
+ * trove_pool_objects_max and trove_pool_drain_seconds_max.
+ *
+ * @param snapshot The histograms
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* arc_pool_stats_to_prometheus(const ArcPoolStatsSnapshot *snapshot);
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds; used to time drains
+ */
+uint64_t arc_pool_stats_clock(void);
+
+/**
+ * @brief Records a popped pool; called by autorelease_pool_pop
+ *
+ * @param objects Objects the pool held
+ * @param capacity Final capacity of its object array
+ * @param drain_ns Nanoseconds its drain took
+ */
+void arc_pool_stats_record_pop(size_t objects, size_t capacity, uint64_t drain_ns);
+
+#endif // POOLSTATS_H
@@ -0,0 +1,101 @@
+/**
+ * @file probes.h
+ * @brief USDT static probes for the Trove ARC memory management system
+ *
+ * Each TROVE_PROBE is a single nop plus an ELF note (provider "trove")
+ * telling perf, bpftrace and SystemTap where the nop is and where to find
+ * its arguments; attaching a tracer turns the nop into a breakpoint. Left
+ * alone, a probe costs the nop and keeping its arguments in registers.
+ *
+ * The probes come from <sys/sdt.h> when it is installed. Otherwise on
+ * x86-64 and AArch64 an equivalent note is emitted here, in the same
+ * format; elsewhere, or with -DTROVE_NO_PROBES, probes compile to nothing.
+ * Arguments are passed as 64-bit signed integers.
+ *
+ * Probes (see tools/bpftrace for scripts that use them):
+ *
+ * - pool_push(pool, parent)
+ * - pool_grow(pool, old_capacity, new_capacity): autorelease_add
+ *   reallocating the pool's object array
+ * - pool_pop_start(pool, count, capacity) and pool_pop_done(pool, count):
+ *   around the drain in autorelease_pool_pop
+ * - no_pool(obj): an autorelease with no pool in place
+ * - release_all(objects, count): a batch release
+ * - dealloc(obj, type, size): arc_object_free
+ * - over_release(obj, ref_count): a release taking a count below zero
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#if !defined(TROVE_NO_PROBES) && defined(__GNUC__) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define TROVE_PROBES_SDT 1
+#endif
+#endif
+
+#if !defined(TROVE_NO_PROBES) && !defined(TROVE_PROBES_SDT) && defined(__GNUC__) && defined(__ELF__) \
+    && (defined(__x86_64__) || defined(__aarch64__))
+#define TROVE_PROBES_NOTE 1
+#endif
+
+#if defined(TROVE_PROBES_SDT)
+
+#include <sys/sdt.h>
+
+#define TROVE_PROBE1(name, a) STAP_PROBE1(trove, name, (long long)(a))
+#define TROVE_PROBE2(name, a, b) STAP_PROBE2(trove, name, (long long)(a), (long long)(b))
+#define TROVE_PROBE3(name, a, b, c) STAP_PROBE3(trove, name, (long long)(a), (long long)(b), (long long)(c))
+
+#elif defined(TROVE_PROBES_NOTE)
+
+/**
+ * @brief Emits the nop and its stapsdt note, version 3 of the format
+ *
+ * The note holds the probe address, the address of the _.stapsdt.base
+ * anchor (used to detect prelink relocation), a zero semaphore address,
+ * the provider, the name and the argument string, e.g. "-8@%rdi -8@$4".
+ */
+#define TROVE_PROBE_ASM(name, args)                                                  \
+    "990: nop\n"                                                                      \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                     \
+    ".balign 4\n"                                                                     \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                                \
+    "991: .asciz \"stapsdt\"\n"                                                       \
+    "992: .balign 4\n"                                                                \
+    "993: .8byte 990b\n"                                                              \
+    ".8byte _.stapsdt.base\n"                                                         \
+    ".8byte 0\n"                                                                      \
+    ".asciz \"trove\"\n"                                                              \
+    ".asciz \"" #name "\"\n"                                                          \
+    ".asciz \"" args "\"\n"                                                           \
+    "994: .balign 4\n"                                                                \
+    ".popsection\n"                                                                   \
+    ".ifndef _.stapsdt.base\n"                                                        \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"           \
+    ".weak _.stapsdt.base\n"                                                          \
+    ".hidden _.stapsdt.base\n"                                                        \
+    "_.stapsdt.base: .space 1\n"                                                      \
+    ".size _.stapsdt.base, 1\n"                                                       \
+    ".popsection\n"                                                                   \
+    ".endif\n"
+
+#define TROVE_PROBE1(name, a)                                                        \
+    __asm__ __volatile__(TROVE_PROBE_ASM(name, "-8@%0")                               \
+                         :: "nor"((long long)(a)))
+#define TROVE_PROBE2(name, a, b)                                                     \
+    __asm__ __volatile__(TROVE_PROBE_ASM(name, "-8@%0 -8@%1")                         \
+                         :: "nor"((long long)(a)), "nor"((long long)(b)))
+#define TROVE_PROBE3(name, a, b, c)                                                  \
+    __asm__ __volatile__(TROVE_PROBE_ASM(name, "-8@%0 -8@%1 -8@%2")                   \
+                         :: "nor"((long long)(a)), "nor"((long long)(b)), "nor"((long long)(c)))
+
+#else
+
+#define TROVE_PROBE1(name, a) ((void)0)
+#define TROVE_PROBE2(name, a, b) ((void)0)
+#define TROVE_PROBE3(name, a, b, c) ((void)0)
+
+#endif
+
+#endif // PROBES_H
@@ -0,0 +1,834 @@
+/**
+ * @file profile.c
+ * @brief Sampling allocation profiler for the Trove ARC memory management system
+ */
+
+#include "profile.h"
+#include "stats.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+/**
+ * @brief Relaxed loads and stores of fields read outside the lock
+ */
+#if defined(__GNUC__)
+#define PROFILE_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define PROFILE_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#else
+#define PROFILE_LOAD(field) (field)
+#define PROFILE_STORE(field, value) ((field) = (value))
+#endif
+
+/** @brief log2 of the entries in profile_filter */
+#define PROFILE_FILTER_BITS 16
+
+/** @brief Hash chains in profile_bucket_heads */
+#define PROFILE_BUCKET_HEADS 4096
+
+/** @brief Initial number of live sample table slots */
+#define PROFILE_INITIAL_LIVE 1024
+
+/** @brief Frames captured before dropping those inside Trove */
+#define PROFILE_CAPTURE_DEPTH (TROVE_PROFILE_MAX_DEPTH + 8)
+
+/** @brief Natural logarithm of 2 */
+#define PROFILE_LN2 0.69314718055994530942
+
+/** @brief Sample value types written to profiles, in order */
+static const char *const PROFILE_VALUE_TYPES[][2] = {
+    { "alloc_objects", "count" },
+    { "alloc_space", "bytes" },
+    { "inuse_objects", "count" },
+    { "inuse_space", "bytes" },
+    { "freed_objects", "count" },
+    { "lifetime", "nanoseconds" },
+};
+
+/** @brief Number of sample values */
+#define PROFILE_VALUES (sizeof(PROFILE_VALUE_TYPES) / sizeof(PROFILE_VALUE_TYPES[0]))
+
+/**
+ * @brief Samples sharing a stack trace and type
+ *
+ * Counts are estimates for the whole program: each sample adds the
+ * inverse of its probability of being taken.
+ */
+typedef struct ProfileBucket {
+    struct ProfileBucket *chain;               /**< Next bucket in the same hash chain */
+    struct ProfileBucket *next;                /**< Next bucket in profile_buckets */
+    uint64_t hash;                             /**< Hash of the frames and type */
+    void (*type)(ARCObject *);                 /**< The objects' dealloc function */
+    int depth;                                 /**< Frames used */
+    void *frames[TROVE_PROFILE_MAX_DEPTH];     /**< Return addresses, innermost first */
+    double values[PROFILE_VALUES];             /**< Estimates, in PROFILE_VALUE_TYPES order */
+} ProfileBucket;
+
+/**
+ * @brief A sampled object that has not been freed yet
+ */
+typedef struct ProfileLive {
+    ARCObject *obj;             /**< The object, NULL for a free slot */
+    ProfileBucket *bucket;      /**< Its bucket */
+    uint64_t time;              /**< CLOCK_MONOTONIC nanoseconds when it was sampled */
+    double weight;              /**< Objects it stands for */
+} ProfileLive;
+
+/**
+ * @brief A growable byte buffer for protobuf encoding
+ */
+typedef struct ProfileBuffer {
+    unsigned char *bytes;    /**< Contents */
+    size_t length;           /**< Bytes used */
+    size_t capacity;         /**< Bytes allocated */
+} ProfileBuffer;
+
+/**
+ * @brief Strings of a profile's string table, index 0 being ""
+ */
+typedef struct ProfileStrings {
+    const char **items;    /**< Strings in table order */
+    size_t count;          /**< Entries used */
+    size_t capacity;       /**< Entries allocated */
+} ProfileStrings;
+
+/**
+ * @brief An executable mapping of the process, from /proc/self/maps
+ */
+typedef struct ProfileMapping {
+    uint64_t start;        /**< First address */
+    uint64_t limit;        /**< Address past the end */
+    uint64_t offset;       /**< File offset of start */
+    char *file;            /**< Mapped file */
+} ProfileMapping;
+
+int arc_profile_enabled = 0;
+
+int arc_profile_watching = 0;
+
+/** @brief Mean sampling interval in bytes */
+static size_t profile_rate = TROVE_PROFILE_DEFAULT_RATE;
+
+/** @brief Bytes the calling thread may allocate before its next sample */
+static TROVE_THREAD_LOCAL int64_t profile_countdown = 0;
+
+/** @brief State of the calling thread's random number generator, 0 until seeded */
+static TROVE_THREAD_LOCAL uint64_t profile_random = 0;
+
+/**
+ * @brief One bit per address hash, set while an object with that hash is sampled
+ *
+ * A clear bit proves an object being freed was not sampled, which lets
+ * most frees skip the lock; at 8 KB the bitmap stays in the L1 cache.
+ */
+static uint64_t profile_filter[(1 << PROFILE_FILTER_BITS) / 64];
+
+/** @brief Live samples per address hash, behind the bits of profile_filter */
+static uint16_t profile_filter_counts[1 << PROFILE_FILTER_BITS];
+
+/** @brief Hash chains of buckets */
+static ProfileBucket *profile_bucket_heads[PROFILE_BUCKET_HEADS];
+
+/** @brief All buckets, newest first */
+static ProfileBucket *profile_buckets = NULL;
+
+/** @brief Buckets in profile_buckets */
+static size_t profile_bucket_count = 0;
+
+/** @brief Open-addressing table of live samples by address, linear probing */
+static ProfileLive *profile_live = NULL;
+
+/** @brief Slots in profile_live (a power of two) */
+static size_t profile_live_capacity = 0;
+
+/** @brief Live samples in profile_live */
+static size_t profile_live_count = 0;
+
+/** @brief Objects sampled so far */
+static size_t profile_sample_count = 0;
+
+/** @brief CLOCK_REALTIME nanoseconds when the profiler was first enabled */
+static uint64_t profile_start_ns = 0;
+
+/** @brief CLOCK_MONOTONIC nanoseconds when the profiler was first enabled */
+static uint64_t profile_start_monotonic = 0;
+
+/** @brief Spin lock guarding the buckets and live samples */
+static volatile char profile_lock = 0;
+
+/** @brief File the profile is saved to at exit, from TROVE_PROFILE */
+static const char *profile_exit_path = NULL;
+
+/**
+ * @brief Acquires the profiler lock
+ */
+static inline void profile_lock_acquire(void) {
+#if defined(__GNUC__)
+    while (__atomic_test_and_set(&profile_lock, __ATOMIC_ACQUIRE)) {
+    }
+#endif
+}
+
+/**
+ * @brief Releases the profiler lock
+ */
+static inline void profile_lock_release(void) {
+#if defined(__GNUC__)
+    __atomic_clear(&profile_lock, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * @brief Returns a clock in nanoseconds
+ */
+static uint64_t profile_clock(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Hashes an address to a slot of a table with a power-of-two capacity
+ */
+static inline size_t profile_hash(const void *address, size_t capacity) {
+    return (size_t)(((uint64_t)(uintptr_t)address * 0x9E3779B97F4A7C15ull) >> 32) & (capacity - 1);
+}
+
+/**
+ * @brief Starts or stops sampling
+ */
+void arc_profile_enable(int enabled) {
+    if (enabled && !profile_start_ns) {
+        profile_start_ns = profile_clock(CLOCK_REALTIME);
+        profile_start_monotonic = profile_clock(CLOCK_MONOTONIC);
+    }
+    if (enabled) {
+        arc_profile_watching = 1;
+    }
+    arc_profile_enabled = enabled != 0;
+}
+
+/**
+ * @brief Sets the mean number of bytes allocated between samples
+ */
+void arc_profile_set_rate(size_t bytes) {
+    PROFILE_STORE(profile_rate, bytes ? bytes : 1);
+}
+
+/**
+ * @brief Returns the number of objects sampled so far
+ */
+size_t arc_profile_samples(void) {
+    return PROFILE_LOAD(profile_sample_count);
+}
+
+/**
+ * @brief Saves the profile to the TROVE_PROFILE path at exit
+ */
+static void profile_save_at_exit(void) {
+    int error = arc_profile_save(profile_exit_path);
+    if (error) {
+        fprintf(stderr, "trove: cannot save profile to %s: %s\n", profile_exit_path, strerror(error));
+    }
+}
+
+#if defined(__GNUC__)
+/**
+ * @brief Enables the profiler at startup when TROVE_PROFILE names a file
+ */
+__attribute__((constructor)) static void profile_enable_from_environment(void) {
+    const char *rate = getenv("TROVE_PROFILE_RATE");
+    if (rate && *rate) {
+        arc_profile_set_rate((size_t)strtoull(rate, NULL, 10));
+    }
+    const char *value = getenv("TROVE_PROFILE");
+    if (value && *value && strcmp(value, "0") != 0) {
+        profile_exit_path = value;
+        atexit(profile_save_at_exit);
+        arc_profile_enable(1);
+    }
+}
+#endif
+
+/**
+ * @brief Returns the natural logarithm of a value in [1, 2)
+ *
+ * Uses ln(m) = 2 atanh((m - 1) / (m + 1)), whose series converges fast
+ * enough here: the library does not link libm.
+ */
+static double profile_log_mantissa(double m) {
+    double t = (m - 1.0) / (m + 1.0);
+    double t2 = t * t;
+    return 2.0 * t * (1.0 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7 + t2 * (1.0 / 9 + t2 / 11)))));
+}
+
+/**
+ * @brief Returns e raised to a value at most 0
+ */
+static double profile_exp_negative(double x) {
+    if (x < -700.0) {
+        return 0.0;
+    }
+    int halvings = (int)(-x / PROFILE_LN2);
+    double r = x + halvings * PROFILE_LN2;
+    double term = 1.0;
+    double sum = 1.0;
+    for (int i = 1; i < 16; i++) {
+        term *= r / i;
+        sum += term;
+    }
+    for (; halvings >= 30; halvings -= 30) {
+        sum /= (double)(1u << 30);
+    }
+    return sum / (double)(1u << halvings);
+}
+
+/**
+ * @brief Returns the next random 64-bit value of the calling thread (xorshift64*)
+ */
+static uint64_t profile_next_random(void) {
+    uint64_t x = profile_random;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    profile_random = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+/**
+ * @brief Draws an exponentially distributed sampling interval
+ *
+ * With u uniform in (0, 1], -ln(u) is exponential with mean 1; u is
+ * q / 2^53 for a random integer q in [1, 2^53], split into a power of two
+ * and a mantissa to take its logarithm.
+ */
+static int64_t profile_next_interval(void) {
+    uint64_t q = (profile_next_random() >> 11) + 1;
+    int exponent = 0;
+    while (q >> (exponent + 1)) {
+        exponent++;
+    }
+    double mantissa = (double)q / (double)((uint64_t)1 << exponent);
+    double exponential = (53 - exponent) * PROFILE_LN2 - profile_log_mantissa(mantissa);
+    return (int64_t)(exponential * (double)PROFILE_LOAD(profile_rate));
+}
+
+/**
+ * @brief Returns how many objects of a size one sample stands for
+ *
+ * An object of size s is sampled with probability 1 - exp(-s / rate).
+ */
+static double profile_weight(size_t size, size_t rate) {
+    double probability = 1.0 - profile_exp_negative(-(double)size / (double)rate);
+    return probability > 0.0 ? 1.0 / probability : 1.0;
+}
+
+/**
+ * @brief Takes the stack trace of an allocation
+ *
+ * Frames up to the caller of arc_object_init belong to Trove and are
+ * dropped, so the innermost frame is the function that created the object.
+ *
+ * @return Number of frames stored
+ */
+static int profile_stack(void **frames, void *caller) {
+#if defined(__GLIBC__)
+    void *trace[PROFILE_CAPTURE_DEPTH];
+    int count = backtrace(trace, PROFILE_CAPTURE_DEPTH);
+    for (int i = 0; i < count; i++) {
+        if (trace[i] == caller) {
+            int depth = count - i < TROVE_PROFILE_MAX_DEPTH ? count - i : TROVE_PROFILE_MAX_DEPTH;
+            memcpy(frames, &trace[i], (size_t)depth * sizeof(void *));
+            return depth;
+        }
+    }
+#endif
+    frames[0] = caller;
+    return 1;
+}
+
+/**
+ * @brief Returns the bucket of a stack trace and type, creating it if new
+ *
+ * Called with the lock held. If allocation fails, the program will exit
+ * with an error message.
+ */
+static ProfileBucket* profile_bucket(void **frames, int depth, void (*type)(ARCObject *)) {
+    uint64_t hash = 14695981039346656037ull ^ (uint64_t)(uintptr_t)type;
+    for (int i = 0; i < depth; i++) {
+        hash = (hash ^ (uint64_t)(uintptr_t)frames[i]) * 1099511628211ull;
+    }
+    size_t head = (size_t)(hash >> 32) & (PROFILE_BUCKET_HEADS - 1);
+    for (ProfileBucket *bucket = profile_bucket_heads[head]; bucket; bucket = bucket->chain) {
+        if (bucket->hash == hash && bucket->type == type && bucket->depth == depth
+            && memcmp(bucket->frames, frames, (size_t)depth * sizeof(void *)) == 0) {
+            return bucket;
+        }
+    }
+    ProfileBucket *bucket = (ProfileBucket *)calloc(1, sizeof(ProfileBucket));
+    if (!bucket) {
+        fprintf(stderr, "Failed to allocate profile bucket.\n");
+        exit(1);
+    }
+    bucket->hash = hash;
+    bucket->type = type;
+    bucket->depth = depth;
+    memcpy(bucket->frames, frames, (size_t)depth * sizeof(void *));
+    bucket->chain = profile_bucket_heads[head];
+    profile_bucket_heads[head] = bucket;
+    bucket->next = profile_buckets;
+    profile_buckets = bucket;
+    profile_bucket_count++;
+    return bucket;
+}
+
+/**
+ * @brief Enters a sample in the live table
+ *
+ * Called with the lock held. If allocation fails, the program will exit
+ * with an error message.
+ */
+static void profile_live_insert(const ProfileLive *sample) {
+    if ((profile_live_count + 1) * 2 > profile_live_capacity) {
+        size_t capacity = profile_live_capacity ? profile_live_capacity * 2 : PROFILE_INITIAL_LIVE;
+        ProfileLive *table = (ProfileLive *)calloc(capacity, sizeof(ProfileLive));
+        if (!table) {
+            fprintf(stderr, "Failed to allocate profile samples.\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < profile_live_capacity; i++) {
+            if (profile_live[i].obj) {
+                size_t slot = profile_hash(profile_live[i].obj, capacity);
+                while (table[slot].obj) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                table[slot] = profile_live[i];
+            }
+        }
+        free(profile_live);
+        profile_live = table;
+        profile_live_capacity = capacity;
+    }
+    size_t slot = profile_hash(sample->obj, profile_live_capacity);
+    while (profile_live[slot].obj) {
+        slot = (slot + 1) & (profile_live_capacity - 1);
+    }
+    profile_live[slot] = *sample;
+    profile_live_count++;
+}
+
+/**
+ * @brief Removes a sample from the live table, shifting later entries of its run back
+ *
+ * Called with the lock held.
+ *
+ * @return Nonzero if the object had a live sample, copied to sample
+ */
+static int profile_live_remove(ARCObject *obj, ProfileLive *sample) {
+    if (!profile_live_count) {
+        return 0;
+    }
+    size_t mask = profile_live_capacity - 1;
+    size_t slot = profile_hash(obj, profile_live_capacity);
+    while (profile_live[slot].obj != obj) {
+        if (!profile_live[slot].obj) {
+            return 0;
+        }
+        slot = (slot + 1) & mask;
+    }
+    *sample = profile_live[slot];
+    size_t hole = slot;
+    for (size_t next = (slot + 1) & mask; profile_live[next].obj; next = (next + 1) & mask) {
+        size_t home = profile_hash(profile_live[next].obj, profile_live_capacity);
+        // Move the entry back unless its home lies cyclically in (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            profile_live[hole] = profile_live[next];
+            hole = next;
+        }
+    }
+    profile_live[hole].obj = NULL;
+    profile_live_count--;
+    return 1;
+}
+
+/**
+ * @brief Samples one object
+ */
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void profile_sample(ARCObject *obj, void *caller) {
+    void *frames[TROVE_PROFILE_MAX_DEPTH];
+    int depth = profile_stack(frames, caller);
+    size_t rate = PROFILE_LOAD(profile_rate);
+    ProfileLive sample;
+    sample.obj = obj;
+    sample.time = profile_clock(CLOCK_MONOTONIC);
+    sample.weight = profile_weight(obj->size, rate);
+
+    profile_lock_acquire();
+    sample.bucket = profile_bucket(frames, depth, obj->dealloc);
+    sample.bucket->values[0] += sample.weight;
+    sample.bucket->values[1] += sample.weight * obj->size;
+    sample.bucket->values[2] += sample.weight;
+    sample.bucket->values[3] += sample.weight * obj->size;
+    profile_live_insert(&sample);
+    size_t slot = profile_hash(obj, (size_t)1 << PROFILE_FILTER_BITS);
+    if (profile_filter_counts[slot]++ == 0) {
+        PROFILE_STORE(profile_filter[slot / 64], profile_filter[slot / 64] | (uint64_t)1 << (slot % 64));
+    }
+    PROFILE_STORE(profile_sample_count, profile_sample_count + 1);
+    profile_lock_release();
+}
+
+/**
+ * @brief Counts a new object towards the next sample
+ *
+ * A sample point that falls inside an object samples it; the next point
+ * is an exponential interval further on, counted from inside the object.
+ * A thread's first allocation only seeds its generator.
+ */
+void arc_profile_record_alloc(ARCObject *obj, void *caller) {
+    profile_countdown -= (int64_t)obj->size;
+    if (profile_countdown >= 0) {
+        return;
+    }
+    int seeded = profile_random != 0;
+    if (!seeded) {
+        profile_random = ((uint64_t)(uintptr_t)&profile_random ^ profile_clock(CLOCK_MONOTONIC)) * 0x9E3779B97F4A7C15ull | 1;
+        profile_countdown = 0;
+    }
+    do {
+        profile_countdown += profile_next_interval();
+    } while (profile_countdown < 0);
+    if (seeded) {
+        profile_sample(obj, caller);
+    }
+}
+
+/**
+ * @brief Closes the sample of an object whose filter bit is set, if it has one
+ */
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+static void profile_close(ARCObject *obj, size_t slot) {
+    ProfileLive sample;
+    profile_lock_acquire();
+    if (profile_live_remove(obj, &sample)) {
+        double lifetime = (double)(profile_clock(CLOCK_MONOTONIC) - sample.time);
+        sample.bucket->values[2] -= sample.weight;
+        sample.bucket->values[3] -= sample.weight * obj->size;
+        sample.bucket->values[4] += sample.weight;
+        sample.bucket->values[5] += sample.weight * lifetime;
+        if (--profile_filter_counts[slot] == 0) {
+            PROFILE_STORE(profile_filter[slot / 64], profile_filter[slot / 64] & ~((uint64_t)1 << (slot % 64)));
+        }
+    }
+    profile_lock_release();
+}
+
+/**
+ * @brief Closes the sample of an object if it has one
+ */
+void arc_profile_record_free(ARCObject *obj) {
+    size_t slot = profile_hash(obj, (size_t)1 << PROFILE_FILTER_BITS);
+    if (PROFILE_LOAD(profile_filter[slot / 64]) >> (slot % 64) & 1) {
+        profile_close(obj, slot);
+    }
+}
+
+/**
+ * @brief Makes room for more bytes in a buffer
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static void buffer_reserve(ProfileBuffer *buffer, size_t more) {
+    if (buffer->length + more > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 256;
+        while (buffer->length + more > capacity) {
+            capacity *= 2;
+        }
+        unsigned char *bytes = (unsigned char *)realloc(buffer->bytes, capacity);
+        if (!bytes) {
+            fprintf(stderr, "Failed to allocate profile buffer.\n");
+            exit(1);
+        }
+        buffer->bytes = bytes;
+        buffer->capacity = capacity;
+    }
+}
+
+/**
+ * @brief Appends a base-128 varint
+ */
+static void buffer_varint(ProfileBuffer *buffer, uint64_t value) {
+    buffer_reserve(buffer, 10);
+    while (value >= 0x80) {
+        buffer->bytes[buffer->length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    buffer->bytes[buffer->length++] = (unsigned char)value;
+}
+
+/**
+ * @brief Appends a varint field
+ */
+static void buffer_uint(ProfileBuffer *buffer, unsigned field, uint64_t value) {
+    buffer_varint(buffer, (uint64_t)field << 3);
+    buffer_varint(buffer, value);
+}
+
+/**
+ * @brief Appends a length-delimited field
+ */
+static void buffer_bytes(ProfileBuffer *buffer, unsigned field, const void *bytes, size_t length) {
+    buffer_varint(buffer, (uint64_t)field << 3 | 2);
+    buffer_varint(buffer, length);
+    buffer_reserve(buffer, length);
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+/**
+ * @brief Appends an embedded message built in another buffer, then empties that buffer
+ */
+static void buffer_message(ProfileBuffer *buffer, unsigned field, ProfileBuffer *message) {
+    buffer_bytes(buffer, field, message->bytes, message->length);
+    message->length = 0;
+}
+
+/**
+ * @brief Returns the string table index of a string, adding it if new
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static uint64_t profile_string(ProfileStrings *strings, const char *text) {
+    for (size_t i = 0; i < strings->count; i++) {
+        if (strcmp(strings->items[i], text) == 0) {
+            return i;
+        }
+    }
+    if (strings->count == strings->capacity) {
+        size_t capacity = strings->capacity ? strings->capacity * 2 : 32;
+        const char **items = (const char **)realloc((void *)strings->items, capacity * sizeof(char *));
+        if (!items) {
+            fprintf(stderr, "Failed to allocate profile strings.\n");
+            exit(1);
+        }
+        strings->items = items;
+        strings->capacity = capacity;
+    }
+    strings->items[strings->count] = text;
+    return strings->count++;
+}
+
+/**
+ * @brief Reads the executable file mappings of the process
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @return Number of mappings stored in *mappings (0 without /proc)
+ */
+static size_t profile_read_mappings(ProfileMapping **mappings) {
+    size_t count = 0;
+    size_t capacity = 0;
+    *mappings = NULL;
+    FILE *maps = fopen("/proc/self/maps", "r");
+    if (!maps) {
+        return 0;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), maps)) {
+        unsigned long long start, limit, offset;
+        char permissions[8];
+        int path = 0;
+        if (sscanf(line, "%llx-%llx %7s %llx %*s %*s %n", &start, &limit, permissions, &offset, &path) < 4
+            || !strchr(permissions, 'x') || !path || line[path] != '/') {
+            continue;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            *mappings = (ProfileMapping *)realloc(*mappings, capacity * sizeof(ProfileMapping));
+            if (!*mappings) {
+                fprintf(stderr, "Failed to allocate profile mappings.\n");
+                exit(1);
+            }
+        }
+        ProfileMapping *mapping = &(*mappings)[count++];
+        mapping->start = start;
+        mapping->limit = limit;
+        mapping->offset = offset;
+        mapping->file = (char *)malloc(strlen(line + path) + 1);
+        if (!mapping->file) {
+            fprintf(stderr, "Failed to allocate profile mappings.\n");
+            exit(1);
+        }
+        strcpy(mapping->file, line + path);
+    }
+    fclose(maps);
+    return count;
+}
+
+/**
+ * @brief Copies the buckets under the lock
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static ProfileBucket* profile_copy_buckets(size_t *count) {
+    profile_lock_acquire();
+    ProfileBucket *copy = (ProfileBucket *)malloc((profile_bucket_count + 1) * sizeof(ProfileBucket));
+    if (!copy) {
+        fprintf(stderr, "Failed to allocate profile buckets.\n");
+        exit(1);
+    }
+    size_t used = 0;
+    for (ProfileBucket *bucket = profile_buckets; bucket; bucket = bucket->next) {
+        copy[used++] = *bucket;
+    }
+    profile_lock_release();
+    *count = used;
+    return copy;
+}
+
+/**
+ * @brief Encodes the profile as a perftools.profiles.Profile message
+ *
+ * Every distinct frame address becomes a location, numbered from 1 in
+ * order of first appearance and tied to the mapping that contains it.
+ * Frames are return addresses, so each location points one byte back,
+ * into the call instruction.
+ */
+static void profile_encode(ProfileBuffer *out, const ProfileBucket *buckets, size_t count,
+                           const ProfileMapping *mappings, size_t mapping_count) {
+    ProfileStrings strings = { NULL, 0, 0 };
+    ProfileBuffer message = { NULL, 0, 0 };
+    ProfileBuffer packed = { NULL, 0, 0 };
+    profile_string(&strings, "");
+
+    for (size_t i = 0; i < PROFILE_VALUES; i++) {
+        buffer_uint(&message, 1, profile_string(&strings, PROFILE_VALUE_TYPES[i][0]));
+        buffer_uint(&message, 2, profile_string(&strings, PROFILE_VALUE_TYPES[i][1]));
+        buffer_message(out, 1, &message);
+    }
+
+    // Location ids by address, in an open-addressing table
+    size_t capacity = 64;
+    while (capacity < count * TROVE_PROFILE_MAX_DEPTH * 2) {
+        capacity *= 2;
+    }
+    uint64_t *addresses = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    uint64_t *ids = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    if (!addresses || !ids) {
+        fprintf(stderr, "Failed to allocate profile locations.\n");
+        exit(1);
+    }
+    uint64_t location_count = 0;
+    uint64_t type_key = profile_string(&strings, "type");
+
+    for (size_t b = 0; b < count; b++) {
+        const ProfileBucket *bucket = &buckets[b];
+        for (int f = 0; f < bucket->depth; f++) {
+            uint64_t address = (uint64_t)(uintptr_t)bucket->frames[f] - 1;
+            size_t slot = profile_hash((void *)(uintptr_t)address, capacity);
+            while (ids[slot] && addresses[slot] != address) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if (!ids[slot]) {
+                addresses[slot] = address;
+                ids[slot] = ++location_count;
+                buffer_uint(&message, 1, ids[slot]);
+                for (size_t m = 0; m < mapping_count; m++) {
+                    if (address >= mappings[m].start && address < mappings[m].limit) {
+                        buffer_uint(&message, 2, m + 1);
+                        break;
+                    }
+                }
+                buffer_uint(&message, 3, address);
+                buffer_message(out, 4, &message);
+            }
+            buffer_varint(&packed, ids[slot]);
+        }
+        buffer_message(&message, 1, &packed);
+        for (size_t v = 0; v < PROFILE_VALUES; v++) {
+            double value = bucket->values[v];
+            buffer_varint(&packed, (uint64_t)(int64_t)(value + (value < 0 ? -0.5 : 0.5)));
+        }
+        buffer_message(&message, 2, &packed);
+        const char *name = arc_stats_type_name(bucket->type);
+        buffer_uint(&packed, 1, type_key);
+        buffer_uint(&packed, 2, profile_string(&strings, name ? name : "(unnamed type)"));
+        buffer_message(&message, 3, &packed);
+        // The sample goes after the locations it introduced, which is allowed
+        buffer_message(out, 2, &message);
+    }
+
+    for (size_t m = 0; m < mapping_count; m++) {
+        buffer_uint(&message, 1, m + 1);
+        buffer_uint(&message, 2, mappings[m].start);
+        buffer_uint(&message, 3, mappings[m].limit);
+        buffer_uint(&message, 4, mappings[m].offset);
+        buffer_uint(&message, 5, profile_string(&strings, mappings[m].file));
+        buffer_message(out, 3, &message);
+    }
+
+    uint64_t period_type = profile_string(&strings, "space");
+    uint64_t period_unit = profile_string(&strings, "bytes");
+    uint64_t default_type = profile_string(&strings, "alloc_objects");
+    for (size_t i = 0; i < strings.count; i++) {
+        buffer_bytes(out, 6, strings.items[i], strlen(strings.items[i]));
+    }
+    buffer_uint(out, 9, profile_start_ns);
+    buffer_uint(out, 10, profile_start_monotonic ? profile_clock(CLOCK_MONOTONIC) - profile_start_monotonic : 0);
+    buffer_uint(&message, 1, period_type);
+    buffer_uint(&message, 2, period_unit);
+    buffer_message(out, 11, &message);
+    buffer_uint(out, 12, PROFILE_LOAD(profile_rate));
+    buffer_uint(out, 14, default_type);
+
+    free(addresses);
+    free(ids);
+    free((void *)strings.items);
+    free(message.bytes);
+    free(packed.bytes);
+}
+
+/**
+ * @brief Writes the profile in pprof's protobuf format
+ */
+int arc_profile_save(const char *path) {
+    size_t count;
+    ProfileBucket *buckets = profile_copy_buckets(&count);
+    ProfileMapping *mappings;
+    size_t mapping_count = profile_read_mappings(&mappings);
+    ProfileBuffer out = { NULL, 0, 0 };
+    profile_encode(&out, buckets, count, mappings, mapping_count);
+
+    int error = 0;
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        error = errno;
+    } else {
+        errno = 0;
+        if (out.length && fwrite(out.bytes, 1, out.length, file) != out.length) {
+            error = errno ? errno : EIO;
+        }
+        if (fclose(file) != 0 && !error) {
+            error = errno ? errno : EIO;
+        }
+    }
+    for (size_t m = 0; m < mapping_count; m++) {
+        free(mappings[m].file);
+    }
+    free(mappings);
+    free(out.bytes);
+    free(buckets);
+    return error;
+}
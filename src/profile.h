@@ -0,0 +1,95 @@
+/**
+ * @file profile.h
+ * @brief Sampling allocation profiler for the Trove ARC memory management system
+ *
+ * When enabled, arc_object_init samples objects as a Poisson process over
+ * allocated bytes: each thread counts down an exponentially distributed
+ * number of bytes, TROVE_PROFILE_DEFAULT_RATE on average, and the object
+ * that crosses zero is sampled. A sampled object has its stack trace taken
+ * and is watched until it is freed, so the profile holds per stack and type
+ * how many objects and bytes were allocated, how many are still live, and
+ * how long the freed ones lived. Unsampled allocations only decrement the
+ * thread's counter; frees look up a small filter, and take the profiler's
+ * lock only for objects that may have been sampled.
+ *
+ * arc_profile_save writes the profile in pprof's protobuf format, scaling
+ * each sample by the inverse of its probability of being sampled, so the
+ * figures estimate the whole program:
+ *
+ *     go tool pprof -sample_index=alloc_space ./program trove.pprof
+ *     go tool pprof -tagfocus type=TroveString -top ./program trove.pprof
+ *
+ * Sample values are alloc_objects, alloc_space, inuse_objects, inuse_space,
+ * freed_objects and lifetime (nanoseconds lived by the freed objects, so
+ * lifetime / freed_objects is their mean lifetime); each sample is labelled
+ * with its type. Stacks come from backtrace() on glibc and are otherwise
+ * just the caller of the create function.
+ *
+ * Setting the environment variable TROVE_PROFILE to a path enables the
+ * profiler at startup (with GCC and Clang) and saves the profile there at
+ * exit; TROVE_PROFILE_RATE sets the mean sampling interval in bytes.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "trove.h"
+#include <stddef.h>
+
+/** @brief Mean bytes allocated between samples unless set otherwise */
+#define TROVE_PROFILE_DEFAULT_RATE (512 * 1024)
+
+/** @brief Frames kept per stack trace */
+#define TROVE_PROFILE_MAX_DEPTH 32
+
+/** @brief Nonzero while objects are sampled; set with arc_profile_enable */
+extern int arc_profile_enabled;
+
+/** @brief Nonzero once the profiler has been enabled, so frees of sampled objects are watched */
+extern int arc_profile_watching;
+
+/**
+ * @brief Starts or stops sampling
+ *
+ * Objects sampled before sampling stops are still watched until freed.
+ *
+ * @param enabled Nonzero to sample
+ */
+void arc_profile_enable(int enabled);
+
+/**
+ * @brief Sets the mean number of bytes allocated between samples
+ *
+ * @param bytes Mean sampling interval; 1 samples every object
+ */
+void arc_profile_set_rate(size_t bytes);
+
+/**
+ * @brief Returns the number of objects sampled so far
+ */
+size_t arc_profile_samples(void);
+
+/**
+ * @brief Writes the profile in pprof's protobuf format
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param path File to create
+ * @return 0 on success, otherwise errno
+ */
+int arc_profile_save(const char *path);
+
+/**
+ * @brief Counts a new object towards the next sample; called by arc_object_init
+ *
+ * @param obj The new object
+ * @param caller Return address into the function that created it
+ */
+void arc_profile_record_alloc(ARCObject *obj, void *caller);
+
+/**
+ * @brief Closes the sample of an object if it has one; called by arc_object_free
+ */
+void arc_profile_record_free(ARCObject *obj);
+
+#endif // PROFILE_H
@@ -0,0 +1,190 @@
+/**
+ * @file reader.c
+ * @brief Implementation of TroveLineReader
+ */
+
+#include "reader.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * @brief Opens a file for reading line by line
+ *
+ * The kernel is told the file will be read sequentially so it reads ahead
+ * aggressively.
+ *
+ * @param path Path of the file
+ * @return A new TroveLineReader with a reference count of 1, or NULL with
+ *         errno set if the file cannot be opened
+ */
+TroveLineReader* TroveLineReader_open(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return TroveLineReader_create_with_fd(fd, 1, 0, 0);
+}
+
+/**
+ * @brief Creates a reader over an open file descriptor
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param fd Descriptor to read from
+ * @param owns_fd Nonzero to close fd when the reader is deallocated
+ * @param chunk_size Bytes requested per read, or 0 for TROVE_LINE_READER_CHUNK_SIZE
+ * @param batch_size Lines per batch, or 0 for TROVE_LINE_READER_BATCH_SIZE
+ * @return A new TroveLineReader with a reference count of 1
+ */
+TroveLineReader* TroveLineReader_create_with_fd(int fd, int owns_fd, size_t chunk_size, size_t batch_size) {
+    TroveLineReader *reader = (TroveLineReader *)malloc(sizeof(TroveLineReader));
+    if (!reader) {
+        fprintf(stderr, "Failed to allocate TroveLineReader.\n");
+        exit(1);
+    }
+    arc_object_init(&reader->base, TroveLineReader_dealloc, sizeof(TroveLineReader));
+    reader->fd = fd;
+    reader->owns_fd = owns_fd;
+    reader->chunk_size = chunk_size ? chunk_size : TROVE_LINE_READER_CHUNK_SIZE;
+    reader->batch_size = batch_size ? batch_size : TROVE_LINE_READER_BATCH_SIZE;
+    reader->chunk = NULL;
+    reader->cursor = 0;
+    reader->scanned = 0;
+    reader->batch = (ARCObject **)malloc(reader->batch_size * sizeof(ARCObject *));
+    if (!reader->batch) {
+        fprintf(stderr, "Failed to allocate TroveLineReader batch.\n");
+        exit(1);
+    }
+    reader->batch_count = 0;
+    reader->eof = 0;
+    reader->error = 0;
+    return reader;
+}
+
+/**
+ * @brief Releases the lines of the current batch in one pass
+ *
+ * The count is reset first, so a dealloc that reaches the reader sees an
+ * empty batch.
+ */
+static void reader_end_batch(TroveLineReader *reader) {
+    size_t count = reader->batch_count;
+    reader->batch_count = 0;
+    arc_release_all(reader->batch, count);
+}
+
+/**
+ * @brief Reads more bytes after the unconsumed part of the current chunk
+ *
+ * Bytes are appended to the current chunk while it has room, which leaves
+ * slices already handed out untouched. A full chunk is replaced by a new one
+ * that starts with the unconsumed partial line; the old chunk stays alive
+ * as long as slices into it do. A partial line longer than half the chunk
+ * size doubles the new chunk so every read has room for at least that much.
+ */
+static void reader_fill(TroveLineReader *reader) {
+    TroveString *chunk = reader->chunk;
+    if (!chunk || chunk->length == chunk->capacity) {
+        size_t carry = chunk ? chunk->length - reader->cursor : 0;
+        size_t capacity = reader->chunk_size;
+        if (carry > capacity / 2) {
+            capacity = carry * 2;
+        }
+        TroveString *next = TroveString_create_with_length(NULL, capacity);
+        if (carry > 0) {
+            memcpy(next->str, chunk->str + reader->cursor, carry);
+        }
+        next->length = carry;
+        arc_release((ARCObject *)chunk);
+        reader->chunk = chunk = next;
+        reader->cursor = 0;
+        reader->scanned = carry;
+    }
+    for (;;) {
+        ssize_t n = read(reader->fd, chunk->str + chunk->length, chunk->capacity - chunk->length);
+        if (n > 0) {
+            chunk->length += (size_t)n;
+            chunk->str[chunk->length] = '\0';
+            return;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            reader->error = errno;
+        }
+        reader->eof = 1;
+        return;
+    }
+}
+
+/**
+ * @brief Creates a slice of the current chunk and adds it to the batch
+ */
+static TroveStringSlice* reader_emit(TroveLineReader *reader, size_t offset, size_t length) {
+    TroveStringSlice *line = TroveStringSlice_create(reader->chunk, offset, length);
+    reader->batch[reader->batch_count++] = (ARCObject *)line;
+    return line;
+}
+
+/**
+ * @brief Returns the next line as a slice owned by the reader
+ *
+ * Every byte is scanned for '\n' once: the scan of a partial line resumes
+ * where the previous one stopped after more bytes arrive.
+ *
+ * @param reader The reader
+ * @return A TroveStringSlice the caller does not own, or NULL at end of input
+ *         or on a read error (see reader->error)
+ */
+TroveStringSlice* TroveLineReader_next(TroveLineReader *reader) {
+    if (reader->batch_count >= reader->batch_size) {
+        reader_end_batch(reader);
+    }
+    for (;;) {
+        TroveString *chunk = reader->chunk;
+        if (chunk) {
+            char *newline = memchr(chunk->str + reader->scanned, '\n', chunk->length - reader->scanned);
+            if (newline) {
+                size_t start = reader->cursor;
+                size_t end = (size_t)(newline - chunk->str);
+                reader->cursor = reader->scanned = end + 1;
+                return reader_emit(reader, start, end - start);
+            }
+            reader->scanned = chunk->length;
+            if (reader->eof && reader->cursor < chunk->length) {
+                size_t start = reader->cursor;
+                reader->cursor = chunk->length;
+                return reader_emit(reader, start, chunk->length - start);
+            }
+        }
+        if (reader->eof) {
+            reader_end_batch(reader);
+            return NULL;
+        }
+        reader_fill(reader);
+    }
+}
+
+/**
+ * @brief Deallocates a TroveLineReader
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveLineReader_dealloc(ARCObject *obj) {
+    TroveLineReader *reader = (TroveLineReader *)obj;
+    reader_end_batch(reader);
+    free(reader->batch);
+    arc_release((ARCObject *)reader->chunk);
+    if (reader->owns_fd) {
+        close(reader->fd);
+    }
+    arc_object_free(&reader->base);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file reader.h
+ * @brief Streaming line reader for the Trove ARC memory management system
+ *
+ * A TroveLineReader reads a file descriptor in large chunks and yields each
+ * line as a TroveStringSlice over the chunk, so no line is ever copied. Each
+ * chunk is an ordinary TroveString that lives exactly as long as some slice
+ * into it: once every line of a chunk has been released, the chunk is freed.
+ *
+ * The reader owns the slices it hands out in batches: it releases a batch
+ * of lines all at once when the next batch starts, so a loop over a file of
+ * any size keeps only about one batch of lines and the chunks they point
+ * into in memory:
+ *
+ * @code
+ * TroveLineReader *reader = TroveLineReader_open("input.txt");
+ * TroveStringSlice *line;
+ * while ((line = TroveLineReader_next(reader))) {
+ *     ... line->ptr, line->length ...
+ * }
+ * arc_release((ARCObject *)reader);
+ * @endcode
+ *
+ * A line returned by TroveLineReader_next stays valid until the reader has
+ * been asked for batch_size more lines or is deallocated; retain it to keep
+ * it longer. The reader never pushes or pops autorelease pools, so the
+ * caller may push and pop its own pools, including one enclosing the
+ * reader, at any point of the loop.
+ */
+
+#ifndef READER_H
+#define READER_H
+
+#include "trove.h"
+#include "slice.h"
+
+/** @brief Default number of bytes requested per read */
+#define TROVE_LINE_READER_CHUNK_SIZE (1 << 20)
+
+/** @brief Default number of lines in each batch */
+#define TROVE_LINE_READER_BATCH_SIZE 4096
+
+/**
+ * @brief Line reader managed by ARC
+ */
+typedef struct TroveLineReader {
+    ARCObject base;            /**< Inheritance: must be the first member */
+    int fd;                    /**< Descriptor being read */
+    int owns_fd;               /**< Nonzero when dealloc closes fd */
+    size_t chunk_size;         /**< Minimum chunk capacity in bytes */
+    size_t batch_size;         /**< Lines per autorelease pool */
+    TroveString *chunk;        /**< Retained current chunk, NULL before the first read */
+    size_t cursor;             /**< Offset of the next line in chunk */
+    size_t scanned;            /**< Offset up to which chunk is known to hold no newline */
+    ARCObject **batch;         /**< Lines handed out in the current batch, owned by the reader */
+    size_t batch_count;        /**< Number of lines in batch */
+    int eof;                   /**< Nonzero once read has returned 0 or failed */
+    int error;                 /**< errno of the failed read, or 0 */
+} TroveLineReader;
+
+/**
+ * @brief Opens a file for reading line by line
+ *
+ * @param path Path of the file
+ * @return A new TroveLineReader with a reference count of 1, or NULL with
+ *         errno set if the file cannot be opened
+ */
+TroveLineReader* TroveLineReader_open(const char *path);
+
+/**
+ * @brief Creates a reader over an open file descriptor
+ *
+ * @param fd Descriptor to read from
+ * @param owns_fd Nonzero to close fd when the reader is deallocated
+ * @param chunk_size Bytes requested per read, or 0 for TROVE_LINE_READER_CHUNK_SIZE
+ * @param batch_size Lines per batch, or 0 for TROVE_LINE_READER_BATCH_SIZE
+ * @return A new TroveLineReader with a reference count of 1
+ */
+TroveLineReader* TroveLineReader_create_with_fd(int fd, int owns_fd, size_t chunk_size, size_t batch_size);
+
+/**
+ * @brief Returns the next line as a slice owned by the reader
+ *
+ * The slice excludes the terminating '\n'. A last line without a newline is
+ * returned as well. Lines longer than the chunk size grow the chunk. Starting
+ * a new batch releases the lines of the previous one.
+ *
+ * @param reader The reader
+ * @return A TroveStringSlice the caller does not own, or NULL at end of input
+ *         or on a read error (see reader->error)
+ */
+TroveStringSlice* TroveLineReader_next(TroveLineReader *reader);
+
+/**
+ * @brief Deallocates a TroveLineReader
+ *
+ * Releases the lines of the current batch and closes the descriptor if the
+ * reader owns it. This function is called automatically when the
+ * reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveLineReader_dealloc(ARCObject *obj);
+
+#endif // READER_H
@@ -0,0 +1,416 @@
+/**
+ * @file rope.c
+ * @brief Implementation of rope strings
+ *
+ * Ropes are AVL-balanced and immutable. Every operation that produces a new
+ * rope copies only the nodes on the path it changes and retains the rest, so
+ * older ropes stay valid and share structure with newer ones.
+ *
+ * Internal helpers below "consume" their rope arguments: the caller hands
+ * over one reference per argument and receives one reference to the result.
+ */
+
+#include "rope.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/** @brief Number of iovec entries submitted per writev call */
+#define ROPE_WRITEV_BATCH 64
+
+/**
+ * @brief Allocates an uninitialized rope node with a reference count of 1
+ */
+static TroveRope* rope_alloc(void) {
+    TroveRope *rope = (TroveRope *)malloc(sizeof(TroveRope));
+    if (!rope) {
+        fprintf(stderr, "Failed to allocate TroveRope.\n");
+        exit(1);
+    }
+    arc_object_init(&rope->base, TroveRope_dealloc, sizeof(TroveRope));
+    return rope;
+}
+
+/**
+ * @brief Returns non-zero if the node is a leaf
+ */
+static int is_leaf(TroveRope *rope) {
+    return rope->left == NULL;
+}
+
+/**
+ * @brief Creates a leaf over bytes owned by owner
+ *
+ * @param owner The object that owns the bytes (retained, may be NULL for static bytes)
+ * @param bytes First byte of the piece
+ * @param length Number of bytes
+ * @return A new leaf with a reference count of 1
+ */
+static TroveRope* leaf_new(ARCObject *owner, const char *bytes, size_t length) {
+    TroveRope *rope = rope_alloc();
+    arc_retain(owner);
+    rope->left = NULL;
+    rope->right = NULL;
+    rope->owner = owner;
+    rope->bytes = bytes;
+    rope->length = length;
+    rope->height = 0;
+    return rope;
+}
+
+/**
+ * @brief Creates a concatenation node, consuming left and right
+ */
+static TroveRope* node_new(TroveRope *left, TroveRope *right) {
+    TroveRope *rope = rope_alloc();
+    rope->left = left;
+    rope->right = right;
+    rope->owner = NULL;
+    rope->bytes = NULL;
+    rope->length = left->length + right->length;
+    rope->height = 1 + (left->height > right->height ? left->height : right->height);
+    return rope;
+}
+
+/**
+ * @brief Replaces two short leaves with a single leaf holding a copy of both
+ */
+static TroveRope* merge_leaves(TroveRope *left, TroveRope *right) {
+    TroveString *str = TroveString_create_with_length(NULL, left->length + right->length);
+    memcpy(str->str, left->bytes, left->length);
+    memcpy(str->str + left->length, right->bytes, right->length);
+    TroveRope *leaf = leaf_new((ARCObject *)str, str->str, str->length);
+    arc_release((ARCObject *)str);
+    arc_release((ARCObject *)left);
+    arc_release((ARCObject *)right);
+    return leaf;
+}
+
+/**
+ * @brief Joins two subtrees whose heights differ by at most two
+ *
+ * Applies a single or double AVL rotation when the difference is two.
+ * Consumes a and b.
+ */
+static TroveRope* balance(TroveRope *a, TroveRope *b) {
+    if (b->height > a->height + 1) {
+        TroveRope *bl = b->left;
+        TroveRope *br = b->right;
+        arc_retain((ARCObject *)bl);
+        arc_retain((ARCObject *)br);
+        arc_release((ARCObject *)b);
+        if (bl->height > br->height) {
+            TroveRope *x1 = bl->left;
+            TroveRope *x2 = bl->right;
+            arc_retain((ARCObject *)x1);
+            arc_retain((ARCObject *)x2);
+            arc_release((ARCObject *)bl);
+            return node_new(node_new(a, x1), node_new(x2, br));
+        }
+        return node_new(node_new(a, bl), br);
+    }
+    if (a->height > b->height + 1) {
+        TroveRope *al = a->left;
+        TroveRope *ar = a->right;
+        arc_retain((ARCObject *)al);
+        arc_retain((ARCObject *)ar);
+        arc_release((ARCObject *)a);
+        if (ar->height > al->height) {
+            TroveRope *x1 = ar->left;
+            TroveRope *x2 = ar->right;
+            arc_retain((ARCObject *)x1);
+            arc_retain((ARCObject *)x2);
+            arc_release((ARCObject *)ar);
+            return node_new(node_new(al, x1), node_new(x2, b));
+        }
+        return node_new(al, node_new(ar, b));
+    }
+    return node_new(a, b);
+}
+
+/**
+ * @brief Concatenates two balanced ropes into a balanced rope
+ *
+ * Descends the taller tree's inner spine until the heights match, so only
+ * O(log n) nodes are created. A short leaf is always pushed down to meet its
+ * neighbouring leaf so the two can be merged. Consumes left and right.
+ */
+static TroveRope* join(TroveRope *left, TroveRope *right) {
+    if (left->length == 0) {
+        arc_release((ARCObject *)left);
+        return right;
+    }
+    if (right->length == 0) {
+        arc_release((ARCObject *)right);
+        return left;
+    }
+    if (is_leaf(left) && is_leaf(right)) {
+        if (left->length + right->length <= TROVE_ROPE_LEAF_MAX) {
+            return merge_leaves(left, right);
+        }
+        return node_new(left, right);
+    }
+    if (left->height > right->height + 1 ||
+        (is_leaf(right) && right->length < TROVE_ROPE_LEAF_MAX)) {
+        TroveRope *ll = left->left;
+        TroveRope *lr = left->right;
+        arc_retain((ARCObject *)ll);
+        arc_retain((ARCObject *)lr);
+        arc_release((ARCObject *)left);
+        return balance(ll, join(lr, right));
+    }
+    if (right->height > left->height + 1 ||
+        (is_leaf(left) && left->length < TROVE_ROPE_LEAF_MAX)) {
+        TroveRope *rl = right->left;
+        TroveRope *rr = right->right;
+        arc_retain((ARCObject *)rl);
+        arc_retain((ARCObject *)rr);
+        arc_release((ARCObject *)right);
+        return balance(join(left, rl), rr);
+    }
+    return node_new(left, right);
+}
+
+/**
+ * @brief Creates a rope holding a copy of a C string
+ *
+ * @param text The initial value (can be NULL for an empty rope)
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_create(const char *text) {
+    TroveString *str = TroveString_create(text);
+    TroveRope *rope = TroveRope_create_with_string(str);
+    arc_release((ARCObject *)str);
+    return rope;
+}
+
+/**
+ * @brief Creates a rope leaf that shares the bytes of a string
+ *
+ * @param str The string to reference (retained)
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_create_with_string(TroveString *str) {
+    return leaf_new((ARCObject *)str, str->str, str->length);
+}
+
+/**
+ * @brief Creates a rope leaf that shares the bytes of a slice
+ *
+ * @param slice The slice to reference
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_create_with_slice(TroveStringSlice *slice) {
+    return leaf_new((ARCObject *)slice->parent, slice->ptr, slice->length);
+}
+
+/**
+ * @brief Concatenates two ropes without modifying either
+ *
+ * @param left The rope providing the leading bytes
+ * @param right The rope providing the trailing bytes
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_concat(TroveRope *left, TroveRope *right) {
+    arc_retain((ARCObject *)left);
+    arc_retain((ARCObject *)right);
+    return join(left, right);
+}
+
+/**
+ * @brief Appends a copy of a C string to a rope
+ *
+ * @param rope The rope to extend (not consumed)
+ * @param text The bytes to append
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_append(TroveRope *rope, const char *text) {
+    arc_retain((ARCObject *)rope);
+    return join(rope, TroveRope_create(text));
+}
+
+/**
+ * @brief Returns the byte at an index in O(log n)
+ *
+ * @param rope The rope to index
+ * @param index Byte offset
+ * @return The byte, or '\0' when index is out of range
+ */
+char TroveRope_char_at(TroveRope *rope, size_t index) {
+    if (index >= rope->length) {
+        return '\0';
+    }
+    while (!is_leaf(rope)) {
+        if (index < rope->left->length) {
+            rope = rope->left;
+        } else {
+            index -= rope->left->length;
+            rope = rope->right;
+        }
+    }
+    return rope->bytes[index];
+}
+
+/**
+ * @brief Recursive worker for TroveRope_substring with an in-range request
+ */
+static TroveRope* substring(TroveRope *rope, size_t offset, size_t length) {
+    if (offset == 0 && length == rope->length) {
+        arc_retain((ARCObject *)rope);
+        return rope;
+    }
+    if (is_leaf(rope)) {
+        return leaf_new(rope->owner, rope->bytes + offset, length);
+    }
+    size_t split = rope->left->length;
+    if (offset + length <= split) {
+        return substring(rope->left, offset, length);
+    }
+    if (offset >= split) {
+        return substring(rope->right, offset - split, length);
+    }
+    return join(substring(rope->left, offset, split - offset),
+                substring(rope->right, 0, offset + length - split));
+}
+
+/**
+ * @brief Returns a rope covering a byte range, sharing nodes with the source
+ *
+ * @param rope The source rope
+ * @param offset Byte offset of the first byte
+ * @param length Number of bytes
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_substring(TroveRope *rope, size_t offset, size_t length) {
+    if (offset > rope->length) {
+        offset = rope->length;
+    }
+    if (length > rope->length - offset) {
+        length = rope->length - offset;
+    }
+    if (length == 0) {
+        return leaf_new(NULL, "", 0);
+    }
+    return substring(rope, offset, length);
+}
+
+/**
+ * @brief Copies a rope into a single flat string
+ *
+ * @param rope The rope to flatten
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveRope_flatten(TroveRope *rope) {
+    TroveString *str = TroveString_create_with_length(NULL, rope->length);
+    TroveRopeIter it;
+    struct iovec iov[ROPE_WRITEV_BATCH];
+    size_t pos = 0;
+    size_t n;
+    TroveRope_iter_init(&it, rope);
+    while ((n = TroveRope_iter_fill(&it, iov, ROPE_WRITEV_BATCH)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            memcpy(str->str + pos, iov[i].iov_base, iov[i].iov_len);
+            pos += iov[i].iov_len;
+        }
+    }
+    return str;
+}
+
+/**
+ * @brief Prepares an iterator over the leaves of a rope
+ *
+ * @param it The iterator to initialize
+ * @param rope The rope to walk
+ */
+void TroveRope_iter_init(TroveRopeIter *it, TroveRope *rope) {
+    it->depth = 0;
+    if (rope->length > 0) {
+        it->stack[it->depth++] = rope;
+    }
+}
+
+/**
+ * @brief Fills an iovec array with the next non-empty leaves of a rope
+ *
+ * The explicit stack never holds more than height + 1 entries because a
+ * node's right child is pushed only while its left subtree is explored.
+ *
+ * @param it The iterator
+ * @param iov The array to fill
+ * @param max Capacity of iov
+ * @return Number of entries written; 0 once the rope is exhausted
+ */
+size_t TroveRope_iter_fill(TroveRopeIter *it, struct iovec *iov, size_t max) {
+    size_t count = 0;
+    while (count < max && it->depth > 0) {
+        TroveRope *rope = it->stack[--it->depth];
+        while (!is_leaf(rope)) {
+            it->stack[it->depth++] = rope->right;
+            rope = rope->left;
+        }
+        if (rope->length > 0) {
+            iov[count].iov_base = (void *)rope->bytes;
+            iov[count].iov_len = rope->length;
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Writes a whole rope to a file descriptor using writev
+ *
+ * @param rope The rope to write
+ * @param fd The destination file descriptor
+ * @return Number of bytes written, or -1 on error (errno is set)
+ */
+ssize_t TroveRope_writev(TroveRope *rope, int fd) {
+    TroveRopeIter it;
+    struct iovec iov[ROPE_WRITEV_BATCH];
+    ssize_t total = 0;
+    size_t n;
+    TroveRope_iter_init(&it, rope);
+    while ((n = TroveRope_iter_fill(&it, iov, ROPE_WRITEV_BATCH)) > 0) {
+        struct iovec *cur = iov;
+        while (n > 0) {
+            ssize_t written = writev(fd, cur, (int)n);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            total += written;
+            while (n > 0 && (size_t)written >= cur->iov_len) {
+                written -= (ssize_t)cur->iov_len;
+                cur++;
+                n--;
+            }
+            if (n > 0) {
+                cur->iov_base = (char *)cur->iov_base + written;
+                cur->iov_len -= (size_t)written;
+            }
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief Deallocates a rope node
+ *
+ * Releases both children of a concatenation node, or the owner of a leaf's
+ * bytes, then frees the node itself.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveRope_dealloc(ARCObject *obj) {
+    TroveRope *rope = (TroveRope *)obj;
+    if (rope->left) {
+        arc_release((ARCObject *)rope->left);
+        arc_release((ARCObject *)rope->right);
+    } else {
+        arc_release(rope->owner);
+    }
+    arc_object_free(&rope->base);
+}
@@ -0,0 +1,178 @@
+/**
+ * @file rope.h
+ * @brief Rope strings for the Trove ARC memory management system
+ *
+ * A TroveRope is an immutable, height-balanced binary tree of string pieces.
+ * Concatenation creates O(log n) new nodes and shares everything else with its
+ * inputs through reference counting, so building a large output by repeated
+ * appends is linear rather than quadratic. Leaves reference the bytes of an
+ * existing TroveString without copying; short adjacent leaves are merged so
+ * appending many small pieces does not produce a tree of tiny nodes.
+ */
+
+#ifndef ROPE_H
+#define ROPE_H
+
+#include "trove.h"
+#include "slice.h"
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/** @brief Leaves shorter than this are merged with a short neighbour on append */
+#define TROVE_ROPE_LEAF_MAX 256
+
+/** @brief Upper bound on rope height (an AVL tree of 2^64 leaves stays below this) */
+#define TROVE_ROPE_MAX_DEPTH 96
+
+/**
+ * @brief Rope node managed by ARC
+ *
+ * A node is either a leaf (left and right are NULL) referencing bytes owned
+ * by another ARC object, or a concatenation of two retained child ropes.
+ */
+typedef struct TroveRope {
+    ARCObject base;           /**< Inheritance: must be the first member */
+    struct TroveRope *left;   /**< Left child, or NULL for a leaf */
+    struct TroveRope *right;  /**< Right child, or NULL for a leaf */
+    ARCObject *owner;         /**< Leaf only: retained object that owns bytes */
+    const char *bytes;        /**< Leaf only: first byte of the piece */
+    size_t length;            /**< Total number of bytes in this subtree */
+    int height;               /**< 0 for leaves, 1 + max child height otherwise */
+} TroveRope;
+
+/**
+ * @brief Iterator state for walking the leaves of a rope in order
+ *
+ * Declare on the stack and initialize with TroveRope_iter_init. The rope
+ * must stay alive while the iterator is in use.
+ */
+typedef struct TroveRopeIter {
+    TroveRope *stack[TROVE_ROPE_MAX_DEPTH + 1];  /**< Pending subtrees, top last */
+    size_t depth;                                /**< Number of pending subtrees */
+} TroveRopeIter;
+
+/**
+ * @brief Creates a rope holding a copy of a C string
+ *
+ * @param text The initial value (can be NULL for an empty rope)
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_create(const char *text);
+
+/**
+ * @brief Creates a rope leaf that shares the bytes of a string
+ *
+ * @param str The string to reference (retained)
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_create_with_string(TroveString *str);
+
+/**
+ * @brief Creates a rope leaf that shares the bytes of a slice
+ *
+ * The leaf retains the slice's parent string, not the slice itself.
+ *
+ * @param slice The slice to reference
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_create_with_slice(TroveStringSlice *slice);
+
+/**
+ * @brief Concatenates two ropes
+ *
+ * Neither input is modified or consumed; the result shares their nodes.
+ *
+ * @param left The rope providing the leading bytes
+ * @param right The rope providing the trailing bytes
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_concat(TroveRope *left, TroveRope *right);
+
+/**
+ * @brief Appends a copy of a C string to a rope
+ *
+ * @param rope The rope to extend (not consumed)
+ * @param text The bytes to append
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_append(TroveRope *rope, const char *text);
+
+/**
+ * @brief Returns the byte at an index in O(log n)
+ *
+ * @param rope The rope to index
+ * @param index Byte offset
+ * @return The byte, or '\0' when index is out of range
+ */
+char TroveRope_char_at(TroveRope *rope, size_t index);
+
+/**
+ * @brief Returns a rope covering a byte range, sharing nodes with the source
+ *
+ * The range is clamped to the bounds of the rope.
+ *
+ * @param rope The source rope
+ * @param offset Byte offset of the first byte
+ * @param length Number of bytes
+ * @return A new TroveRope with a reference count of 1
+ */
+TroveRope* TroveRope_substring(TroveRope *rope, size_t offset, size_t length);
+
+/**
+ * @brief Copies a rope into a single flat string
+ *
+ * @param rope The rope to flatten
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveRope_flatten(TroveRope *rope);
+
+/**
+ * @brief Prepares an iterator over the leaves of a rope
+ *
+ * @param it The iterator to initialize
+ * @param rope The rope to walk
+ */
+void TroveRope_iter_init(TroveRopeIter *it, TroveRope *rope);
+
+/**
+ * @brief Fills an iovec array with the next leaves of a rope
+ *
+ * Entries point directly at leaf bytes, ready for writev.
+ *
+ * @param it The iterator
+ * @param iov The array to fill
+ * @param max Capacity of iov
+ * @return Number of entries written; 0 once the rope is exhausted
+ */
+size_t TroveRope_iter_fill(TroveRopeIter *it, struct iovec *iov, size_t max);
+
+/**
+ * @brief Writes a whole rope to a file descriptor using writev
+ *
+ * Short writes are resumed until every byte is written.
+ *
+ * @param rope The rope to write
+ * @param fd The destination file descriptor
+ * @return Number of bytes written, or -1 on error (errno is set)
+ */
+ssize_t TroveRope_writev(TroveRope *rope, int fd);
+
+/**
+ * @brief Deallocates a rope node and releases its children or owner
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveRope_dealloc(ARCObject *obj);
+
+/**
+ * @brief Convenience macro for creating autoreleased TroveRope objects
+ *
+ * @code
+ * TroveRope *r = Rope("Hello, ");
+ * @endcode
+ */
+#define Rope(text) ((TroveRope *)arc_autorelease((ARCObject *)TROVE_AT_SITE(TroveRope_create(text))))
+
+#endif // ROPE_H
@@ -0,0 +1,907 @@
+/**
+ * @file serial.c
+ * @brief Implementation of binary serialization
+ */
+
+#include "serial.h"
+#include "array.h"
+#include "dictionary.h"
+#include "set.h"
+#include "vector.h"
+#include "map.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/** @brief Largest number of elements reserved up front from a decoded count */
+#define SERIAL_RESERVE_MAX 4096
+
+/** @brief Bytes allocated up front for a string or data payload read from a descriptor */
+#define SERIAL_GROW_MIN (1 << 20)
+
+/**
+ * @brief Encoding registered for a tag
+ */
+typedef struct SerialType {
+    void (*dealloc)(ARCObject *);    /**< Identifies objects of the type, NULL for free tags */
+    TroveEncodeFunction encode;      /**< Payload writer */
+    TroveDecodeFunction decode;      /**< Payload reader */
+} SerialType;
+
+static void encode_string(TroveEncoder *encoder, ARCObject *obj);
+static void encode_array(TroveEncoder *encoder, ARCObject *obj);
+static void encode_dictionary(TroveEncoder *encoder, ARCObject *obj);
+static void encode_set(TroveEncoder *encoder, ARCObject *obj);
+static void encode_vector(TroveEncoder *encoder, ARCObject *obj);
+static void encode_map(TroveEncoder *encoder, ARCObject *obj);
+static void encode_data(TroveEncoder *encoder, ARCObject *obj);
+static ARCObject* decode_string(TroveDecoder *decoder);
+static ARCObject* decode_array(TroveDecoder *decoder);
+static ARCObject* decode_dictionary(TroveDecoder *decoder);
+static ARCObject* decode_set(TroveDecoder *decoder);
+static ARCObject* decode_vector(TroveDecoder *decoder);
+static ARCObject* decode_map(TroveDecoder *decoder);
+static ARCObject* decode_data(TroveDecoder *decoder);
+
+/** @brief Registered encodings by tag; the built-in ones are filled in statically */
+static SerialType serial_types[TROVE_SERIAL_MAX_TAG] = {
+    [TROVE_SERIAL_STRING] = { TroveString_dealloc, encode_string, decode_string },
+    [TROVE_SERIAL_ARRAY] = { TroveArray_dealloc, encode_array, decode_array },
+    [TROVE_SERIAL_DICTIONARY] = { TroveDictionary_dealloc, encode_dictionary, decode_dictionary },
+    [TROVE_SERIAL_SET] = { TroveSet_dealloc, encode_set, decode_set },
+    [TROVE_SERIAL_VECTOR] = { TroveVector_dealloc, encode_vector, decode_vector },
+    [TROVE_SERIAL_MAP] = { TroveMap_dealloc, encode_map, decode_map },
+    [TROVE_SERIAL_DATA] = { TroveData_dealloc, encode_data, decode_data }
+};
+
+/**
+ * @brief Registers the encoding of an application type
+ *
+ * @param tag Tag from TROVE_SERIAL_USER_TAG up to TROVE_SERIAL_MAX_TAG - 1
+ * @param dealloc The dealloc function of the type's objects
+ * @param encode Payload writer
+ * @param decode Payload reader
+ * @return 0 on success, EINVAL if the tag is out of range or taken
+ */
+int trove_serial_register(unsigned tag, void (*dealloc)(ARCObject *), TroveEncodeFunction encode, TroveDecodeFunction decode) {
+    if (tag < TROVE_SERIAL_USER_TAG || tag >= TROVE_SERIAL_MAX_TAG || serial_types[tag].dealloc || !dealloc) {
+        return EINVAL;
+    }
+    serial_types[tag].dealloc = dealloc;
+    serial_types[tag].encode = encode;
+    serial_types[tag].decode = decode;
+    return 0;
+}
+
+/**
+ * @brief Returns the tag registered for a dealloc function, or 0 if there is none
+ */
+static unsigned serial_tag_for(void (*dealloc)(ARCObject *)) {
+    for (unsigned tag = TROVE_SERIAL_STRING; tag < TROVE_SERIAL_MAX_TAG; tag++) {
+        if (serial_types[tag].dealloc == dealloc) {
+            return tag;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes the pending bytes of a descriptor encoder
+ *
+ * After a failed write the encoder keeps its error and drops further output.
+ */
+static void encoder_flush(TroveEncoder *encoder) {
+    size_t written = 0;
+    while (written < encoder->length && !encoder->error) {
+        ssize_t n = write(encoder->fd, encoder->buffer + written, encoder->length - written);
+        if (n > 0) {
+            written += (size_t)n;
+        } else if (n < 0 && errno != EINTR) {
+            encoder->error = errno;
+        }
+    }
+    encoder->length = 0;
+}
+
+/**
+ * @brief Makes room for size more bytes (at most TROVE_SERIAL_BUFFER_SIZE)
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static void encoder_reserve(TroveEncoder *encoder, size_t size) {
+    if (encoder->capacity - encoder->length >= size) {
+        return;
+    }
+    if (encoder->fd >= 0) {
+        encoder_flush(encoder);
+        return;
+    }
+    size_t capacity = encoder->capacity * 2;
+    while (capacity - encoder->length < size) {
+        capacity *= 2;
+    }
+    unsigned char *buffer = (unsigned char *)realloc(encoder->buffer, capacity);
+    if (!buffer) {
+        fprintf(stderr, "Failed to grow serialization buffer.\n");
+        exit(1);
+    }
+    encoder->buffer = buffer;
+    encoder->capacity = capacity;
+}
+
+/**
+ * @brief Writes an unsigned integer
+ *
+ * @param encoder The encoder
+ * @param value The value
+ */
+void trove_encode_uint(TroveEncoder *encoder, uint64_t value) {
+    if (encoder->capacity - encoder->length < 10) {
+        encoder_reserve(encoder, 10);
+    }
+    unsigned char *p = encoder->buffer + encoder->length;
+    while (value >= 0x80) {
+        *p++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+    encoder->length = (size_t)(p - encoder->buffer);
+}
+
+/**
+ * @brief Writes raw bytes
+ *
+ * Runs longer than the buffer bypass it when encoding to a descriptor.
+ *
+ * @param encoder The encoder
+ * @param bytes The bytes
+ * @param length Number of bytes
+ */
+void trove_encode_bytes(TroveEncoder *encoder, const void *bytes, size_t length) {
+    if (encoder->fd >= 0 && length > encoder->capacity) {
+        encoder_flush(encoder);
+        unsigned char *saved = encoder->buffer;
+        encoder->buffer = (unsigned char *)bytes;
+        encoder->length = length;
+        encoder_flush(encoder);
+        encoder->buffer = saved;
+        return;
+    }
+    if (encoder->capacity - encoder->length < length) {
+        encoder_reserve(encoder, length);
+    }
+    memcpy(encoder->buffer + encoder->length, bytes, length);
+    encoder->length += length;
+}
+
+/**
+ * @brief Returns the slot of an object in the shared-object table, or the empty slot where it belongs
+ */
+static size_t encoder_slot(TroveEncoder *encoder, ARCObject *obj) {
+    size_t mask = encoder->seen_capacity - 1;
+    size_t i = (size_t)(((uint64_t)(uintptr_t)obj * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    while (encoder->seen[i] && encoder->seen[i] != obj) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/**
+ * @brief Doubles the shared-object table, or creates it
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static void encoder_grow_seen(TroveEncoder *encoder) {
+    ARCObject **old_seen = encoder->seen;
+    size_t *old_numbers = encoder->numbers;
+    size_t old_capacity = encoder->seen_capacity;
+    encoder->seen_capacity = old_capacity ? old_capacity * 2 : 64;
+    encoder->seen = (ARCObject **)calloc(encoder->seen_capacity, sizeof(ARCObject *));
+    encoder->numbers = (size_t *)malloc(encoder->seen_capacity * sizeof(size_t));
+    if (!encoder->seen || !encoder->numbers) {
+        fprintf(stderr, "Failed to allocate serialization table.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_seen[i]) {
+            size_t slot = encoder_slot(encoder, old_seen[i]);
+            encoder->seen[slot] = old_seen[i];
+            encoder->numbers[slot] = old_numbers[i];
+        }
+    }
+    free(old_seen);
+    free(old_numbers);
+}
+
+/**
+ * @brief Writes an object, or a reference to it if it was written before
+ *
+ * Only objects with a reference count above 1 can be reached twice, so only
+ * those are looked up and recorded. A shared object met again while its own
+ * encoding is in progress is a cycle, which the format cannot express.
+ *
+ * @param encoder The encoder
+ * @param obj The object (may be NULL)
+ */
+void trove_encode_object(TroveEncoder *encoder, ARCObject *obj) {
+    if (encoder->error) {
+        return;
+    }
+    if (!obj) {
+        trove_encode_uint(encoder, TROVE_SERIAL_NULL << 1);
+        return;
+    }
+    unsigned tag = serial_tag_for(obj->dealloc);
+    if (!tag) {
+        encoder->error = ENOTSUP;
+        return;
+    }
+    int shared = obj->ref_count > 1;
+    if (shared) {
+        if ((encoder->seen_count + 1) * 2 > encoder->seen_capacity) {
+            encoder_grow_seen(encoder);
+        }
+        size_t slot = encoder_slot(encoder, obj);
+        if (encoder->seen[slot]) {
+            if (encoder->numbers[slot] == SIZE_MAX) {
+                encoder->error = ELOOP;
+                return;
+            }
+            trove_encode_uint(encoder, TROVE_SERIAL_REF << 1);
+            trove_encode_uint(encoder, encoder->numbers[slot]);
+            return;
+        }
+        encoder->seen[slot] = obj;
+        encoder->numbers[slot] = SIZE_MAX;
+        encoder->seen_count++;
+    }
+    if (encoder->depth >= TROVE_SERIAL_MAX_DEPTH) {
+        encoder->error = ELOOP;
+        return;
+    }
+    trove_encode_uint(encoder, ((uint64_t)tag << 1) | (uint64_t)shared);
+    encoder->depth++;
+    serial_types[tag].encode(encoder, obj);
+    encoder->depth--;
+    if (shared) {
+        encoder->numbers[encoder_slot(encoder, obj)] = encoder->shared_count++;
+    }
+}
+
+/**
+ * @brief Prepares an encoder and writes the magic bytes
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static void encoder_init(TroveEncoder *encoder, int fd) {
+    encoder->fd = fd;
+    encoder->capacity = TROVE_SERIAL_BUFFER_SIZE;
+    encoder->buffer = (unsigned char *)malloc(encoder->capacity);
+    if (!encoder->buffer) {
+        fprintf(stderr, "Failed to allocate serialization buffer.\n");
+        exit(1);
+    }
+    encoder->length = 0;
+    encoder->seen = NULL;
+    encoder->numbers = NULL;
+    encoder->seen_capacity = 0;
+    encoder->seen_count = 0;
+    encoder->shared_count = 0;
+    encoder->depth = 0;
+    encoder->error = 0;
+    trove_encode_bytes(encoder, TROVE_SERIAL_MAGIC, 4);
+}
+
+/**
+ * @brief Frees the shared-object table of an encoder
+ */
+static void encoder_finish(TroveEncoder *encoder) {
+    free(encoder->seen);
+    free(encoder->numbers);
+}
+
+/**
+ * @brief TroveDataDeallocator for buffers returned by trove_serialize
+ */
+static void serial_free_buffer(void *bytes, size_t length, void *context) {
+    (void)length;
+    (void)context;
+    free(bytes);
+}
+
+/**
+ * @brief Encodes an object graph into memory
+ *
+ * The returned data adopts the encoder's buffer.
+ *
+ * @param root The root object (may be NULL)
+ * @param error Receives 0, ENOTSUP for an unregistered type, or ELOOP for a
+ *              cycle or nesting deeper than TROVE_SERIAL_MAX_DEPTH (may be NULL)
+ * @return A new TroveData with a reference count of 1, or NULL on error
+ */
+TroveData* trove_serialize(ARCObject *root, int *error) {
+    TroveEncoder encoder;
+    encoder_init(&encoder, -1);
+    trove_encode_object(&encoder, root);
+    encoder_finish(&encoder);
+    if (error) {
+        *error = encoder.error;
+    }
+    if (encoder.error) {
+        free(encoder.buffer);
+        return NULL;
+    }
+    return TroveData_create_no_copy(encoder.buffer, encoder.length, serial_free_buffer, NULL);
+}
+
+/**
+ * @brief Encodes an object graph to a file descriptor
+ *
+ * @param root The root object (may be NULL)
+ * @param fd Descriptor to write to
+ * @return 0 on success, otherwise an error as for trove_serialize or the
+ *         errno of a failed write
+ */
+int trove_serialize_to_fd(ARCObject *root, int fd) {
+    TroveEncoder encoder;
+    encoder_init(&encoder, fd);
+    trove_encode_object(&encoder, root);
+    if (!encoder.error) {
+        encoder_flush(&encoder);
+    }
+    encoder_finish(&encoder);
+    free(encoder.buffer);
+    return encoder.error;
+}
+
+/**
+ * @brief Reads more input until at least need bytes (at most 10) are buffered
+ *
+ * Running out of input in the middle of an encoding is an error.
+ */
+static int decoder_refill(TroveDecoder *decoder, size_t need) {
+    if (decoder->error) {
+        return decoder->error;
+    }
+    if (decoder->fd < 0) {
+        return decoder->error = EINVAL;
+    }
+    size_t have = (size_t)(decoder->end - decoder->pos);
+    memmove(decoder->buffer, decoder->pos, have);
+    decoder->pos = decoder->buffer;
+    decoder->end = decoder->buffer + have;
+    while ((size_t)(decoder->end - decoder->pos) < need) {
+        ssize_t n = read(decoder->fd, decoder->buffer + have, TROVE_SERIAL_BUFFER_SIZE - have);
+        if (n > 0) {
+            have += (size_t)n;
+            decoder->end = decoder->buffer + have;
+        } else if (n == 0) {
+            return decoder->error = EINVAL;
+        } else if (errno != EINTR) {
+            return decoder->error = errno;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads an unsigned integer
+ *
+ * @param decoder The decoder
+ * @param value Receives the value
+ * @return 0 on success, otherwise the decoder's error
+ */
+int trove_decode_uint(TroveDecoder *decoder, uint64_t *value) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (decoder->pos == decoder->end && decoder_refill(decoder, 1)) {
+            return decoder->error;
+        }
+        unsigned char byte = *decoder->pos++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 0;
+        }
+    }
+    return decoder->error = EINVAL;
+}
+
+/**
+ * @brief Reads raw bytes
+ *
+ * @param decoder The decoder
+ * @param bytes Destination
+ * @param length Number of bytes
+ * @return 0 on success, otherwise the decoder's error
+ */
+int trove_decode_bytes(TroveDecoder *decoder, void *bytes, size_t length) {
+    unsigned char *dst = (unsigned char *)bytes;
+    while (length > 0) {
+        if (decoder->pos == decoder->end && decoder_refill(decoder, 1)) {
+            return decoder->error;
+        }
+        size_t n = (size_t)(decoder->end - decoder->pos);
+        if (n > length) {
+            n = length;
+        }
+        memcpy(dst, decoder->pos, n);
+        decoder->pos += n;
+        dst += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads a length and checks it against the remaining input
+ *
+ * @param decoder The decoder
+ * @param min_bytes Minimum number of encoded bytes per counted item
+ * @param length Receives the length
+ * @return 0 on success, otherwise the decoder's error
+ */
+int trove_decode_length(TroveDecoder *decoder, size_t min_bytes, size_t *length) {
+    uint64_t value;
+    if (trove_decode_uint(decoder, &value)) {
+        return decoder->error;
+    }
+    uint64_t limit = decoder->fd < 0 ? (uint64_t)(decoder->end - decoder->pos) / min_bytes : (uint64_t)(SIZE_MAX / 16);
+    if (value > limit) {
+        return decoder->error = EINVAL;
+    }
+    *length = (size_t)value;
+    return 0;
+}
+
+/**
+ * @brief Records a decoded shared object under the next number, retaining it
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static void decoder_add_shared(TroveDecoder *decoder, ARCObject *obj) {
+    if (decoder->shared_count == decoder->shared_capacity) {
+        size_t capacity = decoder->shared_capacity ? decoder->shared_capacity * 2 : 64;
+        ARCObject **shared = (ARCObject **)realloc(decoder->shared, capacity * sizeof(ARCObject *));
+        if (!shared) {
+            fprintf(stderr, "Failed to grow deserialization table.\n");
+            exit(1);
+        }
+        decoder->shared = shared;
+        decoder->shared_capacity = capacity;
+    }
+    arc_retain(obj);
+    decoder->shared[decoder->shared_count++] = obj;
+}
+
+/**
+ * @brief Reads an object
+ *
+ * @param decoder The decoder
+ * @return The object with its reference count raised by 1, or NULL if it is
+ *         NULL or decoder->error was set
+ */
+ARCObject* trove_decode_object(TroveDecoder *decoder) {
+    uint64_t header;
+    if (decoder->error || trove_decode_uint(decoder, &header)) {
+        return NULL;
+    }
+    uint64_t tag = header >> 1;
+    if (tag == TROVE_SERIAL_NULL && !(header & 1)) {
+        return NULL;
+    }
+    if (tag == TROVE_SERIAL_REF && !(header & 1)) {
+        uint64_t number;
+        if (trove_decode_uint(decoder, &number)) {
+            return NULL;
+        }
+        if (number >= decoder->shared_count) {
+            decoder->error = EINVAL;
+            return NULL;
+        }
+        arc_retain(decoder->shared[number]);
+        return decoder->shared[number];
+    }
+    if (tag >= TROVE_SERIAL_MAX_TAG || !serial_types[tag].decode || decoder->depth >= TROVE_SERIAL_MAX_DEPTH) {
+        decoder->error = EINVAL;
+        return NULL;
+    }
+    decoder->depth++;
+    ARCObject *obj = serial_types[tag].decode(decoder);
+    decoder->depth--;
+    if (!obj) {
+        if (!decoder->error) {
+            decoder->error = EINVAL;
+        }
+        return NULL;
+    }
+    if (header & 1) {
+        decoder_add_shared(decoder, obj);
+    }
+    return obj;
+}
+
+/**
+ * @brief Decodes the magic bytes and root object, then drops the shared-object table
+ */
+static ARCObject* decoder_run(TroveDecoder *decoder, int *error) {
+    decoder->shared = NULL;
+    decoder->shared_count = 0;
+    decoder->shared_capacity = 0;
+    decoder->depth = 0;
+    decoder->error = 0;
+    char magic[4];
+    ARCObject *root = NULL;
+    if (trove_decode_bytes(decoder, magic, sizeof(magic)) == 0) {
+        if (memcmp(magic, TROVE_SERIAL_MAGIC, sizeof(magic)) != 0) {
+            decoder->error = EINVAL;
+        } else {
+            root = trove_decode_object(decoder);
+        }
+    }
+    arc_release_all(decoder->shared, decoder->shared_count);
+    free(decoder->shared);
+    if (decoder->error) {
+        arc_release(root);
+        root = NULL;
+    }
+    if (error) {
+        *error = decoder->error;
+    }
+    return root;
+}
+
+/**
+ * @brief Decodes an object graph from memory
+ *
+ * @param bytes The encoding
+ * @param length Number of bytes
+ * @param error Receives 0, or EINVAL if the bytes are not a valid encoding (may be NULL)
+ * @return The root object with a reference count of 1, or NULL if it is NULL or on error
+ */
+ARCObject* trove_deserialize(const void *bytes, size_t length, int *error) {
+    TroveDecoder decoder;
+    decoder.fd = -1;
+    decoder.buffer = NULL;
+    decoder.pos = (const unsigned char *)bytes;
+    decoder.end = decoder.pos + length;
+    return decoder_run(&decoder, error);
+}
+
+/**
+ * @brief Decodes an object graph from a file descriptor
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param fd Descriptor to read from
+ * @param error Receives 0, EINVAL for an invalid encoding, or the errno of a
+ *              failed read (may be NULL)
+ * @return The root object with a reference count of 1, or NULL if it is NULL or on error
+ */
+ARCObject* trove_deserialize_fd(int fd, int *error) {
+    TroveDecoder decoder;
+    decoder.fd = fd;
+    decoder.buffer = (unsigned char *)malloc(TROVE_SERIAL_BUFFER_SIZE);
+    if (!decoder.buffer) {
+        fprintf(stderr, "Failed to allocate deserialization buffer.\n");
+        exit(1);
+    }
+    decoder.pos = decoder.end = decoder.buffer;
+    ARCObject *root = decoder_run(&decoder, error);
+    free(decoder.buffer);
+    return root;
+}
+
+/**
+ * @brief Reads an object that must be a TroveString, as collection keys are
+ */
+static TroveString* decode_key(TroveDecoder *decoder) {
+    ARCObject *key = trove_decode_object(decoder);
+    if (!key || key->dealloc != TroveString_dealloc) {
+        arc_release(key);
+        if (!decoder->error) {
+            decoder->error = EINVAL;
+        }
+        return NULL;
+    }
+    return (TroveString *)key;
+}
+
+/**
+ * @brief Writes a TroveString: length, then bytes
+ */
+static void encode_string(TroveEncoder *encoder, ARCObject *obj) {
+    TroveString *str = (TroveString *)obj;
+    trove_encode_uint(encoder, str->length);
+    trove_encode_bytes(encoder, str->str, str->length);
+}
+
+/**
+ * @brief Returns how many more payload bytes to allocate room for once have bytes arrived
+ *
+ * A descriptor does not say how much input is left, so a long payload from
+ * one is read in steps that at most double what has arrived. A corrupt
+ * length then fails with EINVAL at the end of the input instead of making
+ * the first allocation huge. Memory input was checked against the bytes
+ * remaining, so it is read in one step.
+ */
+static size_t decoder_payload_step(TroveDecoder *decoder, size_t have, size_t length) {
+    size_t step = length - have;
+    if (decoder->fd >= 0) {
+        size_t bound = have > SERIAL_GROW_MIN ? have : SERIAL_GROW_MIN;
+        if (step > bound) {
+            step = bound;
+        }
+    }
+    return step;
+}
+
+/**
+ * @brief Frees payload bytes adopted by a decoded TroveData
+ */
+static void serial_free_bytes(void *bytes, size_t length, void *context) {
+    (void)length;
+    (void)context;
+    free(bytes);
+}
+
+/**
+ * @brief Reads a TroveString, placing short ones in the current pool's arena chunk
+ */
+static ARCObject* decode_string(TroveDecoder *decoder) {
+    size_t length = 0;
+    if (trove_decode_length(decoder, 1, &length)) {
+        return NULL;
+    }
+    TroveArena *arena = length <= TROVE_SERIAL_ARENA_MAX ? autorelease_pool_arena(length + 1) : NULL;
+    if (arena) {
+        char *bytes = arena->bytes + arena->used;
+        if (trove_decode_bytes(decoder, bytes, length)) {
+            return NULL;
+        }
+        bytes[length] = '\0';
+        arena->used += length + 1;
+        return (ARCObject *)TroveString_create_with_storage(bytes, length, (ARCObject *)arena);
+    }
+    TroveString *str = TroveString_create_with_length(NULL, decoder_payload_step(decoder, 0, length));
+    str->length = 0;
+    while (str->length < length) {
+        size_t step = decoder_payload_step(decoder, str->length, length);
+        TroveString_reserve(&str, str->length + step);
+        if (trove_decode_bytes(decoder, str->str + str->length, step)) {
+            arc_release((ARCObject *)str);
+            return NULL;
+        }
+        str->length += step;
+    }
+    str->str[length] = '\0';
+    return (ARCObject *)str;
+}
+
+/**
+ * @brief Writes a TroveArray: count, then elements
+ */
+static void encode_array(TroveEncoder *encoder, ARCObject *obj) {
+    TroveArray *array = (TroveArray *)obj;
+    trove_encode_uint(encoder, array->count);
+    for (size_t i = 0; i < array->count; i++) {
+        trove_encode_object(encoder, array->items[i]);
+    }
+}
+
+/**
+ * @brief Reads a TroveArray
+ */
+static ARCObject* decode_array(TroveDecoder *decoder) {
+    size_t count = 0;
+    if (trove_decode_length(decoder, 1, &count)) {
+        return NULL;
+    }
+    TroveArray *array = TroveArray_create(count < SERIAL_RESERVE_MAX ? count : SERIAL_RESERVE_MAX);
+    for (size_t i = 0; i < count; i++) {
+        ARCObject *item = trove_decode_object(decoder);
+        if (decoder->error) {
+            arc_release((ARCObject *)array);
+            return NULL;
+        }
+        TroveArray_append(array, item);
+        arc_release(item);
+    }
+    return (ARCObject *)array;
+}
+
+/**
+ * @brief Writes a TroveDictionary: count, then key and value objects
+ */
+static void encode_dictionary(TroveEncoder *encoder, ARCObject *obj) {
+    TroveDictionary *dict = (TroveDictionary *)obj;
+    trove_encode_uint(encoder, TroveDictionary_count(dict));
+    size_t cursor = 0;
+    TroveString *key;
+    ARCObject *value;
+    while (TroveDictionary_next(dict, &cursor, &key, &value)) {
+        trove_encode_object(encoder, (ARCObject *)key);
+        trove_encode_object(encoder, value);
+    }
+}
+
+/**
+ * @brief Reads a TroveDictionary
+ */
+static ARCObject* decode_dictionary(TroveDecoder *decoder) {
+    size_t count = 0;
+    if (trove_decode_length(decoder, 2, &count)) {
+        return NULL;
+    }
+    TroveDictionary *dict = TroveDictionary_create(count < SERIAL_RESERVE_MAX ? count : SERIAL_RESERVE_MAX);
+    for (size_t i = 0; i < count; i++) {
+        TroveString *key = decode_key(decoder);
+        ARCObject *value = trove_decode_object(decoder);
+        if (decoder->error) {
+            arc_release((ARCObject *)key);
+            arc_release(value);
+            arc_release((ARCObject *)dict);
+            return NULL;
+        }
+        TroveDictionary_set(dict, key, value);
+        arc_release((ARCObject *)key);
+        arc_release(value);
+    }
+    return (ARCObject *)dict;
+}
+
+/**
+ * @brief Writes a TroveSet: count, then key objects
+ */
+static void encode_set(TroveEncoder *encoder, ARCObject *obj) {
+    TroveSet *set = (TroveSet *)obj;
+    trove_encode_uint(encoder, TroveSet_count(set));
+    size_t cursor = 0;
+    TroveString *key;
+    while ((key = TroveSet_next(set, &cursor))) {
+        trove_encode_object(encoder, (ARCObject *)key);
+    }
+}
+
+/**
+ * @brief Reads a TroveSet
+ */
+static ARCObject* decode_set(TroveDecoder *decoder) {
+    size_t count = 0;
+    if (trove_decode_length(decoder, 1, &count)) {
+        return NULL;
+    }
+    TroveSet *set = TroveSet_create(count < SERIAL_RESERVE_MAX ? count : SERIAL_RESERVE_MAX);
+    for (size_t i = 0; i < count; i++) {
+        TroveString *key = decode_key(decoder);
+        if (!key) {
+            arc_release((ARCObject *)set);
+            return NULL;
+        }
+        TroveSet_add(set, key);
+        arc_release((ARCObject *)key);
+    }
+    return (ARCObject *)set;
+}
+
+/**
+ * @brief Writes a TroveVector: count, then elements, a leaf at a time
+ */
+static void encode_vector(TroveEncoder *encoder, ARCObject *obj) {
+    TroveVector *vector = (TroveVector *)obj;
+    size_t count = TroveVector_count(vector);
+    trove_encode_uint(encoder, count);
+    for (size_t i = 0; i < count; ) {
+        size_t length;
+        ARCObject *const *chunk = TroveVector_chunk(vector, i, &length);
+        for (size_t j = 0; j < length; j++) {
+            trove_encode_object(encoder, chunk[j]);
+        }
+        i += length;
+    }
+}
+
+/**
+ * @brief Reads a TroveVector, appending in place
+ */
+static ARCObject* decode_vector(TroveDecoder *decoder) {
+    size_t count = 0;
+    if (trove_decode_length(decoder, 1, &count)) {
+        return NULL;
+    }
+    TroveVector *vector = TroveVector_create();
+    for (size_t i = 0; i < count; i++) {
+        ARCObject *item = trove_decode_object(decoder);
+        if (decoder->error) {
+            arc_release((ARCObject *)vector);
+            return NULL;
+        }
+        TroveVector_push_in_place(&vector, item);
+        arc_release(item);
+    }
+    return (ARCObject *)vector;
+}
+
+/**
+ * @brief Writes a TroveMap: count, then key and value objects
+ */
+static void encode_map(TroveEncoder *encoder, ARCObject *obj) {
+    TroveMap *map = (TroveMap *)obj;
+    trove_encode_uint(encoder, TroveMap_count(map));
+    TroveMapIter it;
+    TroveString *key;
+    ARCObject *value;
+    TroveMap_iter_init(&it, map);
+    while (TroveMap_iter_next(&it, &key, &value)) {
+        trove_encode_object(encoder, (ARCObject *)key);
+        trove_encode_object(encoder, value);
+    }
+}
+
+/**
+ * @brief Reads a TroveMap, inserting in place
+ */
+static ARCObject* decode_map(TroveDecoder *decoder) {
+    size_t count = 0;
+    if (trove_decode_length(decoder, 2, &count)) {
+        return NULL;
+    }
+    TroveMap *map = TroveMap_create();
+    for (size_t i = 0; i < count; i++) {
+        TroveString *key = decode_key(decoder);
+        ARCObject *value = trove_decode_object(decoder);
+        if (decoder->error) {
+            arc_release((ARCObject *)key);
+            arc_release(value);
+            arc_release((ARCObject *)map);
+            return NULL;
+        }
+        TroveMap_set_in_place(&map, key, value);
+        arc_release((ARCObject *)key);
+        arc_release(value);
+    }
+    return (ARCObject *)map;
+}
+
+/**
+ * @brief Writes a TroveData: length, then bytes
+ */
+static void encode_data(TroveEncoder *encoder, ARCObject *obj) {
+    TroveData *data = (TroveData *)obj;
+    trove_encode_uint(encoder, data->length);
+    trove_encode_bytes(encoder, data->bytes, data->length);
+}
+
+/**
+ * @brief Reads a TroveData into heap storage
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static ARCObject* decode_data(TroveDecoder *decoder) {
+    size_t length = 0;
+    if (trove_decode_length(decoder, 1, &length)) {
+        return NULL;
+    }
+    if (length == 0) {
+        return (ARCObject *)TroveData_create(NULL, 0);
+    }
+    unsigned char *bytes = NULL;
+    size_t have = 0;
+    while (have < length) {
+        size_t step = decoder_payload_step(decoder, have, length);
+        unsigned char *grown = (unsigned char *)realloc(bytes, have + step);
+        if (!grown) {
+            fprintf(stderr, "Failed to allocate data content.\n");
+            exit(1);
+        }
+        bytes = grown;
+        if (trove_decode_bytes(decoder, bytes + have, step)) {
+            free(bytes);
+            return NULL;
+        }
+        have += step;
+    }
+    return (ARCObject *)TroveData_create_no_copy(bytes, length, serial_free_bytes, NULL);
+}
@@ -0,0 +1,240 @@
+/**
+ * @file serial.h
+ * @brief Binary serialization of ARC object graphs for the Trove ARC memory management system
+ *
+ * An encoding is the magic bytes "TRV1" followed by the root object. Every
+ * object is a LEB128 header, (tag << 1) | shared, followed by its type's
+ * payload; integers inside payloads are LEB128 as well. Objects that may be
+ * referenced more than once (their reference count is above 1 when encoded)
+ * carry the shared bit and are numbered in the order their encoding ends.
+ * Later references to them are written as TROVE_SERIAL_REF and the number,
+ * so shared subgraphs are encoded and decoded once and decoding restores
+ * the sharing.
+ *
+ * Types are identified by their dealloc function, the one thing every
+ * ARCObject of a type has in common. The built-in collections are
+ * registered up front; applications register their own types with
+ * trove_serial_register, using tags from TROVE_SERIAL_USER_TAG on.
+ *
+ * Encoders and decoders stream through a TROVE_SERIAL_BUFFER_SIZE buffer,
+ * so graphs can be written to and read from descriptors without holding the
+ * whole encoding in memory. A descriptor does not tell how much input is
+ * left, so payloads read from one grow at most twice as fast as their bytes
+ * arrive: a corrupt length fails with EINVAL rather than allocating it up
+ * front. Decoded strings of up to TROVE_SERIAL_ARENA_MAX
+ * bytes are allocated from the current autorelease pool's arena when one is
+ * in place, like TroveStringBuilder output. Such strings share the arena
+ * chunk and count it atomically, so a decoded graph may be split across
+ * threads and its parts released on each.
+ */
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "trove.h"
+#include "data.h"
+#include <stdint.h>
+
+/** @brief Bytes at the start of every encoding */
+#define TROVE_SERIAL_MAGIC "TRV1"
+
+/** @brief Size of the encoder and decoder stream buffers */
+#define TROVE_SERIAL_BUFFER_SIZE (64 * 1024)
+
+/** @brief Decoded strings up to this many bytes are allocated from the pool arena */
+#define TROVE_SERIAL_ARENA_MAX 1024
+
+/** @brief Deepest nesting of objects accepted by the encoder and decoder */
+#define TROVE_SERIAL_MAX_DEPTH 512
+
+/** @brief First tag available to application types */
+#define TROVE_SERIAL_USER_TAG 16
+
+/** @brief Number of tags; application tags are below this */
+#define TROVE_SERIAL_MAX_TAG 64
+
+/**
+ * @brief Tags of the built-in encodings
+ */
+enum {
+    TROVE_SERIAL_NULL = 0,          /**< NULL element; no payload */
+    TROVE_SERIAL_REF = 1,           /**< Number of an earlier shared object */
+    TROVE_SERIAL_STRING = 2,        /**< Length, then bytes */
+    TROVE_SERIAL_ARRAY = 3,         /**< Count, then elements */
+    TROVE_SERIAL_DICTIONARY = 4,    /**< Count, then key and value objects */
+    TROVE_SERIAL_SET = 5,           /**< Count, then key objects */
+    TROVE_SERIAL_VECTOR = 6,        /**< Count, then elements */
+    TROVE_SERIAL_MAP = 7,           /**< Count, then key and value objects */
+    TROVE_SERIAL_DATA = 8           /**< Length, then bytes */
+};
+
+/**
+ * @brief Encoder state, passed to per-type encode functions
+ */
+typedef struct TroveEncoder {
+    int fd;                   /**< Descriptor to flush to, or -1 to grow buffer in memory */
+    unsigned char *buffer;    /**< Pending bytes (all bytes when encoding to memory) */
+    size_t length;            /**< Bytes in buffer */
+    size_t capacity;          /**< Size of buffer */
+    ARCObject **seen;         /**< Open-addressing table of shared objects, NULL slots empty */
+    size_t *numbers;          /**< Number of each object in seen, SIZE_MAX while it is being encoded */
+    size_t seen_capacity;     /**< Slots in seen (a power of two) */
+    size_t seen_count;        /**< Occupied slots in seen */
+    size_t shared_count;      /**< Shared objects numbered so far */
+    int depth;                /**< Current nesting depth */
+    int error;                /**< First error, or 0 */
+} TroveEncoder;
+
+/**
+ * @brief Decoder state, passed to per-type decode functions
+ */
+typedef struct TroveDecoder {
+    int fd;                       /**< Descriptor to refill from, or -1 when decoding memory */
+    const unsigned char *pos;     /**< Next byte to decode */
+    const unsigned char *end;     /**< End of the available bytes */
+    unsigned char *buffer;        /**< Refill buffer when decoding a descriptor */
+    ARCObject **shared;           /**< Retained shared objects by number */
+    size_t shared_count;          /**< Shared objects decoded so far */
+    size_t shared_capacity;       /**< Slots in shared */
+    int depth;                    /**< Current nesting depth */
+    int error;                    /**< First error, or 0 */
+} TroveDecoder;
+
+/**
+ * @brief Writes the payload of an object
+ *
+ * @param encoder The encoder
+ * @param obj The object, of the type the function was registered for
+ */
+typedef void (*TroveEncodeFunction)(TroveEncoder *encoder, ARCObject *obj);
+
+/**
+ * @brief Reads a payload and builds the object
+ *
+ * @param decoder The decoder
+ * @return A new object with a reference count of 1, or NULL after setting decoder->error
+ */
+typedef ARCObject* (*TroveDecodeFunction)(TroveDecoder *decoder);
+
+/**
+ * @brief Registers the encoding of an application type
+ *
+ * @param tag Tag from TROVE_SERIAL_USER_TAG up to TROVE_SERIAL_MAX_TAG - 1
+ * @param dealloc The dealloc function of the type's objects
+ * @param encode Payload writer
+ * @param decode Payload reader
+ * @return 0 on success, EINVAL if the tag is out of range or taken
+ */
+int trove_serial_register(unsigned tag, void (*dealloc)(ARCObject *), TroveEncodeFunction encode, TroveDecodeFunction decode);
+
+/**
+ * @brief Encodes an object graph into memory
+ *
+ * @param root The root object (may be NULL)
+ * @param error Receives 0, ENOTSUP for an unregistered type, or ELOOP for a
+ *              cycle or nesting deeper than TROVE_SERIAL_MAX_DEPTH (may be NULL)
+ * @return A new TroveData with a reference count of 1, or NULL on error
+ */
+TroveData* trove_serialize(ARCObject *root, int *error);
+
+/**
+ * @brief Encodes an object graph to a file descriptor
+ *
+ * @param root The root object (may be NULL)
+ * @param fd Descriptor to write to
+ * @return 0 on success, otherwise an error as for trove_serialize or the
+ *         errno of a failed write
+ */
+int trove_serialize_to_fd(ARCObject *root, int fd);
+
+/**
+ * @brief Decodes an object graph from memory
+ *
+ * @param bytes The encoding
+ * @param length Number of bytes
+ * @param error Receives 0, or EINVAL if the bytes are not a valid encoding (may be NULL)
+ * @return The root object with a reference count of 1, or NULL if it is NULL or on error
+ */
+ARCObject* trove_deserialize(const void *bytes, size_t length, int *error);
+
+/**
+ * @brief Decodes an object graph from a file descriptor
+ *
+ * Reads past the end of the encoding are possible; the descriptor should
+ * hold nothing else.
+ *
+ * @param fd Descriptor to read from
+ * @param error Receives 0, EINVAL for an invalid encoding, or the errno of a
+ *              failed read (may be NULL)
+ * @return The root object with a reference count of 1, or NULL if it is NULL or on error
+ */
+ARCObject* trove_deserialize_fd(int fd, int *error);
+
+/**
+ * @brief Writes an unsigned integer
+ *
+ * @param encoder The encoder
+ * @param value The value
+ */
+void trove_encode_uint(TroveEncoder *encoder, uint64_t value);
+
+/**
+ * @brief Writes raw bytes
+ *
+ * @param encoder The encoder
+ * @param bytes The bytes
+ * @param length Number of bytes
+ */
+void trove_encode_bytes(TroveEncoder *encoder, const void *bytes, size_t length);
+
+/**
+ * @brief Writes an object, or a reference to it if it was written before
+ *
+ * @param encoder The encoder
+ * @param obj The object (may be NULL)
+ */
+void trove_encode_object(TroveEncoder *encoder, ARCObject *obj);
+
+/**
+ * @brief Reads an unsigned integer
+ *
+ * @param decoder The decoder
+ * @param value Receives the value
+ * @return 0 on success, otherwise the decoder's error
+ */
+int trove_decode_uint(TroveDecoder *decoder, uint64_t *value);
+
+/**
+ * @brief Reads raw bytes
+ *
+ * @param decoder The decoder
+ * @param bytes Destination
+ * @param length Number of bytes
+ * @return 0 on success, otherwise the decoder's error
+ */
+int trove_decode_bytes(TroveDecoder *decoder, void *bytes, size_t length);
+
+/**
+ * @brief Reads a length and checks it against the remaining input
+ *
+ * Decode functions use this before allocating, so a corrupt length fails
+ * instead of allocating huge buffers. When decoding a descriptor the
+ * remaining input is unknown and only absurd lengths are rejected.
+ *
+ * @param decoder The decoder
+ * @param min_bytes Minimum number of encoded bytes per counted item
+ * @param length Receives the length
+ * @return 0 on success, otherwise the decoder's error
+ */
+int trove_decode_length(TroveDecoder *decoder, size_t min_bytes, size_t *length);
+
+/**
+ * @brief Reads an object
+ *
+ * @param decoder The decoder
+ * @return The object with its reference count raised by 1, or NULL if it is
+ *         NULL or decoder->error was set
+ */
+ARCObject* trove_decode_object(TroveDecoder *decoder);
+
+#endif // SERIAL_H
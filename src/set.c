@@ -0,0 +1,300 @@
+/**
+ * @file set.c
+ * @brief Implementation of TroveSet
+ */
+
+#include "set.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * @brief Creates an empty set
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param capacity Number of keys to hold without rehashing (can be 0)
+ * @return A new TroveSet with a reference count of 1
+ */
+TroveSet* TroveSet_create(size_t capacity) {
+    TroveSet *set = (TroveSet *)malloc(sizeof(TroveSet));
+    if (!set) {
+        fprintf(stderr, "Failed to allocate TroveSet.\n");
+        exit(1);
+    }
+    arc_object_init(&set->base, TroveSet_dealloc, sizeof(TroveSet));
+    trove_table_init(&set->table, capacity);
+    return set;
+}
+
+/**
+ * @brief Creates a set holding the distinct strings of an array
+ *
+ * @param strings The strings (must not contain NULL)
+ * @param count Number of strings
+ * @return A new TroveSet with a reference count of 1
+ */
+TroveSet* TroveSet_create_with_strings(TroveString *const *strings, size_t count) {
+    TroveSet *set = TroveSet_create(count);
+    TroveSet_add_all(set, strings, count);
+    return set;
+}
+
+/**
+ * @brief Returns the number of keys
+ *
+ * @param set The set
+ * @return Number of keys
+ */
+size_t TroveSet_count(TroveSet *set) {
+    return set->table.count;
+}
+
+/**
+ * @brief Makes *set uniquely referenced so it can be mutated
+ *
+ * The copy duplicates the table's storage without rehashing.
+ *
+ * @param set Address of an owned reference; may be replaced with a copy
+ */
+void TroveSet_make_unique(TroveSet **set) {
+    TroveSet *original = *set;
+    if (original->base.ref_count == 1) {
+        return;
+    }
+    TroveSet *copy = TroveSet_create(0);
+    trove_table_copy(&copy->table, &original->table);
+    arc_release((ARCObject *)original);
+    *set = copy;
+}
+
+/**
+ * @brief Grows the set so count keys fit without rehashing
+ *
+ * @param set The set
+ * @param count Number of keys
+ */
+void TroveSet_reserve(TroveSet *set, size_t count) {
+    trove_table_reserve(&set->table, count);
+}
+
+/**
+ * @brief Stores a key known to be absent without retaining it
+ *
+ * The key's hash must already be cached, which holds for every key taken
+ * from another table.
+ */
+static inline void set_insert_absent(TroveSet *set, TroveString *key) {
+    size_t slot = trove_table_claim(&set->table, key->hash);
+    set->table.entries[slot].key = key;
+}
+
+/**
+ * @brief Adds a key, retaining it
+ *
+ * @param set The set
+ * @param key The key
+ * @return 1 if the key was added, 0 if an equal key was present
+ */
+int TroveSet_add(TroveSet *set, TroveString *key) {
+    if (trove_table_find_key(&set->table, key) != TROVE_TABLE_NOT_FOUND) {
+        return 0;
+    }
+    arc_retain((ARCObject *)key);
+    set_insert_absent(set, key);
+    return 1;
+}
+
+/**
+ * @brief Adds every string of an array
+ *
+ * @param set The set
+ * @param strings The strings (must not contain NULL)
+ * @param count Number of strings
+ * @return Number of keys that were added
+ */
+size_t TroveSet_add_all(TroveSet *set, TroveString *const *strings, size_t count) {
+    size_t added = 0;
+    trove_table_reserve(&set->table, set->table.count + count);
+    for (size_t i = 0; i < count; i++) {
+        added += (size_t)TroveSet_add(set, strings[i]);
+    }
+    return added;
+}
+
+/**
+ * @brief Checks whether an equal key is present
+ *
+ * @param set The set
+ * @param key The key
+ * @return 1 if present, 0 otherwise
+ */
+int TroveSet_contains(TroveSet *set, TroveString *key) {
+    return trove_table_find_key(&set->table, key) != TROVE_TABLE_NOT_FOUND;
+}
+
+/**
+ * @brief Checks whether a key given as bytes is present
+ *
+ * @param set The set
+ * @param bytes Key bytes
+ * @param length Number of key bytes
+ * @return 1 if present, 0 otherwise
+ */
+int TroveSet_contains_bytes(TroveSet *set, const char *bytes, size_t length) {
+    return trove_table_find(&set->table, bytes, length, trove_hash_bytes(bytes, length)) != TROVE_TABLE_NOT_FOUND;
+}
+
+/**
+ * @brief Removes a key, releasing the stored key object
+ *
+ * @param set The set
+ * @param key The key
+ * @return 1 if the key was present, 0 otherwise
+ */
+int TroveSet_remove(TroveSet *set, TroveString *key) {
+    size_t slot = trove_table_find_key(&set->table, key);
+    if (slot == TROVE_TABLE_NOT_FOUND) {
+        return 0;
+    }
+    trove_table_erase(&set->table, slot);
+    return 1;
+}
+
+/**
+ * @brief Removes every key, keeping the allocated capacity
+ *
+ * @param set The set
+ */
+void TroveSet_remove_all(TroveSet *set) {
+    trove_table_clear(&set->table);
+}
+
+/**
+ * @brief Iterates over the keys in unspecified order
+ *
+ * @param set The set
+ * @param cursor In/out iteration position
+ * @return The next key (not retained), or NULL when iteration is done
+ */
+TroveString* TroveSet_next(TroveSet *set, size_t *cursor) {
+    size_t slot = trove_table_next(&set->table, cursor);
+    return slot == TROVE_TABLE_NOT_FOUND ? NULL : set->table.entries[slot].key;
+}
+
+/** @brief Number of keys gathered before their probes are issued together */
+#define SET_COPY_BATCH 16
+
+/**
+ * @brief Probes a batch of keys against filter and stores the survivors in result
+ *
+ * The key objects were prefetched while the batch was gathered. Prefetching
+ * every key's first probe group in filter and in result before touching any
+ * of them lets the cache misses of the batch overlap instead of being paid
+ * one after another.
+ */
+static void set_copy_batch(TroveSet *result, TroveString **keys, size_t count, TroveSet *filter, int keep_present) {
+    for (size_t i = 0; i < count; i++) {
+        if (filter) {
+            trove_table_prefetch(&filter->table, keys[i]->hash);
+        }
+        trove_table_prefetch(&result->table, keys[i]->hash);
+    }
+    for (size_t i = 0; i < count; i++) {
+        TroveString *key = keys[i];
+        if (filter) {
+            int present = trove_table_find(&filter->table, key->str, key->length, key->hash) != TROVE_TABLE_NOT_FOUND;
+            if (present != keep_present) {
+                continue;
+            }
+        }
+        arc_retain((ARCObject *)key);
+        set_insert_absent(result, key);
+    }
+}
+
+/**
+ * @brief Copies the keys of source that are (or are not) in filter into result
+ *
+ * A NULL filter copies every key. Keys are handled in batches so that the
+ * scattered key objects and probe groups are fetched ahead of use.
+ *
+ * @param result Destination set, sized for every key of source
+ * @param source Set to take keys from
+ * @param filter Set to probe, or NULL
+ * @param keep_present 1 to copy keys found in filter, 0 to copy keys absent from it
+ */
+static void set_copy_filtered(TroveSet *result, TroveSet *source, TroveSet *filter, int keep_present) {
+    TroveTable *table = &source->table;
+    TroveString *batch[SET_COPY_BATCH];
+    size_t count = 0;
+    for (size_t slot = 0; slot < table->capacity; slot++) {
+        if (table->ctrl[slot] < 0) {
+            continue;
+        }
+        batch[count] = table->entries[slot].key;
+        TROVE_PREFETCH(batch[count]);
+        if (++count == SET_COPY_BATCH) {
+            set_copy_batch(result, batch, count, filter, keep_present);
+            count = 0;
+        }
+    }
+    set_copy_batch(result, batch, count, filter, keep_present);
+}
+
+/**
+ * @brief Returns the keys present in either set
+ *
+ * The result is sized for both sets combined. The larger set is copied
+ * without probing and only the smaller one is checked against it.
+ *
+ * @param a First set
+ * @param b Second set
+ * @return A new TroveSet with a reference count of 1
+ */
+TroveSet* TroveSet_union(TroveSet *a, TroveSet *b) {
+    TroveSet *large = a->table.count >= b->table.count ? a : b;
+    TroveSet *small = large == a ? b : a;
+    TroveSet *result = TroveSet_create(large->table.count + small->table.count);
+    set_copy_filtered(result, large, NULL, 0);
+    set_copy_filtered(result, small, large, 0);
+    return result;
+}
+
+/**
+ * @brief Returns the keys present in both sets
+ *
+ * @param a First set
+ * @param b Second set
+ * @return A new TroveSet with a reference count of 1
+ */
+TroveSet* TroveSet_intersection(TroveSet *a, TroveSet *b) {
+    TroveSet *small = a->table.count <= b->table.count ? a : b;
+    TroveSet *large = small == a ? b : a;
+    TroveSet *result = TroveSet_create(small->table.count);
+    set_copy_filtered(result, small, large, 1);
+    return result;
+}
+
+/**
+ * @brief Returns the keys of a that are not in b
+ *
+ * @param a Set to take keys from
+ * @param b Set of keys to exclude
+ * @return A new TroveSet with a reference count of 1
+ */
+TroveSet* TroveSet_difference(TroveSet *a, TroveSet *b) {
+    TroveSet *result = TroveSet_create(a->table.count);
+    set_copy_filtered(result, a, b, 0);
+    return result;
+}
+
+/**
+ * @brief Deallocates a TroveSet
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveSet_dealloc(ARCObject *obj) {
+    TroveSet *set = (TroveSet *)obj;
+    trove_table_destroy(&set->table);
+    arc_object_free(&set->base);
+}
@@ -0,0 +1,197 @@
+/**
+ * @file set.h
+ * @brief Set of TroveStrings for the Trove ARC memory management system
+ *
+ * A TroveSet stores unique TroveString keys in the same Swiss-table layout
+ * as TroveDictionary (see table.h), with every value slot left NULL. Keys are
+ * retained on insertion and released on removal or when the set is
+ * deallocated.
+ *
+ * The set algebra functions build a new set sized for the largest possible
+ * result up front, so they never rehash. They walk the source tables in
+ * batches, prefetching key objects and probe groups ahead of use, and probe
+ * with the hashes cached in the keys.
+ */
+
+#ifndef SET_H
+#define SET_H
+
+#include "trove.h"
+#include "table.h"
+
+/**
+ * @brief Set type managed by ARC
+ */
+typedef struct TroveSet {
+    ARCObject base;      /**< Inheritance: must be the first member */
+    TroveTable table;    /**< Key storage; every value is NULL */
+} TroveSet;
+
+/**
+ * @brief Creates an empty set
+ *
+ * @param capacity Number of keys to hold without rehashing (can be 0)
+ * @return A new TroveSet with a reference count of 1
+ */
+TroveSet* TroveSet_create(size_t capacity);
+
+/**
+ * @brief Creates a set holding the distinct strings of an array
+ *
+ * @param strings The strings (must not contain NULL)
+ * @param count Number of strings
+ * @return A new TroveSet with a reference count of 1
+ */
+TroveSet* TroveSet_create_with_strings(TroveString *const *strings, size_t count);
+
+/**
+ * @brief Returns the number of keys
+ *
+ * @param set The set
+ * @return Number of keys
+ */
+size_t TroveSet_count(TroveSet *set);
+
+/**
+ * @brief Makes *set uniquely referenced so it can be mutated
+ *
+ * Gives copy-on-write semantics to the in-place mutators: a shared set
+ * is replaced by a copy (the caller's reference to the original is
+ * released), while a unique one is left as is.
+ *
+ * @param set Address of an owned reference; may be replaced with a copy
+ */
+void TroveSet_make_unique(TroveSet **set);
+
+/**
+ * @brief Grows the set so count keys fit without rehashing
+ *
+ * @param set The set
+ * @param count Number of keys
+ */
+void TroveSet_reserve(TroveSet *set, size_t count);
+
+/**
+ * @brief Adds a key, retaining it
+ *
+ * An equal key that is already present is kept and the new one is ignored.
+ *
+ * @param set The set
+ * @param key The key
+ * @return 1 if the key was added, 0 if an equal key was present
+ */
+int TroveSet_add(TroveSet *set, TroveString *key);
+
+/**
+ * @brief Adds every string of an array
+ *
+ * The set is grown once for the worst case before inserting.
+ *
+ * @param set The set
+ * @param strings The strings (must not contain NULL)
+ * @param count Number of strings
+ * @return Number of keys that were added
+ */
+size_t TroveSet_add_all(TroveSet *set, TroveString *const *strings, size_t count);
+
+/**
+ * @brief Checks whether an equal key is present
+ *
+ * @param set The set
+ * @param key The key
+ * @return 1 if present, 0 otherwise
+ */
+int TroveSet_contains(TroveSet *set, TroveString *key);
+
+/**
+ * @brief Checks whether a key given as bytes is present
+ *
+ * @param set The set
+ * @param bytes Key bytes
+ * @param length Number of key bytes
+ * @return 1 if present, 0 otherwise
+ */
+int TroveSet_contains_bytes(TroveSet *set, const char *bytes, size_t length);
+
+/**
+ * @brief Removes a key, releasing the stored key object
+ *
+ * @param set The set
+ * @param key The key
+ * @return 1 if the key was present, 0 otherwise
+ */
+int TroveSet_remove(TroveSet *set, TroveString *key);
+
+/**
+ * @brief Removes every key, keeping the allocated capacity
+ *
+ * @param set The set
+ */
+void TroveSet_remove_all(TroveSet *set);
+
+/**
+ * @brief Iterates over the keys in unspecified order
+ *
+ * Start with *cursor set to 0. The set must not gain keys during iteration;
+ * removing the key just returned is allowed.
+ *
+ * @code
+ * size_t cursor = 0;
+ * TroveString *key;
+ * while ((key = TroveSet_next(set, &cursor))) { ... }
+ * @endcode
+ *
+ * @param set The set
+ * @param cursor In/out iteration position
+ * @return The next key (not retained), or NULL when iteration is done
+ */
+TroveString* TroveSet_next(TroveSet *set, size_t *cursor);
+
+/**
+ * @brief Returns the keys present in either set
+ *
+ * @param a First set
+ * @param b Second set
+ * @return A new TroveSet with a reference count of 1
+ */
+TroveSet* TroveSet_union(TroveSet *a, TroveSet *b);
+
+/**
+ * @brief Returns the keys present in both sets
+ *
+ * Keys are taken from the smaller set, which is also the one iterated.
+ *
+ * @param a First set
+ * @param b Second set
+ * @return A new TroveSet with a reference count of 1
+ */
+TroveSet* TroveSet_intersection(TroveSet *a, TroveSet *b);
+
+/**
+ * @brief Returns the keys of a that are not in b
+ *
+ * @param a Set to take keys from
+ * @param b Set of keys to exclude
+ * @return A new TroveSet with a reference count of 1
+ */
+TroveSet* TroveSet_difference(TroveSet *a, TroveSet *b);
+
+/**
+ * @brief Deallocates a TroveSet, releasing every key
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveSet_dealloc(ARCObject *obj);
+
+/**
+ * @brief Convenience macro for creating autoreleased TroveSet objects
+ *
+ * @code
+ * TroveSet *seen = Set(64);
+ * @endcode
+ */
+#define Set(capacity) ((TroveSet *)arc_autorelease((ARCObject *)TROVE_AT_SITE(TroveSet_create(capacity))))
+
+#endif // SET_H
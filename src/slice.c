@@ -0,0 +1,185 @@
+/**
+ * @file slice.c
+ * @brief Implementation of zero-copy string slices
+ *
+ * Slices share the bytes of their parent TroveString. The only allocation a
+ * slice performs is its own header, which keeps tokenizing large inputs free
+ * of per-token copies.
+ */
+
+#include "slice.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Allocates a slice over bytes owned by parent
+ *
+ * The caller is responsible for passing a range that lies within parent.
+ *
+ * @param parent The string that owns the bytes (retained)
+ * @param ptr First byte of the slice
+ * @param length Number of bytes in the slice
+ * @return A new TroveStringSlice with a reference count of 1
+ */
+static TroveStringSlice* slice_alloc(TroveString *parent, const char *ptr, size_t length) {
+    TroveStringSlice *slice = (TroveStringSlice *)malloc(sizeof(TroveStringSlice));
+    if (!slice) {
+        fprintf(stderr, "Failed to allocate TroveStringSlice.\n");
+        exit(1);
+    }
+    arc_object_init(&slice->base, TroveStringSlice_dealloc, sizeof(TroveStringSlice));
+    arc_retain((ARCObject *)parent);
+    slice->parent = parent;
+    slice->ptr = ptr;
+    slice->length = length;
+    return slice;
+}
+
+/**
+ * @brief Creates a slice referencing a range of a string
+ *
+ * The offset and length are clamped so the slice never extends past the
+ * end of the parent string.
+ *
+ * @param parent The string that owns the bytes
+ * @param offset Byte offset of the first byte of the slice
+ * @param length Number of bytes in the slice
+ * @return A new TroveStringSlice with a reference count of 1
+ */
+TroveStringSlice* TroveStringSlice_create(TroveString *parent, size_t offset, size_t length) {
+    if (offset > parent->length) {
+        offset = parent->length;
+    }
+    if (length > parent->length - offset) {
+        length = parent->length - offset;
+    }
+    return slice_alloc(parent, parent->str + offset, length);
+}
+
+/**
+ * @brief Creates a slice referencing a range of another slice
+ *
+ * @param slice The slice to narrow
+ * @param offset Byte offset relative to the start of slice
+ * @param length Number of bytes in the new slice
+ * @return A new TroveStringSlice with a reference count of 1
+ */
+TroveStringSlice* TroveStringSlice_subslice(TroveStringSlice *slice, size_t offset, size_t length) {
+    if (offset > slice->length) {
+        offset = slice->length;
+    }
+    if (length > slice->length - offset) {
+        length = slice->length - offset;
+    }
+    return slice_alloc(slice->parent, slice->ptr + offset, length);
+}
+
+/**
+ * @brief Returns non-zero for the bytes considered whitespace by trim
+ */
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * @brief Creates a slice of a string with surrounding whitespace removed
+ *
+ * @param parent The string to trim
+ * @return A new TroveStringSlice with a reference count of 1
+ */
+TroveStringSlice* TroveStringSlice_trim(TroveString *parent) {
+    size_t start = 0;
+    size_t end = parent->length;
+    while (start < end && is_space(parent->str[start])) {
+        start++;
+    }
+    while (end > start && is_space(parent->str[end - 1])) {
+        end--;
+    }
+    return slice_alloc(parent, parent->str + start, end - start);
+}
+
+/**
+ * @brief Returns the next delimiter-separated token of a string as a slice
+ *
+ * A single delimiter byte is matched directly; larger delimiter sets are
+ * looked up through a 256-entry table built once per call.
+ *
+ * @param parent The string being tokenized
+ * @param cursor In/out byte offset into parent
+ * @param delims Null-terminated set of delimiter bytes
+ * @return A new TroveStringSlice with a reference count of 1, or NULL when no tokens remain
+ */
+TroveStringSlice* TroveStringSlice_next_token(TroveString *parent, size_t *cursor, const char *delims) {
+    const unsigned char *bytes = (const unsigned char *)parent->str;
+    size_t end = parent->length;
+    size_t pos = *cursor;
+    size_t start;
+
+    if (delims[0] != '\0' && delims[1] == '\0') {
+        unsigned char delim = (unsigned char)delims[0];
+        while (pos < end && bytes[pos] == delim) {
+            pos++;
+        }
+        start = pos;
+        while (pos < end && bytes[pos] != delim) {
+            pos++;
+        }
+    } else {
+        unsigned char table[256];
+        memset(table, 0, sizeof(table));
+        for (const unsigned char *d = (const unsigned char *)delims; *d; d++) {
+            table[*d] = 1;
+        }
+        while (pos < end && table[bytes[pos]]) {
+            pos++;
+        }
+        start = pos;
+        while (pos < end && !table[bytes[pos]]) {
+            pos++;
+        }
+    }
+
+    *cursor = pos;
+    if (start == pos) {
+        return NULL;
+    }
+    return slice_alloc(parent, parent->str + start, pos - start);
+}
+
+/**
+ * @brief Compares a slice with a null-terminated C string
+ *
+ * @param slice The slice to compare
+ * @param cstr The C string to compare against
+ * @return 1 if the bytes are identical, 0 otherwise
+ */
+int TroveStringSlice_equals(TroveStringSlice *slice, const char *cstr) {
+    size_t len = strlen(cstr);
+    return len == slice->length && memcmp(slice->ptr, cstr, len) == 0;
+}
+
+/**
+ * @brief Copies the bytes of a slice into a new standalone string
+ *
+ * @param slice The slice to copy
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_materialize(TroveStringSlice *slice) {
+    return TroveString_create_with_length(slice->ptr, slice->length);
+}
+
+/**
+ * @brief Deallocates a TroveStringSlice
+ *
+ * Releases the parent string, which may free it if this slice held the last
+ * reference, then frees the slice itself.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveStringSlice_dealloc(ARCObject *obj) {
+    TroveStringSlice *slice = (TroveStringSlice *)obj;
+    arc_release((ARCObject *)slice->parent);
+    arc_object_free(&slice->base);
+}
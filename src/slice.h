@@ -0,0 +1,114 @@
+/**
+ * @file slice.h
+ * @brief Zero-copy string slices for the Trove ARC memory management system
+ *
+ * A TroveStringSlice references a byte range inside a parent TroveString and
+ * retains that parent, so splitting, trimming and tokenizing never copy bytes.
+ * Slices are not null-terminated; use TroveString_materialize to obtain a
+ * standalone TroveString when one is needed or when a small slice would
+ * otherwise keep a large parent alive.
+ */
+
+#ifndef SLICE_H
+#define SLICE_H
+
+#include "trove.h"
+
+/**
+ * @brief String slice type managed by ARC
+ *
+ * The slice holds a reference to its parent string for as long as it lives.
+ * Slices of slices point at the original parent, so chains never form.
+ */
+typedef struct TroveStringSlice {
+    ARCObject base;        /**< Inheritance: must be the first member */
+    TroveString *parent;   /**< Retained string that owns the bytes */
+    const char *ptr;       /**< First byte of the slice inside parent->str */
+    size_t length;         /**< Number of bytes in the slice */
+} TroveStringSlice;
+
+/**
+ * @brief Creates a slice referencing a range of a string
+ *
+ * The range is clamped to the bounds of the parent. The parent is retained.
+ *
+ * @param parent The string that owns the bytes
+ * @param offset Byte offset of the first byte of the slice
+ * @param length Number of bytes in the slice
+ * @return A new TroveStringSlice with a reference count of 1
+ */
+TroveStringSlice* TroveStringSlice_create(TroveString *parent, size_t offset, size_t length);
+
+/**
+ * @brief Creates a slice referencing a range of another slice
+ *
+ * The range is clamped to the bounds of the source slice, and the new slice
+ * retains the original parent string rather than the source slice.
+ *
+ * @param slice The slice to narrow
+ * @param offset Byte offset relative to the start of slice
+ * @param length Number of bytes in the new slice
+ * @return A new TroveStringSlice with a reference count of 1
+ */
+TroveStringSlice* TroveStringSlice_subslice(TroveStringSlice *slice, size_t offset, size_t length);
+
+/**
+ * @brief Creates a slice of a string with leading and trailing whitespace removed
+ *
+ * @param parent The string to trim
+ * @return A new TroveStringSlice with a reference count of 1
+ */
+TroveStringSlice* TroveStringSlice_trim(TroveString *parent);
+
+/**
+ * @brief Returns the next delimiter-separated token of a string as a slice
+ *
+ * Skips any delimiters at *cursor, then returns the run of non-delimiter bytes
+ * that follows and advances *cursor past it. Start with *cursor set to 0.
+ *
+ * @param parent The string being tokenized
+ * @param cursor In/out byte offset into parent
+ * @param delims Null-terminated set of delimiter bytes
+ * @return A new TroveStringSlice with a reference count of 1, or NULL when no tokens remain
+ */
+TroveStringSlice* TroveStringSlice_next_token(TroveString *parent, size_t *cursor, const char *delims);
+
+/**
+ * @brief Compares a slice with a null-terminated C string
+ *
+ * @param slice The slice to compare
+ * @param cstr The C string to compare against
+ * @return 1 if the bytes are identical, 0 otherwise
+ */
+int TroveStringSlice_equals(TroveStringSlice *slice, const char *cstr);
+
+/**
+ * @brief Copies the bytes of a slice into a new standalone string
+ *
+ * Use this to compact a slice that outlives a large parent: once the slice is
+ * released, the parent no longer has to stay in memory.
+ *
+ * @param slice The slice to copy
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_materialize(TroveStringSlice *slice);
+
+/**
+ * @brief Deallocates a TroveStringSlice and releases its parent
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveStringSlice_dealloc(ARCObject *obj);
+
+/**
+ * @brief Convenience macro for creating autoreleased TroveStringSlice objects
+ *
+ * @code
+ * TroveStringSlice *word = Slice(line, 0, 5);
+ * @endcode
+ */
+#define Slice(parent, offset, length) ((TroveStringSlice *)arc_autorelease((ARCObject *)TROVE_AT_SITE(TroveStringSlice_create((parent), (offset), (length)))))
+
+#endif // SLICE_H
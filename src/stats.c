@@ -0,0 +1,340 @@
+/**
+ * @file stats.c
+ * @brief Per-type object statistics for the Trove ARC memory management system
+ */
+
+#include "stats.h"
+#include "array.h"
+#include "data.h"
+#include "dictionary.h"
+#include "image.h"
+#include "map.h"
+#include "reader.h"
+#include "rope.h"
+#include "set.h"
+#include "slice.h"
+#include "vector.h"
+#include "writer.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/**
+ * @brief Relaxed loads and stores of counters
+ *
+ * Only the owning thread writes a block, so an increment is a plain load
+ * and store; making both relaxed atomics keeps concurrent snapshots free of
+ * data races at no cost on the hot path.
+ */
+#if defined(__GNUC__)
+#define STATS_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define STATS_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#else
+#define STATS_LOAD(field) (field)
+#define STATS_STORE(field, value) ((field) = (value))
+#endif
+
+/** @brief Adds to a counter of the calling thread's block */
+#define STATS_ADD(field, n) STATS_STORE(field, (field) + (n))
+
+/**
+ * @brief One thread's counters of one type
+ */
+typedef struct StatsCounters {
+    void (*dealloc)(ARCObject *);    /**< Type, NULL while the slot is unused */
+    uint64_t allocations;            /**< Objects created */
+    uint64_t deallocations;          /**< Objects freed */
+    uint64_t retains;                /**< Reference count increments */
+    uint64_t releases;               /**< Reference count decrements */
+    uint64_t allocated_bytes;        /**< Bytes of the objects created */
+    uint64_t freed_bytes;            /**< Bytes of the objects freed */
+} StatsCounters;
+
+/**
+ * @brief Counters of one thread, kept after the thread exits
+ */
+typedef struct StatsBlock {
+    struct StatsBlock *next;                        /**< Next block in stats_blocks */
+    StatsCounters types[TROVE_STATS_MAX_TYPES];     /**< Open-addressing table keyed by dealloc */
+    StatsCounters other;                            /**< Types that did not fit in types */
+    StatsCounters *last;                            /**< Counters found by the previous lookup */
+} StatsBlock;
+
+/**
+ * @brief Type name registered for a dealloc function
+ */
+typedef struct StatsName {
+    void (*dealloc)(ARCObject *);    /**< The type */
+    const char *name;                /**< Its name */
+} StatsName;
+
+int arc_stats_enabled = 0;
+
+/** @brief Blocks of all threads that have recorded an event, newest first */
+static StatsBlock *stats_blocks = NULL;
+
+/** @brief Block of the calling thread, created on its first event */
+static TROVE_THREAD_LOCAL StatsBlock *thread_stats = NULL;
+
+/** @brief Names of the built-in types */
+static const StatsName BUILTIN_NAMES[] = {
+    { TroveArena_dealloc, "TroveArena" },
+    { TroveString_dealloc, "TroveString" },
+    { TroveStringSlice_dealloc, "TroveStringSlice" },
+    { TroveRope_dealloc, "TroveRope" },
+    { TroveArray_dealloc, "TroveArray" },
+    { TroveArraySlice_dealloc, "TroveArraySlice" },
+    { TroveDictionary_dealloc, "TroveDictionary" },
+    { TroveSet_dealloc, "TroveSet" },
+    { TroveVector_dealloc, "TroveVector" },
+    { TroveVectorNode_dealloc, "TroveVectorNode" },
+    { TroveMap_dealloc, "TroveMap" },
+    { TroveMapNode_dealloc, "TroveMapNode" },
+    { TroveData_dealloc, "TroveData" },
+    { TroveLineReader_dealloc, "TroveLineReader" },
+    { TroveWriteBatch_dealloc, "TroveWriteBatch" },
+    { TroveWriter_dealloc, "TroveWriter" },
+    { TroveImage_dealloc, "TroveImage" }
+};
+
+/** @brief Names registered with arc_stats_register_type */
+static StatsName registered_names[TROVE_STATS_MAX_TYPES];
+
+/** @brief Entries used in registered_names */
+static size_t registered_count = 0;
+
+/**
+ * @brief Starts or stops collecting statistics
+ */
+void arc_stats_enable(int enabled) {
+    arc_stats_enabled = enabled != 0;
+}
+
+#if defined(__GNUC__)
+/**
+ * @brief Enables statistics at startup when TROVE_STATS is set to anything but 0
+ */
+__attribute__((constructor)) static void stats_enable_from_environment(void) {
+    const char *value = getenv("TROVE_STATS");
+    if (value && *value && strcmp(value, "0") != 0) {
+        arc_stats_enabled = 1;
+    }
+}
+#endif
+
+/**
+ * @brief Names a type in snapshots
+ */
+void arc_stats_register_type(void (*dealloc)(ARCObject *), const char *name) {
+    for (size_t i = 0; i < registered_count; i++) {
+        if (registered_names[i].dealloc == dealloc) {
+            registered_names[i].name = name;
+            return;
+        }
+    }
+    if (registered_count < TROVE_STATS_MAX_TYPES) {
+        registered_names[registered_count].dealloc = dealloc;
+        registered_names[registered_count].name = name;
+        registered_count++;
+    }
+}
+
+/**
+ * @brief Returns the name of a type
+ */
+const char* arc_stats_type_name(void (*dealloc)(ARCObject *)) {
+    for (size_t i = 0; i < registered_count; i++) {
+        if (registered_names[i].dealloc == dealloc) {
+            return registered_names[i].name;
+        }
+    }
+    for (size_t i = 0; i < sizeof(BUILTIN_NAMES) / sizeof(BUILTIN_NAMES[0]); i++) {
+        if (BUILTIN_NAMES[i].dealloc == dealloc) {
+            return BUILTIN_NAMES[i].name;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Allocates the calling thread's block and publishes it
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static StatsBlock* stats_block_create(void) {
+    StatsBlock *block = (StatsBlock *)calloc(1, sizeof(StatsBlock));
+    if (!block) {
+        fprintf(stderr, "Failed to allocate statistics block.\n");
+        exit(1);
+    }
+#if defined(__GNUC__)
+    block->next = __atomic_load_n(&stats_blocks, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&stats_blocks, &block->next, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+#else
+    block->next = stats_blocks;
+    stats_blocks = block;
+#endif
+    block->last = &block->other;
+    thread_stats = block;
+    return block;
+}
+
+/**
+ * @brief Finds or claims the calling thread's counters for a type in its table
+ */
+static StatsCounters* stats_counters_lookup(void (*dealloc)(ARCObject *)) {
+    StatsBlock *block = thread_stats;
+    if (!block) {
+        block = stats_block_create();
+    }
+    size_t slot = (size_t)((((uintptr_t)dealloc >> 4) * 0x9E3779B97F4A7C15ull) >> 58) & (TROVE_STATS_MAX_TYPES - 1);
+    for (size_t probe = 0; probe < TROVE_STATS_MAX_TYPES; probe++) {
+        StatsCounters *counters = &block->types[slot];
+        if (!counters->dealloc) {
+            STATS_STORE(counters->dealloc, dealloc);
+        }
+        if (counters->dealloc == dealloc) {
+            block->last = counters;
+            return counters;
+        }
+        slot = (slot + 1) & (TROVE_STATS_MAX_TYPES - 1);
+    }
+    return &block->other;
+}
+
+/**
+ * @brief Returns the calling thread's counters for a type
+ *
+ * Runs of events on one type, the common case, skip the table lookup.
+ */
+static inline StatsCounters* stats_counters(void (*dealloc)(ARCObject *)) {
+    StatsBlock *block = thread_stats;
+    if (block && block->last->dealloc == dealloc) {
+        return block->last;
+    }
+    return stats_counters_lookup(dealloc);
+}
+
+/**
+ * @brief Counts the creation of an object
+ */
+void arc_stats_record_alloc(ARCObject *obj) {
+    StatsCounters *counters = stats_counters(obj->dealloc);
+    STATS_ADD(counters->allocations, 1);
+    STATS_ADD(counters->allocated_bytes, obj->size);
+}
+
+/**
+ * @brief Counts the freeing of an object
+ */
+void arc_stats_record_free(ARCObject *obj) {
+    StatsCounters *counters = stats_counters(obj->dealloc);
+    STATS_ADD(counters->deallocations, 1);
+    STATS_ADD(counters->freed_bytes, obj->size);
+}
+
+/**
+ * @brief Counts retains of objects of a type
+ */
+void arc_stats_record_retain(void (*dealloc)(ARCObject *), size_t count) {
+    StatsCounters *counters = stats_counters(dealloc);
+    STATS_ADD(counters->retains, count);
+}
+
+/**
+ * @brief Counts releases of objects of a type
+ */
+void arc_stats_record_release(void (*dealloc)(ARCObject *), size_t count) {
+    StatsCounters *counters = stats_counters(dealloc);
+    STATS_ADD(counters->releases, count);
+}
+
+/**
+ * @brief Finds the snapshot entry of a type
+ */
+static ArcTypeStats* stats_find(ArcStatsSnapshot *snapshot, void (*dealloc)(ARCObject *)) {
+    for (size_t i = 0; i < snapshot->count; i++) {
+        if (snapshot->types[i].dealloc == dealloc) {
+            return &snapshot->types[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Adds one thread's counters into the snapshot entry of their type
+ *
+ * Types beyond TROVE_STATS_MAX_TYPES across all threads go to "other".
+ */
+static void stats_merge(ArcStatsSnapshot *snapshot, void (*dealloc)(ARCObject *), StatsCounters *counters) {
+    ArcTypeStats *entry = stats_find(snapshot, dealloc);
+    if (!entry && dealloc && snapshot->count >= TROVE_STATS_MAX_TYPES) {
+        dealloc = NULL;
+        entry = stats_find(snapshot, NULL);
+    }
+    if (!entry) {
+        entry = &snapshot->types[snapshot->count++];
+        entry->dealloc = dealloc;
+        entry->name = dealloc ? arc_stats_type_name(dealloc) : "other";
+    }
+    uint64_t allocations = STATS_LOAD(counters->allocations);
+    uint64_t deallocations = STATS_LOAD(counters->deallocations);
+    entry->allocations += allocations;
+    entry->deallocations += deallocations;
+    entry->live += (int64_t)(allocations - deallocations);
+    entry->live_bytes += (int64_t)(STATS_LOAD(counters->allocated_bytes) - STATS_LOAD(counters->freed_bytes));
+    entry->retains += STATS_LOAD(counters->retains);
+    entry->releases += STATS_LOAD(counters->releases);
+}
+
+/**
+ * @brief Sums the counters of all threads
+ */
+void arc_stats_snapshot(ArcStatsSnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+#if defined(__GNUC__)
+    StatsBlock *block = __atomic_load_n(&stats_blocks, __ATOMIC_ACQUIRE);
+#else
+    StatsBlock *block = stats_blocks;
+#endif
+    for (; block; block = block->next) {
+        for (size_t i = 0; i < TROVE_STATS_MAX_TYPES; i++) {
+            void (*dealloc)(ARCObject *) = STATS_LOAD(block->types[i].dealloc);
+            if (dealloc) {
+                stats_merge(snapshot, dealloc, &block->types[i]);
+            }
+        }
+        if (STATS_LOAD(block->other.allocations) || STATS_LOAD(block->other.retains) ||
+            STATS_LOAD(block->other.releases) || STATS_LOAD(block->other.deallocations)) {
+            stats_merge(snapshot, NULL, &block->other);
+        }
+    }
+}
+
+/**
+ * @brief Formats a snapshot as a JSON object keyed by type name
+ */
+TroveString* arc_stats_to_json(const ArcStatsSnapshot *snapshot) {
+    TroveString *json = TroveString_create("{");
+    char line[512];
+    for (size_t i = 0; i < snapshot->count; i++) {
+        const ArcTypeStats *type = &snapshot->types[i];
+        char address[32];
+        const char *name = type->name;
+        if (!name) {
+            snprintf(address, sizeof(address), "0x%" PRIxPTR, (uintptr_t)type->dealloc);
+            name = address;
+        }
+        int length = snprintf(line, sizeof(line),
+                              "%s\n  \"%s\": {\"live\": %" PRId64 ", \"live_bytes\": %" PRId64
+                              ", \"allocations\": %" PRIu64 ", \"deallocations\": %" PRIu64
+                              ", \"retains\": %" PRIu64 ", \"releases\": %" PRIu64 "}",
+                              i ? "," : "", name, type->live, type->live_bytes, type->allocations,
+                              type->deallocations, type->retains, type->releases);
+        TroveString_append(&json, line, length < (int)sizeof(line) ? (size_t)length : sizeof(line) - 1);
+    }
+    TroveString_append_cstr(&json, snapshot->count ? "\n}\n" : "}\n");
+    return json;
+}
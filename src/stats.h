@@ -0,0 +1,124 @@
+/**
+ * @file stats.h
+ * @brief Per-type object statistics for the Trove ARC memory management system
+ *
+ * When enabled with arc_stats_enable, the runtime counts allocations,
+ * deallocations, retains, releases and bytes for every type, the type being
+ * identified by its dealloc function. Counters live in per-thread blocks
+ * that only their thread writes, with plain (relaxed) stores: the hot path
+ * takes no locks and no atomic read-modify-writes. arc_stats_snapshot sums
+ * the blocks of all threads, including threads that have exited.
+ *
+ * Counts cover the events since stats were enabled; objects created before
+ * that and freed after it make live counts low. Immortal objects are not
+ * counted. Bytes are the sizes given to arc_object_init: object headers and
+ * inline storage, not separately allocated buffers such as string bytes.
+ *
+ * Setting the environment variable TROVE_STATS to anything but 0 enables
+ * stats at startup (with GCC and Clang), so they can be turned on in a
+ * deployed binary. Otherwise enable stats and register type names before
+ * starting threads.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "trove.h"
+#include <stdint.h>
+
+/** @brief Types tracked per thread; events of further types are counted as "other" */
+#define TROVE_STATS_MAX_TYPES 64
+
+/**
+ * @brief Counters of one type, merged across threads
+ */
+typedef struct ArcTypeStats {
+    void (*dealloc)(ARCObject *);    /**< The type's dealloc function, NULL for "other" */
+    const char *name;                /**< Type name, or NULL if unregistered */
+    int64_t live;                    /**< Allocations minus deallocations */
+    int64_t live_bytes;              /**< Bytes of the live objects */
+    uint64_t allocations;            /**< Objects created */
+    uint64_t deallocations;          /**< Objects freed */
+    uint64_t retains;                /**< Reference count increments */
+    uint64_t releases;               /**< Reference count decrements */
+} ArcTypeStats;
+
+/**
+ * @brief Statistics of every type seen, in no particular order
+ */
+typedef struct ArcStatsSnapshot {
+    size_t count;                                  /**< Entries used in types */
+    ArcTypeStats types[TROVE_STATS_MAX_TYPES + 1]; /**< Per-type counters */
+} ArcStatsSnapshot;
+
+/** @brief Nonzero while statistics are collected; set with arc_stats_enable */
+extern int arc_stats_enabled;
+
+/**
+ * @brief Starts or stops collecting statistics
+ *
+ * @param enabled Nonzero to collect
+ */
+void arc_stats_enable(int enabled);
+
+/**
+ * @brief Names a type in snapshots
+ *
+ * The built-in types are named already.
+ *
+ * @param dealloc The type's dealloc function
+ * @param name Static type name
+ */
+void arc_stats_register_type(void (*dealloc)(ARCObject *), const char *name);
+
+/**
+ * @brief Returns the name of a type
+ *
+ * @param dealloc The type's dealloc function
+ * @return The registered or built-in name, or NULL
+ */
+const char* arc_stats_type_name(void (*dealloc)(ARCObject *));
+
+/**
+ * @brief Sums the counters of all threads
+ *
+ * Counters being updated by other threads are read as they stand, so a
+ * snapshot taken under load is consistent per counter, not across them.
+ *
+ * @param snapshot Receives the statistics
+ */
+void arc_stats_snapshot(ArcStatsSnapshot *snapshot);
+
+/**
+ * @brief Formats a snapshot as a JSON object keyed by type name
+ *
+ * Each type maps to an object with the members live, live_bytes,
+ * allocations, deallocations, retains and releases. Unregistered types are
+ * keyed by their dealloc address.
+ *
+ * @param snapshot The statistics
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* arc_stats_to_json(const ArcStatsSnapshot *snapshot);
+
+/**
+ * @brief Counts the creation of an object; called by arc_object_init
+ */
+void arc_stats_record_alloc(ARCObject *obj);
+
+/**
+ * @brief Counts the freeing of an object; called by arc_object_free
+ */
+void arc_stats_record_free(ARCObject *obj);
+
+/**
+ * @brief Counts retains of objects of a type; called by arc_retain and arc_retain_all
+ */
+void arc_stats_record_retain(void (*dealloc)(ARCObject *), size_t count);
+
+/**
+ * @brief Counts releases of objects of a type; called by arc_release and arc_release_all
+ */
+void arc_stats_record_release(void (*dealloc)(ARCObject *), size_t count);
+
+#endif // STATS_H
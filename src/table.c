@@ -0,0 +1,404 @@
+/**
+ * @file table.c
+ * @brief Implementation of the Swiss-table shared by dictionaries and sets
+ *
+ * A hash is split into H1 (the upper 57 bits), which picks the first group
+ * to probe, and H2 (the low 7 bits), which is stored in the control byte.
+ * Groups are probed triangularly, which visits every group of a
+ * power-of-two table. Tables are kept at most 7/8 full; erased slots become
+ * DELETED tombstones and are purged by the next rehash.
+ */
+
+#include "table.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/** @brief Control byte of a never-used slot */
+#define CTRL_EMPTY ((int8_t)-128)
+
+/** @brief Control byte of an erased slot */
+#define CTRL_DELETED ((int8_t)-2)
+
+/** @brief Keys and values trove_table_clear sets aside on the stack before falling back to malloc */
+#define TABLE_CLEAR_LOCAL 64
+
+/**
+ * @brief Group Matching
+ *
+ * Each function returns a bitmask with bit i set when control byte i of the
+ * group starting at ctrl satisfies the condition.
+ */
+
+#if defined(__SSE2__)
+
+static inline uint32_t group_match(const int8_t *ctrl, int8_t h2) {
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), group));
+}
+
+static inline uint32_t group_match_empty(const int8_t *ctrl) {
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline uint32_t group_match_free(const int8_t *ctrl) {
+    // EMPTY and DELETED are the only control values below -1.
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), group));
+}
+
+#else
+
+static inline uint32_t group_match(const int8_t *ctrl, int8_t h2) {
+    uint32_t mask = 0;
+    for (int i = 0; i < TROVE_TABLE_GROUP_WIDTH; i++) {
+        mask |= (uint32_t)(ctrl[i] == h2) << i;
+    }
+    return mask;
+}
+
+static inline uint32_t group_match_empty(const int8_t *ctrl) {
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline uint32_t group_match_free(const int8_t *ctrl) {
+    uint32_t mask = 0;
+    for (int i = 0; i < TROVE_TABLE_GROUP_WIDTH; i++) {
+        mask |= (uint32_t)(ctrl[i] < -1) << i;
+    }
+    return mask;
+}
+
+#endif
+
+/** @brief Index of the lowest set bit of a non-zero mask */
+static inline unsigned lowest_bit(uint32_t mask) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctz(mask);
+#else
+    unsigned index = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/** @brief H2: the 7 hash bits stored in a full slot's control byte */
+static inline int8_t hash_h2(uint64_t hash) {
+    return (int8_t)(hash & 0x7F);
+}
+
+/** @brief Maximum number of entries a table of the given capacity may hold */
+static size_t max_load(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+/** @brief Writes a control byte, keeping the cloned first group in sync */
+static inline void set_ctrl(TroveTable *table, size_t slot, int8_t value) {
+    table->ctrl[slot] = value;
+    if (slot < TROVE_TABLE_GROUP_WIDTH) {
+        table->ctrl[table->capacity + slot] = value;
+    }
+}
+
+/** @brief Returns the first EMPTY or DELETED slot on the probe sequence of hash */
+static size_t find_free(TroveTable *table, uint64_t hash) {
+    size_t mask = table->capacity - 1;
+    size_t pos = (size_t)(hash >> 7) & mask;
+    size_t step = 0;
+    for (;;) {
+        uint32_t match = group_match_free(table->ctrl + pos);
+        if (match) {
+            return (pos + lowest_bit(match)) & mask;
+        }
+        step += TROVE_TABLE_GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
+
+/**
+ * @brief Moves every entry into freshly allocated storage of a new capacity
+ *
+ * Dropping tombstones happens as a side effect. Entries are moved, so no
+ * reference counts change.
+ * If allocation fails, the program will exit with an error message.
+ */
+static void table_resize(TroveTable *table, size_t capacity) {
+    int8_t *old_ctrl = table->ctrl;
+    TroveTableEntry *old_entries = table->entries;
+    size_t old_capacity = table->capacity;
+
+    table->ctrl = (int8_t *)malloc(capacity + TROVE_TABLE_GROUP_WIDTH);
+    table->entries = (TroveTableEntry *)calloc(capacity, sizeof(TroveTableEntry));
+    if (!table->ctrl || !table->entries) {
+        fprintf(stderr, "Failed to allocate hash table storage.\n");
+        exit(1);
+    }
+    memset(table->ctrl, CTRL_EMPTY, capacity + TROVE_TABLE_GROUP_WIDTH);
+    table->capacity = capacity;
+    table->growth_left = max_load(capacity) - table->count;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_ctrl[i] >= 0) {
+            uint64_t hash = old_entries[i].key->hash;
+            size_t slot = find_free(table, hash);
+            set_ctrl(table, slot, hash_h2(hash));
+            table->entries[slot] = old_entries[i];
+        }
+    }
+    free(old_ctrl);
+    free(old_entries);
+}
+
+/** @brief Smallest table capacity that holds expected entries */
+static size_t capacity_for(size_t expected) {
+    size_t capacity = TROVE_TABLE_GROUP_WIDTH;
+    while (max_load(capacity) < expected) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/**
+ * @brief Initializes an empty table sized for expected entries
+ *
+ * No storage is allocated when expected is 0.
+ *
+ * @param table The table to initialize
+ * @param expected Number of entries to hold without rehashing (can be 0)
+ */
+void trove_table_init(TroveTable *table, size_t expected) {
+    table->ctrl = NULL;
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+    table->growth_left = 0;
+    if (expected > 0) {
+        table_resize(table, capacity_for(expected));
+    }
+}
+
+/**
+ * @brief Releases every key and value and frees the table's storage
+ *
+ * @param table The table
+ */
+void trove_table_destroy(TroveTable *table) {
+    arc_release_all((ARCObject *const *)table->entries, table->capacity * 2);
+    free(table->ctrl);
+    free(table->entries);
+    table->ctrl = NULL;
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+    table->growth_left = 0;
+}
+
+/**
+ * @brief Initializes dst as a copy of src, retaining every key and value
+ *
+ * The control bytes and entries are copied as they are, tombstones
+ * included, so no key is rehashed.
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param dst The table to initialize
+ * @param src The table to copy
+ */
+void trove_table_copy(TroveTable *dst, TroveTable *src) {
+    *dst = *src;
+    if (src->capacity == 0) {
+        return;
+    }
+    dst->ctrl = (int8_t *)malloc(src->capacity + TROVE_TABLE_GROUP_WIDTH);
+    dst->entries = (TroveTableEntry *)malloc(src->capacity * sizeof(TroveTableEntry));
+    if (!dst->ctrl || !dst->entries) {
+        fprintf(stderr, "Failed to allocate hash table storage.\n");
+        exit(1);
+    }
+    memcpy(dst->ctrl, src->ctrl, src->capacity + TROVE_TABLE_GROUP_WIDTH);
+    memcpy(dst->entries, src->entries, src->capacity * sizeof(TroveTableEntry));
+    arc_retain_all((ARCObject *const *)dst->entries, dst->capacity * 2);
+}
+
+/**
+ * @brief Grows the table so expected entries fit without rehashing
+ *
+ * @param table The table
+ * @param expected Number of entries
+ */
+void trove_table_reserve(TroveTable *table, size_t expected) {
+    if (expected > max_load(table->capacity) || table->capacity == 0) {
+        size_t capacity = capacity_for(expected);
+        if (capacity > table->capacity) {
+            table_resize(table, capacity);
+        }
+    }
+}
+
+/**
+ * @brief Finds the slot holding a key given as bytes and hash
+ *
+ * Candidate slots are those whose control byte equals H2; for each, the
+ * cached full hash and length are compared before the bytes.
+ *
+ * @param table The table
+ * @param bytes Key bytes
+ * @param length Number of key bytes
+ * @param hash trove_hash_bytes(bytes, length)
+ * @return The slot index, or TROVE_TABLE_NOT_FOUND
+ */
+size_t trove_table_find(TroveTable *table, const char *bytes, size_t length, uint64_t hash) {
+    if (table->capacity == 0) {
+        return TROVE_TABLE_NOT_FOUND;
+    }
+    size_t mask = table->capacity - 1;
+    size_t pos = (size_t)(hash >> 7) & mask;
+    size_t step = 0;
+    int8_t h2 = hash_h2(hash);
+    for (;;) {
+        const int8_t *group = table->ctrl + pos;
+        uint32_t match = group_match(group, h2);
+        while (match) {
+            size_t slot = (pos + lowest_bit(match)) & mask;
+            TroveString *key = table->entries[slot].key;
+            if (key->hash == hash && key->length == length && memcmp(key->str, bytes, length) == 0) {
+                return slot;
+            }
+            match &= match - 1;
+        }
+        if (group_match_empty(group)) {
+            return TROVE_TABLE_NOT_FOUND;
+        }
+        step += TROVE_TABLE_GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
+
+/**
+ * @brief Finds the slot holding a key
+ *
+ * @param table The table
+ * @param key The key to look up
+ * @return The slot index, or TROVE_TABLE_NOT_FOUND
+ */
+size_t trove_table_find_key(TroveTable *table, TroveString *key) {
+    return trove_table_find(table, key->str, key->length, TroveString_hash(key));
+}
+
+/**
+ * @brief Claims a free slot for a key that is known to be absent
+ *
+ * Reusing a DELETED slot never triggers a rehash. When an EMPTY slot would
+ * be consumed with no growth left, the table doubles if more than half of
+ * its maximum load is live, and otherwise rehashes in place to purge
+ * tombstones.
+ *
+ * @param table The table
+ * @param hash Hash of the key to be stored
+ * @return The claimed slot index
+ */
+size_t trove_table_claim(TroveTable *table, uint64_t hash) {
+    if (table->capacity == 0) {
+        table_resize(table, TROVE_TABLE_GROUP_WIDTH);
+    }
+    size_t slot = find_free(table, hash);
+    if (table->growth_left == 0 && table->ctrl[slot] == CTRL_EMPTY) {
+        size_t capacity = table->capacity;
+        if (table->count + 1 > max_load(capacity) / 2) {
+            capacity *= 2;
+        }
+        table_resize(table, capacity);
+        slot = find_free(table, hash);
+    }
+    if (table->ctrl[slot] == CTRL_EMPTY) {
+        table->growth_left--;
+    }
+    set_ctrl(table, slot, hash_h2(hash));
+    table->count++;
+    return slot;
+}
+
+/**
+ * @brief Removes the entry in a slot, releasing its key and value
+ *
+ * The entry is cleared before the release so the table is consistent even
+ * if a dealloc function re-enters it.
+ *
+ * @param table The table
+ * @param slot A full slot index
+ */
+void trove_table_erase(TroveTable *table, size_t slot) {
+    TroveTableEntry entry = table->entries[slot];
+    table->entries[slot].key = NULL;
+    table->entries[slot].value = NULL;
+    set_ctrl(table, slot, CTRL_DELETED);
+    table->count--;
+    arc_release((ARCObject *)entry.key);
+    arc_release(entry.value);
+}
+
+/**
+ * @brief Removes every entry, keeping the allocated capacity
+ *
+ * The keys and values are copied aside and the table emptied before they
+ * are released, so a dealloc function that re-enters the table finds it
+ * empty rather than holding entries that are being freed.
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param table The table
+ */
+void trove_table_clear(TroveTable *table) {
+    if (table->capacity == 0) {
+        return;
+    }
+    size_t length = table->count * 2;
+    ARCObject *local[TABLE_CLEAR_LOCAL];
+    ARCObject **removed = local;
+    if (length > TABLE_CLEAR_LOCAL) {
+        removed = (ARCObject **)malloc(length * sizeof(ARCObject *));
+        if (!removed) {
+            fprintf(stderr, "Failed to allocate TroveTable removed entries.\n");
+            exit(1);
+        }
+    }
+    size_t used = 0;
+    for (size_t slot = 0; slot < table->capacity; slot++) {
+        if (table->ctrl[slot] >= 0) {
+            removed[used++] = (ARCObject *)table->entries[slot].key;
+            removed[used++] = table->entries[slot].value;
+        }
+    }
+    memset(table->entries, 0, table->capacity * sizeof(TroveTableEntry));
+    memset(table->ctrl, CTRL_EMPTY, table->capacity + TROVE_TABLE_GROUP_WIDTH);
+    table->count = 0;
+    table->growth_left = max_load(table->capacity);
+    arc_release_all(removed, used);
+    if (removed != local) {
+        free(removed);
+    }
+}
+
+/**
+ * @brief Returns the next full slot at or after *cursor
+ *
+ * @param table The table
+ * @param cursor In/out iteration position
+ * @return The slot index, or TROVE_TABLE_NOT_FOUND when iteration is done
+ */
+size_t trove_table_next(TroveTable *table, size_t *cursor) {
+    for (size_t slot = *cursor; slot < table->capacity; slot++) {
+        if (table->ctrl[slot] >= 0) {
+            *cursor = slot + 1;
+            return slot;
+        }
+    }
+    *cursor = table->capacity;
+    return TROVE_TABLE_NOT_FOUND;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file table.h
+ * @brief Open-addressing hash table shared by TroveDictionary and TroveSet
+ *
+ * The table follows the Swiss-table design: every slot has a one-byte
+ * control value holding either EMPTY, DELETED or the low 7 bits of the key's
+ * hash. Lookups compare a whole group of 16 control bytes against the hash
+ * with one SSE2 instruction (or a portable loop on other targets) and only
+ * touch entries whose control byte matches. The control array is followed by
+ * a copy of its first group so a group starting near the end can be loaded
+ * without wrapping.
+ *
+ * Keys are TroveStrings and use their cached hash. The table retains keys and
+ * values stored in it and releases them on erase and destroy. Unused entries
+ * are kept NULL, which lets destroy release the whole entry array with a
+ * single arc_release_all pass.
+ */
+
+#ifndef TABLE_H
+#define TABLE_H
+
+#include "trove.h"
+#include <stdint.h>
+
+/** @brief Number of control bytes examined per probe step */
+#define TROVE_TABLE_GROUP_WIDTH 16
+
+/** @brief Slot index returned when a key is not present */
+#define TROVE_TABLE_NOT_FOUND ((size_t)-1)
+
+/**
+ * @brief A key/value pair stored in a table slot
+ *
+ * Layout must stay two pointers with no padding: the entries array is
+ * released as a flat array of ARCObject pointers.
+ */
+typedef struct TroveTableEntry {
+    TroveString *key;    /**< Retained key, NULL for unused slots */
+    ARCObject *value;    /**< Retained value (may be NULL) */
+} TroveTableEntry;
+
+/**
+ * @brief Swiss-table state, embedded in the collections that use it
+ */
+typedef struct TroveTable {
+    int8_t *ctrl;                /**< capacity + TROVE_TABLE_GROUP_WIDTH control bytes */
+    TroveTableEntry *entries;    /**< capacity entries */
+    size_t capacity;             /**< 0 or a power of two >= TROVE_TABLE_GROUP_WIDTH */
+    size_t count;                /**< Number of live entries */
+    size_t growth_left;          /**< Insertions into EMPTY slots allowed before rehashing */
+} TroveTable;
+
+/**
+ * @brief Initializes an empty table sized for expected entries
+ *
+ * @param table The table to initialize
+ * @param expected Number of entries to hold without rehashing (can be 0)
+ */
+void trove_table_init(TroveTable *table, size_t expected);
+
+/**
+ * @brief Releases every key and value and frees the table's storage
+ *
+ * @param table The table
+ */
+void trove_table_destroy(TroveTable *table);
+
+/**
+ * @brief Initializes dst as a copy of src, retaining every key and value
+ *
+ * @param dst The table to initialize
+ * @param src The table to copy
+ */
+void trove_table_copy(TroveTable *dst, TroveTable *src);
+
+/**
+ * @brief Grows the table so expected entries fit without rehashing
+ *
+ * @param table The table
+ * @param expected Number of entries
+ */
+void trove_table_reserve(TroveTable *table, size_t expected);
+
+/**
+ * @brief Finds the slot holding a key given as bytes and hash
+ *
+ * @param table The table
+ * @param bytes Key bytes
+ * @param length Number of key bytes
+ * @param hash trove_hash_bytes(bytes, length)
+ * @return The slot index, or TROVE_TABLE_NOT_FOUND
+ */
+size_t trove_table_find(TroveTable *table, const char *bytes, size_t length, uint64_t hash);
+
+/**
+ * @brief Finds the slot holding a key
+ *
+ * @param table The table
+ * @param key The key to look up
+ * @return The slot index, or TROVE_TABLE_NOT_FOUND
+ */
+size_t trove_table_find_key(TroveTable *table, TroveString *key);
+
+/**
+ * @brief Hints the CPU to fetch the first probe group of a hash
+ *
+ * Bulk operations call this for a batch of keys before looking them up, so
+ * the cache misses of the batch overlap.
+ *
+ * @param table The table
+ * @param hash Hash of a key about to be looked up
+ */
+static inline void trove_table_prefetch(TroveTable *table, uint64_t hash) {
+    if (table->capacity) {
+        size_t pos = (size_t)(hash >> 7) & (table->capacity - 1);
+        TROVE_PREFETCH(table->ctrl + pos);
+        TROVE_PREFETCH(table->entries + pos);
+    }
+}
+
+/**
+ * @brief Claims a free slot for a key that is known to be absent
+ *
+ * Rehashes if needed, marks the slot full and counts the entry. The caller
+ * stores the (retained) key and value in table->entries[slot].
+ *
+ * @param table The table
+ * @param hash Hash of the key to be stored
+ * @return The claimed slot index
+ */
+size_t trove_table_claim(TroveTable *table, uint64_t hash);
+
+/**
+ * @brief Removes the entry in a slot, releasing its key and value
+ *
+ * @param table The table
+ * @param slot A full slot index
+ */
+void trove_table_erase(TroveTable *table, size_t slot);
+
+/**
+ * @brief Removes every entry, keeping the allocated capacity
+ *
+ * @param table The table
+ */
+void trove_table_clear(TroveTable *table);
+
+/**
+ * @brief Returns the next full slot at or after *cursor
+ *
+ * Start with *cursor set to 0. Do not insert while iterating; erasing the
+ * returned slot is allowed.
+ *
+ * @param table The table
+ * @param cursor In/out iteration position
+ * @return The slot index, or TROVE_TABLE_NOT_FOUND when iteration is done
+ */
+size_t trove_table_next(TroveTable *table, size_t *cursor);
+
+#endif // TABLE_H
@@ -0,0 +1,456 @@
+/**
+ * @file trace.c
+ * @brief Retain/release tracing for the Trove ARC memory management system
+ */
+
+#include "trace.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+
+/**
+ * @brief Relaxed and ordered accesses to ring fields
+ *
+ * Only the owning thread writes a ring; readers copy it concurrently and
+ * discard the events the head shows may have been overwritten meanwhile.
+ */
+#if defined(__GNUC__)
+#define TRACE_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define TRACE_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#define TRACE_LOAD_ACQUIRE(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define TRACE_STORE_RELEASE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+#else
+#define TRACE_LOAD(field) (field)
+#define TRACE_STORE(field, value) ((field) = (value))
+#define TRACE_LOAD_ACQUIRE(field) (field)
+#define TRACE_STORE_RELEASE(field, value) ((field) = (value))
+#endif
+
+/**
+ * @brief Raw timestamp of an event
+ *
+ * On x86 the time stamp counter, several times cheaper than clock_gettime
+ * and constant-rate and synchronized across cores on current processors;
+ * arc_trace_collect converts it to nanoseconds. Elsewhere nanoseconds.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRACE_TICKS() __builtin_ia32_rdtsc()
+#define TRACE_TICKS_ARE_NS 0
+#else
+#define TRACE_TICKS() trace_monotonic_ns()
+#define TRACE_TICKS_ARE_NS 1
+#endif
+
+/** @brief Mask of a ring index */
+#define TRACE_MASK (TROVE_TRACE_EVENTS - 1)
+
+/** @brief Operation names, indexed by ArcTraceOp */
+static const char *const TRACE_OP_NAMES[] = { "?", "alloc", "retain", "release", "autorelease", "dealloc" };
+
+/**
+ * @brief Events of one thread, kept after the thread exits until another thread reuses the ring
+ */
+typedef struct TraceRing {
+    struct TraceRing *next;                       /**< Next ring in trace_rings */
+    uint16_t thread;                              /**< Index of the ring, from 0 */
+    int in_use;                                   /**< Nonzero while a live thread owns the ring */
+    uint64_t head;                                /**< Events ever recorded; the next goes to head & TRACE_MASK */
+    ArcTraceEvent events[TROVE_TRACE_EVENTS];     /**< The last TROVE_TRACE_EVENTS events */
+} TraceRing;
+
+int arc_trace_enabled = 0;
+
+/** @brief Rings of all threads that have recorded an event, newest first */
+static TraceRing *trace_rings = NULL;
+
+/** @brief Rings created so far, at most TROVE_TRACE_MAX_RINGS */
+static size_t trace_ring_count = 0;
+
+/** @brief Ring of the calling thread, taken on its first event */
+static TROVE_THREAD_LOCAL TraceRing *thread_ring = NULL;
+
+/** @brief Nonzero once the calling thread found no ring; its events are dropped */
+static TROVE_THREAD_LOCAL int thread_ring_denied = 0;
+
+/** @brief Key whose destructor hands a thread's ring back when the thread exits */
+static pthread_key_t trace_ring_key;
+
+/** @brief Creates trace_ring_key once */
+static pthread_once_t trace_ring_key_once = PTHREAD_ONCE_INIT;
+
+/** @brief Nonzero once the warning about dropped threads has been printed */
+static int trace_warned_full = 0;
+
+/** @brief Object recorded by the filter, 0 for any */
+static uintptr_t trace_filter_object = 0;
+
+/** @brief Type recorded by the filter, NULL for any */
+static void (*trace_filter_type)(ARCObject *) = NULL;
+
+/** @brief Ticks at the calibration point, taken when tracing is first enabled */
+static uint64_t trace_base_ticks = 0;
+
+/** @brief CLOCK_MONOTONIC nanoseconds at the calibration point */
+static uint64_t trace_base_ns = 0;
+
+/** @brief File the trace is saved to at exit, from TROVE_TRACE */
+static const char *trace_exit_path = NULL;
+
+/**
+ * @brief Returns CLOCK_MONOTONIC in nanoseconds
+ */
+static uint64_t trace_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Starts or stops recording events
+ */
+void arc_trace_enable(int enabled) {
+    if (enabled && !trace_base_ns) {
+        trace_base_ns = trace_monotonic_ns();
+        trace_base_ticks = TRACE_TICKS();
+    }
+    arc_trace_enabled = enabled != 0;
+}
+
+/**
+ * @brief Restricts recording to one object and/or one type
+ */
+void arc_trace_filter(ARCObject *obj, void (*dealloc)(ARCObject *)) {
+    TRACE_STORE(trace_filter_object, (uintptr_t)obj);
+    TRACE_STORE(trace_filter_type, dealloc);
+}
+
+/**
+ * @brief Saves the trace to the TROVE_TRACE path at exit
+ */
+static void trace_save_at_exit(void) {
+    int error = arc_trace_save(trace_exit_path);
+    if (error) {
+        fprintf(stderr, "trove: cannot save trace to %s: %s\n", trace_exit_path, strerror(error));
+    }
+}
+
+#if defined(__GNUC__)
+/**
+ * @brief Enables tracing at startup when TROVE_TRACE names a file
+ */
+__attribute__((constructor)) static void trace_enable_from_environment(void) {
+    const char *value = getenv("TROVE_TRACE");
+    if (value && *value && strcmp(value, "0") != 0) {
+        trace_exit_path = value;
+        atexit(trace_save_at_exit);
+        arc_trace_enable(1);
+    }
+}
+#endif
+
+/**
+ * @brief Hands the ring of an exiting thread back for the next new thread
+ *
+ * The ring keeps its events, which the next owner overwrites oldest first.
+ * A later event of the exiting thread, from another key's destructor,
+ * takes a ring again and schedules this destructor once more.
+ */
+static void trace_ring_release(void *value) {
+    TraceRing *ring = (TraceRing *)value;
+    thread_ring = NULL;
+#if defined(__GNUC__)
+    __atomic_store_n(&ring->in_use, 0, __ATOMIC_RELEASE);
+#else
+    ring->in_use = 0;
+#endif
+}
+
+/**
+ * @brief Creates the key that releases rings at thread exit
+ */
+static void trace_ring_key_create(void) {
+    if (pthread_key_create(&trace_ring_key, trace_ring_release) != 0) {
+        fprintf(stderr, "Failed to create trace ring key.\n");
+        exit(1);
+    }
+}
+
+/**
+ * @brief Takes the ring of an exited thread, if there is one
+ */
+static TraceRing* trace_ring_reuse(void) {
+    for (TraceRing *ring = TRACE_LOAD_ACQUIRE(trace_rings); ring; ring = ring->next) {
+#if defined(__GNUC__)
+        int expected = 0;
+        if (__atomic_load_n(&ring->in_use, __ATOMIC_RELAXED) == 0
+            && __atomic_compare_exchange_n(&ring->in_use, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return ring;
+        }
+#else
+        if (!ring->in_use) {
+            ring->in_use = 1;
+            return ring;
+        }
+#endif
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reserves an index for a new ring, or returns 0 if TROVE_TRACE_MAX_RINGS exist
+ */
+static int trace_ring_reserve(size_t *index) {
+#if defined(__GNUC__)
+    size_t count = __atomic_load_n(&trace_ring_count, __ATOMIC_RELAXED);
+    do {
+        if (count >= TROVE_TRACE_MAX_RINGS) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&trace_ring_count, &count, count + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    *index = count;
+#else
+    if (trace_ring_count >= TROVE_TRACE_MAX_RINGS) {
+        return 0;
+    }
+    *index = trace_ring_count++;
+#endif
+    return 1;
+}
+
+/**
+ * @brief Gives the calling thread a ring: one left by an exited thread, else a new one
+ *
+ * Once TROVE_TRACE_MAX_RINGS rings are owned by live threads, the calling
+ * thread records nothing, and a warning is printed the first time.
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @return The ring, or NULL if the thread's events are dropped
+ */
+static TraceRing* trace_ring_create(void) {
+    pthread_once(&trace_ring_key_once, trace_ring_key_create);
+    TraceRing *ring = trace_ring_reuse();
+    size_t index;
+    if (!ring && trace_ring_reserve(&index)) {
+        ring = (TraceRing *)calloc(1, sizeof(TraceRing));
+        if (!ring) {
+            fprintf(stderr, "Failed to allocate trace ring.\n");
+            exit(1);
+        }
+        ring->thread = (uint16_t)index;
+        ring->in_use = 1;
+#if defined(__GNUC__)
+        ring->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&trace_rings, &ring->next, ring, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+#else
+        ring->next = trace_rings;
+        trace_rings = ring;
+#endif
+    }
+    if (!ring) {
+        thread_ring_denied = 1;
+#if defined(__GNUC__)
+        int warned = __atomic_exchange_n(&trace_warned_full, 1, __ATOMIC_RELAXED);
+#else
+        int warned = trace_warned_full;
+        trace_warned_full = 1;
+#endif
+        if (!warned) {
+            fprintf(stderr, "trove: %d threads are being traced; events of further threads are dropped\n",
+                    TROVE_TRACE_MAX_RINGS);
+        }
+        return NULL;
+    }
+    pthread_setspecific(trace_ring_key, ring);
+    thread_ring = ring;
+    return ring;
+}
+
+/**
+ * @brief Records one event
+ */
+void arc_trace_record(ARCObject *obj, int op, void *caller) {
+    uintptr_t filter_object = TRACE_LOAD(trace_filter_object);
+    void (*filter_type)(ARCObject *) = TRACE_LOAD(trace_filter_type);
+    if ((filter_object && filter_object != (uintptr_t)obj) || (filter_type && filter_type != obj->dealloc)) {
+        return;
+    }
+    TraceRing *ring = thread_ring;
+    if (!ring) {
+        if (thread_ring_denied || !(ring = trace_ring_create())) {
+            return;
+        }
+    }
+    uint64_t head = ring->head;
+    ArcTraceEvent *event = &ring->events[head & TRACE_MASK];
+    TRACE_STORE(event->time, (uint64_t)TRACE_TICKS());
+    TRACE_STORE(event->obj, (uint64_t)(uintptr_t)obj);
+    TRACE_STORE(event->type, (uint64_t)(uintptr_t)obj->dealloc);
+    TRACE_STORE(event->caller, (uint64_t)(uintptr_t)caller);
+    TRACE_STORE(event->ref_count, (int32_t)obj->ref_count);
+    TRACE_STORE(event->op, (uint16_t)op);
+    TRACE_STORE(event->thread, ring->thread);
+    TRACE_STORE_RELEASE(ring->head, head + 1);
+}
+
+/**
+ * @brief Orders events by time, then by thread
+ */
+static int trace_compare_time(const void *a, const void *b) {
+    const ArcTraceEvent *x = (const ArcTraceEvent *)a;
+    const ArcTraceEvent *y = (const ArcTraceEvent *)b;
+    if (x->time != y->time) {
+        return x->time < y->time ? -1 : 1;
+    }
+    return (int)x->thread - (int)y->thread;
+}
+
+/**
+ * @brief Copies the events of all threads, in time order
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+ArcTraceEvent* arc_trace_collect(size_t *count) {
+    TraceRing *rings = TRACE_LOAD_ACQUIRE(trace_rings);
+    size_t capacity = 0;
+    for (TraceRing *ring = rings; ring; ring = ring->next) {
+        capacity += TROVE_TRACE_EVENTS;
+    }
+    *count = 0;
+    if (!capacity) {
+        return NULL;
+    }
+    ArcTraceEvent *events = (ArcTraceEvent *)malloc(capacity * sizeof(ArcTraceEvent));
+    if (!events) {
+        fprintf(stderr, "Failed to allocate trace events.\n");
+        exit(1);
+    }
+    size_t n = 0;
+    for (TraceRing *ring = rings; ring; ring = ring->next) {
+        uint64_t head = TRACE_LOAD_ACQUIRE(ring->head);
+        uint64_t start = head > TROVE_TRACE_EVENTS ? head - TROVE_TRACE_EVENTS : 0;
+        size_t copied = n;
+        for (uint64_t i = start; i < head; i++) {
+            ArcTraceEvent *event = &ring->events[i & TRACE_MASK];
+            ArcTraceEvent *copy = &events[n++];
+            copy->time = TRACE_LOAD_ACQUIRE(event->time);
+            copy->obj = TRACE_LOAD_ACQUIRE(event->obj);
+            copy->type = TRACE_LOAD_ACQUIRE(event->type);
+            copy->caller = TRACE_LOAD_ACQUIRE(event->caller);
+            copy->ref_count = TRACE_LOAD_ACQUIRE(event->ref_count);
+            copy->op = TRACE_LOAD_ACQUIRE(event->op);
+            copy->thread = TRACE_LOAD_ACQUIRE(event->thread);
+        }
+        // The event being written at the current head reuses the slot of
+        // event head - TROVE_TRACE_EVENTS, so only later ones are intact;
+        // the acquire loads above keep this load after the copy
+        uint64_t now = TRACE_LOAD(ring->head);
+        uint64_t intact = now >= TROVE_TRACE_EVENTS ? now - TROVE_TRACE_EVENTS + 1 : 0;
+        if (intact > start) {
+            size_t lost = (size_t)(intact - start) < n - copied ? (size_t)(intact - start) : n - copied;
+            memmove(&events[copied], &events[copied + lost], (n - copied - lost) * sizeof(ArcTraceEvent));
+            n -= lost;
+        }
+    }
+    qsort(events, n, sizeof(ArcTraceEvent), trace_compare_time);
+    if (!TRACE_TICKS_ARE_NS) {
+        uint64_t ticks = TRACE_TICKS();
+        uint64_t ns = trace_monotonic_ns();
+        double scale = ticks > trace_base_ticks ? (double)(ns - trace_base_ns) / (double)(ticks - trace_base_ticks) : 1.0;
+        for (size_t i = 0; i < n; i++) {
+            events[i].time = trace_base_ns + (uint64_t)((double)(int64_t)(events[i].time - trace_base_ticks) * scale);
+        }
+    }
+    *count = n;
+    return events;
+}
+
+/**
+ * @brief Writes the history of one object as text
+ */
+void arc_trace_print_history(FILE *out, ARCObject *obj) {
+    size_t count;
+    ArcTraceEvent *events = arc_trace_collect(&count);
+    const char *name = obj ? arc_stats_type_name(obj->dealloc) : NULL;
+    fprintf(out, "%p %s\n", (void *)obj, name ? name : "");
+    uint64_t first = 0;
+    for (size_t i = 0; i < count; i++) {
+        ArcTraceEvent *event = &events[i];
+        if (event->obj != (uint64_t)(uintptr_t)obj) {
+            continue;
+        }
+        if (!first) {
+            first = event->time;
+        }
+        fprintf(out, "  %12.3f us  thread %-3u %-12s rc %-6" PRId32 " from 0x%" PRIx64 "\n",
+                (double)(event->time - first) / 1e3, (unsigned)event->thread,
+                TRACE_OP_NAMES[event->op <= ARC_TRACE_DEALLOC ? event->op : 0], event->ref_count, event->caller);
+    }
+    free(events);
+}
+
+/**
+ * @brief Adds the type of an event to a trace file's type table, if new
+ */
+static void trace_add_type(ArcTraceType *types, uint32_t *count, uint32_t capacity, uint64_t type) {
+    for (uint32_t i = 0; i < *count; i++) {
+        if (types[i].type == type) {
+            return;
+        }
+    }
+    if (*count == capacity) {
+        return;
+    }
+    ArcTraceType *entry = &types[(*count)++];
+    memset(entry, 0, sizeof(*entry));
+    entry->type = type;
+    const char *name = arc_stats_type_name((void (*)(ARCObject *))(uintptr_t)type);
+    if (name) {
+        strncpy(entry->name, name, TROVE_TRACE_NAME_SIZE - 1);
+    }
+}
+
+/**
+ * @brief Writes the events of all threads to a trace file
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+int arc_trace_save(const char *path) {
+    size_t count;
+    ArcTraceEvent *events = arc_trace_collect(&count);
+    ArcTraceType types[TROVE_STATS_MAX_TYPES];
+    uint32_t type_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        trace_add_type(types, &type_count, TROVE_STATS_MAX_TYPES, events[i].type);
+    }
+
+    ArcTraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TROVE_TRACE_MAGIC, sizeof(TROVE_TRACE_MAGIC));
+    header.type_count = type_count;
+    header.thread_count = (uint32_t)TRACE_LOAD(trace_ring_count);
+    header.event_count = count;
+
+    int error = 0;
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        error = errno;
+    } else {
+        errno = 0;
+        if (fwrite(&header, sizeof(header), 1, file) != 1
+            || fwrite(types, sizeof(ArcTraceType), type_count, file) != type_count
+            || fwrite(events, sizeof(ArcTraceEvent), count, file) != count) {
+            error = errno ? errno : EIO;
+        }
+        if (fclose(file) != 0 && !error) {
+            error = errno;
+        }
+    }
+    free(events);
+    return error;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file trace.h
+ * @brief Retain/release tracing for the Trove ARC memory management system
+ *
+ * When enabled, every allocation, retain, release, autorelease and free is
+ * recorded as an event holding the object, its type, the operation, the
+ * reference count after it, the caller's return address and a timestamp.
+ * Each thread appends to its own ring of TROVE_TRACE_EVENTS events with
+ * plain (relaxed) stores, so recording takes no locks; when a ring is full
+ * the oldest events are overwritten. A ring outlives its thread and is
+ * handed to the next new thread, which overwrites it oldest first, so a
+ * process that keeps starting threads holds no more rings than it ever ran
+ * threads at once. Beyond TROVE_TRACE_MAX_RINGS threads at once, the events
+ * of further threads are dropped.
+ *
+ * A filter restricts recording to one object or one type, which keeps the
+ * history of a suspect object from being overwritten under load.
+ *
+ * arc_trace_save writes the merged events to a file that tools/tracedump
+ * turns into per-object histories, flagging use after free, counts going
+ * negative and objects still alive. Setting the environment variable
+ * TROVE_TRACE to a path enables tracing at startup (with GCC and Clang) and
+ * saves the trace there at exit.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "trove.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/** @brief Events kept per thread (a power of two) */
+#define TROVE_TRACE_EVENTS 65536
+
+/** @brief Rings kept at most, each of TROVE_TRACE_EVENTS events */
+#define TROVE_TRACE_MAX_RINGS 256
+
+/** @brief Magic bytes at the start of a trace file */
+#define TROVE_TRACE_MAGIC "TRVTRC1"
+
+/** @brief Bytes of a type name in a trace file, including the terminator */
+#define TROVE_TRACE_NAME_SIZE 32
+
+/**
+ * @brief Traced operations
+ */
+typedef enum ArcTraceOp {
+    ARC_TRACE_ALLOC = 1,      /**< arc_object_init */
+    ARC_TRACE_RETAIN,         /**< arc_retain, arc_retain_all */
+    ARC_TRACE_RELEASE,        /**< arc_release, arc_release_all */
+    ARC_TRACE_AUTORELEASE,    /**< arc_autorelease */
+    ARC_TRACE_DEALLOC         /**< arc_object_free */
+} ArcTraceOp;
+
+/**
+ * @brief One traced operation
+ *
+ * The layout is also the record format of trace files.
+ */
+typedef struct ArcTraceEvent {
+    uint64_t time;          /**< CLOCK_MONOTONIC nanoseconds */
+    uint64_t obj;           /**< Object address */
+    uint64_t type;          /**< Address of the object's dealloc function */
+    uint64_t caller;        /**< Return address of the traced call, 0 if unknown */
+    int32_t ref_count;      /**< Reference count after the operation */
+    uint16_t op;            /**< ArcTraceOp */
+    uint16_t thread;        /**< Index of the recording thread's ring; threads that ran one after the other may share it */
+} ArcTraceEvent;
+
+/**
+ * @brief Header of a trace file
+ *
+ * Followed by type_count ArcTraceType records and event_count events in
+ * time order, all in the byte order of the traced machine.
+ */
+typedef struct ArcTraceFileHeader {
+    char magic[8];             /**< TROVE_TRACE_MAGIC */
+    uint32_t type_count;       /**< Type records */
+    uint32_t thread_count;     /**< Rings that recorded events */
+    uint64_t event_count;      /**< Events */
+} ArcTraceFileHeader;
+
+/**
+ * @brief Name of a type in a trace file
+ */
+typedef struct ArcTraceType {
+    uint64_t type;                        /**< Address of the dealloc function */
+    char name[TROVE_TRACE_NAME_SIZE];     /**< Type name, empty if unknown */
+} ArcTraceType;
+
+/** @brief Nonzero while events are recorded; set with arc_trace_enable */
+extern int arc_trace_enabled;
+
+/**
+ * @brief Starts or stops recording events
+ *
+ * @param enabled Nonzero to record
+ */
+void arc_trace_enable(int enabled);
+
+/**
+ * @brief Restricts recording to one object and/or one type
+ *
+ * Pass NULL for both to record everything again. An object keeps matching
+ * its filter after it is freed, so the next object at its address is
+ * traced as well.
+ *
+ * @param obj Object to record, or NULL for any
+ * @param dealloc Type to record, or NULL for any
+ */
+void arc_trace_filter(ARCObject *obj, void (*dealloc)(ARCObject *));
+
+/**
+ * @brief Copies the events of all threads, in time order
+ *
+ * Events being overwritten while they are copied are left out.
+ *
+ * @param count Receives the number of events
+ * @return A malloc'd array for the caller to free, or NULL if there are none
+ */
+ArcTraceEvent* arc_trace_collect(size_t *count);
+
+/**
+ * @brief Writes the history of one object as text
+ *
+ * For use from a debugger: `call arc_trace_print_history(stderr, obj)`.
+ *
+ * @param out Stream to write to
+ * @param obj The object
+ */
+void arc_trace_print_history(FILE *out, ARCObject *obj);
+
+/**
+ * @brief Writes the events of all threads to a trace file
+ *
+ * @param path File to create or replace
+ * @return 0 on success, otherwise errno
+ */
+int arc_trace_save(const char *path);
+
+/**
+ * @brief Records one event; called by the ARC operations
+ *
+ * @param obj The object
+ * @param op The ArcTraceOp
+ * @param caller Return address of the traced call
+ */
+void arc_trace_record(ARCObject *obj, int op, void *caller);
+
+/**
+ * @brief Return address of the enclosing function, for arc_trace_record
+ */
+#if defined(__GNUC__)
+#define TROVE_RETURN_ADDRESS() __builtin_extract_return_addr(__builtin_return_address(0))
+#else
+#define TROVE_RETURN_ADDRESS() NULL
+#endif
+
+#endif // TRACE_H
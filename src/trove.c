@@ -8,12 +8,19 @@
  */
 
 #include "trove.h"
+#include "stats.h"
+#include "leaks.h"
+#include "profile.h"
+#include "guard.h"
+#include "trace.h"
+#include "probes.h"
+#include "poolstats.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
-/** Global pointer to the current active autorelease pool */
-AutoreleasePool *current_autorelease_pool = NULL;
+/** The calling thread's current autorelease pool */
+TROVE_THREAD_LOCAL AutoreleasePool *current_autorelease_pool = NULL;
 
 /**
  * @brief Autorelease Pool Management
@@ -32,7 +39,9 @@ void autorelease_pool_push() {
         exit(1);
     }
     pool->count = 0;
-    pool->capacity = 16;  // Initial capacity
+    pool->capacity = TROVE_POOL_INITIAL_CAPACITY;
+    pool->arena = NULL;
+    pool->parent = current_autorelease_pool;
     pool->objects = (ARCObject **)malloc(pool->capacity * sizeof(ARCObject *));
     if (!pool->objects) {
         fprintf(stderr, "Failed to allocate autorelease pool objects.\n");
@@ -40,25 +49,46 @@ void autorelease_pool_push() {
         exit(1);
     }
     current_autorelease_pool = pool;
+    TROVE_PROBE2(pool_push, pool, pool->parent);
 }
 
 /**
  * @brief Pops the current autorelease pool, releasing all objects in it
  * 
- * This function releases all objects in the current autorelease pool,
- * frees the pool itself, and sets the current pool to NULL.
+ * This function releases all objects in the current pool in batches, frees
+ * the pool and makes the enclosing pool current again. The pool stays
+ * current while it drains: each batch takes the pool's objects array and
+ * leaves it empty, so objects autoreleased by dealloc functions meanwhile
+ * are released by the next batch, also when this is the outermost pool.
  * If there is no current pool, this function does nothing.
  */
 void autorelease_pool_pop() {
     if (!current_autorelease_pool)
         return;
     AutoreleasePool *pool = current_autorelease_pool;
-    for (size_t i = 0; i < pool->count; i++) {
-        arc_release(pool->objects[i]);
+    size_t count = pool->count;
+    size_t capacity = pool->capacity;
+    TROVE_PROBE3(pool_pop_start, pool, count, capacity);
+    uint64_t start = arc_pool_stats_enabled ? arc_pool_stats_clock() : 0;
+    size_t drained = 0;
+    while (pool->count > 0) {
+        ARCObject **objects = pool->objects;
+        size_t batch = pool->count;
+        pool->objects = NULL;
+        pool->count = 0;
+        pool->capacity = 0;
+        arc_release_all(objects, batch);
+        free(objects);
+        drained += batch;
     }
+    current_autorelease_pool = pool->parent;
+    TroveArena_release(pool->arena);
+    if (arc_pool_stats_enabled && start) {
+        arc_pool_stats_record_pop(count, capacity, arc_pool_stats_clock() - start);
+    }
+    TROVE_PROBE2(pool_pop_done, pool, drained);
     free(pool->objects);
     free(pool);
-    current_autorelease_pool = NULL;
 }
 
 /**
@@ -72,12 +102,19 @@ void autorelease_pool_pop() {
  */
 void autorelease_add(ARCObject *obj) {
     if (!current_autorelease_pool) {
+        TROVE_PROBE1(no_pool, obj);
         fprintf(stderr, "No autorelease pool in place!\n");
+        if (arc_leaks_enabled) {
+            arc_leaks_orphaned(obj);
+        }
         return;
     }
     AutoreleasePool *pool = current_autorelease_pool;
     if (pool->count >= pool->capacity) {
-        pool->capacity *= 2;
+        // A pool being drained starts over from an empty array
+        size_t capacity = pool->capacity ? pool->capacity * 2 : TROVE_POOL_INITIAL_CAPACITY;
+        TROVE_PROBE3(pool_grow, pool, pool->capacity, capacity);
+        pool->capacity = capacity;
         ARCObject **new_objects = (ARCObject **)realloc(pool->objects, pool->capacity * sizeof(ARCObject *));
         if (!new_objects) {
             fprintf(stderr, "Failed to reallocate autorelease pool objects.\n");
@@ -88,22 +125,192 @@ void autorelease_add(ARCObject *obj) {
     pool->objects[pool->count++] = obj;
 }
 
+/**
+ * @brief Returns an arena chunk of the current pool with at least size free bytes
+ * 
+ * Chunks are created lazily. A chunk that is reserved by a writer or lacks
+ * room is replaced by a new one of TROVE_ARENA_CHUNK_SIZE bytes, or larger
+ * when size demands it.
+ * 
+ * @param size Number of free bytes required
+ * @return The pool's arena chunk (not retained), or NULL if no pool is in place
+ */
+TroveArena* autorelease_pool_arena(size_t size) {
+    AutoreleasePool *pool = current_autorelease_pool;
+    if (!pool) {
+        return NULL;
+    }
+    TroveArena *arena = pool->arena;
+    if (!arena || arena->reserved || arena->capacity - arena->used < size) {
+        TroveArena_release(arena);
+        arena = TroveArena_create(size > TROVE_ARENA_CHUNK_SIZE ? size : TROVE_ARENA_CHUNK_SIZE);
+        pool->arena = arena;
+    }
+    return arena;
+}
+
+/**
+ * @brief TroveArena Implementation
+ */
+
+/**
+ * @brief Creates a new arena chunk
+ * 
+ * The header and storage are a single allocation.
+ * If allocation fails, the program will exit with an error message.
+ * 
+ * @param capacity Number of bytes of storage
+ * @return A new TroveArena with a reference count of 1
+ */
+TroveArena* TroveArena_create(size_t capacity) {
+    TroveArena *arena = (TroveArena *)malloc(sizeof(TroveArena) + capacity);
+    if (!arena) {
+        fprintf(stderr, "Failed to allocate TroveArena.\n");
+        exit(1);
+    }
+    arc_object_init(&arena->base, TroveArena_dealloc, sizeof(TroveArena) + capacity);
+    arena->used = 0;
+    arena->capacity = capacity;
+    arena->reserved = 0;
+    return arena;
+}
+
+/**
+ * @brief Atomically increments the reference count of an arena chunk
+ * 
+ * Strings sharing a chunk may be released on different threads at once,
+ * so unlike arc_retain this is an atomic operation.
+ * 
+ * @param arena The chunk (may be NULL)
+ */
+void TroveArena_retain(TroveArena *arena) {
+    if (!arena) {
+        return;
+    }
+#if defined(__GNUC__)
+    __atomic_add_fetch(&arena->base.ref_count, 1, __ATOMIC_RELAXED);
+#else
+    arena->base.ref_count++;
+#endif
+    if (arc_stats_enabled) {
+        arc_stats_record_retain(arena->base.dealloc, 1);
+    }
+    if (arc_trace_enabled) {
+        arc_trace_record(&arena->base, ARC_TRACE_RETAIN, TROVE_RETURN_ADDRESS());
+    }
+}
+
+/**
+ * @brief Atomically decrements the reference count of an arena chunk, freeing it at zero
+ * 
+ * The decrement that reaches zero acquires the writes of every earlier
+ * release, so the chunk is freed after all its strings are done with it.
+ * 
+ * @param arena The chunk (may be NULL)
+ */
+void TroveArena_release(TroveArena *arena) {
+    if (!arena) {
+        return;
+    }
+    if (arc_stats_enabled) {
+        arc_stats_record_release(arena->base.dealloc, 1);
+    }
+    if (arc_trace_enabled) {
+        arc_trace_record(&arena->base, ARC_TRACE_RELEASE, TROVE_RETURN_ADDRESS());
+    }
+#if defined(__GNUC__)
+    int count = __atomic_sub_fetch(&arena->base.ref_count, 1, __ATOMIC_ACQ_REL);
+#else
+    int count = --arena->base.ref_count;
+#endif
+    if (count == 0) {
+        TroveArena_dealloc(&arena->base);
+    }
+}
+
+/**
+ * @brief Retains the object that owns a string's bytes
+ * 
+ * Arena chunks are shared by strings that may live on different threads
+ * and are counted atomically; any other owner is retained as usual.
+ */
+static void string_storage_retain(ARCObject *storage) {
+    if (storage && storage->dealloc == TroveArena_dealloc) {
+        TroveArena_retain((TroveArena *)storage);
+    } else {
+        arc_retain(storage);
+    }
+}
+
+/**
+ * @brief Releases the object that owns a string's bytes, as string_storage_retain retained it
+ */
+static void string_storage_release(ARCObject *storage) {
+    if (storage && storage->dealloc == TroveArena_dealloc) {
+        TroveArena_release((TroveArena *)storage);
+    } else {
+        arc_release(storage);
+    }
+}
+
+/**
+ * @brief Deallocates a TroveArena
+ * 
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveArena_dealloc(ARCObject *obj) {
+    arc_object_free(obj);
+}
+
 /**
  * @brief ARC Operations
  */
 
+/**
+ * @brief Increments the reference count of an object on behalf of a caller
+ * 
+ * @param obj The object whose reference count should be incremented
+ * @param caller Return address traced as the retain's origin
+ */
+static inline void arc_retain_from(ARCObject *obj, void *caller) {
+    if (obj && obj->ref_count != TROVE_REF_IMMORTAL) {
+        if (arc_guard_enabled && obj->ref_count == TROVE_GUARD_DEAD) {
+            arc_guard_dead(obj, "retain", caller);
+        }
+        obj->ref_count++;
+        if (arc_stats_enabled) {
+            arc_stats_record_retain(obj->dealloc, 1);
+        }
+        if (arc_trace_enabled) {
+            arc_trace_record(obj, ARC_TRACE_RETAIN, caller);
+        }
+    }
+}
+
 /**
  * @brief Increments the reference count of an object
  * 
  * This function increments the reference count of the given object,
  * indicating that a new reference to the object has been created.
- * If the object is NULL, this function does nothing.
+ * If the object is NULL or immortal, this function does nothing.
  * 
  * @param obj The object whose reference count should be incremented
  */
 void arc_retain(ARCObject *obj) {
-    if (obj) {
-        obj->ref_count++;
+    arc_retain_from(obj, TROVE_RETURN_ADDRESS());
+}
+
+/**
+ * @brief Increments the reference count of an object, noting where
+ * 
+ * @param obj The object whose reference count should be incremented
+ * @param file Source file of the call
+ * @param line Source line of the call
+ */
+void arc_retain_at(ARCObject *obj, const char *file, int line) {
+    arc_retain_from(obj, TROVE_RETURN_ADDRESS());
+    if (arc_leaks_enabled && obj && obj->ref_count != TROVE_REF_IMMORTAL) {
+        arc_leaks_retained(obj, file, line);
     }
 }
 
@@ -112,14 +319,26 @@ void arc_retain(ARCObject *obj) {
  * 
  * This function decrements the reference count of the given object.
  * If the reference count reaches zero, the object's dealloc function is called.
- * If the object is NULL, this function does nothing.
+ * If the object is NULL or immortal, this function does nothing.
  * 
  * @param obj The object whose reference count should be decremented
  */
 void arc_release(ARCObject *obj) {
-    if (obj) {
+    if (obj && obj->ref_count != TROVE_REF_IMMORTAL) {
+        if (arc_guard_enabled && obj->ref_count == TROVE_GUARD_DEAD) {
+            arc_guard_dead(obj, "release", TROVE_RETURN_ADDRESS());
+        }
+        if (arc_stats_enabled) {
+            arc_stats_record_release(obj->dealloc, 1);
+        }
         obj->ref_count--;
+        if (arc_trace_enabled) {
+            arc_trace_record(obj, ARC_TRACE_RELEASE, TROVE_RETURN_ADDRESS());
+        }
         if (obj->ref_count <= 0) {
+            if (obj->ref_count < 0) {
+                TROVE_PROBE2(over_release, obj, obj->ref_count);
+            }
             if (obj->dealloc) {
                 obj->dealloc(obj);
             }
@@ -127,6 +346,59 @@ void arc_release(ARCObject *obj) {
     }
 }
 
+/**
+ * @brief Initializes the header of a newly allocated object
+ * 
+ * Sets a reference count of 1 and records the object's type and size.
+ * 
+ * @param obj The object's header
+ * @param dealloc The type's dealloc function
+ * @param size Bytes allocated for the object, including any inline storage
+ */
+void arc_object_init(ARCObject *obj, void (*dealloc)(ARCObject *), size_t size) {
+    obj->ref_count = 1;
+    obj->size = size > UINT32_MAX ? UINT32_MAX : (uint32_t)size;
+    obj->dealloc = dealloc;
+    if (arc_stats_enabled) {
+        arc_stats_record_alloc(obj);
+    }
+    if (arc_leaks_enabled) {
+        arc_leaks_track(obj);
+    }
+    if (arc_trace_enabled) {
+        arc_trace_record(obj, ARC_TRACE_ALLOC, TROVE_RETURN_ADDRESS());
+    }
+    if (arc_profile_enabled) {
+        arc_profile_record_alloc(obj, TROVE_RETURN_ADDRESS());
+    }
+}
+
+/**
+ * @brief Frees the memory of an object initialized with arc_object_init
+ * 
+ * @param obj The object to free
+ */
+void arc_object_free(ARCObject *obj) {
+    if (arc_stats_enabled) {
+        arc_stats_record_free(obj);
+    }
+    if (arc_leaks_enabled) {
+        arc_leaks_untrack(obj);
+    }
+    if (arc_profile_watching) {
+        arc_profile_record_free(obj);
+    }
+    if (arc_trace_enabled) {
+        arc_trace_record(obj, ARC_TRACE_DEALLOC, TROVE_RETURN_ADDRESS());
+    }
+    TROVE_PROBE3(dealloc, obj, obj->dealloc, obj->size);
+    if (arc_guard_enabled) {
+        arc_guard_quarantine(obj);
+        return;
+    }
+    free(obj);
+}
+
 /**
  * @brief Adds an object to the current autorelease pool and returns it
  * 
@@ -137,10 +409,127 @@ void arc_release(ARCObject *obj) {
  * @return The same object (for convenience in chaining)
  */
 ARCObject* arc_autorelease(ARCObject *obj) {
+    if (arc_guard_enabled && obj && obj->ref_count == TROVE_GUARD_DEAD) {
+        arc_guard_dead(obj, "autorelease", TROVE_RETURN_ADDRESS());
+    }
+    if (arc_trace_enabled && obj && obj->ref_count != TROVE_REF_IMMORTAL) {
+        arc_trace_record(obj, ARC_TRACE_AUTORELEASE, TROVE_RETURN_ADDRESS());
+    }
     autorelease_add(obj);
     return obj;
 }
 
+/** @brief Number of objects prefetched ahead of the release loop */
+#define ARC_RELEASE_BATCH 16
+
+/**
+ * @brief Increments the reference counts of an array of objects
+ * 
+ * This function retains every non-NULL entry that is not immortal, adding
+ * the length of each run of identical consecutive entries in a single update.
+ * 
+ * @param objects The objects to retain
+ * @param count Number of entries in objects
+ */
+void arc_retain_all(ARCObject *const *objects, size_t count) {
+    void (*type)(ARCObject *) = NULL;
+    size_t type_count = 0;
+    size_t i = 0;
+    while (i < count) {
+        ARCObject *obj = objects[i];
+        size_t run = 1;
+        while (i + run < count && objects[i + run] == obj) {
+            run++;
+        }
+        if (obj && obj->ref_count != TROVE_REF_IMMORTAL) {
+            if (arc_guard_enabled && obj->ref_count == TROVE_GUARD_DEAD) {
+                arc_guard_dead(obj, "retain", TROVE_RETURN_ADDRESS());
+            }
+            obj->ref_count += (int)run;
+            if (arc_trace_enabled) {
+                arc_trace_record(obj, ARC_TRACE_RETAIN, TROVE_RETURN_ADDRESS());
+            }
+            if (arc_stats_enabled) {
+                if (obj->dealloc != type && type_count) {
+                    arc_stats_record_retain(type, type_count);
+                    type_count = 0;
+                }
+                type = obj->dealloc;
+                type_count += run;
+            }
+        }
+        i += run;
+    }
+    if (type_count) {
+        arc_stats_record_retain(type, type_count);
+    }
+}
+
+/**
+ * @brief Decrements the reference counts of an array of objects
+ * 
+ * This function works in batches: while one batch is released, the headers
+ * of the next batch are prefetched. Runs of identical consecutive entries
+ * are released with a single update, deallocating the object if its count
+ * reaches zero. Immortal objects are skipped.
+ * 
+ * @param objects The objects to release
+ * @param count Number of entries in objects
+ */
+void arc_release_all(ARCObject *const *objects, size_t count) {
+    void (*type)(ARCObject *) = NULL;
+    size_t type_count = 0;
+    TROVE_PROBE2(release_all, objects, count);
+    for (size_t i = 0; i < count && i < ARC_RELEASE_BATCH; i++) {
+        TROVE_PREFETCH(objects[i]);
+    }
+    size_t i = 0;
+    while (i < count) {
+        size_t batch_end = i + ARC_RELEASE_BATCH < count ? i + ARC_RELEASE_BATCH : count;
+        size_t next_end = batch_end + ARC_RELEASE_BATCH < count ? batch_end + ARC_RELEASE_BATCH : count;
+        for (size_t j = batch_end; j < next_end; j++) {
+            TROVE_PREFETCH(objects[j]);
+        }
+        while (i < batch_end) {
+            ARCObject *obj = objects[i];
+            size_t run = 1;
+            while (i + run < count && objects[i + run] == obj) {
+                run++;
+            }
+            i += run;
+            if (!obj || obj->ref_count == TROVE_REF_IMMORTAL) {
+                continue;
+            }
+            if (arc_guard_enabled && obj->ref_count == TROVE_GUARD_DEAD) {
+                arc_guard_dead(obj, "release", TROVE_RETURN_ADDRESS());
+            }
+            if (arc_stats_enabled) {
+                if (obj->dealloc != type && type_count) {
+                    arc_stats_record_release(type, type_count);
+                    type_count = 0;
+                }
+                type = obj->dealloc;
+                type_count += run;
+            }
+            obj->ref_count -= (int)run;
+            if (arc_trace_enabled) {
+                arc_trace_record(obj, ARC_TRACE_RELEASE, TROVE_RETURN_ADDRESS());
+            }
+            if (obj->ref_count <= 0) {
+                if (obj->ref_count < 0) {
+                    TROVE_PROBE2(over_release, obj, obj->ref_count);
+                }
+                if (obj->dealloc) {
+                    obj->dealloc(obj);
+                }
+            }
+        }
+    }
+    if (type_count) {
+        arc_stats_record_release(type, type_count);
+    }
+}
+
 /**
  * @brief TroveString Implementation
  */
@@ -156,23 +545,74 @@ ARCObject* arc_autorelease(ARCObject *obj) {
  * @return A new TroveString with a reference count of 1
  */
 TroveString* TroveString_create(const char *init) {
+    if (!init) {
+        init = "";
+    }
+    return TroveString_create_with_length(init, strlen(init));
+}
+
+/**
+ * @brief Creates a new ARC-managed string from a byte range
+ * 
+ * This function allocates a new TroveString object with a reference count of 1
+ * holding a null-terminated copy of the given bytes. When bytes is NULL the
+ * content is left uninitialized for the caller to fill.
+ * If allocation fails, the program will exit with an error message.
+ * 
+ * @param bytes The bytes to copy, or NULL
+ * @param length The number of bytes to copy
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_create_with_length(const char *bytes, size_t length) {
     TroveString *str_obj = (TroveString *)malloc(sizeof(TroveString));
     if (!str_obj) {
         fprintf(stderr, "Failed to allocate TroveString.\n");
         exit(1);
     }
-    str_obj->base.ref_count = 1;
-    str_obj->base.dealloc = TroveString_dealloc;
-    if (init) {
-        str_obj->str = strdup(init);
-    } else {
-        str_obj->str = strdup("");
-    }
+    arc_object_init(&str_obj->base, TroveString_dealloc, sizeof(TroveString));
+    str_obj->str = (char *)malloc(length + 1);
     if (!str_obj->str) {
         fprintf(stderr, "Failed to allocate string content.\n");
-        free(str_obj);
+        arc_object_free(&str_obj->base);
+        exit(1);
+    }
+    if (bytes && length > 0) {
+        memcpy(str_obj->str, bytes, length);
+    }
+    str_obj->str[length] = '\0';
+    str_obj->length = length;
+    str_obj->capacity = length;
+    str_obj->storage = NULL;
+    str_obj->hash = 0;
+    return str_obj;
+}
+
+/**
+ * @brief Creates a new ARC-managed string that adopts existing bytes
+ * 
+ * This function allocates only the TroveString structure. The bytes are
+ * either a heap buffer whose ownership is transferred (storage is NULL) or
+ * are kept alive by retaining storage.
+ * If allocation fails, the program will exit with an error message.
+ * 
+ * @param str Null-terminated bytes to adopt
+ * @param length Number of bytes in str, excluding the terminator
+ * @param storage Object owning str, or NULL to take ownership of a heap buffer
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_create_with_storage(char *str, size_t length, ARCObject *storage) {
+    TroveString *str_obj = (TroveString *)malloc(sizeof(TroveString));
+    if (!str_obj) {
+        fprintf(stderr, "Failed to allocate TroveString.\n");
         exit(1);
     }
+    arc_object_init(&str_obj->base, TroveString_dealloc, sizeof(TroveString));
+    string_storage_retain(storage);
+    str_obj->str = str;
+    str_obj->length = length;
+    str_obj->capacity = length;
+    str_obj->storage = storage;
+    str_obj->hash = 0;
     return str_obj;
 }
 
@@ -180,15 +620,219 @@ TroveString* TroveString_create(const char *init) {
  * @brief Deallocates a TroveString
  * 
  * This function frees the memory used by a TroveString object.
- * It first frees the string content, then the TroveString structure itself.
+ * It first frees the string content (or releases the object that owns it),
+ * then the TroveString structure itself.
  * This function is called automatically when the reference count reaches zero.
  * 
  * @param obj The object to deallocate (cast to ARCObject)
  */
 void TroveString_dealloc(ARCObject *obj) {
     TroveString *str_obj = (TroveString *)obj;
-    if (str_obj->str) {
+    if (str_obj->storage) {
+        string_storage_release(str_obj->storage);
+    } else if (str_obj->str) {
         free(str_obj->str);
     }
-    free(str_obj);
+    arc_object_free(&str_obj->base);
+}
+
+/**
+ * @brief Hashing
+ */
+
+/**
+ * @brief Hashes a byte range
+ * 
+ * This function implements MurmurHash64A (Austin Appleby, public domain),
+ * which consumes eight bytes per step. A result of 0 is remapped to 1 so
+ * that 0 can mark an uncomputed cache.
+ * 
+ * @param bytes The bytes to hash
+ * @param length Number of bytes
+ * @return The hash value (never 0)
+ */
+uint64_t trove_hash_bytes(const char *bytes, size_t length) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const unsigned char *data = (const unsigned char *)bytes;
+    uint64_t h = 0x5bd1e9955bd1e995ULL ^ ((uint64_t)length * m);
+    size_t blocks = length / 8;
+
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t k;
+        memcpy(&k, data + i * 8, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char *tail = data + blocks * 8;
+    switch (length & 7) {
+    case 7: h ^= (uint64_t)tail[6] << 48; /* fall through */
+    case 6: h ^= (uint64_t)tail[5] << 40; /* fall through */
+    case 5: h ^= (uint64_t)tail[4] << 32; /* fall through */
+    case 4: h ^= (uint64_t)tail[3] << 24; /* fall through */
+    case 3: h ^= (uint64_t)tail[2] << 16; /* fall through */
+    case 2: h ^= (uint64_t)tail[1] << 8;  /* fall through */
+    case 1: h ^= (uint64_t)tail[0];
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h ? h : 1;
+}
+
+/**
+ * @brief Returns the hash of a string, computing and caching it on first use
+ * 
+ * @param str The string to hash
+ * @return The hash value
+ */
+uint64_t TroveString_hash(TroveString *str) {
+    if (str->hash == 0) {
+        str->hash = trove_hash_bytes(str->str, str->length);
+    }
+    return str->hash;
+}
+
+/**
+ * @brief Copy-on-write Mutation
+ */
+
+/**
+ * @brief Checks whether a string has exactly one reference
+ * 
+ * @param str The string to check
+ * @return 1 if ref_count is 1, 0 otherwise
+ */
+int TroveString_is_unique(TroveString *str) {
+    return str->base.ref_count == 1;
+}
+
+/**
+ * @brief Makes *str uniquely referenced with room for capacity bytes
+ * 
+ * A unique string is grown in place with realloc; one whose bytes are
+ * borrowed from another object is first moved to its own heap buffer.
+ * A shared string is copied
+ * into a new buffer, the caller's reference to the original is released and
+ * *str is pointed at the copy. Growth is at least doubling so repeated
+ * appends run in amortized constant time.
+ * If allocation fails, the program will exit with an error message.
+ * 
+ * @param str Address of an owned reference; may be replaced with a copy
+ * @param capacity Minimum number of bytes the buffer must hold
+ */
+void TroveString_reserve(TroveString **str, size_t capacity) {
+    TroveString *str_obj = *str;
+    int unique = TroveString_is_unique(str_obj);
+    if (unique && capacity <= str_obj->capacity) {
+        return;
+    }
+    if (capacity < str_obj->capacity) {
+        capacity = str_obj->capacity;
+    }
+    if (capacity > str_obj->capacity && capacity < str_obj->capacity * 2) {
+        capacity = str_obj->capacity * 2;
+    }
+    if (unique && str_obj->storage) {
+        char *heap = (char *)malloc(capacity + 1);
+        if (!heap) {
+            fprintf(stderr, "Failed to allocate string content.\n");
+            exit(1);
+        }
+        memcpy(heap, str_obj->str, str_obj->length + 1);
+        string_storage_release(str_obj->storage);
+        str_obj->storage = NULL;
+        str_obj->str = heap;
+        str_obj->capacity = capacity;
+        return;
+    }
+    if (unique) {
+        char *grown = (char *)realloc(str_obj->str, capacity + 1);
+        if (!grown) {
+            fprintf(stderr, "Failed to reallocate string content.\n");
+            exit(1);
+        }
+        str_obj->str = grown;
+        str_obj->capacity = capacity;
+        return;
+    }
+    TroveString *copy = TroveString_create_with_length(NULL, capacity);
+    memcpy(copy->str, str_obj->str, str_obj->length + 1);
+    copy->length = str_obj->length;
+    arc_release((ARCObject *)str_obj);
+    *str = copy;
+}
+
+/**
+ * @brief Appends bytes to a string, copying it first if it is shared
+ * 
+ * The bytes may come from the string itself: growing or copying the string
+ * moves its buffer, so they are then read at the same offset of the new one.
+ * 
+ * @param str Address of an owned reference; may be replaced with a copy
+ * @param bytes The bytes to append (need not be null-terminated)
+ * @param length The number of bytes to append
+ */
+void TroveString_append(TroveString **str, const char *bytes, size_t length) {
+    uintptr_t start = (uintptr_t)(*str)->str;
+    uintptr_t at = (uintptr_t)bytes;
+    int inside = length && at >= start && at <= start + (*str)->capacity;
+    size_t offset = (size_t)(at - start);
+    TroveString_reserve(str, (*str)->length + length);
+    TroveString *str_obj = *str;
+    if (inside) {
+        bytes = str_obj->str + offset;
+    }
+    memmove(str_obj->str + str_obj->length, bytes, length);
+    str_obj->length += length;
+    str_obj->hash = 0;
+    str_obj->str[str_obj->length] = '\0';
+}
+
+/**
+ * @brief Appends a null-terminated C string to a string
+ * 
+ * @param str Address of an owned reference; may be replaced with a copy
+ * @param text The text to append
+ */
+void TroveString_append_cstr(TroveString **str, const char *text) {
+    TroveString_append(str, text, strlen(text));
+}
+
+/**
+ * @brief Replaces the byte at an index, copying the string first if it is shared
+ * 
+ * @param str Address of an owned reference; may be replaced with a copy
+ * @param index Byte offset to modify
+ * @param c The new byte
+ */
+void TroveString_set_char(TroveString **str, size_t index, char c) {
+    if (index >= (*str)->length) {
+        return;
+    }
+    TroveString_reserve(str, (*str)->length);
+    (*str)->str[index] = c;
+    (*str)->hash = 0;
+}
+
+/**
+ * @brief Shortens a string, copying it first if it is shared
+ * 
+ * @param str Address of an owned reference; may be replaced with a copy
+ * @param length The new length
+ */
+void TroveString_truncate(TroveString **str, size_t length) {
+    if (length >= (*str)->length) {
+        return;
+    }
+    TroveString_reserve(str, (*str)->length);
+    (*str)->length = length;
+    (*str)->hash = 0;
+    (*str)->str[length] = '\0';
 }
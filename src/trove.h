@@ -13,6 +13,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
 
 /**
  * @brief Base object for all ARC-managed objects
@@ -23,9 +25,73 @@
  */
 typedef struct ARCObject {
     int ref_count;                        /**< Current reference count */
+    uint32_t size;                        /**< Bytes allocated for the object, as passed to arc_object_init */
     void (*dealloc)(struct ARCObject *obj); /**< Function called when refcount reaches zero */
 } ARCObject;
 
+/**
+ * @brief Reference count of immortal objects
+ * 
+ * Retaining or releasing an object whose count is TROVE_REF_IMMORTAL leaves
+ * it untouched, so immortal objects can live in read-only memory, such as a
+ * mapped TroveImage. They are never deallocated and never unique, so
+ * copy-on-write operations always copy them.
+ */
+#define TROVE_REF_IMMORTAL INT_MAX
+
+/** @brief Initial capacity of an autorelease pool's object array, which doubles as it fills */
+#define TROVE_POOL_INITIAL_CAPACITY 16
+
+/** @brief Default size in bytes of an autorelease pool arena chunk */
+#define TROVE_ARENA_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Reference-counted bump-allocation chunk
+ * 
+ * Each autorelease pool hands out short-lived byte storage from an arena
+ * chunk. Objects whose bytes live in a chunk retain it, so the chunk is freed
+ * only after the pool has been popped and the last such object is released.
+ * Those objects are distinct and may move to different threads, so the
+ * chunk's reference count is only changed with TroveArena_retain and
+ * TroveArena_release, which are atomic.
+ */
+typedef struct TroveArena {
+    ARCObject base;     /**< Inheritance: must be the first member */
+    size_t used;        /**< Bytes handed out so far */
+    size_t capacity;    /**< Total bytes available in bytes[] */
+    int reserved;       /**< Non-zero while a writer owns the unused tail */
+    char bytes[];       /**< Storage */
+} TroveArena;
+
+/**
+ * @brief Creates a new arena chunk
+ * 
+ * @param capacity Number of bytes of storage
+ * @return A new TroveArena with a reference count of 1
+ */
+TroveArena* TroveArena_create(size_t capacity);
+
+/**
+ * @brief Atomically increments the reference count of an arena chunk
+ * 
+ * @param arena The chunk (may be NULL)
+ */
+void TroveArena_retain(TroveArena *arena);
+
+/**
+ * @brief Atomically decrements the reference count of an arena chunk, freeing it at zero
+ * 
+ * @param arena The chunk (may be NULL)
+ */
+void TroveArena_release(TroveArena *arena);
+
+/**
+ * @brief Deallocates a TroveArena
+ * 
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveArena_dealloc(ARCObject *obj);
+
 /**
  * @brief Autorelease pool structure
  * 
@@ -36,24 +102,40 @@ typedef struct AutoreleasePool {
     ARCObject **objects;  /**< Array of autoreleased objects */
     size_t count;         /**< Current number of objects in the pool */
     size_t capacity;      /**< Current capacity of the objects array */
+    TroveArena *arena;    /**< Current arena chunk (retained), created on first use */
+    struct AutoreleasePool *parent;  /**< Pool that becomes current again when this one is popped */
 } AutoreleasePool;
 
-/** @brief Pointer to the current active autorelease pool */
-extern AutoreleasePool *current_autorelease_pool;
+/**
+ * @brief Storage class of per-thread runtime state
+ * 
+ * Without compiler support the state is shared by all threads, which is
+ * only correct for single-threaded programs.
+ */
+#if defined(__GNUC__)
+#define TROVE_THREAD_LOCAL __thread
+#else
+#define TROVE_THREAD_LOCAL
+#endif
+
+/** @brief The calling thread's current autorelease pool; each thread has its own stack of pools */
+extern TROVE_THREAD_LOCAL AutoreleasePool *current_autorelease_pool;
 
 /**
  * @brief Creates and pushes a new autorelease pool onto the stack
  * 
  * This function allocates a new autorelease pool and makes it the current pool.
- * Objects that are autoreleased will be added to this pool.
+ * Objects that are autoreleased will be added to this pool. Pools nest: the
+ * previously current pool is restored when this one is popped.
  */
 void autorelease_pool_push();
 
 /**
  * @brief Pops the current autorelease pool, releasing all objects in it
  * 
- * This function releases all objects in the current autorelease pool and
- * frees the pool itself.
+ * This function releases all objects in the current autorelease pool,
+ * including objects that their dealloc functions autorelease meanwhile,
+ * frees the pool itself and makes the enclosing pool current again.
  */
 void autorelease_pool_pop();
 
@@ -64,6 +146,18 @@ void autorelease_pool_pop();
  */
 void autorelease_add(ARCObject *obj);
 
+/**
+ * @brief Returns an arena chunk of the current pool with at least size free bytes
+ * 
+ * When the current chunk is reserved or too small, a new chunk becomes the
+ * pool's current one; the previous chunk lives on for as long as objects
+ * retain it.
+ * 
+ * @param size Number of free bytes required
+ * @return The pool's arena chunk (not retained), or NULL if no pool is in place
+ */
+TroveArena* autorelease_pool_arena(size_t size);
+
 /**
  * @brief ARC Operations
  * 
@@ -73,6 +167,8 @@ void autorelease_add(ARCObject *obj);
 /**
  * @brief Increments the reference count of an object
  * 
+ * Immortal objects are left untouched.
+ * 
  * @param obj The object whose reference count should be incremented
  */
 void arc_retain(ARCObject *obj);
@@ -80,10 +176,68 @@ void arc_retain(ARCObject *obj);
 /**
  * @brief Decrements the reference count of an object and deallocates if zero
  * 
+ * Immortal objects are left untouched.
+ * 
  * @param obj The object whose reference count should be decremented
  */
 void arc_release(ARCObject *obj);
 
+/**
+ * @brief Initializes the header of a newly allocated object
+ * 
+ * Every create function calls this on its malloc'd object, with a
+ * reference count of 1 as the result. It is the one place where the
+ * runtime sees objects being born, e.g. for arc_stats.
+ * 
+ * @param obj The object's header
+ * @param dealloc The type's dealloc function
+ * @param size Bytes allocated for the object, including any inline storage
+ */
+void arc_object_init(ARCObject *obj, void (*dealloc)(ARCObject *), size_t size);
+
+/**
+ * @brief Frees the memory of an object initialized with arc_object_init
+ * 
+ * Dealloc functions end with this instead of free, as does code that
+ * consumes a uniquely owned object without releasing it.
+ * 
+ * @param obj The object to free
+ */
+void arc_object_free(ARCObject *obj);
+
+/**
+ * @brief Increments the reference count of an object, noting where
+ * 
+ * Behaves like arc_retain; with leak tracking on (leaks.h) the location
+ * is recorded as the object's last retain site. RETAIN uses this.
+ * 
+ * @param obj The object whose reference count should be incremented
+ * @param file Source file of the call
+ * @param line Source line of the call
+ */
+void arc_retain_at(ARCObject *obj, const char *file, int line);
+
+/**
+ * @brief Records the allocation site of a newly created object
+ * 
+ * Does nothing unless leak tracking is on, in which case the location
+ * replaces the unknown site the object was tracked with.
+ * 
+ * @param obj The object, may be NULL
+ * @param file Source file of the creation
+ * @param line Source line of the creation
+ * @return obj
+ */
+ARCObject* arc_tag_site(ARCObject *obj, const char *file, int line);
+
+/**
+ * @brief Evaluates a create call and tags the object it returns with the current source location
+ * 
+ * The call, arguments included, runs before the site is recorded, so objects
+ * created while evaluating the arguments keep their own sites.
+ */
+#define TROVE_AT_SITE(create) arc_tag_site((ARCObject *)(create), __FILE__, __LINE__)
+
 /**
  * @brief Adds an object to the current autorelease pool
  * 
@@ -95,6 +249,39 @@ void arc_release(ARCObject *obj);
  */
 ARCObject* arc_autorelease(ARCObject *obj);
 
+/**
+ * @brief Increments the reference counts of an array of objects
+ * 
+ * Consecutive repeats of the same object are coalesced into one update.
+ * NULL entries and immortal objects are skipped.
+ * 
+ * @param objects The objects to retain
+ * @param count Number of entries in objects
+ */
+void arc_retain_all(ARCObject *const *objects, size_t count);
+
+/**
+ * @brief Decrements the reference counts of an array of objects
+ * 
+ * Objects are prefetched a batch ahead of the release loop, which hides
+ * cache misses when the objects are scattered across the heap. Consecutive
+ * repeats of the same object are coalesced into one update. NULL entries
+ * and immortal objects are skipped.
+ * 
+ * @param objects The objects to release
+ * @param count Number of entries in objects
+ */
+void arc_release_all(ARCObject *const *objects, size_t count);
+
+/**
+ * @brief Hints the CPU to fetch the cache line at addr for writing
+ */
+#if defined(__GNUC__)
+#define TROVE_PREFETCH(addr) __builtin_prefetch((addr), 1)
+#else
+#define TROVE_PREFETCH(addr) ((void)(addr))
+#endif
+
 /**
  * @brief String type managed by ARC
  * 
@@ -105,6 +292,10 @@ ARCObject* arc_autorelease(ARCObject *obj);
 typedef struct TroveString {
     ARCObject base;   /**< Inheritance: must be the first member */
     char *str;        /**< Null-terminated C string */
+    size_t length;    /**< Number of bytes in str, excluding the terminator */
+    size_t capacity;  /**< Bytes allocated for str, excluding the terminator */
+    ARCObject *storage; /**< Retained owner of str when it is borrowed, NULL when str is heap-allocated */
+    uint64_t hash;    /**< Cached TroveString_hash value, 0 until computed */
 } TroveString;
 
 /**
@@ -115,6 +306,33 @@ typedef struct TroveString {
  */
 TroveString* TroveString_create(const char *init);
 
+/**
+ * @brief Creates a new ARC-managed string from a byte range
+ * 
+ * Copies exactly length bytes (which need not be null-terminated) and
+ * terminates the copy. Passing NULL for bytes allocates length bytes of
+ * uninitialized content for the caller to fill.
+ * 
+ * @param bytes The bytes to copy, or NULL
+ * @param length The number of bytes to copy
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_create_with_length(const char *bytes, size_t length);
+
+/**
+ * @brief Creates a new ARC-managed string that adopts existing bytes
+ * 
+ * No bytes are copied. When storage is NULL, str must come from malloc and
+ * the string takes ownership of it; otherwise storage is retained as the
+ * owner of str for the lifetime of the string.
+ * 
+ * @param str Null-terminated bytes to adopt
+ * @param length Number of bytes in str, excluding the terminator
+ * @param storage Object owning str, or NULL to take ownership of a heap buffer
+ * @return A new TroveString with a reference count of 1
+ */
+TroveString* TroveString_create_with_storage(char *str, size_t length, ARCObject *storage);
+
 /**
  * @brief Deallocates a TroveString
  * 
@@ -124,6 +342,92 @@ TroveString* TroveString_create(const char *init);
  */
 void TroveString_dealloc(ARCObject *obj);
 
+/**
+ * @brief Returns the 64-bit hash of a string's bytes
+ * 
+ * The hash is computed on first use and cached in the string; the
+ * copy-on-write mutators reset the cache. The result is never 0.
+ * 
+ * @param str The string to hash
+ * @return The hash value
+ */
+uint64_t TroveString_hash(TroveString *str);
+
+/**
+ * @brief Hashes a byte range with the same function as TroveString_hash
+ * 
+ * @param bytes The bytes to hash
+ * @param length Number of bytes
+ * @return The hash value (never 0)
+ */
+uint64_t trove_hash_bytes(const char *bytes, size_t length);
+
+/**
+ * @brief Copy-on-write mutation
+ * 
+ * The mutating functions below take the address of a TroveString reference
+ * that the caller owns. When the string is uniquely referenced
+ * (ref_count == 1) it is modified in place, growing its buffer geometrically.
+ * Otherwise the caller's reference is released and replaced with a modified
+ * private copy, so every other holder keeps seeing the original contents.
+ */
+
+/**
+ * @brief Checks whether a string has exactly one reference
+ * 
+ * Analogous to Swift's isKnownUniquelyReferenced.
+ * 
+ * @param str The string to check
+ * @return 1 if ref_count is 1, 0 otherwise
+ */
+int TroveString_is_unique(TroveString *str);
+
+/**
+ * @brief Ensures a string is uniquely referenced and can hold capacity bytes
+ * 
+ * @param str Address of an owned reference; may be replaced with a copy
+ * @param capacity Minimum number of bytes the buffer must hold
+ */
+void TroveString_reserve(TroveString **str, size_t capacity);
+
+/**
+ * @brief Appends bytes to a string
+ * 
+ * @param str Address of an owned reference; may be replaced with a copy
+ * @param bytes The bytes to append (need not be null-terminated)
+ * @param length The number of bytes to append
+ */
+void TroveString_append(TroveString **str, const char *bytes, size_t length);
+
+/**
+ * @brief Appends a null-terminated C string to a string
+ * 
+ * @param str Address of an owned reference; may be replaced with a copy
+ * @param text The text to append
+ */
+void TroveString_append_cstr(TroveString **str, const char *text);
+
+/**
+ * @brief Replaces the byte at an index
+ * 
+ * Does nothing when index is out of range.
+ * 
+ * @param str Address of an owned reference; may be replaced with a copy
+ * @param index Byte offset to modify
+ * @param c The new byte
+ */
+void TroveString_set_char(TroveString **str, size_t index, char c);
+
+/**
+ * @brief Shortens a string to at most length bytes
+ * 
+ * The buffer keeps its capacity for subsequent appends.
+ * 
+ * @param str Address of an owned reference; may be replaced with a copy
+ * @param length The new length
+ */
+void TroveString_truncate(TroveString **str, size_t length);
+
 /**
  * @brief Convenience macro for creating autoreleased TroveString objects
  * 
@@ -136,6 +440,6 @@ void TroveString_dealloc(ARCObject *obj);
  * TroveString *s = String("Hello, world!");
  * @endcode
  */
-#define String(text) ((TroveString *)arc_autorelease((ARCObject *)TroveString_create(text)))
+#define String(text) ((TroveString *)arc_autorelease((ARCObject *)TROVE_AT_SITE(TroveString_create(text))))
 
 #endif // TROVE_H
@@ -0,0 +1,486 @@
+/**
+ * @file vector.c
+ * @brief Implementation of persistent vectors
+ *
+ * The layout follows the classic persistent vector: elements before
+ * tail_offset(count) live in a trie of TroveVectorNodes whose leaves are at
+ * level 0, and the rest live in the tail. The root's level is given by
+ * shift; index bits (index >> level) & TROVE_VECTOR_MASK select the slot at
+ * each level.
+ *
+ * Internal helpers "consume" node arguments documented as such: the caller
+ * hands over one reference and receives one reference to the result.
+ */
+
+#include "vector.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Mask selecting the slot bits of one trie level */
+#define TROVE_VECTOR_MASK (TROVE_VECTOR_WIDTH - 1)
+
+/**
+ * @brief Allocates a trie node with every slot NULL and a reference count of 1
+ */
+static TroveVectorNode* node_new(void) {
+    TroveVectorNode *node = (TroveVectorNode *)calloc(1, sizeof(TroveVectorNode));
+    if (!node) {
+        fprintf(stderr, "Failed to allocate TroveVectorNode.\n");
+        exit(1);
+    }
+    arc_object_init(&node->base, TroveVectorNode_dealloc, sizeof(TroveVectorNode));
+    return node;
+}
+
+/**
+ * @brief Returns a new node sharing every slot of node (NULL copies as empty)
+ */
+static TroveVectorNode* node_copy(TroveVectorNode *node) {
+    TroveVectorNode *copy = node_new();
+    if (node) {
+        memcpy(copy->slots, node->slots, sizeof(copy->slots));
+        arc_retain_all(copy->slots, TROVE_VECTOR_WIDTH);
+    }
+    return copy;
+}
+
+/**
+ * @brief Stores obj in a slot of a node the caller owns, releasing the old occupant
+ */
+static void node_replace(TroveVectorNode *node, size_t slot, ARCObject *obj) {
+    ARCObject *old = node->slots[slot];
+    node->slots[slot] = obj;
+    arc_release(old);
+}
+
+/**
+ * @brief Creates a vector, consuming root and tail
+ */
+static TroveVector* vector_new(size_t count, unsigned shift, TroveVectorNode *root, TroveVectorNode *tail) {
+    TroveVector *vector = (TroveVector *)malloc(sizeof(TroveVector));
+    if (!vector) {
+        fprintf(stderr, "Failed to allocate TroveVector.\n");
+        exit(1);
+    }
+    arc_object_init(&vector->base, TroveVector_dealloc, sizeof(TroveVector));
+    vector->count = count;
+    vector->shift = shift;
+    vector->root = root;
+    vector->tail = tail;
+    return vector;
+}
+
+/**
+ * @brief Index of the first element stored in the tail
+ */
+static inline size_t tail_offset(size_t count) {
+    return count < TROVE_VECTOR_WIDTH ? 0 : ((count - 1) >> TROVE_VECTOR_BITS) << TROVE_VECTOR_BITS;
+}
+
+/**
+ * @brief Returns the leaf holding index, which must be in range
+ */
+static TroveVectorNode* leaf_for(TroveVector *vector, size_t index) {
+    if (index >= tail_offset(vector->count)) {
+        return vector->tail;
+    }
+    TroveVectorNode *node = vector->root;
+    for (unsigned level = vector->shift; level > 0; level -= TROVE_VECTOR_BITS) {
+        node = (TroveVectorNode *)node->slots[(index >> level) & TROVE_VECTOR_MASK];
+    }
+    return node;
+}
+
+/**
+ * @brief Wraps a leaf in single-child nodes up to the given level, consuming leaf
+ */
+static TroveVectorNode* new_path(unsigned level, TroveVectorNode *leaf) {
+    if (level == 0) {
+        return leaf;
+    }
+    TroveVectorNode *node = node_new();
+    node->slots[0] = (ARCObject *)new_path(level - TROVE_VECTOR_BITS, leaf);
+    return node;
+}
+
+/**
+ * @brief Returns a copy of parent with a full tail leaf added, consuming leaf
+ *
+ * @param count Element count of the vector before the push
+ * @param level Level of parent
+ * @param parent Node to copy (NULL for an empty root)
+ * @param leaf The former tail
+ */
+static TroveVectorNode* push_tail(size_t count, unsigned level, TroveVectorNode *parent, TroveVectorNode *leaf) {
+    TroveVectorNode *node = node_copy(parent);
+    size_t slot = ((count - 1) >> level) & TROVE_VECTOR_MASK;
+    TroveVectorNode *child;
+    if (level == TROVE_VECTOR_BITS) {
+        child = leaf;
+    } else if (node->slots[slot]) {
+        child = push_tail(count, level - TROVE_VECTOR_BITS, (TroveVectorNode *)node->slots[slot], leaf);
+    } else {
+        child = new_path(level - TROVE_VECTOR_BITS, leaf);
+    }
+    node_replace(node, slot, (ARCObject *)child);
+    return node;
+}
+
+/**
+ * @brief Returns a copy of the path to index with the element replaced
+ *
+ * @param level Level of node
+ * @param node Node on the path (not consumed)
+ * @param index Element index
+ * @param obj The new element (already retained, consumed)
+ */
+static TroveVectorNode* assoc(unsigned level, TroveVectorNode *node, size_t index, ARCObject *obj) {
+    TroveVectorNode *copy = node_copy(node);
+    if (level == 0) {
+        node_replace(copy, index & TROVE_VECTOR_MASK, obj);
+    } else {
+        size_t slot = (index >> level) & TROVE_VECTOR_MASK;
+        TroveVectorNode *child = assoc(level - TROVE_VECTOR_BITS, (TroveVectorNode *)node->slots[slot], index, obj);
+        node_replace(copy, slot, (ARCObject *)child);
+    }
+    return copy;
+}
+
+/**
+ * @brief Returns a copy of node without its last leaf, or NULL if nothing remains
+ *
+ * @param count Element count of the vector before the pop
+ * @param level Level of node
+ * @param node Node on the path to the last leaf (not consumed)
+ */
+static TroveVectorNode* pop_tail(size_t count, unsigned level, TroveVectorNode *node) {
+    size_t slot = ((count - 2) >> level) & TROVE_VECTOR_MASK;
+    TroveVectorNode *child = NULL;
+    if (level > TROVE_VECTOR_BITS) {
+        child = pop_tail(count, level - TROVE_VECTOR_BITS, (TroveVectorNode *)node->slots[slot]);
+    }
+    if (!child && slot == 0) {
+        return NULL;
+    }
+    TroveVectorNode *copy = node_copy(node);
+    node_replace(copy, slot, (ARCObject *)child);
+    return copy;
+}
+
+/**
+ * @brief Creates an empty vector
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @return A new TroveVector with a reference count of 1
+ */
+TroveVector* TroveVector_create(void) {
+    return vector_new(0, TROVE_VECTOR_BITS, NULL, NULL);
+}
+
+/**
+ * @brief Returns the number of elements
+ *
+ * @param vector The vector
+ * @return Number of elements
+ */
+size_t TroveVector_count(TroveVector *vector) {
+    return vector->count;
+}
+
+/**
+ * @brief Returns the element at an index without retaining it
+ *
+ * @param vector The vector
+ * @param index Element index
+ * @return The element, or NULL if index is out of range
+ */
+ARCObject* TroveVector_get(TroveVector *vector, size_t index) {
+    if (index >= vector->count) {
+        return NULL;
+    }
+    return leaf_for(vector, index)->slots[index & TROVE_VECTOR_MASK];
+}
+
+/**
+ * @brief Returns the leaf that holds an index, for iterating a chunk at a time
+ *
+ * @param vector The vector
+ * @param index Element index
+ * @param length Receives the number of elements from index to the end of the leaf
+ * @return Pointer to the element at index, or NULL if index is out of range
+ */
+ARCObject *const * TroveVector_chunk(TroveVector *vector, size_t index, size_t *length) {
+    if (index >= vector->count) {
+        *length = 0;
+        return NULL;
+    }
+    size_t leaf_end = (index | TROVE_VECTOR_MASK) + 1;
+    *length = (leaf_end < vector->count ? leaf_end : vector->count) - index;
+    return leaf_for(vector, index)->slots + (index & TROVE_VECTOR_MASK);
+}
+
+/**
+ * @brief Returns a vector with an element appended
+ *
+ * While the tail has room only the tail is copied. A full tail is moved into
+ * the trie, adding a root level when the trie is full.
+ *
+ * @param vector The vector
+ * @param obj The element to append (retained, may be NULL)
+ * @return A new TroveVector with a reference count of 1
+ */
+TroveVector* TroveVector_push(TroveVector *vector, ARCObject *obj) {
+    size_t count = vector->count;
+    unsigned shift = vector->shift;
+    TroveVectorNode *root;
+    TroveVectorNode *tail;
+    arc_retain(obj);
+
+    if (count - tail_offset(count) < TROVE_VECTOR_WIDTH) {
+        tail = node_copy(vector->tail);
+        tail->slots[count & TROVE_VECTOR_MASK] = obj;
+        arc_retain((ARCObject *)vector->root);
+        return vector_new(count + 1, shift, vector->root, tail);
+    }
+
+    arc_retain((ARCObject *)vector->tail);
+    if ((count >> TROVE_VECTOR_BITS) > ((size_t)1 << shift)) {
+        root = node_new();
+        arc_retain((ARCObject *)vector->root);
+        root->slots[0] = (ARCObject *)vector->root;
+        root->slots[1] = (ARCObject *)new_path(shift, vector->tail);
+        shift += TROVE_VECTOR_BITS;
+    } else {
+        root = push_tail(count, shift, vector->root, vector->tail);
+    }
+    tail = node_new();
+    tail->slots[0] = obj;
+    return vector_new(count + 1, shift, root, tail);
+}
+
+/**
+ * @brief Returns a vector with the element at an index replaced
+ *
+ * @param vector The vector
+ * @param index Element index
+ * @param obj The new element (retained, may be NULL)
+ * @return A new TroveVector with a reference count of 1, or vector itself
+ *         retained if index is out of range
+ */
+TroveVector* TroveVector_set(TroveVector *vector, size_t index, ARCObject *obj) {
+    if (index >= vector->count) {
+        arc_retain((ARCObject *)vector);
+        return vector;
+    }
+    arc_retain(obj);
+    if (index >= tail_offset(vector->count)) {
+        TroveVectorNode *tail = node_copy(vector->tail);
+        node_replace(tail, index & TROVE_VECTOR_MASK, obj);
+        arc_retain((ARCObject *)vector->root);
+        return vector_new(vector->count, vector->shift, vector->root, tail);
+    }
+    TroveVectorNode *root = assoc(vector->shift, vector->root, index, obj);
+    arc_retain((ARCObject *)vector->tail);
+    return vector_new(vector->count, vector->shift, root, vector->tail);
+}
+
+/**
+ * @brief Returns a vector without its last element
+ *
+ * When the tail would become empty, the last leaf of the trie becomes the
+ * new tail and the root loses a level if it is left with one child.
+ *
+ * @param vector The vector
+ * @return A new TroveVector with a reference count of 1, or vector itself
+ *         retained if it is empty
+ */
+TroveVector* TroveVector_pop(TroveVector *vector) {
+    size_t count = vector->count;
+    if (count == 0) {
+        arc_retain((ARCObject *)vector);
+        return vector;
+    }
+    if (count == 1) {
+        return TroveVector_create();
+    }
+    if (count - tail_offset(count) > 1) {
+        TroveVectorNode *tail = node_copy(vector->tail);
+        node_replace(tail, (count - 1) & TROVE_VECTOR_MASK, NULL);
+        arc_retain((ARCObject *)vector->root);
+        return vector_new(count - 1, vector->shift, vector->root, tail);
+    }
+
+    TroveVectorNode *tail = leaf_for(vector, count - 2);
+    arc_retain((ARCObject *)tail);
+    unsigned shift = vector->shift;
+    TroveVectorNode *root = pop_tail(count, shift, vector->root);
+    if (root && shift > TROVE_VECTOR_BITS && root->slots[1] == NULL) {
+        TroveVectorNode *child = (TroveVectorNode *)root->slots[0];
+        arc_retain((ARCObject *)child);
+        arc_release((ARCObject *)root);
+        root = child;
+        shift -= TROVE_VECTOR_BITS;
+    }
+    return vector_new(count - 1, root ? shift : TROVE_VECTOR_BITS, root, tail);
+}
+
+/**
+ * @brief In-place Editing
+ *
+ * A node can be edited in place when it and every node above it, up to a
+ * uniquely referenced vector, has a reference count of 1: then no other
+ * vector can reach it. node_editable walks that chain top-down, copying
+ * each shared node once and storing the copy in its (already editable)
+ * parent.
+ */
+
+/**
+ * @brief Makes *vector uniquely referenced, copying only the header if shared
+ */
+static TroveVector* vector_make_unique(TroveVector **vector) {
+    TroveVector *original = *vector;
+    if (original->base.ref_count == 1) {
+        return original;
+    }
+    arc_retain((ARCObject *)original->root);
+    arc_retain((ARCObject *)original->tail);
+    TroveVector *copy = vector_new(original->count, original->shift, original->root, original->tail);
+    arc_release((ARCObject *)original);
+    *vector = copy;
+    return copy;
+}
+
+/**
+ * @brief Returns the node in an editable slot, copying it into the slot if shared
+ *
+ * An empty slot receives a new node.
+ */
+static TroveVectorNode* node_editable(TroveVectorNode **slot) {
+    TroveVectorNode *node = *slot;
+    if (node && node->base.ref_count == 1) {
+        return node;
+    }
+    TroveVectorNode *copy = node_copy(node);
+    *slot = copy;
+    arc_release((ARCObject *)node);
+    return copy;
+}
+
+/**
+ * @brief Adds a full tail leaf below an editable node, consuming leaf
+ */
+static void push_tail_in_place(size_t count, unsigned level, TroveVectorNode **slot, TroveVectorNode *leaf) {
+    TroveVectorNode *node = node_editable(slot);
+    size_t index = ((count - 1) >> level) & TROVE_VECTOR_MASK;
+    if (level == TROVE_VECTOR_BITS) {
+        node->slots[index] = (ARCObject *)leaf;
+    } else if (node->slots[index]) {
+        push_tail_in_place(count, level - TROVE_VECTOR_BITS, (TroveVectorNode **)&node->slots[index], leaf);
+    } else {
+        node->slots[index] = (ARCObject *)new_path(level - TROVE_VECTOR_BITS, leaf);
+    }
+}
+
+/**
+ * @brief Appends an element, editing *vector in place when possible
+ *
+ * @param vector Address of an owned reference; may be replaced with a copy
+ * @param obj The element to append (retained, may be NULL)
+ */
+void TroveVector_push_in_place(TroveVector **vector, ARCObject *obj) {
+    TroveVector *edited = vector_make_unique(vector);
+    size_t count = edited->count;
+    arc_retain(obj);
+
+    if (count - tail_offset(count) < TROVE_VECTOR_WIDTH) {
+        node_editable(&edited->tail)->slots[count & TROVE_VECTOR_MASK] = obj;
+        edited->count++;
+        return;
+    }
+
+    if ((count >> TROVE_VECTOR_BITS) > ((size_t)1 << edited->shift)) {
+        TroveVectorNode *root = node_new();
+        root->slots[0] = (ARCObject *)edited->root;
+        root->slots[1] = (ARCObject *)new_path(edited->shift, edited->tail);
+        edited->root = root;
+        edited->shift += TROVE_VECTOR_BITS;
+    } else {
+        push_tail_in_place(count, edited->shift, &edited->root, edited->tail);
+    }
+    edited->tail = node_new();
+    edited->tail->slots[0] = obj;
+    edited->count++;
+}
+
+/**
+ * @brief Replaces the element at an index, editing *vector in place when possible
+ *
+ * @param vector Address of an owned reference; may be replaced with a copy
+ * @param index Element index (ignored if out of range)
+ * @param obj The new element (retained, may be NULL)
+ */
+void TroveVector_set_in_place(TroveVector **vector, size_t index, ARCObject *obj) {
+    if (index >= (*vector)->count) {
+        return;
+    }
+    TroveVector *edited = vector_make_unique(vector);
+    arc_retain(obj);
+    if (index >= tail_offset(edited->count)) {
+        node_replace(node_editable(&edited->tail), index & TROVE_VECTOR_MASK, obj);
+        return;
+    }
+    TroveVectorNode **slot = &edited->root;
+    for (unsigned level = edited->shift; level > 0; level -= TROVE_VECTOR_BITS) {
+        slot = (TroveVectorNode **)&node_editable(slot)->slots[(index >> level) & TROVE_VECTOR_MASK];
+    }
+    node_replace(node_editable(slot), index & TROVE_VECTOR_MASK, obj);
+}
+
+/**
+ * @brief Removes the last element, editing *vector in place when possible
+ *
+ * Only the tail is edited in place; when the tail empties, the trie is
+ * shrunk as by TroveVector_pop, which happens once every 32 pops.
+ *
+ * @param vector Address of an owned reference; may be replaced with a copy
+ */
+void TroveVector_pop_in_place(TroveVector **vector) {
+    TroveVector *edited = *vector;
+    size_t count = edited->count;
+    if (count == 0) {
+        return;
+    }
+    if (count - tail_offset(count) > 1) {
+        edited = vector_make_unique(vector);
+        node_replace(node_editable(&edited->tail), (count - 1) & TROVE_VECTOR_MASK, NULL);
+        edited->count--;
+        return;
+    }
+    *vector = TroveVector_pop(edited);
+    arc_release((ARCObject *)edited);
+}
+
+/**
+ * @brief Deallocates a TroveVector
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveVector_dealloc(ARCObject *obj) {
+    TroveVector *vector = (TroveVector *)obj;
+    arc_release((ARCObject *)vector->root);
+    arc_release((ARCObject *)vector->tail);
+    arc_object_free(&vector->base);
+}
+
+/**
+ * @brief Deallocates a TroveVectorNode, releasing its slots
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveVectorNode_dealloc(ARCObject *obj) {
+    TroveVectorNode *node = (TroveVectorNode *)obj;
+    arc_release_all(node->slots, TROVE_VECTOR_WIDTH);
+    arc_object_free(&node->base);
+}
@@ -0,0 +1,173 @@
+/**
+ * @file vector.h
+ * @brief Persistent vectors for the Trove ARC memory management system
+ *
+ * A TroveVector is an immutable sequence of ARC objects stored in a 32-way
+ * trie, with the last (up to) 32 elements kept in a separate tail node so
+ * appends rarely touch the trie. Trie nodes are ARC objects themselves:
+ * an update copies the O(log32 n) nodes on the path to the changed element
+ * and retains every other subtree, so each version costs a few hundred
+ * bytes no matter how large the vector is. Releasing an old version frees
+ * exactly the nodes no other version shares.
+ *
+ * Update functions return a new vector and leave their input unchanged. The
+ * _in_place variants instead edit nodes that only the caller's vector
+ * references, falling back to copying the shared ones.
+ */
+
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include "trove.h"
+
+/** @brief Number of index bits consumed per trie level */
+#define TROVE_VECTOR_BITS 5
+
+/** @brief Number of slots per trie node */
+#define TROVE_VECTOR_WIDTH (1 << TROVE_VECTOR_BITS)
+
+/**
+ * @brief Trie node managed by ARC
+ *
+ * Internal nodes hold retained child nodes and leaves hold retained
+ * elements. Unused slots are NULL.
+ */
+typedef struct TroveVectorNode {
+    ARCObject base;                          /**< Inheritance: must be the first member */
+    ARCObject *slots[TROVE_VECTOR_WIDTH];    /**< Retained children or elements */
+} TroveVectorNode;
+
+/**
+ * @brief Persistent vector managed by ARC
+ */
+typedef struct TroveVector {
+    ARCObject base;            /**< Inheritance: must be the first member */
+    size_t count;              /**< Number of elements */
+    unsigned shift;            /**< Index shift of the root level (a multiple of TROVE_VECTOR_BITS) */
+    TroveVectorNode *root;     /**< Retained trie root, NULL while everything fits in the tail */
+    TroveVectorNode *tail;     /**< Retained leaf holding the last elements, NULL when empty */
+} TroveVector;
+
+/**
+ * @brief Creates an empty vector
+ *
+ * @return A new TroveVector with a reference count of 1
+ */
+TroveVector* TroveVector_create(void);
+
+/**
+ * @brief Returns the number of elements
+ *
+ * @param vector The vector
+ * @return Number of elements
+ */
+size_t TroveVector_count(TroveVector *vector);
+
+/**
+ * @brief Returns the element at an index without retaining it
+ *
+ * @param vector The vector
+ * @param index Element index
+ * @return The element, or NULL if index is out of range
+ */
+ARCObject* TroveVector_get(TroveVector *vector, size_t index);
+
+/**
+ * @brief Returns the leaf that holds an index, for iterating a chunk at a time
+ *
+ * @code
+ * for (size_t i = 0; i < TroveVector_count(v); ) {
+ *     size_t length;
+ *     ARCObject *const *chunk = TroveVector_chunk(v, i, &length);
+ *     for (size_t j = 0; j < length; j++) { ... chunk[j] ... }
+ *     i += length;
+ * }
+ * @endcode
+ *
+ * @param vector The vector
+ * @param index Element index
+ * @param length Receives the number of elements from index to the end of the leaf
+ * @return Pointer to the element at index, or NULL if index is out of range
+ */
+ARCObject *const * TroveVector_chunk(TroveVector *vector, size_t index, size_t *length);
+
+/**
+ * @brief Returns a vector with an element appended
+ *
+ * @param vector The vector
+ * @param obj The element to append (retained, may be NULL)
+ * @return A new TroveVector with a reference count of 1
+ */
+TroveVector* TroveVector_push(TroveVector *vector, ARCObject *obj);
+
+/**
+ * @brief Returns a vector with the element at an index replaced
+ *
+ * @param vector The vector
+ * @param index Element index
+ * @param obj The new element (retained, may be NULL)
+ * @return A new TroveVector with a reference count of 1, or vector itself
+ *         retained if index is out of range
+ */
+TroveVector* TroveVector_set(TroveVector *vector, size_t index, ARCObject *obj);
+
+/**
+ * @brief Returns a vector without its last element
+ *
+ * @param vector The vector
+ * @return A new TroveVector with a reference count of 1, or vector itself
+ *         retained if it is empty
+ */
+TroveVector* TroveVector_pop(TroveVector *vector);
+
+/**
+ * @brief Appends an element, editing *vector in place when possible
+ *
+ * This is the transient counterpart of TroveVector_push. When the caller
+ * holds the only reference to *vector, nodes that no other version shares
+ * are updated in place. Otherwise *vector is replaced by a new version (the
+ * caller's reference to the old one is released) that copies only the
+ * shared nodes it changes; later in-place updates reuse those copies.
+ *
+ * @param vector Address of an owned reference; may be replaced with a copy
+ * @param obj The element to append (retained, may be NULL)
+ */
+void TroveVector_push_in_place(TroveVector **vector, ARCObject *obj);
+
+/**
+ * @brief Replaces the element at an index, editing *vector in place when possible
+ *
+ * The transient counterpart of TroveVector_set; see TroveVector_push_in_place.
+ *
+ * @param vector Address of an owned reference; may be replaced with a copy
+ * @param index Element index (ignored if out of range)
+ * @param obj The new element (retained, may be NULL)
+ */
+void TroveVector_set_in_place(TroveVector **vector, size_t index, ARCObject *obj);
+
+/**
+ * @brief Removes the last element, editing *vector in place when possible
+ *
+ * The transient counterpart of TroveVector_pop; see TroveVector_push_in_place.
+ *
+ * @param vector Address of an owned reference; may be replaced with a copy
+ */
+void TroveVector_pop_in_place(TroveVector **vector);
+
+/**
+ * @brief Deallocates a TroveVector
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveVector_dealloc(ARCObject *obj);
+
+/**
+ * @brief Deallocates a TroveVectorNode, releasing its slots
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveVectorNode_dealloc(ARCObject *obj);
+
+#endif // VECTOR_H
@@ -0,0 +1,258 @@
+/**
+ * @file writer.c
+ * @brief Implementation of TroveWriter
+ */
+
+#include "writer.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/**
+ * @brief Allocates an empty batch with room for TROVE_WRITER_MAX_IOV ranges
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static TroveWriteBatch* batch_new(void) {
+    TroveWriteBatch *batch = (TroveWriteBatch *)malloc(sizeof(TroveWriteBatch));
+    if (!batch) {
+        fprintf(stderr, "Failed to allocate TroveWriteBatch.\n");
+        exit(1);
+    }
+    arc_object_init(&batch->base, TroveWriteBatch_dealloc, sizeof(TroveWriteBatch));
+    batch->capacity = TROVE_WRITER_MAX_IOV;
+    batch->iov = (struct iovec *)malloc(batch->capacity * sizeof(struct iovec));
+    batch->owners = (ARCObject **)malloc(batch->capacity * sizeof(ARCObject *));
+    batch->buffer = (char *)malloc(TROVE_WRITER_BUFFER_SIZE);
+    if (!batch->iov || !batch->owners || !batch->buffer) {
+        fprintf(stderr, "Failed to allocate TroveWriteBatch ranges.\n");
+        exit(1);
+    }
+    batch->count = 0;
+    batch->bytes = 0;
+    batch->buffer_used = 0;
+    return batch;
+}
+
+/**
+ * @brief Creates a writer with a custom backend
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @param submit Function that writes and releases batches
+ * @param context Passed to submit
+ * @return A new TroveWriter with a reference count of 1
+ */
+TroveWriter* TroveWriter_create(TroveWriterSubmit submit, void *context) {
+    TroveWriter *writer = (TroveWriter *)malloc(sizeof(TroveWriter));
+    if (!writer) {
+        fprintf(stderr, "Failed to allocate TroveWriter.\n");
+        exit(1);
+    }
+    arc_object_init(&writer->base, TroveWriter_dealloc, sizeof(TroveWriter));
+    writer->submit = submit;
+    writer->context = context;
+    writer->batch = NULL;
+    writer->error = 0;
+    return writer;
+}
+
+/**
+ * @brief Creates a writer that writes batches to a file descriptor with writev
+ *
+ * @param fd Descriptor to write to
+ * @return A new TroveWriter with a reference count of 1
+ */
+TroveWriter* TroveWriter_create_with_fd(int fd) {
+    return TroveWriter_create(TroveWriter_submit_writev, (void *)(intptr_t)fd);
+}
+
+/**
+ * @brief Submits the queued bytes
+ *
+ * The batch is handed over to the backend, and the next write starts a new
+ * one. The first error is remembered in writer->error.
+ *
+ * @param writer The writer
+ * @return 0 on success, otherwise the error returned by the backend
+ */
+int TroveWriter_flush(TroveWriter *writer) {
+    TroveWriteBatch *batch = writer->batch;
+    if (!batch) {
+        return 0;
+    }
+    writer->batch = NULL;
+    int error = writer->submit(writer->context, batch);
+    if (error && !writer->error) {
+        writer->error = error;
+    }
+    return error;
+}
+
+/**
+ * @brief Appends a range owned by owner, which is retained unless the range extends the last one
+ *
+ * Short ranges are copied into the batch buffer, submitting the batch first
+ * when the buffer is full. The batch is submitted as soon as it holds
+ * TROVE_WRITER_MAX_IOV ranges or TROVE_WRITER_MAX_BYTES bytes.
+ */
+static int writer_append(TroveWriter *writer, const void *bytes, size_t length, ARCObject *owner) {
+    if (length == 0) {
+        return 0;
+    }
+    TroveWriteBatch *batch = writer->batch;
+    if (batch && length < TROVE_WRITER_COPY_MAX && batch->buffer_used + length > TROVE_WRITER_BUFFER_SIZE) {
+        int error = TroveWriter_flush(writer);
+        if (error) {
+            return error;
+        }
+        batch = NULL;
+    }
+    if (!batch) {
+        batch = writer->batch = batch_new();
+    }
+    if (length < TROVE_WRITER_COPY_MAX) {
+        char *copy = batch->buffer + batch->buffer_used;
+        memcpy(copy, bytes, length);
+        batch->buffer_used += length;
+        bytes = copy;
+        owner = NULL;
+    }
+    struct iovec *last = batch->count > 0 ? &batch->iov[batch->count - 1] : NULL;
+    if (last && batch->owners[batch->count - 1] == owner &&
+        (const char *)last->iov_base + last->iov_len == (const char *)bytes) {
+        last->iov_len += length;
+    } else {
+        arc_retain(owner);
+        batch->iov[batch->count].iov_base = (void *)bytes;
+        batch->iov[batch->count].iov_len = length;
+        batch->owners[batch->count] = owner;
+        batch->count++;
+    }
+    batch->bytes += length;
+    if (batch->count == batch->capacity || batch->bytes >= TROVE_WRITER_MAX_BYTES) {
+        return TroveWriter_flush(writer);
+    }
+    return 0;
+}
+
+/**
+ * @brief Queues the bytes of a string, retaining it until they are written
+ *
+ * @param writer The writer
+ * @param str The string
+ * @return 0 on success, or the error of a batch submitted to make room
+ */
+int TroveWriter_write_string(TroveWriter *writer, TroveString *str) {
+    return writer_append(writer, str->str, str->length, (ARCObject *)str);
+}
+
+/**
+ * @brief Queues the bytes of a slice, retaining its parent until they are written
+ *
+ * Retaining the parent rather than the slice lets slices of the same string
+ * merge into one range and lets the slice objects be freed right away.
+ *
+ * @param writer The writer
+ * @param slice The slice
+ * @return 0 on success, or the error of a batch submitted to make room
+ */
+int TroveWriter_write_slice(TroveWriter *writer, TroveStringSlice *slice) {
+    return writer_append(writer, slice->ptr, slice->length, (ARCObject *)slice->parent);
+}
+
+/**
+ * @brief Queues the bytes of a data object, retaining it until they are written
+ *
+ * @param writer The writer
+ * @param data The data
+ * @return 0 on success, or the error of a batch submitted to make room
+ */
+int TroveWriter_write_data(TroveWriter *writer, TroveData *data) {
+    return writer_append(writer, data->bytes, data->length, (ARCObject *)data);
+}
+
+/**
+ * @brief Queues bytes that outlive the writer, such as literals, without retaining anything
+ *
+ * @param writer The writer
+ * @param bytes The bytes
+ * @param length Number of bytes
+ * @return 0 on success, or the error of a batch submitted to make room
+ */
+int TroveWriter_write_static(TroveWriter *writer, const void *bytes, size_t length) {
+    return writer_append(writer, bytes, length, NULL);
+}
+
+/**
+ * @brief Writes an entire batch to a file descriptor with writev, then releases it
+ *
+ * The iovecs of the batch are advanced in place as bytes are written, so
+ * the batch must not be reused.
+ *
+ * @param context The descriptor, cast with (void *)(intptr_t)fd
+ * @param batch The batch to write
+ * @return 0 on success, an error number otherwise
+ */
+int TroveWriter_submit_writev(void *context, TroveWriteBatch *batch) {
+    int fd = (int)(intptr_t)context;
+    struct iovec *iov = batch->iov;
+    size_t remaining = batch->count;
+    int error = 0;
+    while (remaining > 0) {
+        ssize_t n = writev(fd, iov, (int)(remaining < TROVE_WRITER_MAX_IOV ? remaining : TROVE_WRITER_MAX_IOV));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = errno;
+            break;
+        }
+        if (n == 0) {
+            error = EIO;
+            break;
+        }
+        size_t written = (size_t)n;
+        while (remaining > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            remaining--;
+        }
+        if (remaining > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    arc_release((ARCObject *)batch);
+    return error;
+}
+
+/**
+ * @brief Deallocates a TroveWriteBatch, releasing the owners of its ranges
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveWriteBatch_dealloc(ARCObject *obj) {
+    TroveWriteBatch *batch = (TroveWriteBatch *)obj;
+    arc_release_all(batch->owners, batch->count);
+    free(batch->iov);
+    free(batch->owners);
+    free(batch->buffer);
+    arc_object_free(&batch->base);
+}
+
+/**
+ * @brief Deallocates a TroveWriter, submitting any queued bytes first
+ *
+ * This function is called automatically when the reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveWriter_dealloc(ARCObject *obj) {
+    TroveWriter *writer = (TroveWriter *)obj;
+    TroveWriter_flush(writer);
+    arc_object_free(&writer->base);
+}
@@ -0,0 +1,187 @@
+/**
+ * @file writer.h
+ * @brief Vectored output of ARC-managed bytes for the Trove ARC memory management system
+ *
+ * A TroveWriter collects references to strings, slices and data objects
+ * into a batch of iovecs instead of copying their bytes into a buffer.
+ * Ranges shorter than TROVE_WRITER_COPY_MAX are the exception: copying a
+ * few bytes is cheaper than retaining their owner and spending an iovec on
+ * them, so they are packed into a buffer owned by the batch. When
+ * the batch is full, or on TroveWriter_flush, the batch is handed to a
+ * submit function that writes it and then releases it, which releases every
+ * object the batch retained.
+ *
+ * The default backend writes batches to a file descriptor with writev.
+ * Because a batch is itself an ARC object, an asynchronous backend (such as
+ * an io_uring submission queue) can keep the batch alive until the kernel
+ * reports completion and release it then; the writer never touches a batch
+ * after submitting it.
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include "trove.h"
+#include "slice.h"
+#include "data.h"
+#include <sys/uio.h>
+
+/** @brief Number of iovecs after which a batch is submitted (Linux's IOV_MAX) */
+#define TROVE_WRITER_MAX_IOV 1024
+
+/** @brief Number of bytes after which a batch is submitted */
+#define TROVE_WRITER_MAX_BYTES (1 << 20)
+
+/** @brief Ranges shorter than this are copied into the batch buffer */
+#define TROVE_WRITER_COPY_MAX 256
+
+/** @brief Size of the buffer each batch packs short ranges into */
+#define TROVE_WRITER_BUFFER_SIZE (64 * 1024)
+
+/**
+ * @brief Batch of byte ranges managed by ARC
+ *
+ * Every range is kept alive by the object at the same index in owners,
+ * which is NULL for bytes in the batch buffer and for bytes that outlive
+ * the batch. A range that directly
+ * follows the previous one in memory and has the same owner extends its
+ * iovec instead of adding one, so consecutive slices of a string cost a
+ * single entry.
+ */
+typedef struct TroveWriteBatch {
+    ARCObject base;          /**< Inheritance: must be the first member */
+    struct iovec *iov;       /**< Byte ranges in output order */
+    ARCObject **owners;      /**< Retained owner of each range, or NULL */
+    size_t count;            /**< Number of ranges */
+    size_t capacity;         /**< Allocated entries in iov and owners */
+    size_t bytes;            /**< Total number of bytes in the ranges */
+    char *buffer;            /**< TROVE_WRITER_BUFFER_SIZE bytes holding copied short ranges */
+    size_t buffer_used;      /**< Bytes of buffer in use */
+} TroveWriteBatch;
+
+/**
+ * @brief Writes a batch, then releases it
+ *
+ * The function receives the writer's reference to the batch. A synchronous
+ * backend releases it before returning; an asynchronous one releases it
+ * when the write completes.
+ *
+ * @param context The context given to TroveWriter_create
+ * @param batch The batch to write
+ * @return 0 on success, an error number otherwise
+ */
+typedef int (*TroveWriterSubmit)(void *context, TroveWriteBatch *batch);
+
+/**
+ * @brief Vectored writer managed by ARC
+ */
+typedef struct TroveWriter {
+    ARCObject base;              /**< Inheritance: must be the first member */
+    TroveWriterSubmit submit;    /**< Backend that writes batches */
+    void *context;               /**< Passed to submit */
+    TroveWriteBatch *batch;      /**< Retained batch being filled, NULL when empty */
+    int error;                   /**< First error returned by submit, or 0 */
+} TroveWriter;
+
+/**
+ * @brief Creates a writer with a custom backend
+ *
+ * @param submit Function that writes and releases batches
+ * @param context Passed to submit
+ * @return A new TroveWriter with a reference count of 1
+ */
+TroveWriter* TroveWriter_create(TroveWriterSubmit submit, void *context);
+
+/**
+ * @brief Creates a writer that writes batches to a file descriptor with writev
+ *
+ * The descriptor is not closed by the writer.
+ *
+ * @param fd Descriptor to write to
+ * @return A new TroveWriter with a reference count of 1
+ */
+TroveWriter* TroveWriter_create_with_fd(int fd);
+
+/**
+ * @brief Queues the bytes of a string, retaining it until they are written
+ *
+ * Short strings are copied instead of retained.
+ *
+ * @param writer The writer
+ * @param str The string
+ * @return 0 on success, or the error of a batch submitted to make room
+ */
+int TroveWriter_write_string(TroveWriter *writer, TroveString *str);
+
+/**
+ * @brief Queues the bytes of a slice, retaining its parent until they are written
+ *
+ * Short slices are copied instead.
+ *
+ * @param writer The writer
+ * @param slice The slice
+ * @return 0 on success, or the error of a batch submitted to make room
+ */
+int TroveWriter_write_slice(TroveWriter *writer, TroveStringSlice *slice);
+
+/**
+ * @brief Queues the bytes of a data object, retaining it until they are written
+ *
+ * Short data is copied instead.
+ *
+ * @param writer The writer
+ * @param data The data
+ * @return 0 on success, or the error of a batch submitted to make room
+ */
+int TroveWriter_write_data(TroveWriter *writer, TroveData *data);
+
+/**
+ * @brief Queues bytes that outlive the writer, such as literals, without retaining anything
+ *
+ * @param writer The writer
+ * @param bytes The bytes
+ * @param length Number of bytes
+ * @return 0 on success, or the error of a batch submitted to make room
+ */
+int TroveWriter_write_static(TroveWriter *writer, const void *bytes, size_t length);
+
+/**
+ * @brief Submits the queued bytes
+ *
+ * @param writer The writer
+ * @return 0 on success, otherwise the error returned by the backend
+ */
+int TroveWriter_flush(TroveWriter *writer);
+
+/**
+ * @brief Writes an entire batch to a file descriptor with writev, then releases it
+ *
+ * This is the backend used by TroveWriter_create_with_fd; custom backends
+ * can call it to fall back to synchronous writes. Partial writes and EINTR
+ * are retried.
+ *
+ * @param context The descriptor, cast with (void *)(intptr_t)fd
+ * @param batch The batch to write
+ * @return 0 on success, an error number otherwise
+ */
+int TroveWriter_submit_writev(void *context, TroveWriteBatch *batch);
+
+/**
+ * @brief Deallocates a TroveWriteBatch, releasing the owners of its ranges
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveWriteBatch_dealloc(ARCObject *obj);
+
+/**
+ * @brief Deallocates a TroveWriter, submitting any queued bytes first
+ *
+ * Errors from this last submission are lost; call TroveWriter_flush first
+ * to observe them. This function is called automatically when the
+ * reference count reaches zero.
+ *
+ * @param obj The object to deallocate (cast to ARCObject)
+ */
+void TroveWriter_dealloc(ARCObject *obj);
+
+#endif // WRITER_H
@@ -0,0 +1,215 @@
+/**
+ * @file builder.c
+ * @brief Tests of TroveStringBuilder: appends, arena and heap storage, and strings leaving their thread
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "builder.h"
+#include "leaks.h"
+#include <string.h>
+#include <pthread.h>
+
+/** @brief Strings handed to the other thread by test_strings_across_threads */
+#define HANDED_OFF 2000
+
+/**
+ * @brief Returns whether a string holds exactly a C string, terminator included
+ */
+static int string_equals(TroveString *str, const char *expected) {
+    return str && str->length == strlen(expected) && memcmp(str->str, expected, str->length + 1) == 0;
+}
+
+/**
+ * @brief Every kind of append lands in order, in a pool's arena and on the heap
+ */
+static void test_appends(void) {
+    const char *expected = "id=42 -7 18446744073709551615 0.1 1e+21 x:[abc] tail";
+    for (int pooled = 0; pooled < 2; pooled++) {
+        if (pooled) {
+            autorelease_pool_push();
+        }
+        TroveStringBuilder builder;
+        TroveStringBuilder_init(&builder);
+        TroveStringBuilder_appendf(&builder, "id=%d", 42);
+        TroveStringBuilder_append_char(&builder, ' ');
+        TroveStringBuilder_append_int(&builder, -7);
+        TroveStringBuilder_append_char(&builder, ' ');
+        TroveStringBuilder_append_uint(&builder, 18446744073709551615ULL);
+        TroveStringBuilder_append_char(&builder, ' ');
+        TroveStringBuilder_append_double(&builder, 0.1);
+        TroveStringBuilder_append_char(&builder, ' ');
+        TroveStringBuilder_append_double(&builder, 1e21);
+        TroveStringBuilder_appendf(&builder, " %c:[%s]", 'x', "abc");
+        TroveStringBuilder_append(&builder, " tail and more", 5);
+        CHECK((builder.arena != NULL) == pooled);
+        TroveString *str = TroveStringBuilder_finish(&builder);
+        CHECK(string_equals(str, expected));
+        CHECK((str->storage != NULL) == pooled);
+        CHECK(builder.buf == NULL && builder.length == 0);
+        if (pooled) {
+            autorelease_pool_pop();
+        }
+        // The string outlives its pool
+        CHECK(string_equals(str, expected));
+        arc_release(&str->base);
+    }
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Output larger than an arena chunk and long appendf output grow the buffer intact
+ */
+static void test_growth(void) {
+    for (int pooled = 0; pooled < 2; pooled++) {
+        if (pooled) {
+            autorelease_pool_push();
+        }
+        TroveStringBuilder builder;
+        TroveStringBuilder_init(&builder);
+        size_t total = TROVE_ARENA_CHUNK_SIZE * 3 + 5;
+        for (size_t i = 0; i < total; i++) {
+            TroveStringBuilder_append_char(&builder, (char)('a' + i % 26));
+        }
+        char wide[300];
+        memset(wide, 'w', sizeof(wide) - 1);
+        wide[sizeof(wide) - 1] = '\0';
+        TroveStringBuilder_appendf(&builder, "%s", wide);
+        TroveString *str = TroveStringBuilder_finish(&builder);
+        int intact = str->length == total + sizeof(wide) - 1 && str->str[str->length] == '\0';
+        for (size_t i = 0; intact && i < total; i++) {
+            intact = str->str[i] == (char)('a' + i % 26);
+        }
+        CHECK(intact && memcmp(str->str + total, wide, sizeof(wide) - 1) == 0);
+        if (pooled) {
+            autorelease_pool_pop();
+        }
+        arc_release(&str->base);
+    }
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Strings built one after another share a chunk; discard frees what was written
+ */
+static void test_shared_chunk_and_discard(void) {
+    autorelease_pool_push();
+    TroveStringBuilder builder;
+    TroveStringBuilder_init(&builder);
+    TroveStringBuilder_append_cstr(&builder, "first");
+    TroveString *first = TroveStringBuilder_finish(&builder);
+    TroveStringBuilder_append_cstr(&builder, "second");
+    TroveString *second = TroveStringBuilder_finish(&builder);
+    CHECK(first->storage && first->storage == second->storage);
+
+    TroveStringBuilder_append_cstr(&builder, "dropped");
+    TroveStringBuilder_discard(&builder);
+    CHECK(builder.buf == NULL && builder.arena == NULL);
+    // The chunk is not reserved by the discarded builder any more
+    TroveStringBuilder_append_cstr(&builder, "third");
+    TroveString *third = TroveStringBuilder_finish(&builder);
+    CHECK(third->storage == first->storage && string_equals(third, "third"));
+    autorelease_pool_pop();
+
+    CHECK(first->storage->ref_count == 3);
+    arc_release(&first->base);
+    arc_release(&third->base);
+    CHECK(string_equals(second, "second"));
+    arc_release(&second->base);
+
+    // Discarding heap output, and discarding a builder never written to
+    TroveStringBuilder_append_cstr(&builder, "heap");
+    TroveStringBuilder_discard(&builder);
+    TroveStringBuilder_discard(&builder);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Appending to a finished string copies it out of the chunk, or grows its heap buffer
+ */
+static void test_cow_growth(void) {
+    autorelease_pool_push();
+    TroveStringBuilder builder;
+    TroveStringBuilder_init(&builder);
+    TroveStringBuilder_append_cstr(&builder, "arena");
+    TroveString *arena_str = TroveStringBuilder_finish(&builder);
+    TroveStringBuilder_append_cstr(&builder, "neighbour");
+    TroveString *neighbour = TroveStringBuilder_finish(&builder);
+    autorelease_pool_pop();
+
+    TroveString_append_cstr(&arena_str, " grown");
+    CHECK(string_equals(arena_str, "arena grown") && arena_str->storage == NULL);
+    // The neighbour's bytes right after it in the chunk are untouched
+    CHECK(string_equals(neighbour, "neighbour"));
+
+    TroveStringBuilder_append_cstr(&builder, "heap");
+    TroveString *heap_str = TroveStringBuilder_finish(&builder);
+    CHECK(heap_str->storage == NULL && heap_str->capacity >= heap_str->length);
+    TroveString *shared = heap_str;
+    arc_retain(&shared->base);
+    TroveString_append_cstr(&heap_str, " grown");
+    CHECK(heap_str != shared);
+    CHECK(string_equals(heap_str, "heap grown") && string_equals(shared, "heap"));
+
+    arc_release(&arena_str->base);
+    arc_release(&neighbour->base);
+    arc_release(&heap_str->base);
+    arc_release(&shared->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/** @brief Strings released by release_handed_off */
+static TroveString *handed_off[HANDED_OFF];
+
+/**
+ * @brief Releases the strings handed to this thread
+ */
+static void *release_handed_off(void *arg) {
+    (void)arg;
+    for (int i = 0; i < HANDED_OFF; i++) {
+        arc_release(&handed_off[i]->base);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Strings sharing a chunk can be released on different threads at once
+ *
+ * Meant for `make test-tsan`: every other string goes to another thread,
+ * and both threads release their strings, and with them the chunk, concurrently.
+ */
+static void test_strings_across_threads(void) {
+    static TroveString *kept[HANDED_OFF];
+    autorelease_pool_push();
+    TroveStringBuilder builder;
+    TroveStringBuilder_init(&builder);
+    for (int i = 0; i < HANDED_OFF * 2; i++) {
+        TroveStringBuilder_appendf(&builder, "string %d", i);
+        TroveString *str = TroveStringBuilder_finish(&builder);
+        if (i % 2) {
+            handed_off[i / 2] = str;
+        } else {
+            kept[i / 2] = str;
+        }
+    }
+    autorelease_pool_pop();
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, release_handed_off, NULL);
+    for (int i = 0; i < HANDED_OFF; i++) {
+        arc_release(&kept[i]->base);
+    }
+    pthread_join(thread, NULL);
+    CHECK(arc_leaks_count() == 0);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_appends();
+    test_growth();
+    test_shared_chunk_and_discard();
+    test_cow_growth();
+    test_strings_across_threads();
+    arc_leaks_enable(0);
+    return check_done("builder");
+}
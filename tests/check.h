@@ -0,0 +1,45 @@
+/**
+ * @file check.h
+ * @brief Shared helpers for the Trove tests
+ *
+ * Each test is a standalone program in tests/. `make test` links it against
+ * the debug library; `make test-asan`, `make test-tsan` and `make test-ubsan`
+ * compile it together with the library sources under a sanitizer. A test
+ * exits with status 0 when every check passed.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** @brief Checks that failed so far */
+static int check_failures = 0;
+
+/**
+ * @brief Records a failure, with its location, when a condition is false
+ */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            check_failures++; \
+        } \
+    } while (0)
+
+/**
+ * @brief Prints a summary and returns the exit status of the test program
+ *
+ * @param name Name of the test program
+ */
+static inline int check_done(const char *name) {
+    if (check_failures) {
+        fprintf(stderr, "%s: %d checks failed\n", name, check_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif // CHECK_H
@@ -0,0 +1,478 @@
+/**
+ * @file core.c
+ * @brief Tests of the ARC core: counts, pools, batches, arrays, strings and the guard
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "array.h"
+#include "guard.h"
+#include "leaks.h"
+#include "slice.h"
+#include "builder.h"
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/** @brief Objects freed by custom_dealloc */
+static int custom_freed = 0;
+
+/**
+ * @brief An object whose dealloc autoreleases what it holds
+ */
+typedef struct CustomObject {
+    ARCObject base;       /**< Inheritance: must be the first member */
+    ARCObject *held;      /**< Retained object, autoreleased on dealloc */
+} CustomObject;
+
+/**
+ * @brief Deallocates a CustomObject, handing its reference to the current pool
+ */
+static void custom_dealloc(ARCObject *obj) {
+    CustomObject *custom = (CustomObject *)obj;
+    if (custom->held) {
+        arc_autorelease(custom->held);
+    }
+    custom_freed++;
+    arc_object_free(obj);
+}
+
+/**
+ * @brief Creates a CustomObject holding a reference to held
+ */
+static CustomObject* custom_create(ARCObject *held) {
+    CustomObject *custom = (CustomObject *)malloc(sizeof(CustomObject));
+    if (!custom) {
+        fprintf(stderr, "Failed to allocate CustomObject.\n");
+        exit(1);
+    }
+    arc_object_init(&custom->base, custom_dealloc, sizeof(CustomObject));
+    arc_retain(held);
+    custom->held = held;
+    return custom;
+}
+
+/**
+ * @brief Retain and release adjust counts; NULL and immortal objects are left alone
+ */
+static void test_retain_release(void) {
+    TroveString *str = TroveString_create("count");
+    CHECK(str->base.ref_count == 1);
+    arc_retain(&str->base);
+    arc_retain(&str->base);
+    CHECK(str->base.ref_count == 3);
+    arc_release(&str->base);
+    CHECK(str->base.ref_count == 2);
+    arc_release(&str->base);
+    arc_release(&str->base);
+    CHECK(arc_leaks_count() == 0);
+
+    arc_retain(NULL);
+    arc_release(NULL);
+
+    TroveString immortal = { { TROVE_REF_IMMORTAL, sizeof(TroveString), TroveString_dealloc }, "immortal", 8, 8, NULL, 0 };
+    arc_retain(&immortal.base);
+    arc_release(&immortal.base);
+    arc_release(&immortal.base);
+    CHECK(immortal.base.ref_count == TROVE_REF_IMMORTAL);
+}
+
+/**
+ * @brief Pools release their objects when popped, innermost first
+ */
+static void test_pools(void) {
+    autorelease_pool_push();
+    TroveString *outer = TroveString_create("outer");
+    arc_autorelease(&outer->base);
+    autorelease_pool_push();
+    TroveString *inner = TroveString_create("inner");
+    arc_retain(&inner->base);
+    arc_autorelease(&inner->base);
+    arc_autorelease(&inner->base);
+    // More objects than the initial capacity make the pool grow
+    for (int i = 0; i < 3 * TROVE_POOL_INITIAL_CAPACITY; i++) {
+        arc_autorelease(&TroveString_create("filler")->base);
+    }
+    CHECK(arc_leaks_count() == 2 + 3 * TROVE_POOL_INITIAL_CAPACITY);
+    autorelease_pool_pop();
+    CHECK(arc_leaks_count() == 1);
+    CHECK(outer->base.ref_count == 1);
+    autorelease_pool_pop();
+    CHECK(arc_leaks_count() == 0);
+    CHECK(current_autorelease_pool == NULL);
+
+    // Popping with no pool does nothing
+    autorelease_pool_pop();
+}
+
+/**
+ * @brief Objects autoreleased by a dealloc during a pop are released by the same pop
+ */
+static void test_pool_dealloc_autorelease(void) {
+    autorelease_pool_push();
+    TroveString *str = TroveString_create("held");
+    autorelease_pool_push();
+    CustomObject *custom = custom_create(&str->base);
+    arc_release(&str->base);
+    arc_autorelease(&custom->base);
+    custom_freed = 0;
+    autorelease_pool_pop();
+    CHECK(custom_freed == 1);
+    CHECK(arc_leaks_count() == 0);
+    CHECK(current_autorelease_pool->count == 0);
+    autorelease_pool_pop();
+
+    // The outermost pool, where deallocs autorelease more objects than a new
+    // pool holds, one of them a chain of further deallocs
+    autorelease_pool_push();
+    int customs = TROVE_POOL_INITIAL_CAPACITY * 3;
+    for (int i = 0; i < customs; i++) {
+        TroveString *held_str = TroveString_create("held");
+        CustomObject *outer = custom_create(&held_str->base);
+        arc_release(&held_str->base);
+        arc_autorelease(&outer->base);
+    }
+    CustomObject *inner = custom_create(NULL);
+    CustomObject *outer = custom_create(&inner->base);
+    arc_release(&inner->base);
+    arc_autorelease(&outer->base);
+    custom_freed = 0;
+    autorelease_pool_pop();
+    CHECK(custom_freed == customs + 2);
+    CHECK(current_autorelease_pool == NULL);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Batch retains and releases handle runs, NULLs and immortal objects
+ */
+static void test_batches(void) {
+    TroveString immortal = { { TROVE_REF_IMMORTAL, sizeof(TroveString), TroveString_dealloc }, "immortal", 8, 8, NULL, 0 };
+    TroveString *a = TroveString_create("a");
+    TroveString *b = TroveString_create("b");
+    // More entries than the release loop's prefetch batch
+    ARCObject *objects[40];
+    for (int i = 0; i < 40; i++) {
+        objects[i] = i % 5 == 4 ? NULL : i % 7 == 6 ? &immortal.base : i < 20 ? &a->base : &b->base;
+    }
+    size_t a_count = 0, b_count = 0;
+    for (int i = 0; i < 40; i++) {
+        a_count += objects[i] == &a->base;
+        b_count += objects[i] == &b->base;
+    }
+    arc_retain_all(objects, 40);
+    CHECK(a->base.ref_count == 1 + (int)a_count);
+    CHECK(b->base.ref_count == 1 + (int)b_count);
+    arc_release_all(objects, 40);
+    CHECK(a->base.ref_count == 1);
+    CHECK(b->base.ref_count == 1);
+    CHECK(immortal.base.ref_count == TROVE_REF_IMMORTAL);
+
+    ARCObject *last[3] = { &a->base, &b->base, &b->base };
+    arc_retain(&b->base);
+    arc_release_all(last, 3);
+    CHECK(arc_leaks_count() == 0);
+    arc_retain_all(NULL, 0);
+    arc_release_all(NULL, 0);
+}
+
+/**
+ * @brief Arrays retain their elements and release them when removed or freed
+ */
+static void test_arrays(void) {
+    TroveString *str = TroveString_create("element");
+    TroveArray *array = TroveArray_create(0);
+    TroveArray_append(array, &str->base);
+    TroveArray_append(array, NULL);
+    ARCObject *many[3] = { &str->base, &str->base, NULL };
+    TroveArray_append_all(array, many, 3);
+    CHECK(array->count == 5);
+    CHECK(str->base.ref_count == 4);
+
+    // Setting an element to itself keeps it alive
+    TroveArray_set(array, 0, &str->base);
+    CHECK(str->base.ref_count == 4);
+    TroveArray_set(array, 1, &str->base);
+    CHECK(str->base.ref_count == 5);
+    TroveArray_set(array, 99, &str->base);
+    CHECK(str->base.ref_count == 5);
+
+    TroveArray_remove_range(array, 1, 2);
+    CHECK(array->count == 3);
+    CHECK(str->base.ref_count == 3);
+    CHECK(TroveArray_get(array, 0) == &str->base);
+    CHECK(TroveArray_get(array, 2) == NULL);
+    CHECK(TroveArray_get(array, 3) == NULL);
+
+    // A shared array is copied; a unique one is kept
+    TroveArray *shared = array;
+    arc_retain(&shared->base);
+    TroveArray_make_unique(&array);
+    CHECK(array != shared);
+    CHECK(shared->base.ref_count == 1);
+    CHECK(str->base.ref_count == 5);
+    TroveArray *unique = array;
+    TroveArray_make_unique(&array);
+    CHECK(array == unique);
+
+    arc_release(&shared->base);
+    CHECK(str->base.ref_count == 3);
+    TroveArray_remove_all(array);
+    CHECK(str->base.ref_count == 1);
+    arc_release(&array->base);
+    arc_release(&str->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/** @brief Array that reentrant_dealloc inspects and appends to */
+static TroveArray *reentrant_array = NULL;
+
+/** @brief Elements of reentrant_array that a reentrant_dealloc found already freed */
+static int reentrant_stale = 0;
+
+/**
+ * @brief Deallocates an object after checking the elements left in reentrant_array and appending to it
+ */
+static void reentrant_dealloc(ARCObject *obj) {
+    for (size_t i = 0; i < reentrant_array->count; i++) {
+        ARCObject *element = reentrant_array->items[i];
+        if (element == obj || (element && element->ref_count <= 0)) {
+            reentrant_stale++;
+        }
+    }
+    TroveArray_append(reentrant_array, NULL);
+    arc_object_free(obj);
+}
+
+/**
+ * @brief Elements removed from an array are out of it before their dealloc runs
+ */
+static void test_array_remove_reentrant(void) {
+    reentrant_array = TroveArray_create(0);
+    TroveString *kept = TroveString_create("kept");
+    TroveArray_append(reentrant_array, &kept->base);
+    // More removed elements than remove_range copies aside on the stack
+    for (int i = 0; i < 100; i++) {
+        ARCObject *obj = (ARCObject *)malloc(sizeof(ARCObject));
+        if (!obj) {
+            fprintf(stderr, "Failed to allocate ARCObject.\n");
+            exit(1);
+        }
+        arc_object_init(obj, reentrant_dealloc, sizeof(ARCObject));
+        TroveArray_append(reentrant_array, obj);
+        arc_release(obj);
+    }
+    TroveArray_append(reentrant_array, &kept->base);
+    reentrant_stale = 0;
+    TroveArray_remove_range(reentrant_array, 1, 100);
+    CHECK(reentrant_stale == 0);
+    CHECK(reentrant_array->count == 102);
+    CHECK(TroveArray_get(reentrant_array, 0) == &kept->base);
+    CHECK(TroveArray_get(reentrant_array, 1) == &kept->base);
+    CHECK(TroveArray_get(reentrant_array, 2) == NULL);
+    arc_release(&reentrant_array->base);
+    arc_release(&kept->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Appending an array's own items works while the append moves its buffer
+ */
+static void test_array_self_append(void) {
+    TroveArray *array = TroveArray_create(0);
+    TroveString *first = TroveString_create("first");
+    TroveString *second = TroveString_create("second");
+    TroveArray_append(array, &first->base);
+    TroveArray_append(array, &second->base);
+    TroveArray_append(array, NULL);
+    // Every doubling regrows the buffer being read
+    for (int i = 0; i < 8; i++) {
+        TroveArray_append_all(array, array->items, array->count);
+    }
+    int pattern = array->count == 768;
+    for (size_t i = 0; pattern && i < array->count; i++) {
+        ARCObject *expected = i % 3 == 0 ? &first->base : i % 3 == 1 ? &second->base : NULL;
+        pattern = TroveArray_get(array, i) == expected;
+    }
+    CHECK(pattern);
+    CHECK(first->base.ref_count == 257);
+    // A sub-range from the middle of the array
+    TroveArray_append_all(array, array->items + 4, 2);
+    CHECK(array->count == 770);
+    CHECK(TroveArray_get(array, 768) == &second->base);
+    CHECK(TroveArray_get(array, 769) == NULL);
+    arc_release(&array->base);
+    CHECK(second->base.ref_count == 1);
+    arc_release(&first->base);
+    arc_release(&second->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Mutating a shared string copies it and leaves the original alone
+ */
+static void test_strings(void) {
+    TroveString *str = TroveString_create("copy");
+    TroveString *original = str;
+    arc_retain(&original->base);
+    TroveString_append_cstr(&str, " on write");
+    CHECK(str != original);
+    CHECK(strcmp(str->str, "copy on write") == 0);
+    CHECK(strcmp(original->str, "copy") == 0);
+    CHECK(original->base.ref_count == 1);
+    TroveString *unique = str;
+    TroveString_truncate(&str, 4);
+    CHECK(str == unique);
+    CHECK(strcmp(str->str, "copy") == 0);
+    CHECK(TroveString_hash(str) == TroveString_hash(original));
+    arc_release(&str->base);
+    arc_release(&original->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Appending a string's own bytes works while the append moves its buffer
+ */
+static void test_string_self_append(void) {
+    // Unique heap string: every doubling reallocs the buffer being read
+    TroveString *str = TroveString_create("ab");
+    for (int i = 0; i < 10; i++) {
+        TroveString_append(&str, str->str, str->length);
+    }
+    int pattern = str->length == 2048 && str->str[2048] == '\0';
+    for (size_t i = 0; pattern && i < str->length; i++) {
+        pattern = str->str[i] == (i % 2 ? 'b' : 'a');
+    }
+    CHECK(pattern);
+    arc_release(&str->base);
+
+    // A sub-range, from a string that is shared and therefore copied
+    str = TroveString_create("0123456789");
+    TroveString *shared = str;
+    arc_retain(&shared->base);
+    TroveString_append(&str, str->str + 3, 4);
+    CHECK(str != shared && strcmp(str->str, "01234567893456") == 0);
+    CHECK(strcmp(shared->str, "0123456789") == 0);
+    arc_release(&shared->base);
+    arc_release(&str->base);
+
+    // Bytes in a pool's arena chunk, copied to the heap by the append
+    autorelease_pool_push();
+    TroveStringBuilder builder;
+    TroveStringBuilder_init(&builder);
+    TroveStringBuilder_append_cstr(&builder, "arena");
+    str = TroveStringBuilder_finish(&builder);
+    autorelease_pool_pop();
+    TroveString_append(&str, str->str + 1, 3);
+    CHECK(strcmp(str->str, "arenaren") == 0 && str->storage == NULL);
+    arc_release(&str->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Counts objects tracked at the site given as context
+ */
+static void count_site(ARCObject *obj, const char *file, int line, void *context) {
+    (void)obj;
+    int *site = (int *)context;
+    if (file && strcmp(file, __FILE__) == 0 && line == site[0]) {
+        site[1]++;
+    }
+}
+
+/**
+ * @brief Creation macros tag their object even when their arguments create objects too
+ */
+static void test_sites(void) {
+    autorelease_pool_push();
+    int site[2] = { __LINE__ + 1, 0 };
+    TroveStringSlice *slice = Slice(String("site"), 0, 2);
+    arc_leaks_each(count_site, site);
+    CHECK(site[1] == 2);
+    CHECK(slice->length == 2);
+    autorelease_pool_pop();
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Runs a function in a child process and returns whether it aborted
+ */
+static int aborts(void (*function)(void)) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Keep the child's expected report out of the test output
+        if (!freopen("/dev/null", "w", stderr)) {
+            _exit(2);
+        }
+        function();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+/**
+ * @brief Releases a string twice
+ */
+static void double_release(void) {
+    TroveString *str = TroveString_create("twice");
+    arc_release(&str->base);
+    arc_release(&str->base);
+}
+
+/**
+ * @brief Retains an array element after the array freed it
+ */
+static void retain_after_free(void) {
+    TroveArray *array = TroveArray_create(1);
+    TroveString *str = TroveString_create("borrowed");
+    TroveArray_append(array, &str->base);
+    arc_release(&str->base);
+    arc_release(&array->base);
+    arc_retain(&str->base);
+}
+
+/**
+ * @brief Writes to a string after releasing it
+ */
+static void write_after_free(void) {
+    TroveString *str = TroveString_create("written");
+    arc_release(&str->base);
+    str->length = 3;
+    arc_guard_flush();
+}
+
+/**
+ * @brief The guard poisons freed objects and aborts on their use
+ */
+static void test_guard(void) {
+    arc_guard_enable(1);
+    TroveString *str = TroveString_create("poisoned");
+    arc_release(&str->base);
+    CHECK(str->base.ref_count == TROVE_GUARD_DEAD);
+    CHECK(aborts(double_release));
+    CHECK(aborts(retain_after_free));
+    CHECK(aborts(write_after_free));
+    arc_guard_enable(0);
+    CHECK(arc_leaks_count() == 0);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_retain_release();
+    test_pools();
+    test_pool_dealloc_autorelease();
+    test_batches();
+    test_arrays();
+    test_array_remove_reentrant();
+    test_array_self_append();
+    test_strings();
+    test_string_self_append();
+    test_sites();
+    test_guard();
+    arc_leaks_enable(0);
+    return check_done("core");
+}
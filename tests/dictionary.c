@@ -0,0 +1,244 @@
+/**
+ * @file dictionary.c
+ * @brief Tests of TroveDictionary against an array model, including copy-on-write snapshots
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "dictionary.h"
+#include "leaks.h"
+#include <string.h>
+
+/** @brief Distinct keys the random operations draw from */
+#define KEYS 3000
+
+/** @brief Random operations applied by the model test */
+#define OPERATIONS 200000
+
+/** @brief State of next_random */
+static uint64_t rng_state = 0xD1B54A32D192ED03ULL;
+
+/**
+ * @brief Returns the next value of a xorshift generator
+ */
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Creates the string for key number i, a new object on every call
+ */
+static TroveString* key_create(size_t i) {
+    char text[32];
+    snprintf(text, sizeof(text), "key-%zu", i * 7919);
+    return TroveString_create(text);
+}
+
+/**
+ * @brief Checks every key of a dictionary against model values, where -1 means absent
+ */
+static void check_model(TroveDictionary *dict, const int *model, TroveString *const *values) {
+    size_t expected = 0;
+    int same = 1;
+    for (size_t i = 0; i < KEYS; i++) {
+        TroveString *key = key_create(i);
+        ARCObject *value = TroveDictionary_get(dict, key);
+        same = same && value == (model[i] < 0 ? NULL : &values[model[i]]->base);
+        same = same && TroveDictionary_contains(dict, key) == (model[i] >= 0);
+        same = same && TroveDictionary_get_bytes(dict, key->str, key->length) == value;
+        expected += model[i] >= 0;
+        arc_release(&key->base);
+    }
+    CHECK(same);
+    CHECK(TroveDictionary_count(dict) == expected);
+
+    size_t cursor = 0;
+    size_t visited = 0;
+    TroveString *key;
+    ARCObject *value;
+    while (TroveDictionary_next(dict, &cursor, &key, &value)) {
+        visited++;
+        CHECK(TroveDictionary_get(dict, key) == value);
+    }
+    CHECK(visited == expected);
+}
+
+/**
+ * @brief Random sets, removals and clears agree with the model; snapshots taken on the way do not change
+ */
+static void test_model(void) {
+    TroveString *values[16];
+    for (int i = 0; i < 16; i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "value-%d", i);
+        values[i] = TroveString_create(text);
+    }
+    static int model[KEYS];
+    static int snapshot_model[KEYS];
+    for (size_t i = 0; i < KEYS; i++) {
+        model[i] = -1;
+    }
+    TroveDictionary *dict = TroveDictionary_create(0);
+    TroveDictionary *snapshot = NULL;
+
+    for (int op = 0; op < OPERATIONS; op++) {
+        size_t i = next_random() % KEYS;
+        uint64_t kind = next_random() % 100;
+        if (kind == 0 && op % 7 == 0) {
+            // Keep a snapshot sharing the dictionary; the next mutation copies it
+            if (snapshot) {
+                check_model(snapshot, snapshot_model, values);
+                arc_release(&snapshot->base);
+            }
+            arc_retain(&dict->base);
+            snapshot = dict;
+            memcpy(snapshot_model, model, sizeof(model));
+        } else if (kind == 1 && op % 50 == 0) {
+            TroveDictionary_make_unique(&dict);
+            TroveDictionary_remove_all(dict);
+            for (size_t k = 0; k < KEYS; k++) {
+                model[k] = -1;
+            }
+        } else if (kind < 60) {
+            int v = (int)(next_random() % 16);
+            TroveString *key = key_create(i);
+            TroveDictionary_make_unique(&dict);
+            TroveDictionary_set(dict, key, &values[v]->base);
+            arc_release(&key->base);
+            model[i] = v;
+        } else {
+            TroveString *key = key_create(i);
+            TroveDictionary_make_unique(&dict);
+            CHECK(TroveDictionary_remove(dict, key) == (model[i] >= 0));
+            arc_release(&key->base);
+            model[i] = -1;
+        }
+        if (op % 20000 == 0) {
+            check_model(dict, model, values);
+        }
+    }
+    check_model(dict, model, values);
+    if (snapshot) {
+        check_model(snapshot, snapshot_model, values);
+        arc_release(&snapshot->base);
+    }
+    arc_release(&dict->base);
+    for (int i = 0; i < 16; i++) {
+        CHECK(values[i]->base.ref_count == 1);
+        arc_release(&values[i]->base);
+    }
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Replacing a value keeps the stored key; removing during iteration visits every entry once
+ */
+static void test_keys_and_iteration(void) {
+    TroveDictionary *dict = TroveDictionary_create(4);
+    TroveString *first = TroveString_create("same");
+    TroveString *second = TroveString_create("same");
+    TroveDictionary_set(dict, first, NULL);
+    TroveDictionary_set(dict, second, &second->base);
+    CHECK(TroveDictionary_count(dict) == 1);
+    CHECK(first->base.ref_count == 2 && second->base.ref_count == 2);
+    size_t cursor = 0;
+    TroveString *key;
+    ARCObject *value;
+    CHECK(TroveDictionary_next(dict, &cursor, &key, &value) && key == first && value == &second->base);
+    // A NULL value is stored and reported as absent by get, but contains sees the key
+    TroveDictionary_set(dict, first, NULL);
+    CHECK(TroveDictionary_get(dict, second) == NULL && TroveDictionary_contains(dict, second));
+    arc_release(&first->base);
+    arc_release(&second->base);
+
+    for (size_t i = 0; i < 1000; i++) {
+        TroveString *k = key_create(i);
+        TroveDictionary_set(dict, k, &k->base);
+        arc_release(&k->base);
+    }
+    cursor = 0;
+    size_t removed = 0;
+    while (TroveDictionary_next(dict, &cursor, &key, &value)) {
+        arc_retain(&key->base);
+        CHECK(TroveDictionary_remove(dict, key));
+        arc_release(&key->base);
+        removed++;
+    }
+    CHECK(removed == 1001);
+    CHECK(TroveDictionary_count(dict) == 0);
+    arc_release(&dict->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/** @brief Dictionary that reentrant_dealloc inspects and adds to */
+static TroveDictionary *reentrant_dict = NULL;
+
+/** @brief Entries of reentrant_dict that a reentrant_dealloc found being freed */
+static int reentrant_stale = 0;
+
+/** @brief Number of reentrant_dealloc calls so far */
+static size_t reentrant_calls = 0;
+
+/**
+ * @brief Deallocates an object after checking the entries left in reentrant_dict and adding one
+ */
+static void reentrant_dealloc(ARCObject *obj) {
+    size_t cursor = 0;
+    TroveString *key;
+    ARCObject *value;
+    while (TroveDictionary_next(reentrant_dict, &cursor, &key, &value)) {
+        if (value == obj || key->base.ref_count <= 0 || (value && value->ref_count <= 0)) {
+            reentrant_stale++;
+        }
+    }
+    TroveString *added = key_create(KEYS + reentrant_calls++);
+    TroveDictionary_set(reentrant_dict, added, NULL);
+    arc_release(&added->base);
+    arc_object_free(obj);
+}
+
+/**
+ * @brief Entries removed by remove_all are out of the dictionary before their values' dealloc runs
+ */
+static void test_remove_all_reentrant(void) {
+    reentrant_dict = TroveDictionary_create(0);
+    // More entries than trove_table_clear sets aside on the stack
+    for (size_t i = 0; i < 100; i++) {
+        ARCObject *obj = (ARCObject *)malloc(sizeof(ARCObject));
+        if (!obj) {
+            fprintf(stderr, "Failed to allocate ARCObject.\n");
+            exit(1);
+        }
+        arc_object_init(obj, reentrant_dealloc, sizeof(ARCObject));
+        TroveString *key = key_create(i);
+        TroveDictionary_set(reentrant_dict, key, obj);
+        arc_release(&key->base);
+        arc_release(obj);
+    }
+    reentrant_stale = 0;
+    reentrant_calls = 0;
+    TroveDictionary_remove_all(reentrant_dict);
+    CHECK(reentrant_stale == 0);
+    CHECK(reentrant_calls == 100);
+    CHECK(TroveDictionary_count(reentrant_dict) == 100);
+    TroveString *key = key_create(0);
+    CHECK(!TroveDictionary_contains(reentrant_dict, key));
+    arc_release(&key->base);
+    key = key_create(KEYS + 99);
+    CHECK(TroveDictionary_contains(reentrant_dict, key));
+    arc_release(&key->base);
+    arc_release(&reentrant_dict->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_model();
+    test_keys_and_iteration();
+    test_remove_all_reentrant();
+    arc_leaks_enable(0);
+    return check_done("dictionary");
+}
@@ -0,0 +1,651 @@
+/**
+ * @file fuzz.c
+ * @brief Fuzz harness: random ARC operations checked against a reference model
+ *
+ * Each input is decoded as a sequence of operations: pushing and popping
+ * autorelease pools, creating strings and arrays, retain, release and
+ * autorelease, batch retains and releases, and array appends, replacements,
+ * removals and copy-on-write copies. A reference model follows every
+ * operation with the count each object should have, the references the
+ * harness itself holds, the pools' contents and the arrays' elements; after
+ * each operation the real objects are compared with it. The guard keeps
+ * freed objects poisoned, so the model also checks that objects are freed
+ * exactly when their last reference goes, and the leak registry's count
+ * must equal the model's live objects. Any difference aborts.
+ *
+ * The harness only ever releases references it holds, and arrays only
+ * hold older objects so no cycles form; everything is released at the end
+ * of each input. A NULL element and an immortal string are mixed into
+ * batches and arrays.
+ *
+ * Builds:
+ * - `make fuzz` (clang): a libFuzzer target, build/fuzz/libfuzzer
+ * - `make fuzz-afl` (afl-clang-fast): build/fuzz/afl, which runs the files
+ *   named on its command line (`afl-fuzz -i in -o out -- build/fuzz/afl @@`),
+ *   "-" standing for stdin
+ * - the test targets: with no arguments, runs FUZZ_SMOKE_INPUTS random
+ *   inputs from the seed in TROVE_FUZZ_SEED (default 1)
+ */
+
+#include "trove.h"
+#include "array.h"
+#include "guard.h"
+#include "leaks.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Most objects created by one input */
+#define FUZZ_MAX_OBJECTS 256
+
+/** @brief Most nested pools */
+#define FUZZ_MAX_POOLS 8
+
+/** @brief Most entries in one batch operation */
+#define FUZZ_MAX_BATCH 16
+
+/** @brief Random inputs run when no input files are given */
+#define FUZZ_SMOKE_INPUTS 3000
+
+/** @brief Longest random input in bytes */
+#define FUZZ_SMOKE_LENGTH 768
+
+/** @brief Model id of a NULL element */
+#define FUZZ_NULL (-1)
+
+/** @brief Model id of the immortal string */
+#define FUZZ_IMMORTAL (-2)
+
+/** @brief Operations, selected by an input byte modulo FUZZ_OPS */
+enum {
+    FUZZ_PUSH,
+    FUZZ_POP,
+    FUZZ_STRING,
+    FUZZ_ARRAY,
+    FUZZ_RETAIN,
+    FUZZ_RELEASE,
+    FUZZ_AUTORELEASE,
+    FUZZ_APPEND,
+    FUZZ_APPEND_ALL,
+    FUZZ_SET,
+    FUZZ_REMOVE_RANGE,
+    FUZZ_MAKE_UNIQUE,
+    FUZZ_RETAIN_ALL,
+    FUZZ_RELEASE_ALL,
+    FUZZ_OPS
+};
+
+/**
+ * @brief A growable list of model ids
+ */
+typedef struct FuzzList {
+    int *ids;           /**< Entries */
+    size_t count;       /**< Entries used */
+    size_t capacity;    /**< Entries allocated */
+} FuzzList;
+
+/**
+ * @brief What the model expects of one object
+ */
+typedef struct FuzzObject {
+    ARCObject *obj;     /**< The real object */
+    int is_array;       /**< Nonzero for a TroveArray, zero for a TroveString */
+    int count;          /**< Expected reference count */
+    int owned;          /**< References held by the harness */
+    int freed;          /**< Nonzero once the count reached zero */
+    FuzzList items;     /**< Expected elements of an array */
+} FuzzObject;
+
+/** @brief Objects created by the current input, by model id */
+static FuzzObject fuzz_objects[FUZZ_MAX_OBJECTS];
+
+/** @brief Entries used in fuzz_objects */
+static int fuzz_object_count = 0;
+
+/** @brief Objects autoreleased into each pushed pool, outermost first */
+static FuzzList fuzz_pools[FUZZ_MAX_POOLS];
+
+/** @brief Pools pushed by the current input */
+static int fuzz_depth = 0;
+
+/** @brief The current input */
+static const uint8_t *fuzz_data = NULL;
+
+/** @brief Bytes in fuzz_data */
+static size_t fuzz_size = 0;
+
+/** @brief Bytes of fuzz_data consumed */
+static size_t fuzz_offset = 0;
+
+/** @brief Operation being run, for failure reports */
+static int fuzz_operation = 0;
+
+/** @brief An immortal string that batches and arrays may contain */
+static TroveString fuzz_immortal = {
+    { TROVE_REF_IMMORTAL, sizeof(TroveString), TroveString_dealloc }, "immortal", 8, 8, NULL, 0
+};
+
+/**
+ * @brief Reports a difference between the library and the model and aborts
+ */
+static void fuzz_fail(const char *what, int id) {
+    fprintf(stderr, "fuzz: %s (object %d, operation %d at input offset %zu)\n", what, id, fuzz_operation, fuzz_offset);
+    abort();
+}
+
+/**
+ * @brief Appends an id to a list
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static void fuzz_list_add(FuzzList *list, int id) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 8;
+        int *ids = (int *)realloc(list->ids, capacity * sizeof(int));
+        if (!ids) {
+            fprintf(stderr, "Failed to allocate fuzz list.\n");
+            exit(1);
+        }
+        list->ids = ids;
+        list->capacity = capacity;
+    }
+    list->ids[list->count++] = id;
+}
+
+/**
+ * @brief Returns the next input byte, or 0 past the end
+ */
+static uint8_t fuzz_byte(void) {
+    return fuzz_offset < fuzz_size ? fuzz_data[fuzz_offset++] : 0;
+}
+
+/**
+ * @brief Returns the real object of a model id, NULL or the immortal string included
+ */
+static ARCObject* fuzz_real(int id) {
+    if (id == FUZZ_NULL) {
+        return NULL;
+    }
+    if (id == FUZZ_IMMORTAL) {
+        return &fuzz_immortal.base;
+    }
+    return fuzz_objects[id].obj;
+}
+
+/**
+ * @brief Drops n references from the model, freeing the object and releasing its elements at zero
+ */
+static void fuzz_model_release(int id, int n) {
+    if (id < 0) {
+        return;
+    }
+    FuzzObject *object = &fuzz_objects[id];
+    object->count -= n;
+    if (object->count < 0) {
+        fuzz_fail("model released a freed object", id);
+    }
+    if (object->count == 0) {
+        object->freed = 1;
+        for (size_t i = 0; i < object->items.count; i++) {
+            fuzz_model_release(object->items.ids[i], 1);
+        }
+        object->items.count = 0;
+    }
+}
+
+/**
+ * @brief Adds one reference to the model, unless id is NULL or immortal
+ */
+static void fuzz_model_retain(int id) {
+    if (id >= 0) {
+        fuzz_objects[id].count++;
+    }
+}
+
+/**
+ * @brief Enters a new object, owned once by the harness, in the model
+ *
+ * @return Its model id
+ */
+static int fuzz_model_add(ARCObject *obj, int is_array) {
+    FuzzObject *object = &fuzz_objects[fuzz_object_count];
+    object->obj = obj;
+    object->is_array = is_array;
+    object->count = 1;
+    object->owned = 1;
+    object->freed = 0;
+    object->items.count = 0;
+    return fuzz_object_count++;
+}
+
+/**
+ * @brief Picks a live object from the next input byte
+ *
+ * @param arrays_only Nonzero to pick only arrays
+ * @param owned_only Nonzero to pick only objects the harness holds a reference to
+ * @return Its model id, or -1 if there is none
+ */
+static int fuzz_pick(int arrays_only, int owned_only) {
+    if (!fuzz_object_count) {
+        fuzz_byte();
+        return -1;
+    }
+    int start = fuzz_byte() % fuzz_object_count;
+    for (int i = 0; i < fuzz_object_count; i++) {
+        int id = (start + i) % fuzz_object_count;
+        FuzzObject *object = &fuzz_objects[id];
+        if (!object->freed && (!arrays_only || object->is_array) && (!owned_only || object->owned)) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Picks an element for an array: NULL, the immortal string or a live object older than the array
+ *
+ * @param parent Model id of the array
+ */
+static int fuzz_pick_element(int parent) {
+    uint8_t b = fuzz_byte();
+    if (b % 8 == 0) {
+        return FUZZ_NULL;
+    }
+    if (b % 8 == 1) {
+        return FUZZ_IMMORTAL;
+    }
+    if (parent == 0) {
+        return FUZZ_NULL;
+    }
+    int start = b % parent;
+    for (int i = 0; i < parent; i++) {
+        int id = (start + i) % parent;
+        if (!fuzz_objects[id].freed) {
+            return id;
+        }
+    }
+    return FUZZ_NULL;
+}
+
+/**
+ * @brief Compares every object with the model and aborts on a difference
+ */
+static void fuzz_verify(void) {
+    size_t live = 0;
+    for (int id = 0; id < fuzz_object_count; id++) {
+        FuzzObject *object = &fuzz_objects[id];
+        if (object->freed) {
+            // The guard's quarantine is unbounded, so freed objects stay poisoned
+            if (object->obj->ref_count != TROVE_GUARD_DEAD) {
+                fuzz_fail("object not freed when its count reached zero", id);
+            }
+            continue;
+        }
+        live++;
+        if (object->obj->ref_count == TROVE_GUARD_DEAD) {
+            fuzz_fail("object freed while referenced", id);
+        }
+        if (object->obj->ref_count != object->count) {
+            fprintf(stderr, "fuzz: count %d, model %d\n", object->obj->ref_count, object->count);
+            fuzz_fail("reference count differs from the model", id);
+        }
+        if (object->is_array) {
+            TroveArray *array = (TroveArray *)object->obj;
+            if (array->count != object->items.count) {
+                fuzz_fail("array count differs from the model", id);
+            }
+            for (size_t i = 0; i < array->count; i++) {
+                if (array->items[i] != fuzz_real(object->items.ids[i])) {
+                    fuzz_fail("array element differs from the model", id);
+                }
+            }
+        }
+    }
+    if (arc_leaks_count() != live) {
+        fuzz_fail("live object count differs from the model", -1);
+    }
+    if (fuzz_immortal.base.ref_count != TROVE_REF_IMMORTAL) {
+        fuzz_fail("immortal object's count changed", FUZZ_IMMORTAL);
+    }
+}
+
+/**
+ * @brief Pops the innermost pool, in the library and the model
+ */
+static void fuzz_pop(void) {
+    FuzzList *pool = &fuzz_pools[--fuzz_depth];
+    autorelease_pool_pop();
+    for (size_t i = 0; i < pool->count; i++) {
+        fuzz_model_release(pool->ids[i], 1);
+    }
+    pool->count = 0;
+}
+
+/**
+ * @brief Fills a batch of elements for a batch operation, with runs of repeats
+ *
+ * @param ids Receives model ids
+ * @param limit Objects with ids below limit may be picked
+ * @return Number of entries
+ */
+static size_t fuzz_batch(int *ids, int limit) {
+    size_t count = fuzz_byte() % (FUZZ_MAX_BATCH + 1);
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && fuzz_byte() % 3 == 0) {
+            ids[i] = ids[i - 1];
+        } else {
+            ids[i] = fuzz_pick_element(limit);
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Runs the operation selected by the next input byte
+ */
+static void fuzz_step(void) {
+    int op = fuzz_byte() % FUZZ_OPS;
+    int ids[FUZZ_MAX_BATCH];
+    ARCObject *batch[FUZZ_MAX_BATCH];
+    int id;
+    switch (op) {
+    case FUZZ_PUSH:
+        if (fuzz_depth < FUZZ_MAX_POOLS) {
+            autorelease_pool_push();
+            fuzz_pools[fuzz_depth++].count = 0;
+        }
+        break;
+    case FUZZ_POP:
+        if (fuzz_depth > 0) {
+            fuzz_pop();
+        }
+        break;
+    case FUZZ_STRING:
+    case FUZZ_ARRAY:
+        if (fuzz_object_count < FUZZ_MAX_OBJECTS) {
+            size_t length = fuzz_byte() % 24;
+            if (op == FUZZ_STRING) {
+                size_t available = fuzz_size - fuzz_offset < length ? fuzz_size - fuzz_offset : length;
+                TroveString *str = TroveString_create_with_length((const char *)fuzz_data + fuzz_offset, available);
+                fuzz_offset += available;
+                fuzz_model_add(&str->base, 0);
+            } else {
+                fuzz_model_add(&TroveArray_create(length % 4)->base, 1);
+            }
+        }
+        break;
+    case FUZZ_RETAIN:
+        if ((id = fuzz_pick(0, 0)) >= 0) {
+            arc_retain(fuzz_objects[id].obj);
+            fuzz_objects[id].count++;
+            fuzz_objects[id].owned++;
+        }
+        break;
+    case FUZZ_RELEASE:
+        if ((id = fuzz_pick(0, 1)) >= 0) {
+            fuzz_objects[id].owned--;
+            arc_release(fuzz_objects[id].obj);
+            fuzz_model_release(id, 1);
+        }
+        break;
+    case FUZZ_AUTORELEASE:
+        if (fuzz_depth > 0 && (id = fuzz_pick(0, 1)) >= 0) {
+            fuzz_objects[id].owned--;
+            arc_autorelease(fuzz_objects[id].obj);
+            fuzz_list_add(&fuzz_pools[fuzz_depth - 1], id);
+        }
+        break;
+    case FUZZ_APPEND:
+        if ((id = fuzz_pick(1, 0)) >= 0) {
+            int element = fuzz_pick_element(id);
+            TroveArray_append((TroveArray *)fuzz_objects[id].obj, fuzz_real(element));
+            fuzz_model_retain(element);
+            fuzz_list_add(&fuzz_objects[id].items, element);
+        }
+        break;
+    case FUZZ_APPEND_ALL:
+        if ((id = fuzz_pick(1, 0)) >= 0) {
+            size_t count = fuzz_batch(ids, id);
+            for (size_t i = 0; i < count; i++) {
+                batch[i] = fuzz_real(ids[i]);
+            }
+            TroveArray_append_all((TroveArray *)fuzz_objects[id].obj, batch, count);
+            for (size_t i = 0; i < count; i++) {
+                fuzz_model_retain(ids[i]);
+                fuzz_list_add(&fuzz_objects[id].items, ids[i]);
+            }
+        }
+        break;
+    case FUZZ_SET:
+        if ((id = fuzz_pick(1, 0)) >= 0) {
+            FuzzList *items = &fuzz_objects[id].items;
+            size_t index = fuzz_byte() % (items->count + 1);
+            int element = fuzz_pick_element(id);
+            TroveArray_set((TroveArray *)fuzz_objects[id].obj, index, fuzz_real(element));
+            if (index < items->count) {
+                int old = items->ids[index];
+                fuzz_model_retain(element);
+                items->ids[index] = element;
+                fuzz_model_release(old, 1);
+            }
+        }
+        break;
+    case FUZZ_REMOVE_RANGE:
+        if ((id = fuzz_pick(1, 0)) >= 0) {
+            FuzzList *items = &fuzz_objects[id].items;
+            size_t offset = fuzz_byte() % (items->count + 2);
+            size_t length = fuzz_byte() % 8;
+            TroveArray_remove_range((TroveArray *)fuzz_objects[id].obj, offset, length);
+            if (offset > items->count) {
+                offset = items->count;
+            }
+            if (length > items->count - offset) {
+                length = items->count - offset;
+            }
+            if (length == 0) {
+                break;
+            }
+            for (size_t i = offset; i < offset + length; i++) {
+                fuzz_model_release(items->ids[i], 1);
+            }
+            memmove(items->ids + offset, items->ids + offset + length, (items->count - offset - length) * sizeof(int));
+            items->count -= length;
+        }
+        break;
+    case FUZZ_MAKE_UNIQUE:
+        if ((id = fuzz_pick(1, 1)) >= 0 && fuzz_object_count < FUZZ_MAX_OBJECTS) {
+            TroveArray *array = (TroveArray *)fuzz_objects[id].obj;
+            TroveArray_make_unique(&array);
+            if (fuzz_objects[id].count == 1) {
+                if (&array->base != fuzz_objects[id].obj) {
+                    fuzz_fail("unique array was copied", id);
+                }
+                break;
+            }
+            int copy = fuzz_model_add(&array->base, 1);
+            for (size_t i = 0; i < fuzz_objects[id].items.count; i++) {
+                fuzz_model_retain(fuzz_objects[id].items.ids[i]);
+                fuzz_list_add(&fuzz_objects[copy].items, fuzz_objects[id].items.ids[i]);
+            }
+            fuzz_objects[id].owned--;
+            fuzz_model_release(id, 1);
+        }
+        break;
+    case FUZZ_RETAIN_ALL: {
+        size_t count = fuzz_batch(ids, fuzz_object_count);
+        for (size_t i = 0; i < count; i++) {
+            batch[i] = fuzz_real(ids[i]);
+        }
+        arc_retain_all(batch, count);
+        for (size_t i = 0; i < count; i++) {
+            fuzz_model_retain(ids[i]);
+            if (ids[i] >= 0) {
+                fuzz_objects[ids[i]].owned++;
+            }
+        }
+        break;
+    }
+    case FUZZ_RELEASE_ALL: {
+        // Only references the harness holds, each at most once
+        size_t count = fuzz_byte() % (FUZZ_MAX_BATCH + 1);
+        size_t used = 0;
+        for (size_t i = 0; i < count; i++) {
+            int repeat = used > 0 && ids[used - 1] >= 0 && fuzz_objects[ids[used - 1]].owned > 0 && fuzz_byte() % 2;
+            id = repeat ? ids[used - 1] : fuzz_pick(0, 1);
+            if (id < 0) {
+                ids[used++] = fuzz_byte() % 2 ? FUZZ_NULL : FUZZ_IMMORTAL;
+                continue;
+            }
+            fuzz_objects[id].owned--;
+            ids[used++] = id;
+        }
+        for (size_t i = 0; i < used; i++) {
+            batch[i] = fuzz_real(ids[i]);
+        }
+        arc_release_all(batch, used);
+        for (size_t i = 0; i < used; i++) {
+            fuzz_model_release(ids[i], 1);
+        }
+        break;
+    }
+    }
+}
+
+/**
+ * @brief Runs one input, then releases everything and checks that all was freed
+ */
+static void fuzz_run(const uint8_t *data, size_t size) {
+    fuzz_data = data;
+    fuzz_size = size;
+    fuzz_offset = 0;
+    fuzz_object_count = 0;
+    fuzz_depth = 0;
+    for (fuzz_operation = 0; fuzz_offset < fuzz_size; fuzz_operation++) {
+        fuzz_step();
+        fuzz_verify();
+    }
+    for (int id = 0; id < fuzz_object_count; id++) {
+        while (fuzz_objects[id].owned > 0) {
+            fuzz_objects[id].owned--;
+            arc_release(fuzz_objects[id].obj);
+            fuzz_model_release(id, 1);
+        }
+    }
+    while (fuzz_depth > 0) {
+        fuzz_pop();
+    }
+    fuzz_verify();
+    for (int id = 0; id < fuzz_object_count; id++) {
+        if (!fuzz_objects[id].freed) {
+            fuzz_fail("object still referenced after everything was released", id);
+        }
+    }
+    arc_guard_flush();
+}
+
+/**
+ * @brief Turns on the guard and leak tracking the model relies on, once
+ */
+static void fuzz_setup(void) {
+    static int done = 0;
+    if (done) {
+        return;
+    }
+    done = 1;
+    arc_leaks_enable(1);
+    arc_guard_set_quarantine((size_t)-1);
+    if (!getenv("TROVE_GUARD_FRAMES")) {
+        arc_guard_set_frames(0);
+    }
+    arc_guard_enable(1);
+}
+
+/**
+ * @brief libFuzzer entry point
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    fuzz_setup();
+    fuzz_run(data, size);
+    return 0;
+}
+
+#if !defined(TROVE_FUZZ_LIBFUZZER)
+/**
+ * @brief Reads a whole file, or stdin for "-"
+ *
+ * If allocation fails, the program will exit with an error message.
+ *
+ * @return The bytes (to free), or NULL if the file cannot be opened
+ */
+static uint8_t* fuzz_read(const char *path, size_t *size) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    size_t capacity = 4096;
+    uint8_t *bytes = (uint8_t *)malloc(capacity);
+    *size = 0;
+    for (;;) {
+        if (!bytes) {
+            fprintf(stderr, "Failed to allocate fuzz input.\n");
+            exit(1);
+        }
+        *size += fread(bytes + *size, 1, capacity - *size, file);
+        if (*size < capacity) {
+            break;
+        }
+        capacity *= 2;
+        uint8_t *grown = (uint8_t *)realloc(bytes, capacity);
+        if (!grown) {
+            free(bytes);
+        }
+        bytes = grown;
+    }
+    if (file != stdin) {
+        fclose(file);
+    }
+    return bytes;
+}
+
+/**
+ * @brief Runs the files given as arguments, or random inputs when there are none
+ */
+int main(int argc, char **argv) {
+    fuzz_setup();
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            size_t size;
+            uint8_t *bytes = fuzz_read(argv[i], &size);
+            if (!bytes) {
+                perror(argv[i]);
+                return 1;
+            }
+            fuzz_run(bytes, size);
+            free(bytes);
+        }
+        return 0;
+    }
+    const char *seed_text = getenv("TROVE_FUZZ_SEED");
+    uint64_t seed = seed_text && *seed_text ? strtoull(seed_text, NULL, 10) : 1;
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    uint8_t bytes[FUZZ_SMOKE_LENGTH];
+    size_t operations = 0;
+    for (int input = 0; input < FUZZ_SMOKE_INPUTS; input++) {
+        // xorshift64*
+        for (size_t i = 0; i < FUZZ_SMOKE_LENGTH; i++) {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            bytes[i] = (uint8_t)((state * 0x2545F4914F6CDD1Dull) >> 56);
+        }
+        fuzz_run(bytes, ((size_t)bytes[0] << 8 | bytes[1]) % (FUZZ_SMOKE_LENGTH + 1));
+        operations += (size_t)fuzz_operation;
+    }
+    printf("fuzz: ok, %d random inputs, %zu operations (seed %llu)\n", FUZZ_SMOKE_INPUTS, operations,
+           (unsigned long long)seed);
+    return 0;
+}
+#endif
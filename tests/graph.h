@@ -0,0 +1,199 @@
+/**
+ * @file graph.h
+ * @brief A graph of every built-in type and a structural comparison, for the serial and image tests
+ */
+
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "trove.h"
+#include "array.h"
+#include "dictionary.h"
+#include "set.h"
+#include "vector.h"
+#include "map.h"
+#include "data.h"
+#include <string.h>
+
+/**
+ * @brief Creates a string of the form prefix-n
+ */
+static inline TroveString* graph_string(const char *prefix, size_t n) {
+    char text[64];
+    snprintf(text, sizeof(text), "%s-%zu", prefix, n);
+    return TroveString_create(text);
+}
+
+/**
+ * @brief Builds a graph holding every built-in type, with count entries per collection
+ *
+ * The root is an array of: a shared string, an empty string, NULL, a long
+ * string, a dictionary, a set, a vector, a map, data bytes, a nested array
+ * and the shared string again. The collections also refer to the shared
+ * string, so a decoder that restores sharing returns one object for all of
+ * its uses.
+ *
+ * @param count Entries per collection
+ * @return The root array with a reference count of 1
+ */
+static inline TroveArray* graph_create(size_t count) {
+    TroveArray *root = TroveArray_create(0);
+    TroveString *shared = TroveString_create("shared");
+    TroveArray_append(root, &shared->base);
+    TroveString *empty = TroveString_create("");
+    TroveArray_append(root, &empty->base);
+    arc_release(&empty->base);
+    TroveArray_append(root, NULL);
+    TroveString *long_text = TroveString_create_with_length(NULL, 5000);
+    for (size_t i = 0; i < long_text->length; i++) {
+        long_text->str[i] = (char)(' ' + i % 95);
+    }
+    TroveArray_append(root, &long_text->base);
+    arc_release(&long_text->base);
+
+    TroveDictionary *dict = TroveDictionary_create(0);
+    TroveSet *set = TroveSet_create(0);
+    TroveVector *vector = TroveVector_create();
+    TroveMap *map = TroveMap_create();
+    TroveArray *nested = TroveArray_create(0);
+    for (size_t i = 0; i < count; i++) {
+        TroveString *key = graph_string("key", i);
+        TroveString *value = graph_string("value", i * 31);
+        ARCObject *stored = i % 5 == 0 ? &shared->base : i % 7 == 0 ? NULL : &value->base;
+        TroveDictionary_set(dict, key, stored);
+        TroveSet_add(set, key);
+        TroveVector_push_in_place(&vector, stored);
+        TroveMap_set_in_place(&map, key, stored);
+        TroveArray_append(nested, &key->base);
+        arc_release(&key->base);
+        arc_release(&value->base);
+    }
+    TroveArray_append(root, &dict->base);
+    TroveArray_append(root, &set->base);
+    TroveArray_append(root, &vector->base);
+    TroveArray_append(root, &map->base);
+    arc_release(&dict->base);
+    arc_release(&set->base);
+    arc_release(&vector->base);
+    arc_release(&map->base);
+
+    unsigned char bytes[300];
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        bytes[i] = (unsigned char)(i * 7);
+    }
+    TroveData *data = TroveData_create(bytes, sizeof(bytes));
+    TroveArray_append(root, &data->base);
+    arc_release(&data->base);
+    TroveArray_append(root, &nested->base);
+    arc_release(&nested->base);
+    TroveArray_append(root, &shared->base);
+    arc_release(&shared->base);
+    return root;
+}
+
+/**
+ * @brief Returns whether two strings hold the same bytes
+ */
+static inline int graph_strings_equal(TroveString *a, TroveString *b) {
+    return a->length == b->length && memcmp(a->str, b->str, a->length) == 0 && b->str[b->length] == '\0';
+}
+
+/**
+ * @brief Returns whether two graphs of built-in types have the same structure and contents
+ *
+ * Dictionaries, sets and maps are compared by looking each key of one up
+ * in the other, so their iteration order does not matter.
+ */
+static inline int graph_equal(ARCObject *a, ARCObject *b) {
+    if (!a || !b) {
+        return a == b;
+    }
+    if (a->dealloc != b->dealloc) {
+        return 0;
+    }
+    if (a->dealloc == TroveString_dealloc) {
+        return graph_strings_equal((TroveString *)a, (TroveString *)b);
+    }
+    if (a->dealloc == TroveData_dealloc) {
+        TroveData *x = (TroveData *)a;
+        TroveData *y = (TroveData *)b;
+        return x->length == y->length && (x->length == 0 || memcmp(x->bytes, y->bytes, x->length) == 0);
+    }
+    if (a->dealloc == TroveArray_dealloc) {
+        TroveArray *x = (TroveArray *)a;
+        TroveArray *y = (TroveArray *)b;
+        if (x->count != y->count) {
+            return 0;
+        }
+        for (size_t i = 0; i < x->count; i++) {
+            if (!graph_equal(x->items[i], y->items[i])) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (a->dealloc == TroveDictionary_dealloc) {
+        TroveDictionary *x = (TroveDictionary *)a;
+        TroveDictionary *y = (TroveDictionary *)b;
+        if (TroveDictionary_count(x) != TroveDictionary_count(y)) {
+            return 0;
+        }
+        size_t cursor = 0;
+        TroveString *key;
+        ARCObject *value;
+        while (TroveDictionary_next(x, &cursor, &key, &value)) {
+            if (!TroveDictionary_contains(y, key) || !graph_equal(value, TroveDictionary_get(y, key))) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (a->dealloc == TroveSet_dealloc) {
+        TroveSet *x = (TroveSet *)a;
+        TroveSet *y = (TroveSet *)b;
+        if (TroveSet_count(x) != TroveSet_count(y)) {
+            return 0;
+        }
+        size_t cursor = 0;
+        TroveString *key;
+        while ((key = TroveSet_next(x, &cursor))) {
+            if (!TroveSet_contains(y, key)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (a->dealloc == TroveVector_dealloc) {
+        TroveVector *x = (TroveVector *)a;
+        TroveVector *y = (TroveVector *)b;
+        if (TroveVector_count(x) != TroveVector_count(y)) {
+            return 0;
+        }
+        for (size_t i = 0; i < TroveVector_count(x); i++) {
+            if (!graph_equal(TroveVector_get(x, i), TroveVector_get(y, i))) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (a->dealloc == TroveMap_dealloc) {
+        TroveMap *x = (TroveMap *)a;
+        TroveMap *y = (TroveMap *)b;
+        if (TroveMap_count(x) != TroveMap_count(y)) {
+            return 0;
+        }
+        TroveMapIter it;
+        TroveString *key;
+        ARCObject *value;
+        TroveMap_iter_init(&it, x);
+        while (TroveMap_iter_next(&it, &key, &value)) {
+            if (!TroveMap_contains(y, key) || !graph_equal(value, TroveMap_get(y, key))) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+#endif // GRAPH_H
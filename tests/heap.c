@@ -0,0 +1,282 @@
+/**
+ * @file heap.c
+ * @brief Tests of heap snapshots: nodes, edges, types and sites read back from the file
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "array.h"
+#include "heap.h"
+#include "leaks.h"
+#include "stats.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/** @brief Objects in the graph built by test_snapshot */
+#define GRAPH_NODES 7
+
+/**
+ * @brief Custom object holding one retained child, known to snapshots by registration
+ */
+typedef struct Holder {
+    ARCObject base;        /**< Inheritance: must be the first member */
+    ARCObject *child;      /**< Retained child, or NULL */
+} Holder;
+
+/**
+ * @brief A node read back from a snapshot, with its edges
+ */
+typedef struct ReadNode {
+    ArcHeapNode node;        /**< The node record */
+    uint64_t edges[4];       /**< Its first child addresses */
+} ReadNode;
+
+/**
+ * @brief Deallocates a Holder, releasing its child
+ */
+static void Holder_dealloc(ARCObject *obj) {
+    arc_release(((Holder *)obj)->child);
+    arc_object_free(obj);
+}
+
+/**
+ * @brief Visits the child of a Holder
+ */
+static void Holder_children(ARCObject *obj, TroveHeapVisitor visit, void *context) {
+    visit(((Holder *)obj)->child, context);
+}
+
+/**
+ * @brief Creates a Holder retaining child
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static Holder* Holder_create(ARCObject *child) {
+    Holder *holder = (Holder *)malloc(sizeof(Holder));
+    if (!holder) {
+        fprintf(stderr, "Failed to allocate Holder.\n");
+        exit(1);
+    }
+    arc_object_init(&holder->base, Holder_dealloc, sizeof(Holder));
+    arc_retain(child);
+    holder->child = child;
+    return holder;
+}
+
+/**
+ * @brief Fills path with the name of a new empty temporary file
+ */
+static void temp_path(char *path, size_t size) {
+    snprintf(path, size, "/tmp/trove-test-heap-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+}
+
+/**
+ * @brief Returns the node read back for an object, or NULL
+ */
+static ReadNode* find_node(ReadNode *nodes, size_t count, const void *obj) {
+    for (size_t i = 0; i < count; i++) {
+        if (nodes[i].node.address == (uint64_t)(uintptr_t)obj) {
+            return &nodes[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Returns whether a node has exactly the given edges, in order
+ */
+static int has_edges(const ReadNode *node, const void *const *children, uint32_t count) {
+    if (!node || node->node.edge_count != count) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (node->edges[i] != (uint64_t)(uintptr_t)children[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Returns the name recorded for a type in the type table, or NULL
+ */
+static const char* type_name(const ArcHeapType *types, uint32_t count, void (*dealloc)(ARCObject *)) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (types[i].type == (uint64_t)(uintptr_t)dealloc) {
+            return types[i].name;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief A graph with a shared child, a cycle and a custom type reads back node for node
+ *
+ * The root array holds two arrays sharing a string (one of them twice),
+ * a NULL, the first of two arrays holding each other, and a registered
+ * custom object holding the string as well.
+ */
+static void test_snapshot(void) {
+    arc_heap_register_type(Holder_dealloc, Holder_children);
+    arc_stats_register_type(Holder_dealloc, "Holder");
+
+    int root_line = __LINE__ + 1;
+    TroveArray *root = (TroveArray *)TROVE_AT_SITE(TroveArray_create(8));
+    int shared_line = __LINE__ + 1;
+    TroveString *shared = (TroveString *)TROVE_AT_SITE(TroveString_create("shared"));
+    TroveArray *first = TroveArray_create(1);
+    TroveArray *second = TroveArray_create(2);
+    TroveArray *cycle_a = TroveArray_create(1);
+    TroveArray *cycle_b = TroveArray_create(1);
+    Holder *holder = Holder_create(&shared->base);
+    TroveArray_append(first, &shared->base);
+    TroveArray_append(second, &shared->base);
+    TroveArray_append(second, &shared->base);
+    TroveArray_append(cycle_a, &cycle_b->base);
+    TroveArray_append(cycle_b, &cycle_a->base);
+    TroveArray_append(root, &first->base);
+    TroveArray_append(root, &second->base);
+    TroveArray_append(root, NULL);
+    TroveArray_append(root, &cycle_a->base);
+    TroveArray_append(root, &holder->base);
+    arc_release(&shared->base);
+    arc_release(&first->base);
+    arc_release(&second->base);
+    arc_release(&cycle_a->base);
+    arc_release(&cycle_b->base);
+    arc_release(&holder->base);
+    CHECK(arc_leaks_count() == GRAPH_NODES);
+
+    char path[64];
+    temp_path(path, sizeof(path));
+    CHECK(arc_heap_snapshot(path) == 0);
+    FILE *file = fopen(path, "rb");
+    CHECK(file != NULL);
+    if (!file) {
+        return;
+    }
+
+    ArcHeapFileHeader header;
+    CHECK(fread(&header, sizeof(header), 1, file) == 1);
+    CHECK(memcmp(header.magic, TROVE_HEAP_MAGIC, sizeof(header.magic)) == 0);
+    CHECK(header.node_count == GRAPH_NODES);
+    // root 4, first 1, second 2, each cycle array 1, holder 1
+    CHECK(header.edge_count == 10);
+    CHECK(header.type_count == 3 && header.site_count == 2);
+
+    ReadNode nodes[GRAPH_NODES];
+    size_t count = 0;
+    int edges_fit = 1;
+    while (count < GRAPH_NODES && count < header.node_count &&
+           fread(&nodes[count].node, sizeof(ArcHeapNode), 1, file) == 1) {
+        uint32_t edges = nodes[count].node.edge_count;
+        edges_fit = edges_fit && edges <= 4 && fread(nodes[count].edges, sizeof(uint64_t), edges, file) == edges;
+        if (!edges_fit) {
+            break;
+        }
+        count++;
+    }
+    CHECK(edges_fit && count == GRAPH_NODES);
+    CHECK((uint64_t)ftello(file) == header.types_offset);
+
+    ReadNode *root_node = find_node(nodes, count, root);
+    ReadNode *shared_node = find_node(nodes, count, shared);
+    const void *root_edges[] = {first, second, cycle_a, holder};
+    const void *first_edges[] = {shared};
+    const void *second_edges[] = {shared, shared};
+    const void *cycle_a_edges[] = {cycle_b};
+    const void *cycle_b_edges[] = {cycle_a};
+    CHECK(has_edges(root_node, root_edges, 4));
+    CHECK(has_edges(find_node(nodes, count, first), first_edges, 1));
+    CHECK(has_edges(find_node(nodes, count, second), second_edges, 2));
+    CHECK(has_edges(find_node(nodes, count, cycle_a), cycle_a_edges, 1));
+    CHECK(has_edges(find_node(nodes, count, cycle_b), cycle_b_edges, 1));
+    CHECK(has_edges(find_node(nodes, count, holder), first_edges, 1));
+    CHECK(has_edges(shared_node, NULL, 0));
+    CHECK(root_node && root_node->node.type == (uint64_t)(uintptr_t)TroveArray_dealloc);
+    CHECK(root_node && root_node->node.size == root->base.size && root_node->node.ref_count == 1);
+    CHECK(shared_node && shared_node->node.ref_count == 4);
+    ReadNode *cycle_node = find_node(nodes, count, cycle_a);
+    CHECK(cycle_node && cycle_node->node.ref_count == 2);
+
+    ArcHeapType types[3];
+    CHECK(fread(types, sizeof(ArcHeapType), 3, file) == 3);
+    const char *name = type_name(types, 3, TroveArray_dealloc);
+    CHECK(name && strcmp(name, "TroveArray") == 0);
+    name = type_name(types, 3, TroveString_dealloc);
+    CHECK(name && strcmp(name, "TroveString") == 0);
+    name = type_name(types, 3, Holder_dealloc);
+    CHECK(name && strcmp(name, "Holder") == 0);
+
+    // Sites are numbered from 1 in the order they are first written; untagged objects have none
+    CHECK((uint64_t)ftello(file) == header.sites_offset);
+    int sites_match = 1;
+    for (uint32_t i = 1; i <= header.site_count; i++) {
+        uint32_t record[2];
+        char site_file[256];
+        sites_match = sites_match && fread(record, sizeof(uint32_t), 2, file) == 2 && record[1] < sizeof(site_file) &&
+                      fread(site_file, 1, record[1], file) == record[1];
+        if (!sites_match) {
+            break;
+        }
+        site_file[record[1]] = '\0';
+        sites_match = strcmp(site_file, __FILE__) == 0;
+        if (root_node && root_node->node.site == i) {
+            sites_match = sites_match && record[0] == (uint32_t)root_line;
+        } else if (shared_node && shared_node->node.site == i) {
+            sites_match = sites_match && record[0] == (uint32_t)shared_line;
+        } else {
+            sites_match = 0;
+        }
+    }
+    CHECK(sites_match);
+    CHECK(fgetc(file) == EOF);
+    ReadNode *first_node = find_node(nodes, count, first);
+    ReadNode *holder_node = find_node(nodes, count, holder);
+    CHECK(first_node && first_node->node.site == 0 && holder_node && holder_node->node.site == 0);
+    fclose(file);
+    unlink(path);
+
+    // Break the cycle so that the whole graph is freed
+    TroveArray_remove_range(cycle_b, 0, 1);
+    arc_release(&root->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Snapshots fail with ENOTSUP while leak tracking is off, and with errno when the file cannot be created
+ */
+static void test_errors(void) {
+    char path[64];
+    temp_path(path, sizeof(path));
+    arc_leaks_enable(0);
+    CHECK(arc_heap_snapshot(path) == ENOTSUP);
+    arc_leaks_enable(1);
+    CHECK(arc_heap_snapshot("/nonexistent-trove-dir/heap") == ENOENT);
+
+    // An empty heap writes just the header
+    CHECK(arc_heap_snapshot(path) == 0);
+    FILE *file = fopen(path, "rb");
+    ArcHeapFileHeader header;
+    CHECK(file && fread(&header, sizeof(header), 1, file) == 1 && fgetc(file) == EOF);
+    CHECK(header.node_count == 0 && header.edge_count == 0 && header.type_count == 0 && header.site_count == 0);
+    if (file) {
+        fclose(file);
+    }
+    unlink(path);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_snapshot();
+    test_errors();
+    arc_leaks_enable(0);
+    return check_done("heap");
+}
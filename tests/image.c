@@ -0,0 +1,156 @@
+/**
+ * @file image.c
+ * @brief Tests of memory-mapped images: written graphs load back equal, immortal and shared
+ */
+
+#include "check.h"
+#include "graph.h"
+#include "trove.h"
+#include "image.h"
+#include "slice.h"
+#include "leaks.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/**
+ * @brief Fills path with the name of a new empty temporary file
+ */
+static void temp_path(char *path, size_t size) {
+    snprintf(path, size, "/tmp/trove-test-image-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+}
+
+/**
+ * @brief Returns whether every object of a graph of built-in types is immortal
+ */
+static int graph_immortal(ARCObject *obj) {
+    if (!obj) {
+        return 1;
+    }
+    if (obj->ref_count != TROVE_REF_IMMORTAL) {
+        return 0;
+    }
+    if (obj->dealloc == TroveArray_dealloc) {
+        TroveArray *array = (TroveArray *)obj;
+        for (size_t i = 0; i < array->count; i++) {
+            if (!graph_immortal(array->items[i])) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief A graph loads back equal, twice at once, with its sharing and without any allocation per object
+ */
+static void test_round_trip(void) {
+    char path[64];
+    temp_path(path, sizeof(path));
+    TroveArray *graph = graph_create(300);
+    CHECK(trove_image_write(&graph->base, path) == 0);
+
+    size_t live = arc_leaks_count();
+    TroveImage *first = TroveImage_open(path);
+    TroveImage *second = TroveImage_open(path);
+    CHECK(first && second);
+    // Only one mapping can sit at the preferred base
+    CHECK(first && second && (first->rebased || second->rebased));
+    CHECK(arc_leaks_count() == live + 2);
+    TroveImage *images[2] = { first, second };
+    for (int i = 0; i < 2 && first && second; i++) {
+        ARCObject *root = images[i]->root;
+        CHECK(graph_equal(&graph->base, root));
+        CHECK(graph_immortal(root));
+        TroveArray *array = (TroveArray *)root;
+        CHECK(array->items[0] == array->items[array->count - 1]);
+        TroveDictionary *dict = (TroveDictionary *)array->items[4];
+        TroveString *key = TroveString_create("key-10");
+        CHECK(TroveDictionary_get(dict, key) == array->items[0]);
+        CHECK(TroveMap_get((TroveMap *)array->items[7], key) == array->items[0]);
+        arc_release(&key->base);
+
+        // Mapped objects can be held by ordinary collections; counts stay put
+        TroveArray *holder = TroveArray_create(0);
+        TroveArray_append(holder, array->items[0]);
+        arc_retain(root);
+        arc_release(root);
+        arc_release(&holder->base);
+        CHECK(root->ref_count == TROVE_REF_IMMORTAL);
+    }
+    arc_release(&graph->base);
+    arc_release((ARCObject *)first);
+    arc_release((ARCObject *)second);
+    unlink(path);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief A NULL root round-trips and unsupported types are refused
+ */
+static void test_null_and_unsupported(void) {
+    char path[64];
+    temp_path(path, sizeof(path));
+    CHECK(trove_image_write(NULL, path) == 0);
+    TroveImage *image = TroveImage_open(path);
+    CHECK(image && image->root == NULL);
+    arc_release((ARCObject *)image);
+
+    TroveString *str = TroveString_create("unsupported");
+    TroveStringSlice *slice = TroveStringSlice_create(str, 0, 3);
+    TroveArray *holder = TroveArray_create(0);
+    TroveArray_append(holder, (ARCObject *)slice);
+    CHECK(trove_image_write(&holder->base, path) == ENOTSUP);
+    arc_release(&holder->base);
+    arc_release((ARCObject *)slice);
+    arc_release(&str->base);
+    unlink(path);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Files that are not images are refused with EINVAL, missing ones with their errno
+ */
+static void test_bad_files(void) {
+    char path[64];
+    temp_path(path, sizeof(path));
+    TroveArray *graph = graph_create(10);
+    CHECK(trove_image_write(&graph->base, path) == 0);
+    arc_release(&graph->base);
+
+    FILE *file = fopen(path, "r+b");
+    CHECK(file != NULL);
+    if (file) {
+        // A header cut short
+        CHECK(truncate(path, sizeof(TroveImageHeader) / 2) == 0);
+        errno = 0;
+        CHECK(TroveImage_open(path) == NULL && errno == EINVAL);
+        // A full-size header with the wrong magic
+        TroveImageHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "NOTIMG1", 8);
+        CHECK(fwrite(&header, sizeof(header), 1, file) == 1 && fflush(file) == 0);
+        errno = 0;
+        CHECK(TroveImage_open(path) == NULL && errno == EINVAL);
+        fclose(file);
+    }
+    unlink(path);
+    errno = 0;
+    CHECK(TroveImage_open(path) == NULL && errno == ENOENT);
+    CHECK(arc_leaks_count() == 0);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_round_trip();
+    test_null_and_unsupported();
+    test_bad_files();
+    arc_leaks_enable(0);
+    return check_done("image");
+}
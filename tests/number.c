@@ -0,0 +1,189 @@
+/**
+ * @file number.c
+ * @brief Tests of number formatting and parsing against snprintf and strtod
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "number.h"
+#include "leaks.h"
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+
+/** @brief Random values converted each way */
+#define RANDOM_VALUES 200000
+
+/** @brief State of next_random */
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+/**
+ * @brief Returns the next value of a xorshift generator
+ */
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Returns whether a C string holds exactly the given bytes
+ */
+static int text_equals(const char *text, const char *bytes, size_t length) {
+    return strlen(text) == length && memcmp(text, bytes, length) == 0;
+}
+
+/**
+ * @brief Integers format like printf and parse back, including the extremes
+ */
+static void test_integers(void) {
+    int64_t edges[] = { 0, 1, -1, 9, 10, 99, 100, -100, 999999999, 1000000000, INT64_MAX, INT64_MIN, INT64_MIN + 1 };
+    char buf[TROVE_NUMBER_BUFFER_SIZE];
+    char expected[TROVE_NUMBER_BUFFER_SIZE];
+    for (size_t i = 0; i < RANDOM_VALUES + sizeof(edges) / sizeof(edges[0]); i++) {
+        int64_t value = i < sizeof(edges) / sizeof(edges[0]) ? edges[i]
+                        : (int64_t)(next_random() >> (next_random() % 64)) * ((i & 1) ? -1 : 1);
+        size_t length = trove_format_int64(value, buf);
+        snprintf(expected, sizeof(expected), "%" PRId64, value);
+        CHECK(text_equals(expected, buf, length));
+        int64_t parsed = 0;
+        CHECK(trove_parse_int64(buf, length, &parsed) && parsed == value);
+
+        uint64_t unsigned_value = (uint64_t)value;
+        length = trove_format_uint64(unsigned_value, buf);
+        snprintf(expected, sizeof(expected), "%" PRIu64, unsigned_value);
+        CHECK(text_equals(expected, buf, length));
+        uint64_t unsigned_parsed = 0;
+        CHECK(trove_parse_uint64(buf, length, &unsigned_parsed) && unsigned_parsed == unsigned_value);
+    }
+}
+
+/**
+ * @brief Malformed and out-of-range integers are rejected
+ */
+static void test_integer_errors(void) {
+    const char *bad_signed[] = { "", "-", "+", " 1", "1 ", "12a", "0x10", "--1", "9223372036854775808",
+                                 "-9223372036854775809", "99999999999999999999" };
+    for (size_t i = 0; i < sizeof(bad_signed) / sizeof(bad_signed[0]); i++) {
+        int64_t value;
+        CHECK(!trove_parse_int64(bad_signed[i], strlen(bad_signed[i]), &value));
+    }
+    const char *bad_unsigned[] = { "", "+", "-1", "1.0", "18446744073709551616", "100000000000000000000" };
+    for (size_t i = 0; i < sizeof(bad_unsigned) / sizeof(bad_unsigned[0]); i++) {
+        uint64_t value;
+        CHECK(!trove_parse_uint64(bad_unsigned[i], strlen(bad_unsigned[i]), &value));
+    }
+    uint64_t value = 0;
+    CHECK(trove_parse_uint64("+18446744073709551615", 21, &value) && value == UINT64_MAX);
+    // Only length bytes are parsed
+    CHECK(trove_parse_uint64("1234", 2, &value) && value == 12);
+}
+
+/**
+ * @brief Formats a double and checks that the text parses back exactly, with strtod too
+ */
+static void check_double(double value) {
+    char buf[TROVE_NUMBER_BUFFER_SIZE];
+    size_t length = trove_format_double(value, buf);
+    CHECK(length > 0 && length < TROVE_NUMBER_BUFFER_SIZE);
+    double parsed = 0;
+    CHECK(trove_parse_double(buf, length, &parsed));
+    CHECK(memcmp(&parsed, &value, sizeof(double)) == 0);
+    char terminated[TROVE_NUMBER_BUFFER_SIZE];
+    memcpy(terminated, buf, length);
+    terminated[length] = '\0';
+    double libc = strtod(terminated, NULL);
+    CHECK(memcmp(&libc, &value, sizeof(double)) == 0);
+}
+
+/**
+ * @brief Doubles round-trip, over random bit patterns and values with few digits
+ */
+static void test_doubles(void) {
+    double edges[] = { 0.0, -0.0, 1.0, -1.0, 0.1, 0.3, 1e-6, 1e-7, 1e21, 1e20, 123456789012345680000.0,
+                       5e-324, 2.2250738585072014e-308, 1.7976931348623157e308, 9007199254740993.0 };
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        check_double(edges[i]);
+    }
+    for (size_t i = 0; i < RANDOM_VALUES; i++) {
+        uint64_t bits = next_random();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        if (isfinite(value)) {
+            check_double(value);
+        }
+        check_double((double)(next_random() % 1000000) / 1000.0);
+    }
+}
+
+/**
+ * @brief Doubles use the documented notation and parse what strtod does, without surrounding space
+ */
+static void test_double_text(void) {
+    struct {
+        double value;
+        const char *text;
+    } formats[] = {
+        { 0.0, "0" }, { 1.5, "1.5" }, { -2.25, "-2.25" }, { 100.0, "100" }, { 0.000001, "0.000001" },
+        { 1e21, "1e+21" }, { 1.5e300, "1.5e+300" }, { 2.5e-7, "2.5e-7" }, { NAN, "nan" },
+        { INFINITY, "inf" }, { -INFINITY, "-inf" }
+    };
+    char buf[TROVE_NUMBER_BUFFER_SIZE];
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        size_t length = trove_format_double(formats[i].value, buf);
+        CHECK(text_equals(formats[i].text, buf, length));
+    }
+
+    const char *texts[] = { "0.1", "1e10", "-3.5E-2", "12345678901234567890123", "0.30000000000000004",
+                            "2.4703282292062328e-324", "1e-400", "1e400", ".5", "5.", "0x1p3", "inf", "-infinity" };
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+        char *end;
+        double expected = strtod(texts[i], &end);
+        double value = 0;
+        int ok = trove_parse_double(texts[i], strlen(texts[i]), &value);
+        CHECK(ok == (*end == '\0'));
+        CHECK(!ok || memcmp(&value, &expected, sizeof(double)) == 0);
+    }
+    const char *bad[] = { "", "-", "e5", "1e", "1.2.3", "1,5", "1 ", " 1" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        double value;
+        CHECK(!trove_parse_double(bad[i], strlen(bad[i]), &value));
+    }
+}
+
+/**
+ * @brief The TroveString wrappers format and parse whole strings
+ */
+static void test_strings(void) {
+    TroveString *str = TroveString_from_int64(-42);
+    int64_t value = 0;
+    CHECK(strcmp(str->str, "-42") == 0 && str->length == 3);
+    CHECK(TroveString_parse_int64(str, &value) && value == -42);
+    uint64_t unsigned_value;
+    CHECK(!TroveString_parse_uint64(str, &unsigned_value));
+    arc_release(&str->base);
+
+    str = TroveString_from_uint64(UINT64_MAX);
+    CHECK(strcmp(str->str, "18446744073709551615") == 0);
+    CHECK(TroveString_parse_uint64(str, &unsigned_value) && unsigned_value == UINT64_MAX);
+    arc_release(&str->base);
+
+    str = TroveString_from_double(0.1);
+    double parsed = 0;
+    CHECK(strcmp(str->str, "0.1") == 0);
+    CHECK(TroveString_parse_double(str, &parsed) && parsed == 0.1);
+    arc_release(&str->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_integers();
+    test_integer_errors();
+    test_doubles();
+    test_double_text();
+    test_strings();
+    arc_leaks_enable(0);
+    return check_done("number");
+}
@@ -0,0 +1,351 @@
+/**
+ * @file persistent.c
+ * @brief Tests of TroveVector and TroveMap: every kept version must match its own model
+ *
+ * Each test keeps several versions alive, derives new ones from random
+ * versions with the persistent and the _in_place updates, and after every
+ * step checks all kept versions, so an update that wrote into a shared
+ * node shows up as a change in an older version.
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "vector.h"
+#include "map.h"
+#include "leaks.h"
+#include <string.h>
+
+/** @brief Versions kept alive at once */
+#define VERSIONS 6
+
+/** @brief Distinct elements, values and keys */
+#define ELEMENTS 64
+
+/** @brief Largest vector the test builds: three trie levels plus a tail */
+#define MAX_COUNT 40000
+
+/** @brief Distinct map keys */
+#define KEYS 5000
+
+/** @brief Keys of the map test that share one forced hash */
+#define COLLIDING 40
+
+/** @brief Derivation steps of each model test */
+#define STEPS 400
+
+/** @brief State of next_random */
+static uint64_t rng_state = 0xBF58476D1CE4E5B9ULL;
+
+/** @brief Shared elements and values */
+static TroveString *elements[ELEMENTS];
+
+/**
+ * @brief Returns the next value of a xorshift generator
+ */
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Allocates an int array, exiting with an error message on failure
+ */
+static int* model_alloc(size_t count) {
+    int *model = (int *)malloc(count * sizeof(int));
+    if (!model) {
+        fprintf(stderr, "Failed to allocate model.\n");
+        exit(1);
+    }
+    return model;
+}
+
+/**
+ * @brief A vector version and the element index expected at each position
+ */
+typedef struct VectorModel {
+    TroveVector *vector;    /**< The version */
+    int *items;             /**< Element index per position, MAX_COUNT entries */
+    size_t count;           /**< Expected count */
+} VectorModel;
+
+/**
+ * @brief Checks a vector version by index and chunk by chunk
+ */
+static void check_vector(VectorModel *model) {
+    TroveVector *vector = model->vector;
+    CHECK(TroveVector_count(vector) == model->count);
+    int same = 1;
+    for (size_t i = 0; i < model->count; i++) {
+        same = same && TroveVector_get(vector, i) == &elements[model->items[i]]->base;
+    }
+    CHECK(same);
+    CHECK(TroveVector_get(vector, model->count) == NULL);
+    size_t i = 0;
+    while (i < model->count) {
+        size_t length = 0;
+        ARCObject *const *chunk = TroveVector_chunk(vector, i, &length);
+        CHECK(chunk && length > 0 && length <= TROVE_VECTOR_WIDTH && i + length <= model->count);
+        if (!chunk || length == 0) {
+            break;
+        }
+        for (size_t j = 0; j < length; j++) {
+            same = same && chunk[j] == &elements[model->items[i + j]]->base;
+        }
+        i += length;
+    }
+    CHECK(same && i == model->count);
+}
+
+/**
+ * @brief Random pushes, sets and pops, persistent and in place, leave every other version alone
+ */
+static void test_vector(void) {
+    VectorModel models[VERSIONS];
+    for (int v = 0; v < VERSIONS; v++) {
+        models[v].vector = TroveVector_create();
+        models[v].items = model_alloc(MAX_COUNT);
+        models[v].count = 0;
+    }
+    // One version starts past the third trie level
+    for (size_t i = 0; i < MAX_COUNT - 1000; i++) {
+        int element = (int)(next_random() % ELEMENTS);
+        TroveVector_push_in_place(&models[0].vector, &elements[element]->base);
+        models[0].items[models[0].count++] = element;
+    }
+    for (int step = 0; step < STEPS; step++) {
+        VectorModel *source = &models[next_random() % VERSIONS];
+        VectorModel *target = &models[next_random() % VERSIONS];
+        TroveVector *vector = source->vector;
+        arc_retain(&vector->base);
+        int *items = model_alloc(MAX_COUNT);
+        memcpy(items, source->items, source->count * sizeof(int));
+        size_t count = source->count;
+
+        size_t updates = next_random() % 4 == 0 ? next_random() % 3000 : 1 + next_random() % 8;
+        int in_place = (int)(next_random() % 2);
+        for (size_t u = 0; u < updates; u++) {
+            int element = (int)(next_random() % ELEMENTS);
+            uint64_t kind = next_random() % 10;
+            TroveVector *next = NULL;
+            if (kind < 5 && count < MAX_COUNT) {
+                if (in_place) {
+                    TroveVector_push_in_place(&vector, &elements[element]->base);
+                } else {
+                    next = TroveVector_push(vector, &elements[element]->base);
+                }
+                items[count++] = element;
+            } else if (kind < 8 && count > 0) {
+                size_t index = next_random() % count;
+                if (in_place) {
+                    TroveVector_set_in_place(&vector, index, &elements[element]->base);
+                } else {
+                    next = TroveVector_set(vector, index, &elements[element]->base);
+                }
+                items[index] = element;
+            } else {
+                if (in_place) {
+                    TroveVector_pop_in_place(&vector);
+                } else {
+                    next = TroveVector_pop(vector);
+                }
+                count -= count > 0;
+            }
+            if (next) {
+                arc_release(&vector->base);
+                vector = next;
+            }
+        }
+        arc_release(&target->vector->base);
+        free(target->items);
+        target->vector = vector;
+        target->items = items;
+        target->count = count;
+        for (int v = 0; v < VERSIONS; v++) {
+            check_vector(&models[v]);
+        }
+    }
+    for (int v = 0; v < VERSIONS; v++) {
+        arc_release(&models[v].vector->base);
+        free(models[v].items);
+    }
+    CHECK(arc_leaks_count() == ELEMENTS);
+}
+
+/**
+ * @brief Growing across every trie level and popping back down keeps snapshots taken on the way
+ */
+static void test_vector_levels(void) {
+    size_t sizes[] = { 0, 1, TROVE_VECTOR_WIDTH, TROVE_VECTOR_WIDTH + 1, 1056, 1057, 32800, 32801, MAX_COUNT };
+    VectorModel snapshots[sizeof(sizes) / sizeof(sizes[0])];
+    int *items = model_alloc(MAX_COUNT);
+    TroveVector *vector = TroveVector_create();
+    size_t taken = 0;
+    for (size_t count = 0; count <= MAX_COUNT; count++) {
+        if (count == sizes[taken]) {
+            arc_retain(&vector->base);
+            snapshots[taken].vector = vector;
+            snapshots[taken].items = items;
+            snapshots[taken].count = count;
+            taken++;
+        }
+        if (count < MAX_COUNT) {
+            items[count] = (int)(count % ELEMENTS);
+            TroveVector_push_in_place(&vector, &elements[items[count]]->base);
+        }
+    }
+    CHECK(taken == sizeof(sizes) / sizeof(sizes[0]));
+    for (size_t count = MAX_COUNT; count > 0; count--) {
+        TroveVector_pop_in_place(&vector);
+    }
+    CHECK(TroveVector_count(vector) == 0 && vector->root == NULL);
+    for (size_t i = 0; i < taken; i++) {
+        check_vector(&snapshots[i]);
+        arc_release(&snapshots[i].vector->base);
+    }
+    arc_release(&vector->base);
+    free(items);
+    CHECK(arc_leaks_count() == ELEMENTS);
+}
+
+/**
+ * @brief A map version and the value index expected for each key, -1 when absent
+ */
+typedef struct MapModel {
+    TroveMap *map;    /**< The version */
+    int *values;      /**< Value index per key, KEYS entries */
+} MapModel;
+
+/** @brief Keys of the map test; the first COLLIDING share one hash */
+static TroveString *keys[KEYS];
+
+/**
+ * @brief Checks a map version by key and by iteration
+ */
+static void check_map(MapModel *model) {
+    TroveMap *map = model->map;
+    size_t expected = 0;
+    int same = 1;
+    for (size_t i = 0; i < KEYS; i++) {
+        ARCObject *value = model->values[i] < 0 ? NULL : &elements[model->values[i]]->base;
+        same = same && TroveMap_get(map, keys[i]) == value;
+        same = same && TroveMap_contains(map, keys[i]) == (model->values[i] >= 0);
+        if (i >= COLLIDING) {
+            // Colliding keys carry a forced hash that their bytes do not produce
+            same = same && TroveMap_get_bytes(map, keys[i]->str, keys[i]->length) == value;
+        }
+        expected += model->values[i] >= 0;
+    }
+    CHECK(same);
+    CHECK(TroveMap_count(map) == expected);
+
+    TroveMapIter it;
+    TroveString *key;
+    ARCObject *value;
+    size_t visited = 0;
+    TroveMap_iter_init(&it, map);
+    while (TroveMap_iter_next(&it, &key, &value)) {
+        same = same && TroveMap_get(map, key) == value;
+        visited++;
+    }
+    CHECK(same && visited == expected);
+}
+
+/**
+ * @brief Random sets and removals, persistent and in place, leave every other version alone
+ */
+static void test_map(void) {
+    for (size_t i = 0; i < KEYS; i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "map-key-%zu", i);
+        keys[i] = TroveString_create(text);
+        if (i < COLLIDING) {
+            // One full-depth collision node, reached through every bitmap level
+            keys[i]->hash = 0x5555555555555555ULL;
+        }
+    }
+    MapModel models[VERSIONS];
+    for (int v = 0; v < VERSIONS; v++) {
+        models[v].map = TroveMap_create();
+        models[v].values = model_alloc(KEYS);
+        for (size_t i = 0; i < KEYS; i++) {
+            models[v].values[i] = -1;
+        }
+    }
+    for (int step = 0; step < STEPS; step++) {
+        MapModel *source = &models[next_random() % VERSIONS];
+        MapModel *target = &models[next_random() % VERSIONS];
+        TroveMap *map = source->map;
+        arc_retain(&map->base);
+        int *values = model_alloc(KEYS);
+        memcpy(values, source->values, KEYS * sizeof(int));
+
+        size_t updates = next_random() % 4 == 0 ? next_random() % 3000 : 1 + next_random() % 8;
+        int in_place = (int)(next_random() % 2);
+        for (size_t u = 0; u < updates; u++) {
+            // Half of the updates hit the colliding keys
+            size_t i = next_random() % 2 ? next_random() % COLLIDING : next_random() % KEYS;
+            int value = (int)(next_random() % ELEMENTS);
+            TroveMap *next = NULL;
+            if (next_random() % 3) {
+                if (in_place) {
+                    TroveMap_set_in_place(&map, keys[i], &elements[value]->base);
+                } else {
+                    next = TroveMap_set(map, keys[i], &elements[value]->base);
+                }
+                values[i] = value;
+            } else {
+                if (in_place) {
+                    CHECK(TroveMap_remove_in_place(&map, keys[i]) == (values[i] >= 0));
+                } else {
+                    next = TroveMap_remove(map, keys[i]);
+                }
+                values[i] = -1;
+            }
+            if (next) {
+                arc_release(&map->base);
+                map = next;
+            }
+        }
+        arc_release(&target->map->base);
+        free(target->values);
+        target->map = map;
+        target->values = values;
+        for (int v = 0; v < VERSIONS; v++) {
+            check_map(&models[v]);
+        }
+    }
+    for (int v = 0; v < VERSIONS; v++) {
+        arc_release(&models[v].map->base);
+        free(models[v].values);
+    }
+    int unshared = 1;
+    for (size_t i = 0; i < KEYS; i++) {
+        unshared = unshared && keys[i]->base.ref_count == 1;
+        arc_release(&keys[i]->base);
+    }
+    CHECK(unshared);
+    CHECK(arc_leaks_count() == ELEMENTS);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    for (int i = 0; i < ELEMENTS; i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "element-%d", i);
+        elements[i] = TroveString_create(text);
+    }
+    test_vector();
+    test_vector_levels();
+    test_map();
+    int unshared = 1;
+    for (int i = 0; i < ELEMENTS; i++) {
+        unshared = unshared && elements[i]->base.ref_count == 1;
+        arc_release(&elements[i]->base);
+    }
+    CHECK(unshared);
+    CHECK(arc_leaks_count() == 0);
+    arc_leaks_enable(0);
+    return check_done("persistent");
+}
@@ -0,0 +1,273 @@
+/**
+ * @file poolstats.c
+ * @brief Tests of pool histograms: bucket bounds, quantiles, recording and the Prometheus text
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "poolstats.h"
+#include "leaks.h"
+#include <string.h>
+#include <pthread.h>
+
+/** @brief Pools popped by the thread started in test_recording */
+#define THREAD_POPS 5
+
+/**
+ * @brief Adds a value to a histogram the way arc_pool_stats_record_pop does
+ */
+static void histogram_add(ArcHistogram *histogram, uint64_t value) {
+    histogram->buckets[arc_histogram_bucket(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+/**
+ * @brief Returns whether a value lies in the range its bucket covers
+ */
+static int bucket_holds(uint64_t value) {
+    size_t bucket = arc_histogram_bucket(value);
+    return bucket < TROVE_HISTOGRAM_BUCKETS && value <= arc_histogram_bound(bucket) &&
+           (bucket == 0 || value > arc_histogram_bound(bucket - 1));
+}
+
+/**
+ * @brief Values map to the buckets whose bounds enclose them, at the edges of the linear and 64-bit ranges too
+ */
+static void test_buckets(void) {
+    static const struct {
+        uint64_t value;
+        size_t bucket;
+        uint64_t bound;
+    } cases[] = {
+        {0, 0, 0},
+        {1, 1, 1},
+        {8, 8, 8},
+        {9, 9, 9},
+        {16, 16, 16},
+        {17, 17, 18},
+        {18, 17, 18},
+        {19, 18, 20},
+        {(uint64_t)1 << 63, TROVE_HISTOGRAM_BUCKETS - 9, (uint64_t)1 << 63},
+        {((uint64_t)1 << 63) + 1, TROVE_HISTOGRAM_BUCKETS - 8, ((uint64_t)1 << 63) + ((uint64_t)1 << 60)},
+        {UINT64_MAX, TROVE_HISTOGRAM_BUCKETS - 1, UINT64_MAX},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        CHECK(arc_histogram_bucket(cases[i].value) == cases[i].bucket);
+        CHECK(arc_histogram_bound(cases[i].bucket) == cases[i].bound);
+        CHECK(bucket_holds(cases[i].value));
+    }
+
+    // Every bound is the top of its own bucket, and bounds grow by at most an eighth
+    int round_trip = 1;
+    int precise = 1;
+    for (size_t bucket = 0; bucket < TROVE_HISTOGRAM_BUCKETS; bucket++) {
+        uint64_t bound = arc_histogram_bound(bucket);
+        round_trip = round_trip && arc_histogram_bucket(bound) == bucket && bucket_holds(bound);
+        if (bucket > 16) {
+            uint64_t below = arc_histogram_bound(bucket - 1);
+            precise = precise && bound > below && bound - below <= below / 8 + 1;
+        }
+    }
+    CHECK(round_trip);
+    CHECK(precise);
+    for (int shift = 0; shift < 64; shift++) {
+        uint64_t power = (uint64_t)1 << shift;
+        CHECK(bucket_holds(power) && arc_histogram_bound(arc_histogram_bucket(power)) == power);
+        CHECK(bucket_holds(power - 1) && bucket_holds(power + 1));
+    }
+}
+
+/**
+ * @brief Quantiles report the bound of the bucket holding the rank, capped at the maximum
+ */
+static void test_quantiles(void) {
+    ArcHistogram histogram;
+    memset(&histogram, 0, sizeof(histogram));
+    CHECK(arc_histogram_quantile(&histogram, 0.5) == 0);
+    for (int i = 0; i < 90; i++) {
+        histogram_add(&histogram, 4);
+    }
+    for (int i = 0; i < 9; i++) {
+        histogram_add(&histogram, 64);
+    }
+    histogram_add(&histogram, 1000);
+    CHECK(arc_histogram_quantile(&histogram, 0.0) == 4);
+    CHECK(arc_histogram_quantile(&histogram, 0.5) == 4);
+    CHECK(arc_histogram_quantile(&histogram, 0.9) == 4);
+    CHECK(arc_histogram_quantile(&histogram, 0.95) == 64);
+    CHECK(arc_histogram_quantile(&histogram, 0.99) == 64);
+    // 1000 falls in the bucket bounded by 1024, which the maximum caps
+    CHECK(arc_histogram_quantile(&histogram, 1.0) == 1000);
+
+    memset(&histogram, 0, sizeof(histogram));
+    histogram_add(&histogram, 1001);
+    CHECK(arc_histogram_quantile(&histogram, 0.5) == 1001);
+    histogram_add(&histogram, 5000);
+    CHECK(arc_histogram_quantile(&histogram, 0.5) == 1024);
+    CHECK(arc_histogram_quantile(&histogram, 1.0) == 5000);
+}
+
+/**
+ * @brief Pops a pool holding count strings
+ */
+static void pop_pool_of(size_t count) {
+    autorelease_pool_push();
+    for (size_t i = 0; i < count; i++) {
+        arc_autorelease(&TroveString_create("pooled")->base);
+    }
+    autorelease_pool_pop();
+}
+
+/**
+ * @brief Pops THREAD_POPS pools of one object and exits
+ */
+static void *pop_pools(void *arg) {
+    (void)arg;
+    for (int i = 0; i < THREAD_POPS; i++) {
+        pop_pool_of(1);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Popped pools are recorded only while enabled, and the blocks of exited threads still count
+ */
+static void test_recording(void) {
+    static ArcPoolStatsSnapshot before;
+    static ArcPoolStatsSnapshot after;
+    arc_pool_stats_snapshot(&before);
+    pop_pool_of(3);
+    arc_pool_stats_snapshot(&after);
+    CHECK(after.objects.count == before.objects.count);
+
+    arc_pool_stats_enable(1);
+    size_t objects = 3 * TROVE_POOL_INITIAL_CAPACITY;
+    pop_pool_of(objects);
+    pthread_t thread;
+    pthread_create(&thread, NULL, pop_pools, NULL);
+    pthread_join(thread, NULL);
+    arc_pool_stats_enable(0);
+    arc_pool_stats_snapshot(&after);
+
+    CHECK(after.objects.count == before.objects.count + 1 + THREAD_POPS);
+    CHECK(after.objects.sum == before.objects.sum + objects + THREAD_POPS);
+    CHECK(after.objects.max >= objects);
+    size_t bucket = arc_histogram_bucket(objects);
+    CHECK(after.objects.buckets[bucket] == before.objects.buckets[bucket] + 1);
+    CHECK(after.objects.buckets[1] == before.objects.buckets[1] + THREAD_POPS);
+    // The array grew from TROVE_POOL_INITIAL_CAPACITY to twice, then four times that
+    CHECK(after.grows.buckets[2] == before.grows.buckets[2] + 1);
+    CHECK(after.grows.buckets[0] == before.grows.buckets[0] + THREAD_POPS);
+    CHECK(after.drain_ns.count == before.drain_ns.count + 1 + THREAD_POPS);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Returns whether text contains line as a whole line
+ */
+static int has_line(TroveString *text, const char *line) {
+    size_t length = strlen(line);
+    for (const char *at = strstr(text->str, line); at; at = strstr(at + 1, line)) {
+        if ((at == text->str || at[-1] == '\n') && at[length] == '\n') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns how many times a substring occurs in text
+ */
+static size_t occurrences(TroveString *text, const char *part) {
+    size_t count = 0;
+    for (const char *at = strstr(text->str, part); at; at = strstr(at + 1, part)) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief The Prometheus text of known histograms has the expected cumulative buckets, sums and gauges
+ */
+static void test_prometheus(void) {
+    static ArcPoolStatsSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    histogram_add(&snapshot.objects, 1);
+    histogram_add(&snapshot.objects, 3);
+    histogram_add(&snapshot.objects, 3);
+    histogram_add(&snapshot.objects, 1000);
+    histogram_add(&snapshot.drain_ns, 1000);
+    histogram_add(&snapshot.drain_ns, 5000);
+    histogram_add(&snapshot.grows, 0);
+    histogram_add(&snapshot.grows, 0);
+    histogram_add(&snapshot.grows, 2);
+
+    TroveString *text = arc_pool_stats_to_prometheus(&snapshot);
+    static const char *const lines[] = {
+        "# HELP trove_pool_objects Objects in an autorelease pool when it is popped.",
+        "# TYPE trove_pool_objects histogram",
+        "trove_pool_objects_bucket{le=\"1\"} 1",
+        "trove_pool_objects_bucket{le=\"2\"} 1",
+        "trove_pool_objects_bucket{le=\"4\"} 3",
+        "trove_pool_objects_bucket{le=\"512\"} 3",
+        "trove_pool_objects_bucket{le=\"1024\"} 4",
+        "trove_pool_objects_bucket{le=\"1048576\"} 4",
+        "trove_pool_objects_bucket{le=\"+Inf\"} 4",
+        "trove_pool_objects_sum 1007",
+        "trove_pool_objects_count 4",
+        "# TYPE trove_pool_drain_seconds histogram",
+        "trove_pool_drain_seconds_bucket{le=\"1.024e-06\"} 1",
+        "trove_pool_drain_seconds_bucket{le=\"4.096e-06\"} 1",
+        "trove_pool_drain_seconds_bucket{le=\"1.6384e-05\"} 2",
+        "trove_pool_drain_seconds_bucket{le=\"17.1798692\"} 2",
+        "trove_pool_drain_seconds_bucket{le=\"+Inf\"} 2",
+        "trove_pool_drain_seconds_sum 6e-06",
+        "trove_pool_drain_seconds_count 2",
+        "# TYPE trove_pool_grows histogram",
+        "trove_pool_grows_bucket{le=\"0\"} 2",
+        "trove_pool_grows_bucket{le=\"1\"} 2",
+        "trove_pool_grows_bucket{le=\"2\"} 3",
+        "trove_pool_grows_bucket{le=\"16\"} 3",
+        "trove_pool_grows_sum 2",
+        "trove_pool_grows_count 3",
+        "# TYPE trove_pool_objects_max gauge",
+        "trove_pool_objects_max 1000",
+        "# TYPE trove_pool_drain_seconds_max gauge",
+        "trove_pool_drain_seconds_max 5e-06",
+    };
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        if (!has_line(text, lines[i])) {
+            fprintf(stderr, "missing line: %s\n", lines[i]);
+            CHECK(0);
+        }
+    }
+    // Powers of two from 1 to 2^20, times 4 from 2^10 to 2^34 nanoseconds, and 0 to 16, each with +Inf
+    CHECK(occurrences(text, "trove_pool_objects_bucket{") == 22);
+    CHECK(occurrences(text, "trove_pool_drain_seconds_bucket{") == 14);
+    CHECK(occurrences(text, "trove_pool_grows_bucket{") == 18);
+    CHECK(text->length > 0 && text->str[text->length - 1] == '\n');
+    arc_release(&text->base);
+
+    // An empty snapshot has zero counts throughout
+    memset(&snapshot, 0, sizeof(snapshot));
+    text = arc_pool_stats_to_prometheus(&snapshot);
+    CHECK(has_line(text, "trove_pool_objects_bucket{le=\"+Inf\"} 0"));
+    CHECK(has_line(text, "trove_pool_drain_seconds_sum 0"));
+    CHECK(has_line(text, "trove_pool_objects_max 0"));
+    arc_release(&text->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_buckets();
+    test_quantiles();
+    test_recording();
+    test_prometheus();
+    arc_leaks_enable(0);
+    return check_done("poolstats");
+}
@@ -0,0 +1,139 @@
+/**
+ * @file reader.c
+ * @brief Tests of TroveLineReader: line splitting, batches and caller-owned pools
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "reader.h"
+#include "leaks.h"
+#include <string.h>
+#include <unistd.h>
+
+/** @brief Lines of the test input, including empty lines and one longer than a chunk */
+static const char *const test_lines[] = {
+    "first", "", "third line", "a line that is longer than the 16-byte chunk size",
+    "5", "six", "", "eight", "nine", "ten", "eleven", "last line without a newline"
+};
+
+/** @brief Number of entries in test_lines */
+#define TEST_LINE_COUNT (sizeof(test_lines) / sizeof(test_lines[0]))
+
+/**
+ * @brief Writes test_lines to a temporary file and returns a reader over it
+ *
+ * The file is unlinked at once; the reader keeps it open.
+ */
+static TroveLineReader* open_test_input(size_t batch_size) {
+    char path[] = "/tmp/trove-test-reader-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    unlink(path);
+    for (size_t i = 0; i < TEST_LINE_COUNT; i++) {
+        size_t length = strlen(test_lines[i]);
+        int last = i == TEST_LINE_COUNT - 1;
+        if (write(fd, test_lines[i], length) != (ssize_t)length || (!last && write(fd, "\n", 1) != 1)) {
+            perror("write");
+            exit(1);
+        }
+    }
+    lseek(fd, 0, SEEK_SET);
+    return TroveLineReader_create_with_fd(fd, 1, 16, batch_size);
+}
+
+/**
+ * @brief Returns whether a slice holds exactly the bytes of a C string
+ */
+static int slice_equals(TroveStringSlice *line, const char *expected) {
+    return line && line->length == strlen(expected) && memcmp(line->ptr, expected, line->length) == 0;
+}
+
+/**
+ * @brief Lines come back in order, without their newline, across chunks and batches
+ */
+static void test_lines_in_order(void) {
+    TroveLineReader *reader = open_test_input(3);
+    size_t count = 0;
+    TroveStringSlice *line;
+    while ((line = TroveLineReader_next(reader))) {
+        CHECK(count < TEST_LINE_COUNT && slice_equals(line, test_lines[count]));
+        CHECK(reader->batch_count <= 3);
+        count++;
+    }
+    CHECK(count == TEST_LINE_COUNT);
+    CHECK(reader->error == 0);
+    CHECK(TroveLineReader_next(reader) == NULL);
+    arc_release((ARCObject *)reader);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief A retained line outlives its batch and the reader
+ */
+static void test_retained_line(void) {
+    TroveLineReader *reader = open_test_input(2);
+    TroveStringSlice *kept = TroveLineReader_next(reader);
+    arc_retain((ARCObject *)kept);
+    while (TroveLineReader_next(reader)) {
+    }
+    arc_release((ARCObject *)reader);
+    CHECK(slice_equals(kept, test_lines[0]));
+    CHECK(kept->base.ref_count == 1);
+    arc_release((ARCObject *)kept);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief The caller pushes and pops its own pools, including one enclosing the reader, mid-stream
+ */
+static void test_caller_pools(void) {
+    autorelease_pool_push();
+    AutoreleasePool *enclosing = current_autorelease_pool;
+    TroveLineReader *reader = open_test_input(2);
+    arc_retain((ARCObject *)reader);
+    arc_autorelease((ARCObject *)reader);
+
+    size_t count = 0;
+    TroveStringSlice *line;
+    TroveString *autoreleased = NULL;
+    while ((line = TroveLineReader_next(reader))) {
+        CHECK(slice_equals(line, test_lines[count]));
+        if (count == 1) {
+            // A pool spanning several of the reader's batches
+            autorelease_pool_push();
+            autoreleased = TroveString_create("caller");
+            arc_retain((ARCObject *)autoreleased);
+            arc_autorelease((ARCObject *)autoreleased);
+        }
+        if (count == 6) {
+            CHECK(autoreleased->base.ref_count == 2);
+            autorelease_pool_pop();
+            CHECK(autoreleased->base.ref_count == 1);
+            CHECK(current_autorelease_pool == enclosing);
+        }
+        if (count == 8) {
+            // Popping the pool the reader was created in leaves it usable
+            autorelease_pool_pop();
+            CHECK(current_autorelease_pool == NULL);
+            CHECK(reader->base.ref_count == 1);
+        }
+        count++;
+    }
+    CHECK(count == TEST_LINE_COUNT);
+    CHECK(current_autorelease_pool == NULL);
+    arc_release((ARCObject *)reader);
+    arc_release((ARCObject *)autoreleased);
+    CHECK(arc_leaks_count() == 0);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_lines_in_order();
+    test_retained_line();
+    test_caller_pools();
+    arc_leaks_enable(0);
+    return check_done("reader");
+}
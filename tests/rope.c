@@ -0,0 +1,271 @@
+/**
+ * @file rope.c
+ * @brief Tests of TroveRope against a flat byte buffer model
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "rope.h"
+#include "slice.h"
+#include "leaks.h"
+#include <string.h>
+#include <unistd.h>
+
+/** @brief Ropes kept at once by the model test */
+#define ROPES 8
+
+/** @brief Random operations applied by the model test */
+#define OPERATIONS 4000
+
+/** @brief Ropes longer than this are cut down with a substring */
+#define MAX_LENGTH 20000
+
+/**
+ * @brief A rope and the bytes it should hold
+ */
+typedef struct RopeModel {
+    TroveRope *rope;      /**< The rope */
+    char *bytes;          /**< Expected bytes */
+    size_t length;        /**< Number of expected bytes */
+} RopeModel;
+
+/** @brief State of next_random */
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+/**
+ * @brief Returns the next value of a xorshift generator
+ */
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Replaces a model's rope and bytes, releasing the old rope
+ */
+static void model_set(RopeModel *model, TroveRope *rope, const char *bytes, size_t length) {
+    char *copy = (char *)malloc(length + 1);
+    if (!copy) {
+        fprintf(stderr, "Failed to allocate rope model.\n");
+        exit(1);
+    }
+    memcpy(copy, bytes, length);
+    arc_release((ARCObject *)model->rope);
+    free(model->bytes);
+    model->rope = rope;
+    model->bytes = copy;
+    model->length = length;
+}
+
+/**
+ * @brief Grows a scratch buffer to at least size bytes
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static char* scratch_reserve(char *scratch, size_t size) {
+    scratch = (char *)realloc(scratch, size);
+    if (!scratch) {
+        fprintf(stderr, "Failed to allocate rope scratch buffer.\n");
+        exit(1);
+    }
+    return scratch;
+}
+
+/**
+ * @brief Returns the AVL height bound for a rope of at most leaves leaves
+ */
+static int height_bound(size_t leaves) {
+    int bits = 0;
+    while (leaves >> bits) {
+        bits++;
+    }
+    return bits * 3 / 2 + 2;
+}
+
+/**
+ * @brief Checks a rope's length, bytes, indexing, leaves and height against its model
+ */
+static void check_model(RopeModel *model) {
+    TroveRope *rope = model->rope;
+    CHECK(rope->length == model->length);
+    TroveString *flat = TroveRope_flatten(rope);
+    CHECK(flat->length == model->length && memcmp(flat->str, model->bytes, model->length) == 0);
+    arc_release(&flat->base);
+    for (int i = 0; i < 8 && model->length; i++) {
+        size_t index = next_random() % model->length;
+        CHECK(TroveRope_char_at(rope, index) == model->bytes[index]);
+    }
+    CHECK(TroveRope_char_at(rope, model->length) == '\0');
+
+    TroveRopeIter it;
+    TroveRope_iter_init(&it, rope);
+    struct iovec iov[4];
+    size_t offset = 0;
+    size_t leaves = 0;
+    size_t filled;
+    int same = 1;
+    while ((filled = TroveRope_iter_fill(&it, iov, 4)) > 0) {
+        for (size_t i = 0; i < filled; i++) {
+            same = same && offset + iov[i].iov_len <= model->length
+                   && memcmp(iov[i].iov_base, model->bytes + offset, iov[i].iov_len) == 0;
+            offset += iov[i].iov_len;
+            leaves++;
+        }
+    }
+    CHECK(same && offset == model->length);
+    CHECK(rope->height <= height_bound(leaves));
+}
+
+/**
+ * @brief Random appends, concatenations and substrings agree with the model
+ */
+static void test_model(void) {
+    RopeModel models[ROPES];
+    memset(models, 0, sizeof(models));
+    for (int i = 0; i < ROPES; i++) {
+        model_set(&models[i], TroveRope_create(NULL), "", 0);
+    }
+    TroveString *source = TroveString_create_with_length(NULL, 1000);
+    for (size_t i = 0; i < source->length; i++) {
+        source->str[i] = (char)('A' + i % 58);
+    }
+
+    char text[64];
+    char *scratch = NULL;
+    for (int op = 0; op < OPERATIONS; op++) {
+        RopeModel *target = &models[next_random() % ROPES];
+        RopeModel *other = &models[next_random() % ROPES];
+        size_t total;
+        switch (next_random() % 5) {
+        case 0: {
+            // Append a short copied piece
+            size_t length = next_random() % (sizeof(text) - 1);
+            for (size_t i = 0; i < length; i++) {
+                text[i] = (char)('a' + next_random() % 26);
+            }
+            text[length] = '\0';
+            total = target->length + length;
+            scratch = scratch_reserve(scratch, total + 1);
+            memcpy(scratch, target->bytes, target->length);
+            memcpy(scratch + target->length, text, length);
+            model_set(target, TroveRope_append(target->rope, text), scratch, total);
+            break;
+        }
+        case 1:
+        case 2: {
+            // Concatenate two ropes, possibly the same one
+            total = target->length + other->length;
+            scratch = scratch_reserve(scratch, total + 1);
+            memcpy(scratch, target->bytes, target->length);
+            memcpy(scratch + target->length, other->bytes, other->length);
+            model_set(target, TroveRope_concat(target->rope, other->rope), scratch, total);
+            break;
+        }
+        case 3: {
+            // Prepend a leaf sharing a slice of the source string
+            size_t offset = next_random() % source->length;
+            size_t length = next_random() % (source->length - offset + 1);
+            TroveStringSlice *slice = TroveStringSlice_create(source, offset, length);
+            TroveRope *leaf = TroveRope_create_with_slice(slice);
+            arc_release((ARCObject *)slice);
+            total = length + target->length;
+            scratch = scratch_reserve(scratch, total + 1);
+            memcpy(scratch, source->str + offset, length);
+            memcpy(scratch + length, target->bytes, target->length);
+            model_set(target, TroveRope_concat(leaf, target->rope), scratch, total);
+            arc_release((ARCObject *)leaf);
+            break;
+        }
+        default: {
+            // Take a substring, with a range that may run past the end
+            size_t offset = target->length ? next_random() % (target->length + 2) : 0;
+            size_t length = next_random() % (target->length + 2);
+            size_t start = offset < target->length ? offset : target->length;
+            size_t kept = length < target->length - start ? length : target->length - start;
+            scratch = scratch_reserve(scratch, kept + 1);
+            memcpy(scratch, target->bytes + start, kept);
+            model_set(target, TroveRope_substring(target->rope, offset, length), scratch, kept);
+            break;
+        }
+        }
+        if (target->length > MAX_LENGTH) {
+            size_t start = next_random() % (target->length - MAX_LENGTH / 2);
+            scratch = scratch_reserve(scratch, MAX_LENGTH / 2 + 1);
+            memcpy(scratch, target->bytes + start, MAX_LENGTH / 2);
+            model_set(target, TroveRope_substring(target->rope, start, MAX_LENGTH / 2), scratch, MAX_LENGTH / 2);
+        }
+        check_model(target);
+    }
+    free(scratch);
+    for (int i = 0; i < ROPES; i++) {
+        arc_release((ARCObject *)models[i].rope);
+        free(models[i].bytes);
+    }
+    arc_release(&source->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Many single-byte appends stay balanced and write out in order
+ */
+static void test_appends_and_writev(void) {
+    TroveRope *rope = TroveRope_create("");
+    size_t count = 100000;
+    for (size_t i = 0; i < count; i++) {
+        char text[2] = { (char)('0' + i % 10), '\0' };
+        TroveRope *longer = TroveRope_append(rope, text);
+        arc_release((ARCObject *)rope);
+        rope = longer;
+    }
+    CHECK(rope->length == count);
+    CHECK(rope->height <= height_bound(count / (TROVE_ROPE_LEAF_MAX / 2)));
+
+    char path[] = "/tmp/trove-test-rope-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    unlink(path);
+    CHECK(TroveRope_writev(rope, fd) == (ssize_t)count);
+    lseek(fd, 0, SEEK_SET);
+    char *bytes = (char *)malloc(count);
+    CHECK(bytes && read(fd, bytes, count) == (ssize_t)count);
+    int ordered = 1;
+    for (size_t i = 0; bytes && i < count; i++) {
+        ordered = ordered && bytes[i] == (char)('0' + i % 10);
+    }
+    CHECK(ordered);
+    free(bytes);
+    close(fd);
+    arc_release((ARCObject *)rope);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief A leaf keeps the string it shares alive after the caller releases it
+ */
+static void test_shared_leaf(void) {
+    TroveString *str = TroveString_create("shared bytes");
+    TroveRope *rope = TroveRope_create_with_string(str);
+    CHECK(str->base.ref_count == 2);
+    arc_release(&str->base);
+    TroveRope *tail = TroveRope_substring(rope, 7, 100);
+    arc_release((ARCObject *)rope);
+    TroveString *flat = TroveRope_flatten(tail);
+    CHECK(strcmp(flat->str, "bytes") == 0);
+    arc_release(&flat->base);
+    arc_release((ARCObject *)tail);
+    CHECK(arc_leaks_count() == 0);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_model();
+    test_appends_and_writev();
+    test_shared_leaf();
+    arc_leaks_enable(0);
+    return check_done("rope");
+}
@@ -0,0 +1,334 @@
+/**
+ * @file serial.c
+ * @brief Tests of binary serialization: round trips, sharing, descriptor streams and bad input
+ */
+
+#include "check.h"
+#include "graph.h"
+#include "trove.h"
+#include "data.h"
+#include "serial.h"
+#include "slice.h"
+#include "leaks.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/**
+ * @brief Returns a descriptor positioned at the start of an unlinked temporary file
+ */
+static int temp_fd(void) {
+    char path[] = "/tmp/trove-test-serial-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    unlink(path);
+    return fd;
+}
+
+/**
+ * @brief Returns a descriptor holding the given bytes
+ */
+static int fd_with_bytes(const void *bytes, size_t length) {
+    int fd = temp_fd();
+    if (write(fd, bytes, length) != (ssize_t)length) {
+        perror("write");
+        exit(1);
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/** @brief State of next_random */
+static uint64_t rng_state = 0x9FB21C651E98DF25ULL;
+
+/**
+ * @brief Returns the next value of a xorshift generator
+ */
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Every built-in type round-trips through memory and a descriptor, with sharing restored
+ */
+static void test_round_trip(void) {
+    TroveArray *graph = graph_create(200);
+    int error = -1;
+    TroveData *encoded = trove_serialize(&graph->base, &error);
+    CHECK(encoded && error == 0);
+
+    for (int from_fd = 0; from_fd < 2 && encoded; from_fd++) {
+        ARCObject *decoded;
+        error = -1;
+        if (from_fd) {
+            int fd = fd_with_bytes(encoded->bytes, encoded->length);
+            decoded = trove_deserialize_fd(fd, &error);
+            close(fd);
+        } else {
+            decoded = trove_deserialize(encoded->bytes, encoded->length, &error);
+        }
+        CHECK(error == 0);
+        CHECK(graph_equal(&graph->base, decoded));
+        if (decoded && decoded->dealloc == TroveArray_dealloc) {
+            // The shared string is decoded once, for the root and the collections alike
+            TroveArray *root = (TroveArray *)decoded;
+            TroveDictionary *dict = (TroveDictionary *)root->items[4];
+            CHECK(root->items[0] == root->items[root->count - 1]);
+            CHECK(TroveDictionary_get_bytes(dict, "key-0", 5) == root->items[0]);
+            CHECK(TroveVector_get((TroveVector *)root->items[6], 5) == root->items[0]);
+        }
+        arc_release(decoded);
+    }
+
+    // A NULL root encodes and decodes as NULL
+    TroveData *null_encoded = trove_serialize(NULL, &error);
+    CHECK(null_encoded && error == 0);
+    error = -1;
+    CHECK(null_encoded && trove_deserialize(null_encoded->bytes, null_encoded->length, &error) == NULL && error == 0);
+    arc_release((ARCObject *)null_encoded);
+    arc_release((ARCObject *)encoded);
+    arc_release(&graph->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Every truncation of a valid encoding fails with EINVAL and frees what it decoded
+ */
+static void test_truncated(void) {
+    TroveArray *graph = graph_create(20);
+    TroveData *encoded = trove_serialize(&graph->base, NULL);
+    arc_release(&graph->base);
+    CHECK(encoded != NULL);
+    for (size_t length = 0; encoded && length < encoded->length; length++) {
+        int error = 0;
+        ARCObject *decoded = trove_deserialize(encoded->bytes, length, &error);
+        CHECK(decoded == NULL && error == EINVAL);
+        if (length % 64 == 0) {
+            int fd = fd_with_bytes(encoded->bytes, length);
+            error = 0;
+            decoded = trove_deserialize_fd(fd, &error);
+            close(fd);
+            CHECK(decoded == NULL && error == EINVAL);
+        }
+    }
+    arc_release((ARCObject *)encoded);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Corrupted encodings either decode or fail with EINVAL, and never leak
+ */
+static void test_corrupt(void) {
+    TroveArray *graph = graph_create(20);
+    TroveData *encoded = trove_serialize(&graph->base, NULL);
+    arc_release(&graph->base);
+    CHECK(encoded != NULL);
+    unsigned char *bytes = (unsigned char *)malloc(encoded ? encoded->length : 1);
+    if (!bytes) {
+        fprintf(stderr, "Failed to allocate corrupt encoding.\n");
+        exit(1);
+    }
+    size_t live = arc_leaks_count();
+    size_t failed = 0;
+    for (int trial = 0; trial < 5000 && encoded; trial++) {
+        memcpy(bytes, encoded->bytes, encoded->length);
+        int flips = 1 + (int)(next_random() % 4);
+        for (int f = 0; f < flips; f++) {
+            size_t at = 4 + next_random() % (encoded->length - 4);
+            bytes[at] = next_random() % 2 ? (unsigned char)next_random() : (unsigned char)(bytes[at] ^ (1u << (next_random() % 8)));
+        }
+        int error = -1;
+        ARCObject *decoded = trove_deserialize(bytes, encoded->length, &error);
+        CHECK(decoded ? error == 0 : error == EINVAL || error == 0);
+        failed += error != 0;
+        arc_release(decoded);
+        CHECK(arc_leaks_count() == live);
+    }
+    CHECK(failed > 0);
+
+    // A wrong magic, an unknown tag and a reference to an object not yet decoded
+    unsigned char bad_magic[] = { 'T', 'R', 'V', '2', TROVE_SERIAL_NULL << 1 };
+    unsigned char unknown_tag[] = { 'T', 'R', 'V', '1', (TROVE_SERIAL_MAX_TAG - 1) << 1 };
+    unsigned char bad_ref[] = { 'T', 'R', 'V', '1', TROVE_SERIAL_ARRAY << 1, 1, TROVE_SERIAL_REF << 1, 0 };
+    const unsigned char *cases[] = { bad_magic, unknown_tag, bad_ref };
+    size_t lengths[] = { sizeof(bad_magic), sizeof(unknown_tag), sizeof(bad_ref) };
+    for (int i = 0; i < 3; i++) {
+        int error = 0;
+        CHECK(trove_deserialize(cases[i], lengths[i], &error) == NULL && error == EINVAL);
+    }
+    free(bytes);
+    arc_release((ARCObject *)encoded);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Cycles and unregistered types are refused when encoding
+ */
+static void test_encode_errors(void) {
+    TroveArray *cycle = TroveArray_create(0);
+    TroveArray *inner = TroveArray_create(0);
+    TroveArray_append(cycle, &inner->base);
+    TroveArray_append(inner, &cycle->base);
+    int error = 0;
+    CHECK(trove_serialize(&cycle->base, &error) == NULL && error == ELOOP);
+    // Break the cycle so both arrays can be freed
+    TroveArray_remove_all(inner);
+    arc_release(&inner->base);
+    arc_release(&cycle->base);
+
+    // Slices are not registered, here or nested in an array
+    TroveString *str = TroveString_create("unregistered");
+    TroveStringSlice *slice = TroveStringSlice_create(str, 2, 8);
+    TroveArray *holder = TroveArray_create(0);
+    TroveArray_append(holder, &str->base);
+    TroveArray_append(holder, (ARCObject *)slice);
+    error = 0;
+    CHECK(trove_serialize((ARCObject *)slice, &error) == NULL && error == ENOTSUP);
+    error = 0;
+    CHECK(trove_serialize(&holder->base, &error) == NULL && error == ENOTSUP);
+    arc_release(&holder->base);
+    arc_release((ARCObject *)slice);
+    arc_release(&str->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Payloads longer than the first allocation round-trip through a descriptor
+ */
+static void test_fd_large_payloads(void) {
+    size_t length = 5 * 1024 * 1024 + 17;
+    TroveString *str = TroveString_create_with_length(NULL, length);
+    for (size_t i = 0; i < length; i++) {
+        str->str[i] = (char)('a' + i % 26);
+    }
+    TroveData *data = TroveData_create(str->str, length);
+    ARCObject *roots[2] = { &str->base, &data->base };
+    for (int i = 0; i < 2; i++) {
+        int fd = temp_fd();
+        CHECK(trove_serialize_to_fd(roots[i], fd) == 0);
+        lseek(fd, 0, SEEK_SET);
+        int error = -1;
+        ARCObject *decoded = trove_deserialize_fd(fd, &error);
+        close(fd);
+        CHECK(error == 0);
+        CHECK(decoded && decoded->dealloc == roots[i]->dealloc);
+        if (decoded && decoded->dealloc == TroveString_dealloc) {
+            TroveString *copy = (TroveString *)decoded;
+            CHECK(copy->length == length && memcmp(copy->str, str->str, length) == 0 && copy->str[length] == '\0');
+        } else if (decoded) {
+            TroveData *copy = (TroveData *)decoded;
+            CHECK(copy->length == length && memcmp(copy->bytes, str->str, length) == 0);
+        }
+        arc_release(decoded);
+    }
+    arc_release(&str->base);
+    arc_release(&data->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief A huge length prefix on a short stream fails with EINVAL instead of allocating it
+ */
+static void test_fd_corrupt_length(void) {
+    unsigned tags[2] = { TROVE_SERIAL_STRING, TROVE_SERIAL_DATA };
+    for (int i = 0; i < 2; i++) {
+        // Magic, header, a length of 2^42 as LEB128, then a few payload bytes
+        unsigned char stream[] = { 'T', 'R', 'V', '1', (unsigned char)(tags[i] << 1),
+                                   0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01, 'x', 'y', 'z' };
+        int fd = fd_with_bytes(stream, sizeof(stream));
+        int error = 0;
+        ARCObject *decoded = trove_deserialize_fd(fd, &error);
+        close(fd);
+        CHECK(decoded == NULL);
+        CHECK(error == EINVAL);
+
+        error = 0;
+        decoded = trove_deserialize(stream, sizeof(stream), &error);
+        CHECK(decoded == NULL);
+        CHECK(error == EINVAL);
+    }
+    CHECK(arc_leaks_count() == 0);
+}
+
+/** @brief Strings in each half of the graph decoded by test_split_across_threads */
+#define SPLIT_STRINGS 1000
+
+/**
+ * @brief Releases the half of a decoded graph handed to this thread
+ */
+static void *release_half(void *half) {
+    arc_release((ARCObject *)half);
+    return NULL;
+}
+
+/**
+ * @brief The halves of a decoded graph can be released on different threads at once
+ *
+ * Meant for `make test-tsan`: the short strings of both halves share the
+ * pool's arena chunk, which each thread releases as it frees its strings.
+ */
+static void test_split_across_threads(void) {
+    TroveArray *graph = TroveArray_create(2);
+    for (int half = 0; half < 2; half++) {
+        TroveArray *strings = TroveArray_create(SPLIT_STRINGS);
+        for (int i = 0; i < SPLIT_STRINGS; i++) {
+            char text[32];
+            snprintf(text, sizeof(text), "string %d", i * 2 + half);
+            TroveString *str = TroveString_create(text);
+            TroveArray_append(strings, &str->base);
+            arc_release(&str->base);
+        }
+        TroveArray_append(graph, &strings->base);
+        arc_release(&strings->base);
+    }
+    int error = -1;
+    TroveData *encoded = trove_serialize(&graph->base, &error);
+    CHECK(encoded && error == 0);
+    size_t live = arc_leaks_count();
+
+    autorelease_pool_push();
+    ARCObject *decoded = encoded ? trove_deserialize(encoded->bytes, encoded->length, &error) : NULL;
+    autorelease_pool_pop();
+    CHECK(error == 0 && graph_equal(&graph->base, decoded));
+    if (decoded && decoded->dealloc == TroveArray_dealloc) {
+        TroveArray *root = (TroveArray *)decoded;
+        TroveString *first = (TroveString *)TroveArray_get((TroveArray *)root->items[0], 0);
+        TroveString *second = (TroveString *)TroveArray_get((TroveArray *)root->items[1], 0);
+        CHECK(first->storage != NULL && first->storage == second->storage);
+        ARCObject *halves[2] = {root->items[0], root->items[1]};
+        arc_retain(halves[0]);
+        arc_retain(halves[1]);
+        arc_release(decoded);
+
+        pthread_t thread;
+        pthread_create(&thread, NULL, release_half, halves[1]);
+        arc_release(halves[0]);
+        pthread_join(thread, NULL);
+    } else {
+        arc_release(decoded);
+    }
+    CHECK(arc_leaks_count() == live);
+    arc_release((ARCObject *)encoded);
+    arc_release(&graph->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_round_trip();
+    test_truncated();
+    test_corrupt();
+    test_encode_errors();
+    test_fd_large_payloads();
+    test_fd_corrupt_length();
+    test_split_across_threads();
+    arc_leaks_enable(0);
+    return check_done("serial");
+}
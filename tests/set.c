@@ -0,0 +1,199 @@
+/**
+ * @file set.c
+ * @brief Tests of TroveSet and its set algebra against bitmap models
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "set.h"
+#include "leaks.h"
+#include <string.h>
+
+/** @brief Distinct keys the sets draw from */
+#define KEYS 4000
+
+/** @brief Random set pairs compared by the algebra test */
+#define ROUNDS 40
+
+/** @brief State of next_random */
+static uint64_t rng_state = 0x94D049BB133111EBULL;
+
+/** @brief One string per key, shared by every set */
+static TroveString *keys[KEYS];
+
+/**
+ * @brief Returns the next value of a xorshift generator
+ */
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Checks a set against a model holding 1 for each key present
+ *
+ * Lookups use fresh equal strings and raw bytes, not the stored objects.
+ */
+static void check_model(TroveSet *set, const char *model) {
+    size_t expected = 0;
+    int same = 1;
+    for (size_t i = 0; i < KEYS; i++) {
+        TroveString *copy = TroveString_create_with_length(keys[i]->str, keys[i]->length);
+        same = same && TroveSet_contains(set, copy) == model[i];
+        same = same && TroveSet_contains_bytes(set, keys[i]->str, keys[i]->length) == model[i];
+        arc_release(&copy->base);
+        expected += (size_t)model[i];
+    }
+    CHECK(same);
+    CHECK(TroveSet_count(set) == expected);
+
+    size_t cursor = 0;
+    size_t visited = 0;
+    TroveString *key;
+    while ((key = TroveSet_next(set, &cursor))) {
+        visited++;
+    }
+    CHECK(visited == expected);
+}
+
+/**
+ * @brief Builds a random set of about density percent of the keys, filling its model
+ */
+static TroveSet* random_set(char *model, unsigned density) {
+    TroveString **chosen = (TroveString **)malloc(KEYS * sizeof(TroveString *));
+    if (!chosen) {
+        fprintf(stderr, "Failed to allocate set keys.\n");
+        exit(1);
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < KEYS; i++) {
+        model[i] = next_random() % 100 < density;
+        if (model[i]) {
+            chosen[count++] = keys[i];
+        }
+    }
+    TroveSet *set;
+    if (next_random() % 2) {
+        set = TroveSet_create_with_strings(chosen, count);
+    } else {
+        set = TroveSet_create(0);
+        // Every key twice: the second add finds it present
+        CHECK(TroveSet_add_all(set, chosen, count) == count);
+        CHECK(TroveSet_add_all(set, chosen, count) == 0);
+    }
+    free(chosen);
+    return set;
+}
+
+/**
+ * @brief Union, intersection and difference agree with the models, leaving their inputs alone
+ */
+static void test_algebra(void) {
+    static char a_model[KEYS];
+    static char b_model[KEYS];
+    static char expected[KEYS];
+    unsigned densities[] = { 0, 1, 10, 50, 90, 100 };
+    for (int round = 0; round < ROUNDS; round++) {
+        TroveSet *a = random_set(a_model, densities[next_random() % 6]);
+        TroveSet *b = random_set(b_model, densities[next_random() % 6]);
+
+        TroveSet *result = TroveSet_union(a, b);
+        for (size_t i = 0; i < KEYS; i++) {
+            expected[i] = a_model[i] | b_model[i];
+        }
+        check_model(result, expected);
+        arc_release(&result->base);
+
+        result = TroveSet_intersection(a, b);
+        for (size_t i = 0; i < KEYS; i++) {
+            expected[i] = a_model[i] & b_model[i];
+        }
+        check_model(result, expected);
+        arc_release(&result->base);
+
+        result = TroveSet_difference(a, b);
+        for (size_t i = 0; i < KEYS; i++) {
+            expected[i] = a_model[i] & !b_model[i];
+        }
+        check_model(result, expected);
+        arc_release(&result->base);
+
+        result = TroveSet_union(a, a);
+        check_model(result, a_model);
+        arc_release(&result->base);
+
+        check_model(a, a_model);
+        check_model(b, b_model);
+        arc_release(&a->base);
+        arc_release(&b->base);
+    }
+    CHECK(arc_leaks_count() == KEYS);
+}
+
+/**
+ * @brief Single adds and removals agree with the model; a shared set is copied before it changes
+ */
+static void test_add_remove(void) {
+    static char model[KEYS];
+    static char shared_model[KEYS];
+    memset(model, 0, sizeof(model));
+    TroveSet *set = TroveSet_create(0);
+    TroveSet *shared = NULL;
+    for (int op = 0; op < 100000; op++) {
+        size_t i = next_random() % KEYS;
+        TroveSet_make_unique(&set);
+        if (next_random() % 3) {
+            CHECK(TroveSet_add(set, keys[i]) == !model[i]);
+            model[i] = 1;
+        } else {
+            CHECK(TroveSet_remove(set, keys[i]) == model[i]);
+            model[i] = 0;
+        }
+        if (op % 10000 == 0) {
+            if (shared) {
+                check_model(shared, shared_model);
+                arc_release(&shared->base);
+            }
+            arc_retain(&set->base);
+            shared = set;
+            memcpy(shared_model, model, sizeof(model));
+        }
+    }
+    check_model(set, model);
+    check_model(shared, shared_model);
+    arc_release(&shared->base);
+
+    size_t cursor = 0;
+    TroveString *key;
+    while ((key = TroveSet_next(set, &cursor))) {
+        CHECK(TroveSet_remove(set, key));
+    }
+    CHECK(TroveSet_count(set) == 0);
+    TroveSet_add(set, keys[0]);
+    TroveSet_remove_all(set);
+    CHECK(TroveSet_count(set) == 0 && !TroveSet_contains(set, keys[0]));
+    arc_release(&set->base);
+    CHECK(arc_leaks_count() == KEYS);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    for (size_t i = 0; i < KEYS; i++) {
+        char text[32];
+        snprintf(text, sizeof(text), "member-%zu", i * 104729);
+        keys[i] = TroveString_create(text);
+    }
+    test_algebra();
+    test_add_remove();
+    int shared = 0;
+    for (size_t i = 0; i < KEYS; i++) {
+        shared += keys[i]->base.ref_count != 1;
+        arc_release(&keys[i]->base);
+    }
+    CHECK(shared == 0);
+    CHECK(arc_leaks_count() == 0);
+    arc_leaks_enable(0);
+    return check_done("set");
+}
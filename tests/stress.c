@@ -0,0 +1,456 @@
+/**
+ * @file stress.c
+ * @brief Stress test: objects passed between threads, freed exactly once
+ *
+ * Each thread repeatedly creates nodes (an object holding a string and an
+ * array of child nodes), receives nodes from its queue, sends nodes to
+ * random threads' queues, retains and releases them in pairs and in
+ * batches, adopts one node into another, releases them and autoreleases
+ * them into its own pool, which it pops every STRESS_POOL_OPS operations.
+ * A thread only touches nodes it holds the sole reference to, directly or
+ * through a node it holds: sending, adopting, releasing and autoreleasing
+ * all give up the handle, so reference counts need no atomics.
+ *
+ * At the end of each run the queues are drained and every node must have
+ * been freed exactly once: a node deallocated twice aborts, the nodes
+ * freed must equal those created, and the per-type live counters of
+ * stats.h must all be zero. With -g the guard poisons freed objects, so a
+ * retain or release after the last one aborts at once.
+ *
+ * Options: -t THREADS (a comma-separated list runs each count in turn, as
+ * a scalability benchmark), -d SECONDS per run, -s SEED (fixes each
+ * thread's choices; interleavings still vary) and -g. `make test` runs 4
+ * threads for a second; `make bench` builds build/bench/stress against the
+ * release library, e.g. `build/bench/stress -t 1,2,4,8 -d 5`.
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "array.h"
+#include "stats.h"
+#include "guard.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/** @brief Most threads in one run */
+#define STRESS_MAX_THREADS 256
+
+/** @brief Nodes each thread's queue holds */
+#define STRESS_QUEUE_CAPACITY 256
+
+/** @brief Nodes each thread holds handles to */
+#define STRESS_OWNED 64
+
+/** @brief Operations between a thread's pool pops */
+#define STRESS_POOL_OPS 64
+
+/** @brief Deepest tree of adopted nodes, bounding the recursion of dealloc */
+#define STRESS_MAX_DEPTH 8
+
+/** @brief Most children a node keeps; adopting beyond it drops the oldest half */
+#define STRESS_MAX_CHILDREN 16
+
+/** @brief Magic of a live node */
+#define STRESS_LIVE 0x4C495645u
+
+/** @brief Magic of a deallocated node */
+#define STRESS_FREED 0x46524545u
+
+/**
+ * @brief A node passed between threads
+ */
+typedef struct StressNode {
+    ARCObject base;           /**< Inheritance: must be the first member */
+    uint32_t magic;           /**< STRESS_LIVE until deallocated */
+    uint32_t depth;           /**< Height of the tree of adopted nodes below, 0 for none */
+    TroveString *label;       /**< Retained string */
+    TroveArray *children;     /**< Retained adopted nodes, NULL until the first */
+} StressNode;
+
+/**
+ * @brief A bounded queue of nodes sent to one thread
+ */
+typedef struct StressQueue {
+    pthread_mutex_t lock;                         /**< Guards the other fields */
+    ARCObject *items[STRESS_QUEUE_CAPACITY];      /**< Ring of nodes, each the only handle */
+    size_t head;                                  /**< Slot of the oldest node */
+    size_t count;                                 /**< Nodes queued */
+} StressQueue;
+
+/**
+ * @brief What one thread did, summed into a run's report
+ */
+typedef struct StressCounts {
+    uint64_t operations;      /**< Operations run */
+    uint64_t created;         /**< Nodes created */
+    uint64_t sent;            /**< Nodes sent to a queue */
+    uint64_t received;        /**< Nodes taken from the thread's queue */
+    uint64_t retains;         /**< Retains, single or batched */
+    uint64_t autoreleases;    /**< Nodes autoreleased */
+    uint64_t adopted;         /**< Nodes adopted into another */
+} StressCounts;
+
+/**
+ * @brief A worker thread
+ */
+typedef struct StressThread {
+    pthread_t thread;         /**< The thread */
+    int index;                /**< Index in stress_threads */
+    uint64_t random;          /**< xorshift64* state */
+    StressQueue queue;        /**< Nodes sent to this thread */
+    StressCounts counts;      /**< Written when the thread finishes */
+} StressThread;
+
+/** @brief Threads of the current run */
+static StressThread stress_threads[STRESS_MAX_THREADS];
+
+/** @brief Threads in stress_threads */
+static int stress_thread_count = 0;
+
+/** @brief CLOCK_MONOTONIC seconds at which the current run ends */
+static double stress_deadline = 0;
+
+/** @brief Nodes deallocated, by all threads */
+static uint64_t stress_freed = 0;
+
+/** @brief Bytes that labels are cut from */
+static const char STRESS_TEXT[] = "the quick brown fox jumps over the lazy dog";
+
+/**
+ * @brief Returns a monotonic timestamp in seconds
+ */
+static double stress_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Returns the next number of a thread's xorshift64* generator
+ */
+static uint64_t stress_random(StressThread *self) {
+    self->random ^= self->random >> 12;
+    self->random ^= self->random << 25;
+    self->random ^= self->random >> 27;
+    return self->random * 0x2545F4914F6CDD1Dull;
+}
+
+/**
+ * @brief Deallocates a StressNode, aborting if it was deallocated before
+ */
+static void StressNode_dealloc(ARCObject *obj) {
+    StressNode *node = (StressNode *)obj;
+    if (node->magic != STRESS_LIVE) {
+        fprintf(stderr, "stress: node %p deallocated twice\n", (void *)node);
+        abort();
+    }
+    node->magic = STRESS_FREED;
+    arc_release(&node->label->base);
+    arc_release((ARCObject *)node->children);
+    __atomic_add_fetch(&stress_freed, 1, __ATOMIC_RELAXED);
+    arc_object_free(obj);
+}
+
+/**
+ * @brief Creates a node with a random label and no children
+ *
+ * If allocation fails, the program will exit with an error message.
+ */
+static StressNode* StressNode_create(StressThread *self) {
+    StressNode *node = (StressNode *)malloc(sizeof(StressNode));
+    if (!node) {
+        fprintf(stderr, "Failed to allocate StressNode.\n");
+        exit(1);
+    }
+    arc_object_init(&node->base, StressNode_dealloc, sizeof(StressNode));
+    node->magic = STRESS_LIVE;
+    node->depth = 0;
+    size_t length = stress_random(self) % (sizeof(STRESS_TEXT) - 1);
+    node->label = TroveString_create_with_length(STRESS_TEXT, length);
+    node->children = NULL;
+    return node;
+}
+
+/**
+ * @brief Adds a node to a thread's queue
+ *
+ * @return 1 if it was queued, 0 if the queue is full
+ */
+static int stress_send(StressThread *target, ARCObject *obj) {
+    StressQueue *queue = &target->queue;
+    pthread_mutex_lock(&queue->lock);
+    int queued = queue->count < STRESS_QUEUE_CAPACITY;
+    if (queued) {
+        queue->items[(queue->head + queue->count) % STRESS_QUEUE_CAPACITY] = obj;
+        queue->count++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return queued;
+}
+
+/**
+ * @brief Takes the oldest node from a thread's queue
+ *
+ * @return The node, or NULL if the queue is empty
+ */
+static ARCObject* stress_receive(StressThread *self) {
+    StressQueue *queue = &self->queue;
+    ARCObject *obj = NULL;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count) {
+        obj = queue->items[queue->head];
+        queue->head = (queue->head + 1) % STRESS_QUEUE_CAPACITY;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return obj;
+}
+
+/**
+ * @brief Adopts node b into node a, handing over the handle to b
+ */
+static void stress_adopt(StressNode *a, StressNode *b) {
+    if (!a->children) {
+        a->children = TroveArray_create(0);
+    }
+    if (a->children->count >= STRESS_MAX_CHILDREN) {
+        TroveArray_remove_range(a->children, 0, STRESS_MAX_CHILDREN / 2);
+    }
+    TroveArray_append(a->children, &b->base);
+    arc_release(&b->base);
+    if (a->depth < b->depth + 1) {
+        a->depth = b->depth + 1;
+    }
+}
+
+/**
+ * @brief Runs one random operation
+ *
+ * @param owned Nodes the thread holds the only handle to
+ * @param owned_count Entries used in owned
+ */
+static void stress_step(StressThread *self, ARCObject **owned, size_t *owned_count, StressCounts *counts) {
+    unsigned choice = (unsigned)(stress_random(self) % 100);
+    size_t pick = *owned_count ? (size_t)(stress_random(self) % *owned_count) : 0;
+    counts->operations++;
+    if (*owned_count == 0 || (choice < 20 && *owned_count < STRESS_OWNED)) {
+        owned[(*owned_count)++] = &StressNode_create(self)->base;
+        counts->created++;
+    } else if (choice < 40) {
+        ARCObject *obj = *owned_count < STRESS_OWNED ? stress_receive(self) : NULL;
+        if (obj) {
+            owned[(*owned_count)++] = obj;
+            counts->received++;
+        }
+    } else if (choice < 55) {
+        // Retain and release in pairs, singly and in a batch with a run of the node and its children
+        StressNode *node = (StressNode *)owned[pick];
+        unsigned pairs = 1 + (unsigned)(stress_random(self) % 4);
+        ARCObject *batch[4 + STRESS_MAX_CHILDREN];
+        size_t count = 0;
+        for (unsigned i = 0; i < pairs; i++) {
+            arc_retain(&node->base);
+            batch[count++] = &node->base;
+        }
+        for (unsigned i = 0; i < pairs; i++) {
+            arc_release(&node->base);
+        }
+        if (node->children) {
+            memcpy(batch + count, node->children->items, node->children->count * sizeof(ARCObject *));
+            count += node->children->count;
+        }
+        arc_retain_all(batch, count);
+        arc_release_all(batch, count);
+        counts->retains += pairs + count;
+    } else if (choice < 65) {
+        size_t other = (size_t)(stress_random(self) % *owned_count);
+        StressNode *b = (StressNode *)owned[other];
+        if (other != pick && b->depth < STRESS_MAX_DEPTH) {
+            stress_adopt((StressNode *)owned[pick], b);
+            owned[other] = owned[--(*owned_count)];
+            counts->adopted++;
+        }
+    } else if (choice < 80) {
+        StressThread *target = &stress_threads[stress_random(self) % (uint64_t)stress_thread_count];
+        if (stress_send(target, owned[pick])) {
+            owned[pick] = owned[--(*owned_count)];
+            counts->sent++;
+        }
+    } else if (choice < 90) {
+        arc_release(owned[pick]);
+        owned[pick] = owned[--(*owned_count)];
+    } else {
+        // Extra references make runs of the node in the pool
+        unsigned extra = (unsigned)(stress_random(self) % 3);
+        for (unsigned i = 0; i < extra; i++) {
+            arc_retain(owned[pick]);
+        }
+        for (unsigned i = 0; i <= extra; i++) {
+            arc_autorelease(owned[pick]);
+        }
+        owned[pick] = owned[--(*owned_count)];
+        counts->retains += extra;
+        counts->autoreleases += extra + 1;
+    }
+}
+
+/**
+ * @brief Runs random operations until the deadline, then releases what the thread holds
+ */
+static void *stress_worker(void *arg) {
+    StressThread *self = (StressThread *)arg;
+    ARCObject *owned[STRESS_OWNED];
+    size_t owned_count = 0;
+    StressCounts counts;
+    memset(&counts, 0, sizeof(counts));
+    autorelease_pool_push();
+    while (stress_now() < stress_deadline) {
+        for (int i = 0; i < STRESS_POOL_OPS; i++) {
+            stress_step(self, owned, &owned_count, &counts);
+        }
+        autorelease_pool_pop();
+        autorelease_pool_push();
+    }
+    for (size_t i = 0; i < owned_count; i++) {
+        arc_release(owned[i]);
+    }
+    autorelease_pool_pop();
+    self->counts = counts;
+    return NULL;
+}
+
+/**
+ * @brief Runs the workload on a number of threads, checks that every node was freed once and reports throughput
+ *
+ * @return Nodes created
+ */
+static uint64_t stress_run(int threads, double seconds, uint64_t seed) {
+    stress_thread_count = threads;
+    __atomic_store_n(&stress_freed, 0, __ATOMIC_RELAXED);
+    for (int i = 0; i < threads; i++) {
+        StressThread *thread = &stress_threads[i];
+        thread->index = i;
+        thread->random = (seed + 1) * 0x9E3779B97F4A7C15ull + (uint64_t)i * 0xBF58476D1CE4E5B9ull;
+        if (!thread->random) {
+            thread->random = 1;
+        }
+        thread->queue.head = 0;
+        thread->queue.count = 0;
+        pthread_mutex_init(&thread->queue.lock, NULL);
+    }
+    double start = stress_now();
+    stress_deadline = start + seconds;
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&stress_threads[i].thread, NULL, stress_worker, &stress_threads[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(stress_threads[i].thread, NULL);
+    }
+    double elapsed = stress_now() - start;
+
+    // Nodes still queued are released by this thread, which joined their senders
+    StressCounts total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < threads; i++) {
+        ARCObject *obj;
+        while ((obj = stress_receive(&stress_threads[i])) != NULL) {
+            arc_release(obj);
+        }
+        pthread_mutex_destroy(&stress_threads[i].queue.lock);
+        StressCounts *counts = &stress_threads[i].counts;
+        total.operations += counts->operations;
+        total.created += counts->created;
+        total.sent += counts->sent;
+        total.received += counts->received;
+        total.retains += counts->retains;
+        total.autoreleases += counts->autoreleases;
+        total.adopted += counts->adopted;
+    }
+    CHECK(__atomic_load_n(&stress_freed, __ATOMIC_RELAXED) == total.created);
+
+    printf("%7d %9.2f %12.0f %12.0f %12.0f %12.0f %12.0f %12.0f\n", threads, elapsed,
+           (double)total.operations / elapsed, (double)total.operations / elapsed / threads,
+           (double)total.created / elapsed, (double)total.sent / elapsed, (double)total.retains / elapsed,
+           (double)total.autoreleases / elapsed);
+    fflush(stdout);
+    return total.created;
+}
+
+/**
+ * @brief Checks that stats counted every node created and no live object of any type
+ */
+static void stress_check_stats(uint64_t created) {
+    ArcStatsSnapshot *snapshot = (ArcStatsSnapshot *)malloc(sizeof(ArcStatsSnapshot));
+    if (!snapshot) {
+        fprintf(stderr, "Failed to allocate ArcStatsSnapshot.\n");
+        exit(1);
+    }
+    arc_stats_snapshot(snapshot);
+    int nodes_seen = 0;
+    for (size_t i = 0; i < snapshot->count; i++) {
+        ArcTypeStats *type = &snapshot->types[i];
+        if (type->live != 0) {
+            fprintf(stderr, "stress: %lld %s objects still live\n", (long long)type->live,
+                    type->name ? type->name : "unnamed");
+        }
+        CHECK(type->live == 0);
+        CHECK(type->allocations == type->deallocations);
+        if (type->dealloc == StressNode_dealloc) {
+            nodes_seen = 1;
+            CHECK(type->allocations == created);
+        }
+    }
+    CHECK(nodes_seen || created == 0);
+    free(snapshot);
+}
+
+int main(int argc, char **argv) {
+    const char *thread_list = "4";
+    double seconds = 1.0;
+    uint64_t seed = 1;
+    int guard = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            thread_list = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            seconds = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-g") == 0) {
+            guard = 1;
+        } else {
+            fprintf(stderr, "usage: %s [-t THREADS[,THREADS...]] [-d SECONDS] [-s SEED] [-g]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    arc_stats_register_type(StressNode_dealloc, "StressNode");
+    arc_stats_enable(1);
+    if (guard) {
+        arc_guard_set_frames(0);
+        arc_guard_enable(1);
+    }
+    printf("stress: %.2f s per run, seed %llu%s\n", seconds, (unsigned long long)seed, guard ? ", guard on" : "");
+    printf("%7s %9s %12s %12s %12s %12s %12s %12s\n", "threads", "seconds", "ops/s", "ops/s/thread",
+           "creates/s", "sends/s", "retains/s", "autorel/s");
+    uint64_t created = 0;
+    const char *cursor = thread_list;
+    while (*cursor) {
+        char *end;
+        long threads = strtol(cursor, &end, 10);
+        if (end == cursor || threads < 1 || threads > STRESS_MAX_THREADS) {
+            fprintf(stderr, "stress: thread counts must be between 1 and %d\n", STRESS_MAX_THREADS);
+            return 2;
+        }
+        created += stress_run((int)threads, seconds, seed);
+        cursor = *end == ',' ? end + 1 : end;
+    }
+    stress_check_stats(created);
+    if (guard) {
+        arc_guard_enable(0);
+    }
+    arc_stats_enable(0);
+    return check_done("stress");
+}
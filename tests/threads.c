@@ -0,0 +1,122 @@
+/**
+ * @file threads.c
+ * @brief Tests of the diagnostics shared by threads, meant for `make test-tsan`
+ *
+ * Worker threads create, retain and release their own objects with
+ * statistics, leak tracking, tracing, profiling and the guard all enabled,
+ * while another thread keeps taking snapshots. Objects and pools are not
+ * shared between threads: the diagnostics are what must be thread-safe.
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "array.h"
+#include "stats.h"
+#include "leaks.h"
+#include "trace.h"
+#include "profile.h"
+#include "guard.h"
+#include <pthread.h>
+
+/** @brief Worker threads */
+#define THREADS 4
+
+/** @brief Strings created by each worker */
+#define OBJECTS_PER_THREAD 20000
+
+/** @brief Nonzero once the workers are done; read by the snapshot thread */
+static int workers_done = 0;
+
+/**
+ * @brief Creates strings, keeps a few in an array for a while and releases everything
+ */
+static void *worker(void *arg) {
+    (void)arg;
+    TroveArray *kept = TroveArray_create(0);
+    for (int i = 0; i < OBJECTS_PER_THREAD; i++) {
+        TroveString *str = TroveString_create("thread");
+        arc_retain(&str->base);
+        if (i % 10 == 0) {
+            TroveArray_append(kept, &str->base);
+        }
+        arc_release(&str->base);
+        arc_release(&str->base);
+        if (kept->count == 64) {
+            TroveArray_remove_all(kept);
+        }
+    }
+    arc_release(&kept->base);
+    return NULL;
+}
+
+/**
+ * @brief Takes snapshots of every diagnostic until the workers are done
+ */
+static void *snapshotter(void *arg) {
+    (void)arg;
+    ArcStatsSnapshot *snapshot = (ArcStatsSnapshot *)malloc(sizeof(ArcStatsSnapshot));
+    if (!snapshot) {
+        fprintf(stderr, "Failed to allocate ArcStatsSnapshot.\n");
+        exit(1);
+    }
+    while (!__atomic_load_n(&workers_done, __ATOMIC_ACQUIRE)) {
+        arc_stats_snapshot(snapshot);
+        arc_leaks_count();
+        arc_profile_samples();
+        size_t count = 0;
+        free(arc_trace_collect(&count));
+    }
+    free(snapshot);
+    return NULL;
+}
+
+int main(void) {
+    arc_stats_enable(1);
+    arc_leaks_enable(1);
+    arc_trace_enable(1);
+    arc_profile_set_rate(4096);
+    arc_profile_enable(1);
+    arc_guard_set_quarantine(256 * 1024);
+    arc_guard_set_frames(0);
+    arc_guard_enable(1);
+
+    pthread_t threads[THREADS];
+    pthread_t snapshot_thread;
+    pthread_create(&snapshot_thread, NULL, snapshotter, NULL);
+    for (int i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, worker, NULL);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    __atomic_store_n(&workers_done, 1, __ATOMIC_RELEASE);
+    pthread_join(snapshot_thread, NULL);
+
+    ArcStatsSnapshot *snapshot = (ArcStatsSnapshot *)malloc(sizeof(ArcStatsSnapshot));
+    if (!snapshot) {
+        fprintf(stderr, "Failed to allocate ArcStatsSnapshot.\n");
+        exit(1);
+    }
+    arc_stats_snapshot(snapshot);
+    int strings_seen = 0;
+    for (size_t i = 0; i < snapshot->count; i++) {
+        ArcTypeStats *type = &snapshot->types[i];
+        CHECK(type->live == 0);
+        CHECK(type->allocations == type->deallocations);
+        if (type->dealloc == TroveString_dealloc) {
+            strings_seen = 1;
+            CHECK(type->allocations == (uint64_t)THREADS * OBJECTS_PER_THREAD);
+        }
+    }
+    CHECK(strings_seen);
+    free(snapshot);
+    CHECK(arc_leaks_count() == 0);
+    CHECK(arc_profile_samples() > 0);
+
+    arc_guard_enable(0);
+    arc_profile_enable(0);
+    arc_trace_enable(0);
+    arc_leaks_enable(0);
+    arc_stats_enable(0);
+    return check_done("threads");
+}
@@ -0,0 +1,134 @@
+/**
+ * @file trace.c
+ * @brief Tests of tracing across threads: ring reuse and the ring limit
+ */
+
+#include "check.h"
+#include "trove.h"
+#include "trace.h"
+#include "leaks.h"
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/** @brief Threads started one after the other */
+#define SEQUENTIAL_THREADS 50
+
+/** @brief Threads alive at once, more than there may be rings */
+#define CONCURRENT_THREADS (TROVE_TRACE_MAX_RINGS + 8)
+
+/** @brief Holds the concurrent threads until all have recorded their events */
+static pthread_barrier_t all_recorded;
+
+/**
+ * @brief Creates and releases one string: alloc, release and dealloc events
+ */
+static void *record_three(void *arg) {
+    (void)arg;
+    arc_release((ARCObject *)TroveString_create("traced"));
+    return NULL;
+}
+
+/**
+ * @brief Records three events, then waits for the other threads
+ */
+static void *record_three_and_wait(void *arg) {
+    record_three(arg);
+    pthread_barrier_wait(&all_recorded);
+    return NULL;
+}
+
+/**
+ * @brief Returns the ring count saved in a trace file's header
+ */
+static uint32_t saved_ring_count(void) {
+    char path[] = "/tmp/trove-test-trace-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        exit(1);
+    }
+    close(fd);
+    CHECK(arc_trace_save(path) == 0);
+    ArcTraceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    FILE *file = fopen(path, "rb");
+    CHECK(file && fread(&header, sizeof(header), 1, file) == 1);
+    if (file) {
+        fclose(file);
+    }
+    unlink(path);
+    return header.thread_count;
+}
+
+/**
+ * @brief Returns the number of distinct ring indexes among events
+ */
+static size_t distinct_rings(const ArcTraceEvent *events, size_t count) {
+    static char seen[TROVE_TRACE_MAX_RINGS];
+    memset(seen, 0, sizeof(seen));
+    size_t distinct = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].thread < TROVE_TRACE_MAX_RINGS && !seen[events[i].thread]) {
+            seen[events[i].thread] = 1;
+            distinct++;
+        }
+    }
+    return distinct;
+}
+
+/**
+ * @brief Threads that run one after the other all record into one ring
+ */
+static void test_rings_reused(void) {
+    for (int i = 0; i < SEQUENTIAL_THREADS; i++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, record_three, NULL);
+        pthread_join(thread, NULL);
+    }
+    size_t count;
+    ArcTraceEvent *events = arc_trace_collect(&count);
+    CHECK(count == SEQUENTIAL_THREADS * 3);
+    CHECK(distinct_rings(events, count) == 1);
+    free(events);
+    CHECK(saved_ring_count() == 1);
+}
+
+/**
+ * @brief More threads at once than TROVE_TRACE_MAX_RINGS fill every ring and drop the rest
+ */
+static void test_ring_limit(void) {
+    static pthread_t threads[CONCURRENT_THREADS];
+    pthread_barrier_init(&all_recorded, NULL, CONCURRENT_THREADS);
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        pthread_create(&threads[i], NULL, record_three_and_wait, NULL);
+    }
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&all_recorded);
+    size_t count;
+    ArcTraceEvent *events = arc_trace_collect(&count);
+    CHECK(count == (SEQUENTIAL_THREADS + TROVE_TRACE_MAX_RINGS) * 3);
+    CHECK(distinct_rings(events, count) == TROVE_TRACE_MAX_RINGS);
+    free(events);
+    CHECK(saved_ring_count() == TROVE_TRACE_MAX_RINGS);
+
+    // Every ring is free again once those threads have exited
+    pthread_t thread;
+    pthread_create(&thread, NULL, record_three, NULL);
+    pthread_join(thread, NULL);
+    CHECK(saved_ring_count() == TROVE_TRACE_MAX_RINGS);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    arc_trace_enable(1);
+    // The main thread records nothing, so the rings belong to the test's threads
+    test_rings_reused();
+    test_ring_limit();
+    arc_trace_enable(0);
+    CHECK(arc_leaks_count() == 0);
+    arc_leaks_enable(0);
+    return check_done("trace");
+}
@@ -0,0 +1,389 @@
+/**
+ * @file writer.c
+ * @brief Tests of TroveWriter: batched ranges and their owners, limits, pipes and partial writes
+ */
+
+#define _DEFAULT_SOURCE    // syscall
+
+#include "check.h"
+#include "trove.h"
+#include "slice.h"
+#include "data.h"
+#include "writer.h"
+#include "leaks.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/** @brief Descriptor whose writes go to the fake writev below instead of the kernel */
+#define MOCK_FD 1000
+
+/** @brief Most bytes captured from MOCK_FD by one test */
+#define MOCK_CAPACITY (256 * 1024)
+
+/** @brief State of the xorshift generator behind next_random */
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+/** @brief Bytes written to MOCK_FD so far */
+static char mock_bytes[MOCK_CAPACITY];
+
+/** @brief Number of bytes in mock_bytes */
+static size_t mock_length;
+
+/** @brief Most bytes one writev to MOCK_FD accepts */
+static size_t mock_limit;
+
+/** @brief Every this many writev calls to MOCK_FD fail with EINTR, or 0 */
+static int mock_interrupt_every;
+
+/** @brief Number of writev calls to MOCK_FD */
+static int mock_calls;
+
+/** @brief Error returned once mock_fail_at bytes are written: an errno, or 0 to return 0 */
+static int mock_error;
+
+/** @brief Bytes after which writev to MOCK_FD fails, or SIZE_MAX */
+static size_t mock_fail_at = SIZE_MAX;
+
+/** @brief Batches kept by hold_submit until the test releases them */
+static TroveWriteBatch *held[8];
+
+/** @brief Number of batches in held */
+static size_t held_count;
+
+/**
+ * @brief Returns the next value of a xorshift generator
+ */
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+/**
+ * @brief Resets MOCK_FD to accept up to limit bytes per call, without failures
+ */
+static void mock_reset(size_t limit, int interrupt_every) {
+    mock_length = 0;
+    mock_limit = limit;
+    mock_interrupt_every = interrupt_every;
+    mock_calls = 0;
+    mock_error = 0;
+    mock_fail_at = SIZE_MAX;
+}
+
+/**
+ * @brief Stands in for writev, which the writer's backend resolves to this definition
+ *
+ * Writes to MOCK_FD land in mock_bytes, at most a random 1 to mock_limit
+ * bytes at a time, so that calls end in the middle of an iovec; other
+ * descriptors go to the kernel.
+ */
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+    if (fd != MOCK_FD) {
+        return (ssize_t)syscall(SYS_writev, fd, iov, iovcnt);
+    }
+    mock_calls++;
+    CHECK(iovcnt > 0 && iovcnt <= TROVE_WRITER_MAX_IOV);
+    if (mock_interrupt_every && mock_calls % mock_interrupt_every == 0) {
+        errno = EINTR;
+        return -1;
+    }
+    if (mock_length >= mock_fail_at) {
+        if (mock_error) {
+            errno = mock_error;
+            return -1;
+        }
+        return 0;
+    }
+    size_t budget = (size_t)(next_random() % mock_limit) + 1;
+    if (budget > mock_fail_at - mock_length) {
+        budget = mock_fail_at - mock_length;
+    }
+    size_t written = 0;
+    for (int i = 0; i < iovcnt && written < budget; i++) {
+        size_t length = iov[i].iov_len < budget - written ? iov[i].iov_len : budget - written;
+        CHECK(mock_length + length <= MOCK_CAPACITY);
+        if (mock_length + length > MOCK_CAPACITY) {
+            errno = EFBIG;
+            return -1;
+        }
+        memcpy(mock_bytes + mock_length, iov[i].iov_base, length);
+        mock_length += length;
+        written += length;
+    }
+    return (ssize_t)written;
+}
+
+/**
+ * @brief Backend that keeps batches, like an asynchronous one waiting for completion
+ */
+static int hold_submit(void *context, TroveWriteBatch *batch) {
+    (void)context;
+    CHECK(held_count < sizeof(held) / sizeof(held[0]));
+    held[held_count++] = batch;
+    return 0;
+}
+
+/**
+ * @brief Backend that releases batches without writing them and fails with the error in context
+ */
+static int failing_submit(void *context, TroveWriteBatch *batch) {
+    arc_release(&batch->base);
+    return *(int *)context;
+}
+
+/**
+ * @brief Releases the batches kept by hold_submit
+ */
+static void release_held(void) {
+    for (size_t i = 0; i < held_count; i++) {
+        arc_release(&held[i]->base);
+    }
+    held_count = 0;
+}
+
+/**
+ * @brief Creates a string of length bytes that differ from one position to the next
+ */
+static TroveString* patterned_string(size_t length, char first) {
+    char *bytes = (char *)malloc(length);
+    if (!bytes) {
+        fprintf(stderr, "Failed to allocate string bytes.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < length; i++) {
+        bytes[i] = (char)(first + i % 23);
+    }
+    TroveString *str = TroveString_create_with_length(bytes, length);
+    free(bytes);
+    return str;
+}
+
+/**
+ * @brief Returns whether the ranges of a batch hold exactly the expected bytes
+ */
+static int batch_equals(TroveWriteBatch *batch, const char *expected, size_t length) {
+    size_t at = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        if (at + batch->iov[i].iov_len > length || memcmp(batch->iov[i].iov_base, expected + at, batch->iov[i].iov_len) != 0) {
+            return 0;
+        }
+        at += batch->iov[i].iov_len;
+    }
+    return at == length && batch->bytes == length;
+}
+
+/**
+ * @brief Each kind of write lands in order with the right owner, retained until the batch goes
+ *
+ * Long strings and data are retained, slices retain their parent and merge
+ * when they follow each other, and short ranges are copied into the batch
+ * buffer without retaining anything.
+ */
+static void test_ranges_and_owners(void) {
+    static const char long_static[400] = "static bytes outlive the writer";
+    TroveString *text = patterned_string(1000, 'a');
+    TroveString *parent = patterned_string(1000, 'A');
+    TroveString *short_text = TroveString_create("short ");
+    char data_bytes[2000];
+    memset(data_bytes, 'd', sizeof(data_bytes));
+    TroveData *data = TroveData_create(data_bytes, sizeof(data_bytes));
+    TroveData *short_data = TroveData_create("0123456789", 10);
+
+    TroveWriter *writer = TroveWriter_create(hold_submit, NULL);
+    CHECK(TroveWriter_write_string(writer, text) == 0);
+    CHECK(TroveWriter_write_string(writer, short_text) == 0);
+    CHECK(TroveWriter_write_static(writer, "literal ", 8) == 0);
+    for (size_t offset = 0; offset < 800; offset += 400) {
+        TroveStringSlice *slice = TroveStringSlice_create(parent, offset, 400);
+        CHECK(TroveWriter_write_slice(writer, slice) == 0);
+        arc_release(&slice->base);
+    }
+    CHECK(TroveWriter_write_data(writer, data) == 0);
+    CHECK(TroveWriter_write_data(writer, short_data) == 0);
+    CHECK(TroveWriter_write_static(writer, long_static, sizeof(long_static)) == 0);
+    CHECK(TroveWriter_write_static(writer, "", 0) == 0);
+
+    // Queued but not submitted: the batch holds one reference per owner
+    CHECK(held_count == 0 && writer->batch != NULL);
+    CHECK(text->base.ref_count == 2 && parent->base.ref_count == 2 && data->base.ref_count == 2);
+    CHECK(short_text->base.ref_count == 1 && short_data->base.ref_count == 1);
+
+    CHECK(TroveWriter_flush(writer) == 0);
+    CHECK(held_count == 1 && writer->batch == NULL);
+    CHECK(TroveWriter_flush(writer) == 0 && held_count == 1);
+    arc_release(&writer->base);
+
+    char expected[1000 + 6 + 8 + 800 + 2000 + 10 + sizeof(long_static)];
+    memcpy(expected, text->str, 1000);
+    memcpy(expected + 1000, "short literal ", 14);
+    memcpy(expected + 1014, parent->str, 800);
+    memcpy(expected + 1814, data->bytes, 2000);
+    memcpy(expected + 3814, "0123456789", 10);
+    memcpy(expected + 3824, long_static, sizeof(long_static));
+    TroveWriteBatch *batch = held[0];
+    ARCObject *owners[] = {&text->base, NULL, &parent->base, &data->base, NULL, NULL};
+    CHECK(batch->count == 6 && memcmp(batch->owners, owners, sizeof(owners)) == 0);
+    CHECK(batch_equals(batch, expected, sizeof(expected)));
+    CHECK(batch->iov[5].iov_base == (void *)long_static);
+
+    // The writer is gone but the submitted batch still keeps the owners alive
+    CHECK(text->base.ref_count == 2 && parent->base.ref_count == 2 && data->base.ref_count == 2);
+    release_held();
+    CHECK(text->base.ref_count == 1 && parent->base.ref_count == 1 && data->base.ref_count == 1);
+    arc_release(&text->base);
+    arc_release(&parent->base);
+    arc_release(&short_text->base);
+    arc_release(&data->base);
+    arc_release(&short_data->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Batches are submitted when their ranges, bytes or buffer run out, and errors are kept
+ */
+static void test_limits_and_errors(void) {
+    TroveString *text = patterned_string(TROVE_WRITER_COPY_MAX, 'a');
+    TroveWriter *writer = TroveWriter_create(hold_submit, NULL);
+    // Writing the same string twice does not merge, so every write is a range
+    for (int i = 0; i < TROVE_WRITER_MAX_IOV + 1; i++) {
+        CHECK(TroveWriter_write_string(writer, text) == 0);
+    }
+    CHECK(held_count == 1 && held[0]->count == TROVE_WRITER_MAX_IOV);
+    CHECK(text->base.ref_count == 1 + TROVE_WRITER_MAX_IOV + 1);
+    CHECK(TroveWriter_flush(writer) == 0 && held_count == 2 && held[1]->count == 1);
+    release_held();
+    CHECK(text->base.ref_count == 1);
+
+    TroveData *data = TroveData_create(NULL, TROVE_WRITER_MAX_BYTES / 2 + 1);
+    CHECK(TroveWriter_write_data(writer, data) == 0 && held_count == 0);
+    CHECK(TroveWriter_write_data(writer, data) == 0 && held_count == 1);
+    CHECK(held[0]->bytes == 2 * data->length && writer->batch == NULL);
+    release_held();
+    arc_release((ARCObject *)data);
+
+    // A short range that no longer fits the buffer goes to the next batch
+    size_t fits = TROVE_WRITER_BUFFER_SIZE / (TROVE_WRITER_COPY_MAX - 1);
+    for (size_t i = 0; i <= fits; i++) {
+        CHECK(TroveWriter_write_static(writer, text->str, TROVE_WRITER_COPY_MAX - 1) == 0);
+    }
+    CHECK(held_count == 1 && held[0]->bytes == fits * (TROVE_WRITER_COPY_MAX - 1));
+    CHECK(held[0]->count == 1 && held[0]->buffer_used == held[0]->bytes);
+    CHECK(TroveWriter_flush(writer) == 0 && held_count == 2 && held[1]->bytes == TROVE_WRITER_COPY_MAX - 1);
+    release_held();
+    arc_release(&writer->base);
+
+    // The first error is kept, and owners are released whatever the outcome
+    int error = EPIPE;
+    writer = TroveWriter_create(failing_submit, &error);
+    CHECK(TroveWriter_write_string(writer, text) == 0);
+    CHECK(TroveWriter_flush(writer) == EPIPE && writer->error == EPIPE);
+    error = EIO;
+    CHECK(TroveWriter_write_string(writer, text) == 0);
+    CHECK(TroveWriter_flush(writer) == EIO && writer->error == EPIPE);
+    CHECK(text->base.ref_count == 1);
+    arc_release(&writer->base);
+    arc_release(&text->base);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief Everything written to a pipe reads back in order, and the owners are released on flush
+ */
+static void test_pipe(void) {
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    TroveString *text = patterned_string(3000, 'a');
+    TroveData *data = TroveData_create("short data", 10);
+    TroveWriter *writer = TroveWriter_create_with_fd(fds[1]);
+    CHECK(TroveWriter_write_static(writer, "<", 1) == 0);
+    CHECK(TroveWriter_write_string(writer, text) == 0);
+    TroveStringSlice *slice = TroveStringSlice_create(text, 1000, 500);
+    CHECK(TroveWriter_write_slice(writer, slice) == 0);
+    arc_release(&slice->base);
+    CHECK(TroveWriter_write_data(writer, data) == 0);
+    CHECK(TroveWriter_write_static(writer, ">", 1) == 0);
+    // The string and the slice are separate ranges, each retaining the string
+    CHECK(text->base.ref_count == 3);
+    CHECK(TroveWriter_flush(writer) == 0 && writer->error == 0);
+    CHECK(text->base.ref_count == 1);
+
+    char expected[3512];
+    expected[0] = '<';
+    memcpy(expected + 1, text->str, 3000);
+    memcpy(expected + 3001, text->str + 1000, 500);
+    memcpy(expected + 3501, "short data>", 11);
+    char read_back[sizeof(expected) + 1];
+    size_t length = 0;
+    ssize_t n;
+    close(fds[1]);
+    while ((n = read(fds[0], read_back + length, sizeof(read_back) - length)) > 0) {
+        length += (size_t)n;
+    }
+    close(fds[0]);
+    CHECK(length == sizeof(expected) && memcmp(read_back, expected, sizeof(expected)) == 0);
+    arc_release(&writer->base);
+    arc_release(&text->base);
+    arc_release((ARCObject *)data);
+    CHECK(arc_leaks_count() == 0);
+}
+
+/**
+ * @brief The writev backend resumes short and interrupted writes where they stopped
+ *
+ * Writes to MOCK_FD accept a random few bytes at a time, often stopping in
+ * the middle of an iovec, and some fail with EINTR; the bytes must still
+ * arrive once each and in order. A failing descriptor returns its error,
+ * and one that accepts nothing returns EIO, with the owners released.
+ */
+static void test_partial_writes(void) {
+    static char expected[200 * 1024];
+    size_t capacity = sizeof(expected);
+    size_t length = 0;
+    TroveWriter *writer = TroveWriter_create_with_fd(MOCK_FD);
+    TroveString *strings[64];
+    for (int i = 0; i < 64; i++) {
+        strings[i] = patterned_string(200 + next_random() % 2800, (char)('!' + i));
+    }
+    mock_reset(700, 5);
+    while (length < capacity - 3000) {
+        TroveString *str = strings[next_random() % 64];
+        CHECK(TroveWriter_write_string(writer, str) == 0);
+        memcpy(expected + length, str->str, str->length);
+        length += str->length;
+    }
+    CHECK(TroveWriter_flush(writer) == 0);
+    CHECK(mock_length == length && memcmp(mock_bytes, expected, length) == 0);
+    CHECK(mock_calls > (int)(length / 700));
+
+    for (int i = 0; i < 2; i++) {
+        mock_reset(100, 0);
+        mock_error = i == 0 ? ENOSPC : 0;
+        mock_fail_at = 1234;
+        for (int j = 0; j < 10; j++) {
+            CHECK(TroveWriter_write_string(writer, strings[j]) == 0);
+        }
+        CHECK(TroveWriter_flush(writer) == (i == 0 ? ENOSPC : EIO));
+        CHECK(mock_length == 1234);
+    }
+    CHECK(writer->error == ENOSPC);
+    arc_release(&writer->base);
+    for (int i = 0; i < 64; i++) {
+        CHECK(strings[i]->base.ref_count == 1);
+        arc_release(&strings[i]->base);
+    }
+    CHECK(arc_leaks_count() == 0);
+}
+
+int main(void) {
+    arc_leaks_enable(1);
+    test_ranges_and_owners();
+    test_limits_and_errors();
+    test_pipe();
+    test_partial_writes();
+    arc_leaks_enable(0);
+    return check_done("writer");
+}
@@ -0,0 +1,693 @@
+/**
+ * @file heapanalyze.c
+ * @brief Computes dominators and retained sizes from a snapshot written by arc_heap_snapshot
+ *
+ * Usage: heapanalyze FILE [-n COUNT]
+ *
+ * An object whose reference count exceeds the references it receives from
+ * other objects in the snapshot is held from outside the heap (a local,
+ * a global, an autorelease pool) and is a root; so is every object that
+ * only appears as the target of an edge, because it was created before
+ * tracking began. All roots hang off one synthetic super-root.
+ *
+ * Object A dominates B when every path from the super-root to B passes
+ * through A, so freeing A would free B; the bytes A retains are the sizes
+ * of everything it dominates, itself included. Dominators are computed
+ * with the iterative algorithm of Cooper, Harvey and Kennedy over reverse
+ * postorder, which converges in a few passes on heap-shaped graphs.
+ *
+ * Objects unreachable from every root are held only by reference cycles:
+ * nothing can release them any more, so they are leaks. They are reported
+ * first, then the COUNT (default 20) objects retaining the most bytes,
+ * then totals per type and per allocation site. A type's retained bytes
+ * count only objects not dominated by another object of the same type, so
+ * a linked structure is not counted once per node.
+ */
+
+#include "heap.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/** @brief Marks an unset dominator or an unvisited node */
+#define UNDEFINED UINT32_MAX
+
+/**
+ * @brief An allocation site from a snapshot
+ */
+typedef struct Site {
+    char *file;          /**< Source file */
+    uint32_t line;       /**< Source line */
+    uint64_t count;      /**< Objects allocated there */
+    uint64_t bytes;      /**< Their sizes */
+} Site;
+
+/**
+ * @brief Totals for one type
+ */
+typedef struct TypeTotal {
+    uint64_t type;         /**< Address of the dealloc function, 0 for untracked objects */
+    const char *name;      /**< Name from the snapshot, or NULL */
+    uint64_t count;        /**< Objects */
+    uint64_t shallow;      /**< Their sizes */
+    uint64_t retained;     /**< Bytes retained by its outermost objects */
+} TypeTotal;
+
+/**
+ * @brief An object graph loaded from a snapshot
+ *
+ * Node 0 is the super-root; nodes 1..count are the snapshot's objects in
+ * file order, followed by untracked objects found as edge targets. Edges
+ * are stored by node, in compressed sparse row form.
+ */
+typedef struct Heap {
+    ArcHeapFileHeader header;    /**< File header */
+    size_t count;                /**< Nodes, super-root included */
+    size_t capacity;             /**< Entries allocated in the node arrays */
+    uint64_t *address;           /**< Object address of each node */
+    uint32_t *type;              /**< Index in types of each node */
+    uint32_t *size;              /**< Shallow size of each node */
+    int32_t *ref_count;          /**< Reference count of each node, 0 if untracked */
+    uint32_t *site;              /**< Site index of each node, 0 if unknown */
+    uint64_t *edge_start;        /**< First edge of each snapshot node, then the total */
+    uint32_t *edges;             /**< Edge targets */
+    uint32_t *roots;             /**< Children of the super-root */
+    size_t root_count;           /**< Entries used in roots */
+    size_t held_roots;           /**< Leading roots held from outside the heap */
+    TypeTotal *types;            /**< Types, in file order, then one for untracked objects */
+    size_t type_count;           /**< Entries used in types */
+    Site *sites;                 /**< Sites by index, entry 0 unused */
+    uint32_t *idom;              /**< Immediate dominator of each node */
+    uint64_t *retained;          /**< Retained bytes of each node */
+    uint8_t *cyclic;             /**< Nonzero for nodes unreachable from every root */
+} Heap;
+
+/**
+ * @brief Allocates memory, exiting with an error message on failure
+ */
+static void* heap_alloc(size_t count, size_t size) {
+    void *memory = calloc(count ? count : 1, size);
+    if (!memory) {
+        fprintf(stderr, "Failed to allocate heap analysis.\n");
+        exit(1);
+    }
+    return memory;
+}
+
+/**
+ * @brief Makes room for one more node
+ */
+static size_t heap_add_node(Heap *heap) {
+    if (heap->count == heap->capacity) {
+        size_t capacity = heap->capacity * 2;
+        heap->address = (uint64_t *)realloc(heap->address, capacity * sizeof(uint64_t));
+        heap->type = (uint32_t *)realloc(heap->type, capacity * sizeof(uint32_t));
+        heap->size = (uint32_t *)realloc(heap->size, capacity * sizeof(uint32_t));
+        heap->ref_count = (int32_t *)realloc(heap->ref_count, capacity * sizeof(int32_t));
+        heap->site = (uint32_t *)realloc(heap->site, capacity * sizeof(uint32_t));
+        if (!heap->address || !heap->type || !heap->size || !heap->ref_count || !heap->site) {
+            fprintf(stderr, "Failed to allocate heap analysis.\n");
+            exit(1);
+        }
+        heap->capacity = capacity;
+    }
+    return heap->count++;
+}
+
+/**
+ * @brief Returns the index in heap->types of a type address, adding it if new
+ */
+static uint32_t heap_type_index(Heap *heap, uint64_t type) {
+    static uint32_t last = 0;
+    if (last < heap->type_count && heap->types[last].type == type) {
+        return last;
+    }
+    for (uint32_t i = 0; i < heap->type_count; i++) {
+        if (heap->types[i].type == type) {
+            return last = i;
+        }
+    }
+    heap->types = (TypeTotal *)realloc(heap->types, (heap->type_count + 1) * sizeof(TypeTotal));
+    if (!heap->types) {
+        fprintf(stderr, "Failed to allocate heap analysis.\n");
+        exit(1);
+    }
+    memset(&heap->types[heap->type_count], 0, sizeof(TypeTotal));
+    heap->types[heap->type_count].type = type;
+    return last = (uint32_t)heap->type_count++;
+}
+
+/**
+ * @brief Reads the type and site tables at the end of a snapshot
+ *
+ * @return 0 on success, or -1 after printing an error
+ */
+static int heap_read_tables(Heap *heap, FILE *file, const char *path) {
+    ArcHeapType *names = (ArcHeapType *)heap_alloc(heap->header.type_count, sizeof(ArcHeapType));
+    heap->sites = (Site *)heap_alloc((size_t)heap->header.site_count + 1, sizeof(Site));
+    int ok = fseeko(file, (off_t)heap->header.types_offset, SEEK_SET) == 0
+             && fread(names, sizeof(ArcHeapType), heap->header.type_count, file) == heap->header.type_count;
+    for (uint32_t i = 0; ok && i < heap->header.type_count; i++) {
+        names[i].name[TROVE_HEAP_NAME_SIZE - 1] = '\0';
+        uint32_t type = heap_type_index(heap, names[i].type);
+        heap->types[type].name = names[i].name[0] ? strdup(names[i].name) : NULL;
+    }
+    ok = ok && fseeko(file, (off_t)heap->header.sites_offset, SEEK_SET) == 0;
+    for (uint32_t i = 1; ok && i <= heap->header.site_count; i++) {
+        uint32_t record[2];
+        ok = fread(record, sizeof(uint32_t), 2, file) == 2;
+        if (ok) {
+            heap->sites[i].line = record[0];
+            heap->sites[i].file = (char *)heap_alloc((size_t)record[1] + 1, 1);
+            ok = fread(heap->sites[i].file, 1, record[1], file) == record[1];
+        }
+    }
+    free(names);
+    if (!ok) {
+        fprintf(stderr, "%s: truncated heap snapshot\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads the nodes of a snapshot, with edges as target addresses
+ *
+ * @return 0 on success, or -1 after printing an error
+ */
+static int heap_read_nodes(Heap *heap, FILE *file, const char *path, uint64_t *targets) {
+    size_t nodes = (size_t)heap->header.node_count;
+    uint64_t edge = 0;
+    if (fseeko(file, (off_t)sizeof(ArcHeapFileHeader), SEEK_SET) != 0) {
+        nodes = 0;
+    }
+    for (size_t i = 1; i <= nodes; i++) {
+        ArcHeapNode node;
+        if (fread(&node, sizeof(node), 1, file) != 1 || edge + node.edge_count > heap->header.edge_count
+            || fread(&targets[edge], sizeof(uint64_t), node.edge_count, file) != node.edge_count) {
+            fprintf(stderr, "%s: truncated heap snapshot\n", path);
+            return -1;
+        }
+        size_t index = heap_add_node(heap);
+        heap->address[index] = node.address;
+        heap->type[index] = heap_type_index(heap, node.type);
+        heap->size[index] = node.size;
+        heap->ref_count[index] = node.ref_count;
+        heap->site[index] = node.site <= heap->header.site_count ? node.site : 0;
+        heap->edge_start[index] = edge;
+        edge += node.edge_count;
+    }
+    heap->edge_start[nodes + 1] = edge;
+    return 0;
+}
+
+/**
+ * @brief Returns the slot of an address in an open-addressing index of nodes
+ */
+static size_t heap_slot(const Heap *heap, const uint32_t *index, size_t mask, uint64_t address) {
+    size_t slot = (size_t)((address >> 4) * 0x9E3779B97F4A7C15ull >> 20) & mask;
+    while (index[slot] != UNDEFINED && heap->address[index[slot]] != address) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @brief Turns edge target addresses into node indices
+ *
+ * Targets missing from the snapshot become untracked nodes of size 0.
+ */
+static void heap_link(Heap *heap, const uint64_t *targets) {
+    size_t nodes = (size_t)heap->header.node_count;
+    size_t capacity = 16;
+    while (capacity < 2 * (nodes + 1) + 2 * (size_t)heap->header.edge_count / 8) {
+        capacity *= 2;
+    }
+    uint32_t *index = (uint32_t *)heap_alloc(capacity, sizeof(uint32_t));
+    memset(index, 0xFF, capacity * sizeof(uint32_t));
+    size_t mask = capacity - 1;
+    for (size_t i = 1; i <= nodes; i++) {
+        index[heap_slot(heap, index, mask, heap->address[i])] = (uint32_t)i;
+    }
+    uint32_t untracked = (uint32_t)heap->type_count;
+    for (uint64_t e = 0; e < heap->header.edge_count; e++) {
+        size_t slot = heap_slot(heap, index, mask, targets[e]);
+        if (index[slot] == UNDEFINED) {
+            if (untracked == heap->type_count) {
+                untracked = heap_type_index(heap, 0);
+            }
+            size_t node = heap_add_node(heap);
+            heap->address[node] = targets[e];
+            heap->type[node] = untracked;
+            heap->size[node] = 0;
+            heap->ref_count[node] = 0;
+            heap->site[node] = 0;
+            if ((heap->count - nodes) * 2 > capacity / 2) {
+                // Rare: far more untracked objects than expected
+                free(index);
+                capacity *= 4;
+                mask = capacity - 1;
+                index = (uint32_t *)heap_alloc(capacity, sizeof(uint32_t));
+                memset(index, 0xFF, capacity * sizeof(uint32_t));
+                for (size_t i = 1; i < heap->count; i++) {
+                    index[heap_slot(heap, index, mask, heap->address[i])] = (uint32_t)i;
+                }
+                slot = heap_slot(heap, index, mask, targets[e]);
+            }
+            index[slot] = (uint32_t)node;
+        }
+        heap->edges[e] = index[slot];
+    }
+    free(index);
+}
+
+/**
+ * @brief Reads a heap snapshot
+ *
+ * @return 0 on success, or -1 after printing an error
+ */
+static int heap_read(const char *path, Heap *heap) {
+    memset(heap, 0, sizeof(*heap));
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&heap->header, sizeof(heap->header), 1, file) != 1
+        || memcmp(heap->header.magic, TROVE_HEAP_MAGIC, sizeof(heap->header.magic)) != 0) {
+        fprintf(stderr, "%s: not a heap snapshot\n", path);
+        fclose(file);
+        return -1;
+    }
+    if (heap->header.node_count >= UNDEFINED / 2 || heap->header.edge_count >= UNDEFINED) {
+        fprintf(stderr, "%s: too many objects\n", path);
+        fclose(file);
+        return -1;
+    }
+    size_t nodes = (size_t)heap->header.node_count;
+    heap->capacity = nodes + 1 + 1024;
+    heap->address = (uint64_t *)heap_alloc(heap->capacity, sizeof(uint64_t));
+    heap->type = (uint32_t *)heap_alloc(heap->capacity, sizeof(uint32_t));
+    heap->size = (uint32_t *)heap_alloc(heap->capacity, sizeof(uint32_t));
+    heap->ref_count = (int32_t *)heap_alloc(heap->capacity, sizeof(int32_t));
+    heap->site = (uint32_t *)heap_alloc(heap->capacity, sizeof(uint32_t));
+    heap->edge_start = (uint64_t *)heap_alloc(nodes + 2, sizeof(uint64_t));
+    heap->edges = (uint32_t *)heap_alloc((size_t)heap->header.edge_count, sizeof(uint32_t));
+    heap->count = 1;
+
+    uint64_t *targets = (uint64_t *)heap_alloc((size_t)heap->header.edge_count, sizeof(uint64_t));
+    int status = heap_read_tables(heap, file, path);
+    if (status == 0) {
+        status = heap_read_nodes(heap, file, path, targets);
+    }
+    fclose(file);
+    if (status == 0) {
+        heap_link(heap, targets);
+    }
+    free(targets);
+    return status;
+}
+
+/**
+ * @brief Returns the first edge and edge count of a node
+ */
+static const uint32_t* heap_children(const Heap *heap, uint32_t node, size_t *count) {
+    if (node == 0) {
+        *count = heap->root_count;
+        return heap->roots;
+    }
+    if (node > heap->header.node_count) {
+        *count = 0;
+        return NULL;
+    }
+    *count = (size_t)(heap->edge_start[node + 1] - heap->edge_start[node]);
+    return &heap->edges[heap->edge_start[node]];
+}
+
+/**
+ * @brief Finds the roots: objects held from outside the heap, and untracked objects
+ */
+static void heap_find_roots(Heap *heap) {
+    uint32_t *in_degree = (uint32_t *)heap_alloc(heap->count, sizeof(uint32_t));
+    for (uint64_t e = 0; e < heap->header.edge_count; e++) {
+        in_degree[heap->edges[e]]++;
+    }
+    heap->roots = (uint32_t *)heap_alloc(heap->count, sizeof(uint32_t));
+    for (size_t i = 1; i < heap->count; i++) {
+        if (i > heap->header.node_count || (int64_t)heap->ref_count[i] > (int64_t)in_degree[i]) {
+            heap->roots[heap->root_count++] = (uint32_t)i;
+        }
+    }
+    heap->held_roots = heap->root_count;
+    free(in_degree);
+}
+
+/**
+ * @brief Numbers nodes in depth-first postorder from the super-root
+ *
+ * Nodes left unvisited are held only by cycles; each becomes a root in
+ * turn, in file order, until every node is numbered.
+ *
+ * @param order Receives the nodes in postorder
+ * @param postorder Receives the postorder number of each node
+ */
+static void heap_postorder(Heap *heap, uint32_t *order, uint32_t *postorder) {
+    uint32_t *stack = (uint32_t *)heap_alloc(heap->count, sizeof(uint32_t));
+    size_t *next = (size_t *)heap_alloc(heap->count, sizeof(size_t));
+    heap->cyclic = (uint8_t *)heap_alloc(heap->count, 1);
+    uint32_t numbered = 0;
+    uint32_t held = UNDEFINED;
+    size_t first_root = 0;
+    memset(postorder, 0xFF, heap->count * sizeof(uint32_t));
+
+    for (size_t candidate = 1; ; candidate++) {
+        size_t depth = 0;
+        stack[depth] = 0;
+        next[depth++] = first_root;
+        while (depth) {
+            uint32_t node = stack[depth - 1];
+            size_t count;
+            const uint32_t *children = heap_children(heap, node, &count);
+            if (next[depth - 1] < count) {
+                uint32_t child = children[next[depth - 1]++];
+                if (postorder[child] == UNDEFINED) {
+                    postorder[child] = UNDEFINED - 1;
+                    stack[depth] = child;
+                    next[depth++] = 0;
+                }
+            } else {
+                if (node != 0) {
+                    postorder[node] = numbered;
+                    order[numbered++] = node;
+                }
+                depth--;
+            }
+        }
+        if (held == UNDEFINED) {
+            held = numbered;
+        }
+        // Attach the next unvisited node and walk on from there
+        while (candidate < heap->count && postorder[candidate] != UNDEFINED) {
+            candidate++;
+        }
+        if (candidate == heap->count) {
+            break;
+        }
+        first_root = heap->root_count;
+        heap->roots[heap->root_count++] = (uint32_t)candidate;
+    }
+    postorder[0] = numbered;
+    order[numbered] = 0;
+    // Walks from held roots finish first, so later numbers were reached only through cycles
+    for (uint32_t k = held; k < numbered; k++) {
+        heap->cyclic[order[k]] = 1;
+    }
+    free(stack);
+    free(next);
+}
+
+/**
+ * @brief Computes immediate dominators and retained sizes
+ */
+static void heap_dominators(Heap *heap) {
+    size_t count = heap->count;
+    uint32_t *order = (uint32_t *)heap_alloc(count, sizeof(uint32_t));
+    uint32_t *postorder = (uint32_t *)heap_alloc(count, sizeof(uint32_t));
+    heap_postorder(heap, order, postorder);
+
+    // Predecessors in compressed sparse row form; super-root edges are implied by is_root
+    uint64_t *pred_start = (uint64_t *)heap_alloc(count + 1, sizeof(uint64_t));
+    uint32_t *preds = (uint32_t *)heap_alloc((size_t)heap->header.edge_count, sizeof(uint32_t));
+    uint8_t *is_root = (uint8_t *)heap_alloc(count, 1);
+    for (size_t i = 0; i < heap->root_count; i++) {
+        is_root[heap->roots[i]] = 1;
+    }
+    for (uint64_t e = 0; e < heap->header.edge_count; e++) {
+        pred_start[heap->edges[e] + 1]++;
+    }
+    for (size_t i = 0; i < count; i++) {
+        pred_start[i + 1] += pred_start[i];
+    }
+    uint64_t *fill = (uint64_t *)heap_alloc(count, sizeof(uint64_t));
+    memcpy(fill, pred_start, count * sizeof(uint64_t));
+    for (uint32_t node = 1; node <= heap->header.node_count; node++) {
+        for (uint64_t e = heap->edge_start[node]; e < heap->edge_start[node + 1]; e++) {
+            preds[fill[heap->edges[e]]++] = node;
+        }
+    }
+    free(fill);
+
+    uint32_t *idom = (uint32_t *)heap_alloc(count, sizeof(uint32_t));
+    memset(idom, 0xFF, count * sizeof(uint32_t));
+    idom[0] = 0;
+    uint32_t root_number = postorder[0];
+    for (int changed = 1; changed; ) {
+        changed = 0;
+        for (uint32_t k = root_number; k-- > 0; ) {
+            uint32_t node = order[k];
+            uint32_t dominator = is_root[node] ? 0 : UNDEFINED;
+            for (uint64_t e = pred_start[node]; e < pred_start[node + 1]; e++) {
+                uint32_t pred = preds[e];
+                if (idom[pred] == UNDEFINED) {
+                    continue;
+                }
+                if (dominator == UNDEFINED) {
+                    dominator = pred;
+                    continue;
+                }
+                uint32_t a = pred;
+                uint32_t b = dominator;
+                while (a != b) {
+                    while (postorder[a] < postorder[b]) {
+                        a = idom[a];
+                    }
+                    while (postorder[b] < postorder[a]) {
+                        b = idom[b];
+                    }
+                }
+                dominator = a;
+            }
+            if (idom[node] != dominator) {
+                idom[node] = dominator;
+                changed = 1;
+            }
+        }
+    }
+
+    // Dominators finish after the nodes they dominate, so postorder sums subtrees
+    heap->retained = (uint64_t *)heap_alloc(count, sizeof(uint64_t));
+    for (uint32_t k = 0; k < root_number; k++) {
+        uint32_t node = order[k];
+        heap->retained[node] += heap->size[node];
+        heap->retained[idom[node]] += heap->retained[node];
+    }
+    heap->idom = idom;
+    free(is_root);
+    free(pred_start);
+    free(preds);
+    free(order);
+    free(postorder);
+}
+
+/**
+ * @brief Returns the display name of a node's type
+ */
+static const char* heap_type_name(const Heap *heap, uint32_t node) {
+    const TypeTotal *type = &heap->types[heap->type[node]];
+    if (!type->type) {
+        return "(untracked)";
+    }
+    return type->name ? type->name : "(unnamed type)";
+}
+
+/**
+ * @brief Prints one object: retained and shallow bytes, count, type, address, site
+ */
+static void print_node(const Heap *heap, uint32_t node) {
+    printf("  %14" PRIu64 " %10" PRIu32 " %6" PRId32 "  %-18s 0x%" PRIx64,
+           heap->retained[node], heap->size[node], heap->ref_count[node], heap_type_name(heap, node), heap->address[node]);
+    if (heap->site[node]) {
+        printf("  %s:%" PRIu32, heap->sites[heap->site[node]].file, heap->sites[heap->site[node]].line);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Prints the nodes with the largest retained sizes among a set
+ *
+ * @param nodes Candidate nodes
+ * @param count Number of candidates
+ * @param limit Most nodes to print
+ */
+static void print_top(const Heap *heap, const uint32_t *nodes, size_t count, size_t limit) {
+    uint32_t *top = (uint32_t *)heap_alloc(limit + 1, sizeof(uint32_t));
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t node = nodes[i];
+        size_t position = used;
+        while (position > 0 && heap->retained[top[position - 1]] < heap->retained[node]) {
+            position--;
+        }
+        if (position < limit) {
+            memmove(&top[position + 1], &top[position], (used - position) * sizeof(uint32_t));
+            top[position] = node;
+            used += used < limit;
+        }
+    }
+    printf("  %14s %10s %6s  %-18s %s\n", "retained", "shallow", "refs", "type", "address and allocation site");
+    for (size_t i = 0; i < used; i++) {
+        print_node(heap, top[i]);
+    }
+    free(top);
+}
+
+/**
+ * @brief Orders sites by bytes, largest first
+ */
+static int compare_site_bytes(const void *a, const void *b) {
+    const Site *x = (const Site *)a;
+    const Site *y = (const Site *)b;
+    return x->bytes < y->bytes ? 1 : x->bytes > y->bytes ? -1 : 0;
+}
+
+/**
+ * @brief Orders type totals by retained bytes, largest first
+ */
+static int compare_type_retained(const void *a, const void *b) {
+    const TypeTotal *x = (const TypeTotal *)a;
+    const TypeTotal *y = (const TypeTotal *)b;
+    return x->retained < y->retained ? 1 : x->retained > y->retained ? -1 : 0;
+}
+
+/**
+ * @brief Prints the analysis
+ *
+ * @param limit Objects and sites to list
+ * @return Number of objects held only by cycles
+ */
+static size_t report(Heap *heap, size_t limit) {
+    uint64_t cyclic_bytes = 0;
+    size_t cyclic = 0;
+    size_t untracked = heap->count - 1 - (size_t)heap->header.node_count;
+    for (uint32_t node = 1; node < heap->count; node++) {
+        TypeTotal *type = &heap->types[heap->type[node]];
+        type->count++;
+        type->shallow += heap->size[node];
+        uint32_t dominator = heap->idom[node];
+        if (dominator == 0 || heap->type[dominator] != heap->type[node]) {
+            type->retained += heap->retained[node];
+        }
+        heap->sites[heap->site[node]].count++;
+        heap->sites[heap->site[node]].bytes += heap->size[node];
+        if (heap->cyclic[node]) {
+            cyclic++;
+            cyclic_bytes += heap->size[node];
+        }
+    }
+
+    printf("%" PRIu64 " objects, %" PRIu64 " bytes, %" PRIu64 " references; %zu roots",
+           heap->header.node_count, heap->retained[0], heap->header.edge_count, heap->held_roots);
+    if (untracked) {
+        printf(", %zu of them untracked", untracked);
+    }
+    printf("\n");
+
+    if (cyclic) {
+        printf("\n%zu objects (%" PRIu64 " bytes) are held only by reference cycles and can never be freed:\n",
+               cyclic, cyclic_bytes);
+        print_top(heap, &heap->roots[heap->held_roots], heap->root_count - heap->held_roots, limit);
+    }
+
+    printf("\nLargest retained sizes:\n");
+    uint32_t *nodes = (uint32_t *)heap_alloc(heap->count, sizeof(uint32_t));
+    for (uint32_t node = 1; node < heap->count; node++) {
+        nodes[node - 1] = node;
+    }
+    print_top(heap, nodes, heap->count - 1, limit);
+    free(nodes);
+
+    printf("\nBy type:\n  %14s %14s %12s  %s\n", "retained", "shallow", "objects", "type");
+    qsort(heap->types, heap->type_count, sizeof(TypeTotal), compare_type_retained);
+    for (size_t i = 0; i < heap->type_count; i++) {
+        const TypeTotal *type = &heap->types[i];
+        if (type->count) {
+            printf("  %14" PRIu64 " %14" PRIu64 " %12" PRIu64 "  %s\n", type->retained, type->shallow, type->count,
+                   !type->type ? "(untracked)" : type->name ? type->name : "(unnamed type)");
+        }
+    }
+
+    printf("\nBy allocation site:\n  %14s %12s  %s\n", "shallow", "objects", "site");
+    Site *sites = heap->sites;
+    size_t site_count = (size_t)heap->header.site_count + 1;
+    qsort(sites, site_count, sizeof(Site), compare_site_bytes);
+    for (size_t i = 0; i < site_count && i < limit; i++) {
+        if (sites[i].count) {
+            if (sites[i].file) {
+                printf("  %14" PRIu64 " %12" PRIu64 "  %s:%" PRIu32 "\n", sites[i].bytes, sites[i].count, sites[i].file, sites[i].line);
+            } else {
+                printf("  %14" PRIu64 " %12" PRIu64 "  (unknown)\n", sites[i].bytes, sites[i].count);
+            }
+        }
+    }
+    return cyclic;
+}
+
+/**
+ * @brief Frees a loaded heap
+ */
+static void heap_free(Heap *heap) {
+    for (size_t i = 0; i < heap->type_count; i++) {
+        free((char *)heap->types[i].name);
+    }
+    for (size_t i = 0; heap->sites && i <= heap->header.site_count; i++) {
+        free(heap->sites[i].file);
+    }
+    free(heap->address);
+    free(heap->type);
+    free(heap->size);
+    free(heap->ref_count);
+    free(heap->site);
+    free(heap->edge_start);
+    free(heap->edges);
+    free(heap->roots);
+    free(heap->types);
+    free(heap->sites);
+    free(heap->idom);
+    free(heap->retained);
+    free(heap->cyclic);
+}
+
+/**
+ * @brief Program entry point
+ *
+ * @return 0, 1 if objects are held only by cycles, or 2 on error
+ */
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    size_t limit = 20;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            limit = (size_t)strtoull(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: %s FILE [-n COUNT]\n", argv[0]);
+        return 2;
+    }
+    Heap heap;
+    if (heap_read(path, &heap) != 0) {
+        heap_free(&heap);
+        return 2;
+    }
+    heap_find_roots(&heap);
+    heap_dominators(&heap);
+    size_t cyclic = report(&heap, limit);
+    heap_free(&heap);
+    return cyclic ? 1 : 0;
+}
@@ -0,0 +1,250 @@
+/**
+ * @file tracedump.c
+ * @brief Prints per-object histories from a trace file written by arc_trace_save
+ *
+ * Usage: tracedump FILE [-o ADDRESS] [-t TYPE] [-a]
+ *
+ * Events are grouped by object and split into lives at each allocation,
+ * since freed addresses are reused. Each life is checked for operations
+ * after its dealloc (use after free, usually an over-release elsewhere) and
+ * for reference counts below zero; lives still holding references when the
+ * trace ends are marked alive, which points at a missing release when the
+ * program was done with the object.
+ *
+ * -o keeps one object, -t one type by name and -a only lives with errors.
+ * Callers are return addresses; resolve them with `info symbol ADDRESS` in
+ * gdb attached to the traced process, or with addr2line after subtracting
+ * the executable's load address.
+ */
+
+#include "trace.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/** @brief Operation names, indexed by ArcTraceOp */
+static const char *const OP_NAMES[] = { "?", "alloc", "retain", "release", "autorelease", "dealloc" };
+
+/**
+ * @brief A trace file in memory
+ */
+typedef struct Trace {
+    ArcTraceFileHeader header;    /**< File header */
+    ArcTraceType *types;          /**< Type names */
+    ArcTraceEvent *events;        /**< Events in time order */
+    size_t *order;                /**< Event indices grouped by object, in time order within each */
+} Trace;
+
+/**
+ * @brief Dump options from the command line
+ */
+typedef struct Options {
+    const char *path;         /**< Trace file */
+    uint64_t object;          /**< Object to show, 0 for all */
+    const char *type;         /**< Type name to show, NULL for all */
+    int errors_only;          /**< Nonzero to show only lives with errors */
+} Options;
+
+/** @brief Events of the trace being sorted, for compare_object */
+static const ArcTraceEvent *sort_events = NULL;
+
+/**
+ * @brief Orders event indices by object, then by position in the trace
+ */
+static int compare_object(const void *a, const void *b) {
+    size_t x = *(const size_t *)a;
+    size_t y = *(const size_t *)b;
+    if (sort_events[x].obj != sort_events[y].obj) {
+        return sort_events[x].obj < sort_events[y].obj ? -1 : 1;
+    }
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/**
+ * @brief Reads a trace file
+ *
+ * @return 0 on success, or -1 after printing an error
+ */
+static int trace_read(const char *path, Trace *trace) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    memset(trace, 0, sizeof(*trace));
+    ArcTraceFileHeader *header = &trace->header;
+    if (fread(header, sizeof(*header), 1, file) != 1 || memcmp(header->magic, TROVE_TRACE_MAGIC, sizeof(TROVE_TRACE_MAGIC)) != 0) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        fclose(file);
+        return -1;
+    }
+    size_t count = (size_t)header->event_count;
+    trace->types = (ArcTraceType *)malloc((header->type_count + 1) * sizeof(ArcTraceType));
+    trace->events = (ArcTraceEvent *)malloc((count + 1) * sizeof(ArcTraceEvent));
+    trace->order = (size_t *)malloc((count + 1) * sizeof(size_t));
+    if (!trace->types || !trace->events || !trace->order) {
+        fprintf(stderr, "Failed to allocate trace.\n");
+        exit(1);
+    }
+    if (fread(trace->types, sizeof(ArcTraceType), header->type_count, file) != header->type_count
+        || fread(trace->events, sizeof(ArcTraceEvent), count, file) != count) {
+        fprintf(stderr, "%s: truncated trace file\n", path);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    for (size_t i = 0; i < count; i++) {
+        trace->order[i] = i;
+    }
+    sort_events = trace->events;
+    qsort(trace->order, count, sizeof(size_t), compare_object);
+    return 0;
+}
+
+/**
+ * @brief Returns the name of a type in a trace, or NULL if unknown
+ */
+static const char* trace_type_name(const Trace *trace, uint64_t type) {
+    for (uint32_t i = 0; i < trace->header.type_count; i++) {
+        if (trace->types[i].type == type && trace->types[i].name[0]) {
+            return trace->types[i].name;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks and prints one life of an object
+ *
+ * @param trace The trace
+ * @param order Indices of the life's events
+ * @param count Number of events
+ * @param options Dump options
+ * @return Number of errors found
+ */
+static size_t dump_life(const Trace *trace, const size_t *order, size_t count, const Options *options) {
+    const ArcTraceEvent *events = trace->events;
+    const ArcTraceEvent *first = &events[order[0]];
+    const ArcTraceEvent *last = &events[order[count - 1]];
+    size_t errors = 0;
+    int freed = 0;
+    for (size_t i = 0; i < count; i++) {
+        const ArcTraceEvent *event = &events[order[i]];
+        if (freed || event->ref_count < 0) {
+            errors++;
+        }
+        freed |= event->op == ARC_TRACE_DEALLOC;
+    }
+    if (options->errors_only && !errors) {
+        return 0;
+    }
+
+    const char *name = trace_type_name(trace, first->type);
+    printf("0x%" PRIx64 " %s", first->obj, name ? name : "(unnamed type)");
+    if (first->op != ARC_TRACE_ALLOC) {
+        printf(", history starts before the trace");
+    }
+    if (errors) {
+        printf(", %zu error%s", errors, errors == 1 ? "" : "s");
+    } else if (!freed && last->ref_count > 0) {
+        printf(", alive at end with %" PRId32 " reference%s", last->ref_count, last->ref_count == 1 ? "" : "s");
+    }
+    printf("\n");
+
+    freed = 0;
+    for (size_t i = 0; i < count; i++) {
+        const ArcTraceEvent *event = &events[order[i]];
+        const char *op = OP_NAMES[event->op <= ARC_TRACE_DEALLOC ? event->op : 0];
+        printf("  %12.3f us  thread %-3u %-12s rc %-6" PRId32 " from 0x%" PRIx64,
+               (double)(event->time - first->time) / 1e3, (unsigned)event->thread, op, event->ref_count, event->caller);
+        if (freed) {
+            printf("  <- %s after dealloc", op);
+        } else if (event->ref_count < 0) {
+            printf("  <- count below zero");
+        }
+        printf("\n");
+        freed |= event->op == ARC_TRACE_DEALLOC;
+    }
+    return errors;
+}
+
+/**
+ * @brief Prints the histories selected by the options
+ *
+ * @return Number of errors found in the printed lives
+ */
+static size_t dump(const Trace *trace, const Options *options) {
+    size_t count = (size_t)trace->header.event_count;
+    size_t errors = 0;
+    size_t objects = 0;
+    size_t i = 0;
+    while (i < count) {
+        uint64_t obj = trace->events[trace->order[i]].obj;
+        size_t end = i + 1;
+        while (end < count && trace->events[trace->order[end]].obj == obj) {
+            end++;
+        }
+        int selected = !options->object || options->object == obj;
+        if (selected && options->type) {
+            const char *name = trace_type_name(trace, trace->events[trace->order[i]].type);
+            selected = name && strcmp(name, options->type) == 0;
+        }
+        if (selected) {
+            objects++;
+            // A new life begins at each allocation after the first event
+            size_t start = i;
+            for (size_t j = i + 1; j <= end; j++) {
+                if (j == end || trace->events[trace->order[j]].op == ARC_TRACE_ALLOC) {
+                    errors += dump_life(trace, &trace->order[start], j - start, options);
+                    start = j;
+                }
+            }
+        }
+        i = end;
+    }
+    printf("%" PRIu64 " events from %" PRIu32 " threads, %zu objects shown, %zu errors\n",
+           trace->header.event_count, trace->header.thread_count, objects, errors);
+    return errors;
+}
+
+/**
+ * @brief Parses the command line
+ *
+ * @return 0 on success, or -1 after printing usage
+ */
+static int parse_options(int argc, char **argv, Options *options) {
+    memset(options, 0, sizeof(*options));
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            options->object = (uint64_t)strtoull(argv[++i], NULL, 16);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            options->type = argv[++i];
+        } else if (strcmp(argv[i], "-a") == 0) {
+            options->errors_only = 1;
+        } else if (argv[i][0] != '-' && !options->path) {
+            options->path = argv[i];
+        } else {
+            options->path = NULL;
+            break;
+        }
+    }
+    if (!options->path) {
+        fprintf(stderr, "usage: %s FILE [-o ADDRESS] [-t TYPE] [-a]\n", argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    Trace trace;
+    if (parse_options(argc, argv, &options) != 0 || trace_read(options.path, &trace) != 0) {
+        return 2;
+    }
+    size_t errors = dump(&trace, &options);
+    free(trace.types);
+    free(trace.events);
+    free(trace.order);
+    return errors ? 1 : 0;
+}